@@ -0,0 +1,53 @@
+# Script mode (cmake -P) helper for embed_kernels().
+#
+# Converts INPUT into a C header OUTPUT that defines the byte array VARIABLE
+# (NULL terminated) and VARIABLE_size. If IL_INPUT is set its contents are
+# also embedded as VARIABLE_il and VARIABLE_il_size.
+
+if(NOT INPUT OR NOT OUTPUT OR NOT VARIABLE)
+    message(FATAL_ERROR "INPUT, OUTPUT and VARIABLE must be set")
+endif()
+
+# Sets ${bytesVariable} to a C initialiser list for the contents of ${file}
+# and ${sizeVariable} to the file size.
+macro(file_to_bytes file bytesVariable sizeVariable)
+    file(READ "${file}" hexContent HEX)
+    string(LENGTH "${hexContent}" hexLength)
+    math(EXPR ${sizeVariable} "${hexLength} / 2")
+
+    # Break the array up into lines of 16 bytes
+    set(linePattern "")
+    foreach(i RANGE 1 32)
+        set(linePattern "${linePattern}[0-9a-f]")
+    endforeach()
+    string(REGEX REPLACE "(${linePattern})" "\\1\n" hexContent "${hexContent}")
+    string(REGEX REPLACE "([0-9a-f][0-9a-f])" "0x\\1," ${bytesVariable} "${hexContent}")
+endmacro()
+
+file_to_bytes("${INPUT}" bytes size)
+
+get_filename_component(inputName "${INPUT}" NAME)
+file(WRITE "${OUTPUT}"
+     "/* Generated from ${inputName} by embedFile.cmake. Do not edit. */\n"
+     "#include <stddef.h>\n"
+     "static const unsigned char ${VARIABLE}[] = {\n"
+     "${bytes}\n"
+     "0x00 };\n"
+     "static const size_t ${VARIABLE}_size = ${size};\n"
+    )
+
+if(IL_INPUT)
+    file_to_bytes("${IL_INPUT}" ilBytes ilSize)
+    file(APPEND "${OUTPUT}"
+         "static const unsigned char ${VARIABLE}_il_data[] = {\n"
+         "${ilBytes}\n"
+         "0x00 };\n"
+         "static const unsigned char* const ${VARIABLE}_il = ${VARIABLE}_il_data;\n"
+         "static const size_t ${VARIABLE}_il_size = ${ilSize};\n"
+        )
+else()
+    file(APPEND "${OUTPUT}"
+         "static const unsigned char* const ${VARIABLE}_il = NULL;\n"
+         "static const size_t ${VARIABLE}_il_size = 0;\n"
+        )
+endif()
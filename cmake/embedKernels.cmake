@@ -0,0 +1,77 @@
+# Support for compiling OpenCL kernels into executables.
+#
+# embed_kernels(<output variable> <kernel> ...)
+#
+# For each kernel file (relative to the current source directory) a header
+# <kernel>.h is generated in the current binary directory. The header defines
+#
+#   static const unsigned char <name>[];   /* File contents + '\0' */
+#   static const size_t <name>_size;       /* File size in bytes (no '\0') */
+#   static const unsigned char* <name>_il; /* SPIR-V module or NULL */
+#   static const size_t <name>_il_size;    /* SPIR-V module size in bytes */
+#
+# where <name> is the kernel file name with every character that is not
+# valid in a C identifier replaced by '_' (e.g. add.cl -> add_cl).
+#
+# If BUILD_SPIRV is enabled each kernel is also compiled offline to a
+# SPIR-V module (spir64) using clang and llvm-spirv which is embedded as
+# <name>_il. Otherwise <name>_il is NULL.
+#
+# The list of generated headers is stored in <output variable> so it can be
+# added to the sources of an executable, which makes the executable depend
+# on them.
+
+set(EMBED_FILE_SCRIPT "${CMAKE_CURRENT_LIST_DIR}/embedFile.cmake")
+
+if(BUILD_SPIRV)
+    find_program(CLANG_EXECUTABLE NAMES clang)
+    find_program(LLVM_SPIRV_EXECUTABLE NAMES llvm-spirv)
+    if(NOT CLANG_EXECUTABLE OR NOT LLVM_SPIRV_EXECUTABLE)
+        message(FATAL_ERROR "BUILD_SPIRV requires clang and llvm-spirv. "
+                            "Set CLANG_EXECUTABLE and LLVM_SPIRV_EXECUTABLE.")
+    endif()
+    message(STATUS "Compiling kernels to SPIR-V with ${CLANG_EXECUTABLE} and ${LLVM_SPIRV_EXECUTABLE}")
+    set(SPIRV_COMPILE_FLAGS "-cl-std=CL1.2 -O2" CACHE STRING "Flags passed to clang when compiling kernels to SPIR-V")
+endif()
+
+function(embed_kernels outputVariable)
+    set(headers "")
+    foreach(kernel ${ARGN})
+        get_filename_component(kernelName ${kernel} NAME)
+        string(REGEX REPLACE "[^A-Za-z0-9_]" "_" variableName ${kernelName})
+        set(input "${CMAKE_CURRENT_SOURCE_DIR}/${kernel}")
+        set(header "${CMAKE_CURRENT_BINARY_DIR}/${kernelName}.h")
+        set(ilArguments "")
+        set(ilDependencies "")
+
+        if(BUILD_SPIRV)
+            set(bitcode "${CMAKE_CURRENT_BINARY_DIR}/${kernelName}.bc")
+            set(spirv "${CMAKE_CURRENT_BINARY_DIR}/${kernelName}.spv")
+            separate_arguments(spirvFlags UNIX_COMMAND "${SPIRV_COMPILE_FLAGS}")
+            add_custom_command(OUTPUT ${spirv}
+                               COMMAND ${CLANG_EXECUTABLE} -target spir64-unknown-unknown
+                                       -Xclang -finclude-default-header ${spirvFlags}
+                                       -emit-llvm -c ${input} -o ${bitcode}
+                               COMMAND ${LLVM_SPIRV_EXECUTABLE} ${bitcode} -o ${spirv}
+                               DEPENDS ${input}
+                               COMMENT "Compiling kernel ${kernel} to SPIR-V"
+                              )
+            set(ilArguments -DIL_INPUT=${spirv})
+            set(ilDependencies ${spirv})
+        endif()
+
+        message(STATUS "Embedding kernel ${kernel} as ${variableName}")
+        add_custom_command(OUTPUT ${header}
+                           COMMAND ${CMAKE_COMMAND}
+                                   -DINPUT=${input}
+                                   ${ilArguments}
+                                   -DOUTPUT=${header}
+                                   -DVARIABLE=${variableName}
+                                   -P ${EMBED_FILE_SCRIPT}
+                           DEPENDS ${input} ${ilDependencies} ${EMBED_FILE_SCRIPT}
+                           COMMENT "Embedding kernel ${kernel}"
+                          )
+        list(APPEND headers ${header})
+    endforeach()
+    set(${outputVariable} ${headers} PARENT_SCOPE)
+endfunction()
@@ -0,0 +1,79 @@
+// Micro-benchmark kernels used to characterise a device.
+
+// Global memory bandwidth. Each work item handles one float4.
+__kernel void read_global(__global const float4* restrict in, __global float* restrict out)
+{
+    size_t tid = get_global_id(0);
+    float4 v = in[tid];
+    float sum = v.x + v.y + v.z + v.w;
+
+    // Never true for the data we use but stops the read being optimised away
+    if ( sum == -1.0f )
+        out[0] = sum;
+}
+
+__kernel void write_global(__global float4* restrict out)
+{
+    size_t tid = get_global_id(0);
+    out[tid] = (float4) (tid);
+}
+
+__kernel void copy_global(__global const float4* restrict in, __global float4* restrict out)
+{
+    size_t tid = get_global_id(0);
+    out[tid] = in[tid];
+}
+
+// Local memory bandwidth. The work group size must be a power of two.
+// Each work item reads 4 floats from local memory per iteration.
+__kernel void read_local(__global float* restrict out, __local float* scratch, int iterations)
+{
+    size_t lid = get_local_id(0);
+    size_t mask = get_local_size(0) -1;
+    scratch[lid] = lid;
+    barrier(CLK_LOCAL_MEM_FENCE);
+
+    float sum = 0.0f;
+    for (int i=0; i < iterations; ++i)
+    {
+        sum += scratch[(lid + i) & mask];
+        sum += scratch[(lid + i + 1) & mask];
+        sum += scratch[(lid + i + 2) & mask];
+        sum += scratch[(lid + i + 3) & mask];
+    }
+
+    out[get_global_id(0)] = sum;
+}
+
+// Used to measure launch latency
+__kernel void empty_kernel()
+{
+}
+
+// Arithmetic throughput. Each MAD16 is 16 multiply-adds on 4 lanes.
+#define MAD4(A,B) A = A*B + B; B = B*A + A; A = A*B + B; B = B*A + A
+#define MAD16(A,B) MAD4(A,B); MAD4(A,B); MAD4(A,B); MAD4(A,B)
+
+__kernel void float_throughput(__global float* restrict out, float seed, int iterations)
+{
+    float4 a = (float4) (seed, seed + 1.0f, seed + 2.0f, seed + 3.0f) + (float) get_global_id(0);
+    float4 b = (float4) (seed);
+    for (int i=0; i < iterations; ++i)
+    {
+        MAD16(a,b);
+    }
+
+    out[get_global_id(0)] = a.x + a.y + a.z + a.w + b.x + b.y + b.z + b.w;
+}
+
+__kernel void int_throughput(__global int* restrict out, int seed, int iterations)
+{
+    int4 a = (int4) (seed, seed + 1, seed + 2, seed + 3) + (int) get_global_id(0);
+    int4 b = (int4) (seed);
+    for (int i=0; i < iterations; ++i)
+    {
+        MAD16(a,b);
+    }
+
+    out[get_global_id(0)] = a.x + a.y + a.z + a.w + b.x + b.y + b.z + b.w;
+}
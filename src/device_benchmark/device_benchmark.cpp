@@ -0,0 +1,808 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <CL/opencl.h>
+#include <libclprobe/clprobe.h>
+#include <libclprobe/kernelsource.h>
+#include <libclprobe/buildmanager.h>
+#include <libclprobe/timing.h>
+#include <libclprobe/devicepeaks.h>
+#include <vector>
+#include <thread>
+#include "device_benchmark.cl.h"
+
+/* Kernels compiled into the executable */
+static const EmbeddedKernel embeddedKernels[] =
+{
+    EMBEDDED_KERNEL("device_benchmark.cl", device_benchmark_cl)
+};
+
+/* Each measurement is repeated this many times and the best result is reported */
+static const unsigned int repetitions = 10;
+
+/* Number of launches averaged when measuring launch latency */
+static const unsigned int latencyLaunches = 100;
+
+/* Upper limit on the size of the buffers used for bandwidth tests (bytes) */
+static const size_t maxBufferSize = 64*1024*1024;
+
+/* Iterations of the inner loop of the local memory and throughput kernels */
+static const cl_int localIterations = 1024;
+static const cl_int throughputIterations = 256;
+
+/* State for benchmarking a single device */
+typedef struct
+{
+    cl_device_id device;
+    cl_context context;
+    cl_command_queue queue;
+    cl_program program;
+    size_t bufferSize; /* In bytes, a multiple of sizeof(cl_float4) */
+    cl_uint computeUnits;
+    cl_uint platformIndex;
+    cl_uint deviceIndex;
+    cl_int setUpError; /* Failure creating the context, queue or program */
+    cl_int buildError; /* Result of the program build */
+} Benchmark;
+
+static double toGBs(size_t bytes, double seconds)
+{
+    return bytes / seconds * 1.0e-9;
+}
+
+static void doIndent(cl_uint indent)
+{
+    for (cl_uint i=0; i < indent; ++i) printf(" ");
+}
+
+/* Run kernel repeatedly and set *seconds to the fastest device execution time. */
+static cl_int timeKernel(Benchmark* bench,
+                         cl_kernel kernel,
+                         size_t globalSize,
+                         const size_t* localSize,
+                         double* seconds)
+{
+    *seconds = 0.0;
+    for (unsigned int rep=0; rep < repetitions; ++rep)
+    {
+        cl_event event;
+        cl_int err = clEnqueueNDRangeKernel( bench->queue,
+                                             kernel,
+                                             /* Work dim */ 1,
+                                             /* global_work_offset */ NULL,
+                                             &globalSize,
+                                             localSize,
+                                             /* num_events_in_wait_list */ 0,
+                                             /* event_wait_list */ NULL,
+                                             &event
+                                           );
+        if ( err != CL_SUCCESS )
+        {
+            printf("Failed to enqueue kernel: %d\n", err);
+            return err;
+        }
+
+        err = clWaitForEvents(1, &event);
+        double duration=0.0;
+        if ( err == CL_SUCCESS )
+            err = getEventDuration(event, &duration);
+
+        clReleaseEvent(event);
+        if ( err != CL_SUCCESS )
+        {
+            printf("Failed to time kernel: %d\n", err);
+            return err;
+        }
+
+        if ( rep == 0 || duration < *seconds )
+            *seconds = duration;
+    }
+
+    return CL_SUCCESS;
+}
+
+/* Time blocking transfers between hostPtr and buffer in both directions.
+*  Host timing is used so the cost of any staging copies is included.
+*/
+static cl_int timeTransfers(Benchmark* bench,
+                            cl_mem buffer,
+                            void* hostPtr,
+                            double* hostToDeviceGBs,
+                            double* deviceToHostGBs)
+{
+    double bestWrite=0.0;
+    double bestRead=0.0;
+    for (unsigned int rep=0; rep < repetitions; ++rep)
+    {
+        double start = getHostTime();
+        cl_int err = clEnqueueWriteBuffer( bench->queue,
+                                           buffer,
+                                           /* blocking_write */ CL_TRUE,
+                                           /* offset */ 0,
+                                           bench->bufferSize,
+                                           hostPtr,
+                                           0, NULL, NULL
+                                         );
+        double duration = getHostTime() - start;
+        if ( err != CL_SUCCESS )
+        {
+            printf("Failed to write buffer: %d\n", err);
+            return err;
+        }
+        if ( rep == 0 || duration < bestWrite ) bestWrite = duration;
+
+        start = getHostTime();
+        err = clEnqueueReadBuffer( bench->queue,
+                                   buffer,
+                                   /* blocking_read */ CL_TRUE,
+                                   /* offset */ 0,
+                                   bench->bufferSize,
+                                   hostPtr,
+                                   0, NULL, NULL
+                                 );
+        duration = getHostTime() - start;
+        if ( err != CL_SUCCESS )
+        {
+            printf("Failed to read buffer: %d\n", err);
+            return err;
+        }
+        if ( rep == 0 || duration < bestRead ) bestRead = duration;
+    }
+
+    *hostToDeviceGBs = toGBs(bench->bufferSize, bestWrite);
+    *deviceToHostGBs = toGBs(bench->bufferSize, bestRead);
+    return CL_SUCCESS;
+}
+
+/* Time map, copy and unmap of buffer in both directions */
+static cl_int timeMappedTransfers(Benchmark* bench,
+                                  cl_mem buffer,
+                                  void* hostPtr,
+                                  double* hostToDeviceGBs,
+                                  double* deviceToHostGBs)
+{
+    #ifdef CL_VERSION_1_2
+    const cl_map_flags writeFlags = CL_MAP_WRITE_INVALIDATE_REGION;
+    #else
+    const cl_map_flags writeFlags = CL_MAP_WRITE;
+    #endif
+
+    double bestWrite=0.0;
+    double bestRead=0.0;
+    for (unsigned int rep=0; rep < repetitions; ++rep)
+    {
+        for (int direction=0; direction < 2; ++direction)
+        {
+            bool toDevice = (direction == 0);
+            cl_int err;
+            double start = getHostTime();
+            void* mapped = clEnqueueMapBuffer( bench->queue,
+                                               buffer,
+                                               /* blocking_map */ CL_TRUE,
+                                               toDevice? writeFlags : CL_MAP_READ,
+                                               /* offset */ 0,
+                                               bench->bufferSize,
+                                               0, NULL, NULL,
+                                               &err
+                                             );
+            if ( err != CL_SUCCESS )
+            {
+                printf("Failed to map buffer: %d\n", err);
+                return err;
+            }
+
+            if ( toDevice )
+                memcpy(mapped, hostPtr, bench->bufferSize);
+            else
+                memcpy(hostPtr, mapped, bench->bufferSize);
+
+            err = clEnqueueUnmapMemObject(bench->queue, buffer, mapped, 0, NULL, NULL);
+            if ( err == CL_SUCCESS )
+                err = clFinish(bench->queue);
+
+            double duration = getHostTime() - start;
+            if ( err != CL_SUCCESS )
+            {
+                printf("Failed to unmap buffer: %d\n", err);
+                return err;
+            }
+
+            double& best = toDevice? bestWrite : bestRead;
+            if ( rep == 0 || duration < best ) best = duration;
+        }
+    }
+
+    *hostToDeviceGBs = toGBs(bench->bufferSize, bestWrite);
+    *deviceToHostGBs = toGBs(bench->bufferSize, bestRead);
+    return CL_SUCCESS;
+}
+
+static void recordTransfer(const char* mode,
+                           double hostToDeviceGBs,
+                           double deviceToHostGBs,
+                           DevicePeaks* peaks,
+                           cl_uint indent)
+{
+    doIndent(indent);
+    printf("Host to device (%s): %.2f GB/s\n", mode, hostToDeviceGBs);
+    doIndent(indent);
+    printf("Device to host (%s): %.2f GB/s\n", mode, deviceToHostGBs);
+
+    if ( hostToDeviceGBs > peaks->hostToDeviceGBs ) peaks->hostToDeviceGBs = hostToDeviceGBs;
+    if ( deviceToHostGBs > peaks->deviceToHostGBs ) peaks->deviceToHostGBs = deviceToHostGBs;
+}
+
+static cl_int benchmarkHostTransfers(Benchmark* bench, DevicePeaks* peaks, cl_uint indent)
+{
+    cl_int err;
+    double hostToDevice=0.0;
+    double deviceToHost=0.0;
+
+    cl_mem deviceBuffer = clCreateBuffer( bench->context,
+                                          CL_MEM_READ_WRITE,
+                                          bench->bufferSize,
+                                          NULL,
+                                          &err
+                                        );
+    if ( err != CL_SUCCESS )
+    {
+        printf("Failed to create buffer. Error:%d\n", err);
+        return err;
+    }
+
+    /* Pageable host memory */
+    void* pageable = calloc(bench->bufferSize, 1);
+    if ( pageable == 0 )
+    {
+        printf("Failed to malloc\n");
+        clReleaseMemObject(deviceBuffer);
+        return CL_OUT_OF_HOST_MEMORY;
+    }
+
+    err = timeTransfers(bench, deviceBuffer, pageable, &hostToDevice, &deviceToHost);
+    if ( err == CL_SUCCESS )
+        recordTransfer("pageable", hostToDevice, deviceToHost, peaks, indent);
+
+    /* Pinned host memory. Implementations allocate CL_MEM_ALLOC_HOST_PTR
+    *  buffers in page locked memory so use a mapping of one as the host
+    *  pointer.
+    */
+    cl_mem pinnedBuffer=0;
+    void* pinned=0;
+    if ( err == CL_SUCCESS )
+    {
+        pinnedBuffer = clCreateBuffer( bench->context,
+                                       CL_MEM_READ_WRITE | CL_MEM_ALLOC_HOST_PTR,
+                                       bench->bufferSize,
+                                       NULL,
+                                       &err
+                                     );
+    }
+
+    if ( err == CL_SUCCESS )
+    {
+        pinned = clEnqueueMapBuffer( bench->queue,
+                                     pinnedBuffer,
+                                     /* blocking_map */ CL_TRUE,
+                                     CL_MAP_READ | CL_MAP_WRITE,
+                                     /* offset */ 0,
+                                     bench->bufferSize,
+                                     0, NULL, NULL,
+                                     &err
+                                   );
+    }
+
+    if ( err == CL_SUCCESS )
+    {
+        err = timeTransfers(bench, deviceBuffer, pinned, &hostToDevice, &deviceToHost);
+        if ( err == CL_SUCCESS )
+            recordTransfer("pinned", hostToDevice, deviceToHost, peaks, indent);
+    }
+
+    /* Mapped device memory */
+    if ( err == CL_SUCCESS )
+    {
+        err = timeMappedTransfers(bench, deviceBuffer, pageable, &hostToDevice, &deviceToHost);
+        if ( err == CL_SUCCESS )
+            recordTransfer("mapped", hostToDevice, deviceToHost, peaks, indent);
+    }
+
+    if ( pinned != 0 )
+    {
+        clEnqueueUnmapMemObject(bench->queue, pinnedBuffer, pinned, 0, NULL, NULL);
+        clFinish(bench->queue);
+    }
+
+    if ( pinnedBuffer != 0 )
+        clReleaseMemObject(pinnedBuffer);
+
+    clReleaseMemObject(deviceBuffer);
+    free(pageable);
+    return err;
+}
+
+static cl_int benchmarkGlobalMemory(Benchmark* bench, DevicePeaks* peaks, cl_uint indent)
+{
+    cl_int err;
+    cl_mem in=0;
+    cl_mem out=0;
+    cl_kernel readKernel=0;
+    cl_kernel writeKernel=0;
+    cl_kernel copyKernel=0;
+    size_t numElements = bench->bufferSize / sizeof(cl_float4);
+    double seconds=0.0;
+
+    // Zero filled so read_global never writes
+    void* zeros = calloc(bench->bufferSize, 1);
+    if ( zeros == 0 )
+    {
+        printf("Failed to malloc\n");
+        return CL_OUT_OF_HOST_MEMORY;
+    }
+
+    in = clCreateBuffer( bench->context,
+                         CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR,
+                         bench->bufferSize,
+                         zeros,
+                         &err
+                       );
+    free(zeros);
+    if ( err != CL_SUCCESS ) goto done;
+
+    out = clCreateBuffer( bench->context, CL_MEM_READ_WRITE, bench->bufferSize, NULL, &err);
+    if ( err != CL_SUCCESS ) goto done;
+
+    readKernel = clCreateKernel(bench->program, "read_global", &err);
+    if ( err != CL_SUCCESS ) goto done;
+    err = clSetKernelArg(readKernel, 0, sizeof(cl_mem), &in);
+    if ( err == CL_SUCCESS )
+        err = clSetKernelArg(readKernel, 1, sizeof(cl_mem), &out);
+    if ( err != CL_SUCCESS ) goto done;
+
+    err = timeKernel(bench, readKernel, numElements, NULL, &seconds);
+    if ( err != CL_SUCCESS ) goto done;
+    peaks->globalReadGBs = toGBs(bench->bufferSize, seconds);
+    doIndent(indent);
+    printf("Global memory read: %.2f GB/s\n", peaks->globalReadGBs);
+
+    writeKernel = clCreateKernel(bench->program, "write_global", &err);
+    if ( err != CL_SUCCESS ) goto done;
+    err = clSetKernelArg(writeKernel, 0, sizeof(cl_mem), &out);
+    if ( err != CL_SUCCESS ) goto done;
+
+    err = timeKernel(bench, writeKernel, numElements, NULL, &seconds);
+    if ( err != CL_SUCCESS ) goto done;
+    peaks->globalWriteGBs = toGBs(bench->bufferSize, seconds);
+    doIndent(indent);
+    printf("Global memory write: %.2f GB/s\n", peaks->globalWriteGBs);
+
+    copyKernel = clCreateKernel(bench->program, "copy_global", &err);
+    if ( err != CL_SUCCESS ) goto done;
+    err = clSetKernelArg(copyKernel, 0, sizeof(cl_mem), &in);
+    if ( err == CL_SUCCESS )
+        err = clSetKernelArg(copyKernel, 1, sizeof(cl_mem), &out);
+    if ( err != CL_SUCCESS ) goto done;
+
+    err = timeKernel(bench, copyKernel, numElements, NULL, &seconds);
+    if ( err != CL_SUCCESS ) goto done;
+    /* Each element is read and written */
+    peaks->globalCopyGBs = toGBs(2*bench->bufferSize, seconds);
+    doIndent(indent);
+    printf("Global memory copy: %.2f GB/s\n", peaks->globalCopyGBs);
+
+done:
+    if ( err != CL_SUCCESS )
+        printf("Global memory benchmark failed: %d\n", err);
+
+    if ( copyKernel != 0 ) clReleaseKernel(copyKernel);
+    if ( writeKernel != 0 ) clReleaseKernel(writeKernel);
+    if ( readKernel != 0 ) clReleaseKernel(readKernel);
+    if ( out != 0 ) clReleaseMemObject(out);
+    if ( in != 0 ) clReleaseMemObject(in);
+    return err;
+}
+
+static cl_int benchmarkLocalMemory(Benchmark* bench, DevicePeaks* peaks, cl_uint indent)
+{
+    cl_int err;
+    cl_mem out=0;
+    double seconds=0.0;
+    size_t localSize=1;
+    size_t globalSize=0;
+    size_t kernelMaxWorkGroupSize=0;
+
+    cl_kernel kernel = clCreateKernel(bench->program, "read_local", &err);
+    if ( err != CL_SUCCESS ) goto done;
+
+    err = clGetKernelWorkGroupInfo( kernel,
+                                    bench->device,
+                                    CL_KERNEL_WORK_GROUP_SIZE,
+                                    sizeof(size_t),
+                                    &kernelMaxWorkGroupSize,
+                                    NULL
+                                  );
+    if ( err != CL_SUCCESS ) goto done;
+
+    // read_local needs a power of two work group size
+    while ( localSize*2 <= kernelMaxWorkGroupSize && localSize*2 <= 256 )
+        localSize *= 2;
+
+    globalSize = bench->computeUnits * localSize * 16;
+
+    out = clCreateBuffer( bench->context, CL_MEM_WRITE_ONLY, sizeof(cl_float) * globalSize, NULL, &err);
+    if ( err != CL_SUCCESS ) goto done;
+
+    err = clSetKernelArg(kernel, 0, sizeof(cl_mem), &out);
+    if ( err == CL_SUCCESS )
+        err = clSetKernelArg(kernel, 1, sizeof(cl_float) * localSize, NULL);
+    if ( err == CL_SUCCESS )
+        err = clSetKernelArg(kernel, 2, sizeof(cl_int), &localIterations);
+    if ( err != CL_SUCCESS ) goto done;
+
+    err = timeKernel(bench, kernel, globalSize, &localSize, &seconds);
+    if ( err != CL_SUCCESS ) goto done;
+
+    /* 4 float reads per iteration */
+    peaks->localGBs = toGBs(globalSize * localIterations * 4 * sizeof(cl_float), seconds);
+    doIndent(indent);
+    printf("Local memory read: %.2f GB/s (work group size %lu)\n",
+           peaks->localGBs, (unsigned long) localSize);
+
+done:
+    if ( err != CL_SUCCESS )
+        printf("Local memory benchmark failed: %d\n", err);
+
+    if ( out != 0 ) clReleaseMemObject(out);
+    if ( kernel != 0 ) clReleaseKernel(kernel);
+    return err;
+}
+
+static cl_int benchmarkLaunchLatency(Benchmark* bench, DevicePeaks* peaks, cl_uint indent)
+{
+    cl_int err;
+    cl_kernel kernel = clCreateKernel(bench->program, "empty_kernel", &err);
+    if ( err != CL_SUCCESS )
+    {
+        printf("Failed to create kernel object.\n");
+        return err;
+    }
+
+    size_t globalSize = 1;
+    double total=0.0;
+    /* The first launch is a warm up and is not counted */
+    for (unsigned int launch=0; launch <= latencyLaunches; ++launch)
+    {
+        double start = getHostTime();
+        err = clEnqueueNDRangeKernel( bench->queue, kernel, 1, NULL, &globalSize, NULL, 0, NULL, NULL);
+        if ( err == CL_SUCCESS )
+            err = clFinish(bench->queue);
+
+        if ( err != CL_SUCCESS )
+        {
+            printf("Failed to launch kernel: %d\n", err);
+            clReleaseKernel(kernel);
+            return err;
+        }
+
+        if ( launch > 0 )
+            total += getHostTime() - start;
+    }
+
+    peaks->launchLatencyUs = total / latencyLaunches * 1.0e6;
+    doIndent(indent);
+    printf("Kernel launch latency: %.2f us\n", peaks->launchLatencyUs);
+
+    clReleaseKernel(kernel);
+    return CL_SUCCESS;
+}
+
+/* Measure throughput of one of the *_throughput kernels in G operations per second */
+static cl_int timeThroughput(Benchmark* bench,
+                             const char* kernelName,
+                             const void* seed,
+                             size_t seedSize,
+                             double* gops)
+{
+    cl_int err;
+    cl_mem out=0;
+    double seconds=0.0;
+    size_t globalSize = bench->computeUnits * 256 * 16;
+
+    cl_kernel kernel = clCreateKernel(bench->program, kernelName, &err);
+    if ( err != CL_SUCCESS ) goto done;
+
+    out = clCreateBuffer( bench->context, CL_MEM_WRITE_ONLY, sizeof(cl_float) * globalSize, NULL, &err);
+    if ( err != CL_SUCCESS ) goto done;
+
+    err = clSetKernelArg(kernel, 0, sizeof(cl_mem), &out);
+    if ( err == CL_SUCCESS )
+        err = clSetKernelArg(kernel, 1, seedSize, seed);
+    if ( err == CL_SUCCESS )
+        err = clSetKernelArg(kernel, 2, sizeof(cl_int), &throughputIterations);
+    if ( err != CL_SUCCESS ) goto done;
+
+    err = timeKernel(bench, kernel, globalSize, NULL, &seconds);
+    if ( err != CL_SUCCESS ) goto done;
+
+    /* 16 multiply-adds on 4 lanes per iteration. Each counts as 2 operations */
+    *gops = (double) globalSize * throughputIterations * 16 * 4 * 2 / seconds * 1.0e-9;
+
+done:
+    if ( err != CL_SUCCESS )
+        printf("%s failed: %d\n", kernelName, err);
+
+    if ( out != 0 ) clReleaseMemObject(out);
+    if ( kernel != 0 ) clReleaseKernel(kernel);
+    return err;
+}
+
+static cl_int benchmarkThroughput(Benchmark* bench, DevicePeaks* peaks, cl_uint indent)
+{
+    cl_float floatSeed = 1.0f;
+    cl_int err = timeThroughput(bench, "float_throughput", &floatSeed, sizeof(floatSeed), &(peaks->floatGFLOPs));
+    if ( err != CL_SUCCESS )
+        return err;
+
+    doIndent(indent);
+    printf("Float throughput: %.2f GFLOP/s\n", peaks->floatGFLOPs);
+
+    cl_int intSeed = 1;
+    err = timeThroughput(bench, "int_throughput", &intSeed, sizeof(intSeed), &(peaks->intGOPs));
+    if ( err != CL_SUCCESS )
+        return err;
+
+    doIndent(indent);
+    printf("Int throughput: %.2f GOP/s\n", peaks->intGOPs);
+    return CL_SUCCESS;
+}
+
+static void releaseBenchmark(Benchmark* bench)
+{
+    if ( bench->program != 0 ) clReleaseProgram(bench->program);
+    if ( bench->queue != 0 ) clReleaseCommandQueue(bench->queue);
+    if ( bench->context != 0 ) clReleaseContext(bench->context);
+}
+
+/* Create the context, queue and program for device and queue the build
+*  of the program on manager
+*/
+static cl_int setUpBenchmark(Benchmark* bench,
+                             BuildManager* manager,
+                             cl_platform_id platform,
+                             cl_device_id device,
+                             const KernelSource* kernelSource)
+{
+    bench->device = device;
+
+    cl_int err = clGetDeviceInfo(device, CL_DEVICE_MAX_COMPUTE_UNITS, sizeof(cl_uint), &(bench->computeUnits), NULL);
+    if ( err != CL_SUCCESS )
+    {
+        printf("Could not get CL_DEVICE_MAX_COMPUTE_UNITS\n");
+        return err;
+    }
+
+    cl_ulong maxAlloc=0;
+    err = clGetDeviceInfo(device, CL_DEVICE_MAX_MEM_ALLOC_SIZE, sizeof(cl_ulong), &maxAlloc, NULL);
+    if ( err != CL_SUCCESS )
+    {
+        printf("Could not get CL_DEVICE_MAX_MEM_ALLOC_SIZE\n");
+        return err;
+    }
+
+    bench->bufferSize = ( maxAlloc/2 < maxBufferSize )? maxAlloc/2 : maxBufferSize;
+    bench->bufferSize -= bench->bufferSize % sizeof(cl_float4);
+
+    cl_context_properties cProp[] = { CL_CONTEXT_PLATFORM, (cl_context_properties) platform, 0 };
+    bench->context = clCreateContext(cProp, 1, &device, NULL, NULL, &err);
+    if ( err != CL_SUCCESS )
+    {
+        printf("Failed to create context: %d\n", err);
+        return err;
+    }
+
+    bench->queue = clCreateCommandQueue(bench->context, device, CL_QUEUE_PROFILING_ENABLE, &err);
+    if ( err != CL_SUCCESS )
+    {
+        printf("Couldn't create command queue.\n");
+        return err;
+    }
+
+    bench->program = createProgramFromKernelSource(bench->context, device, kernelSource, /*buildOptions*/ NULL, &err);
+    if ( err != CL_SUCCESS )
+    {
+        printf("Could not create program:%d\n", err);
+        return err;
+    }
+
+    err = startProgramBuild(manager, bench->program, 1, &device, /*options*/ NULL);
+    if ( err != CL_SUCCESS )
+    {
+        printf("Failed to start build\n");
+        return err;
+    }
+    return CL_SUCCESS;
+}
+
+/* Run all the benchmarks on a device set up by setUpBenchmark() whose
+*  program has been built
+*/
+static cl_int benchmarkDevice(Benchmark* bench, DevicePeaks* peaks, cl_uint indent)
+{
+    memset(peaks, 0, sizeof(DevicePeaks));
+
+    doIndent(indent);
+    printf("Buffer size: %lu bytes, repetitions: %u\n",
+           (unsigned long) bench->bufferSize, repetitions);
+
+    /* Run all benchmarks. Report the last failure. */
+    cl_int lastError = CL_SUCCESS;
+    cl_int err = benchmarkHostTransfers(bench, peaks, indent);
+    if ( err != CL_SUCCESS ) lastError = err;
+
+    err = benchmarkGlobalMemory(bench, peaks, indent);
+    if ( err != CL_SUCCESS ) lastError = err;
+
+    err = benchmarkLocalMemory(bench, peaks, indent);
+    if ( err != CL_SUCCESS ) lastError = err;
+
+    err = benchmarkLaunchLatency(bench, peaks, indent);
+    if ( err != CL_SUCCESS ) lastError = err;
+
+    err = benchmarkThroughput(bench, peaks, indent);
+    if ( err != CL_SUCCESS ) lastError = err;
+
+    return lastError;
+}
+
+void usage(const char* progName)
+{
+    printf("Usage: %s [peaks file]\n\n", progName);
+    printf("Measures transfer and memory bandwidth, launch latency and\n"
+           "arithmetic throughput of every OpenCL device. If [peaks file]\n"
+           "is given the results for each device are appended to it.\n");
+    exit(1);
+}
+
+int main(int argc, char** argv)
+{
+    const cl_uint indent=2;
+
+    if ( argc > 2 || ( argc == 2 && argv[1][0] == '-' ) )
+        usage(argv[0]);
+
+    const char* peaksFile = (argc == 2)? argv[1] : NULL;
+
+    KernelSource kernelSource;
+    cl_int err = getKernelSource( "device_benchmark.cl",
+                                  embeddedKernels,
+                                  sizeof(embeddedKernels)/sizeof(EmbeddedKernel),
+                                  &kernelSource);
+    if ( err != CL_SUCCESS )
+    {
+        printf("Could not load benchmark kernels\n");
+        exit(1);
+    }
+
+    cl_platform_id* platforms;
+    cl_uint numOfPlatforms;
+    err = getPlatformIDs( &platforms, &numOfPlatforms);
+    if ( err != CL_SUCCESS )
+    {
+        printf("Failed to get platformsIDs\n");
+        exit(1);
+    }
+
+    cl_int lastError = CL_SUCCESS;
+    std::vector<Benchmark> benches;
+
+    /* Iterate through platforms */
+    for (unsigned int index=0; index < numOfPlatforms; ++index)
+    {
+        cl_uint numDevices = 0;
+        cl_device_id* devices=0;
+        err = getDeviceIDs(platforms[index], &devices, &numDevices);
+        if ( err != CL_SUCCESS )
+        {
+            printf("Failed to get devices IDs of platform %u\n", index);
+            lastError = err;
+            continue;
+        }
+
+        for (unsigned int deviceIndex=0; deviceIndex < numDevices; ++deviceIndex)
+        {
+            Benchmark bench;
+            memset(&bench, 0, sizeof(Benchmark));
+            bench.device = devices[deviceIndex];
+            bench.platformIndex = index;
+            bench.deviceIndex = deviceIndex;
+            benches.push_back(bench);
+        }
+        free(devices);
+    }
+
+    /* Build the programs of all the devices concurrently. Build logs are
+    *  only printed on failure
+    */
+    cl_uint maxConcurrentBuilds = std::thread::hardware_concurrency();
+    if ( maxConcurrentBuilds == 0 || maxConcurrentBuilds > benches.size() )
+        maxConcurrentBuilds = benches.size();
+
+    BuildManager* buildManager = createBuildManager(maxConcurrentBuilds, CL_FALSE);
+    if ( buildManager == NULL )
+    {
+        printf("Failed to create build manager\n");
+        exit(1);
+    }
+
+    for (size_t index=0; index < benches.size(); ++index)
+    {
+        Benchmark* bench = &benches[index];
+        cl_platform_id platform = platforms[bench->platformIndex];
+        bench->setUpError = setUpBenchmark(bench, buildManager, platform, bench->device, &kernelSource);
+    }
+
+    // Wait for every build before timing so no compiler competes with the
+    // benchmarks for the host
+    for (size_t index=0; index < benches.size(); ++index)
+    {
+        if ( benches[index].setUpError == CL_SUCCESS )
+            benches[index].buildError = waitForProgramBuild(buildManager, benches[index].program);
+    }
+
+    for (size_t index=0; index < benches.size(); ++index)
+    {
+        Benchmark* bench = &benches[index];
+        if ( index == 0 || bench->platformIndex != benches[index -1].platformIndex )
+        {
+            if ( index != 0 )
+                printf("\n");
+            printf("Platform # %u\n", bench->platformIndex);
+        }
+
+        char deviceName[256];
+        err = clGetDeviceInfo(bench->device, CL_DEVICE_NAME, sizeof(deviceName), deviceName, NULL);
+        if ( err != CL_SUCCESS )
+            strcpy(deviceName, "<unknown>");
+
+        doIndent(indent);
+        printf("Device :%u (%s)\n", bench->deviceIndex, deviceName);
+
+        DevicePeaks peaks;
+        err = bench->setUpError;
+        if ( err == CL_SUCCESS && bench->buildError != CL_SUCCESS )
+        {
+            err = bench->buildError;
+            doIndent(indent*2);
+            printf("Build failed\n");
+            printProgramBuildInfo(bench->program, bench->device, indent*2);
+        }
+
+        if ( err == CL_SUCCESS )
+            err = benchmarkDevice(bench, &peaks, indent*2);
+
+        if ( err != CL_SUCCESS )
+        {
+            printf("Benchmark of device %u failed\n", bench->deviceIndex);
+            lastError = err;
+        }
+
+        else if ( peaksFile != NULL )
+        {
+            err = saveDevicePeaks(peaksFile, bench->device, &peaks);
+            if ( err != CL_SUCCESS )
+                lastError = err;
+        }
+    }
+    if ( !benches.empty() )
+        printf("\n");
+
+    releaseBuildManager(buildManager);
+    for (size_t index=0; index < benches.size(); ++index)
+        releaseBenchmark(&benches[index]);
+
+    free(platforms);
+    releaseKernelSource(&kernelSource);
+
+    return (lastError == CL_SUCCESS)? 0 : 1;
+}
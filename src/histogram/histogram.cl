@@ -0,0 +1,50 @@
+// Histogram of uint values. The bin of a value is value % numBins.
+//
+// Both kernels use a grid-stride loop so any number of work groups can
+// cover the input.
+
+// Baseline: every element is added straight to the global bins.
+__kernel void histogram_global(__global const uint* data,
+                               __global uint* bins,
+                               uint n,
+                               uint numBins)
+{
+    for (size_t index = get_global_id(0); index < n; index += get_global_size(0))
+        atomic_inc(&bins[data[index] % numBins]);
+}
+
+// Each work group keeps a private copy of bins [firstBin, firstBin + passBins)
+// in local memory, updated with local atomics, and merges it into the global
+// bins at the end. When numBins does not fit in local memory the host runs
+// one pass per range of bins. localBins must hold passBins elements.
+__kernel void histogram_local(__global const uint* data,
+                              __global uint* bins,
+                              __local uint* localBins,
+                              uint n,
+                              uint numBins,
+                              uint firstBin,
+                              uint passBins)
+{
+    size_t lid = get_local_id(0);
+    size_t localSize = get_local_size(0);
+
+    for (size_t bin = lid; bin < passBins; bin += localSize)
+        localBins[bin] = 0;
+    barrier(CLK_LOCAL_MEM_FENCE);
+
+    for (size_t index = get_global_id(0); index < n; index += get_global_size(0))
+    {
+        // Bins below firstBin wrap around to large values
+        uint bin = data[index] % numBins - firstBin;
+        if ( bin < passBins )
+            atomic_inc(&localBins[bin]);
+    }
+    barrier(CLK_LOCAL_MEM_FENCE);
+
+    for (size_t bin = lid; bin < passBins; bin += localSize)
+    {
+        uint count = localBins[bin];
+        if ( count != 0 )
+            atomic_add(&bins[firstBin + bin], count);
+    }
+}
@@ -0,0 +1,455 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <assert.h>
+#include <string.h>
+#include <getopt.h>
+#include <CL/opencl.h>
+#include <libclprobe/clprobe.h>
+#include <libclprobe/driverutil.h>
+#include <libclprobe/kernelsource.h>
+#include <libclprobe/buildmanager.h>
+#include <libclprobe/timing.h>
+#include <libclprobe/devicepeaks.h>
+#include <libclprobe/resultstore.h>
+#include <vector>
+#include "histogram.cl.h"
+
+/* Kernels compiled into the executable */
+static const EmbeddedKernel embeddedKernels[] =
+{
+    EMBEDDED_KERNEL("histogram.cl", histogram_cl)
+};
+
+void usage(const char* progName)
+{
+    printf("Usage: %s [options] <num_elements>\n\n", progName);
+    printf("Computes a histogram of random values with global atomics and with\n"
+           "per work group histograms in local memory and reports their throughput.\n\n"
+           "Options:\n"
+           "  --bins <n>         Number of bins (default 256)\n"
+           "  --pass-bins <n>    Limit the bins handled per pass of the local memory\n"
+           "                     kernel (default: as many as fit in local memory)\n"
+           "  --repetitions <n>  Number of timed runs, the best is reported (default 5)\n"
+           "  --peaks <file>     Device peaks measured by device_benchmark used for the\n"
+           "                     roofline report (default: estimate from device info)\n"
+           "  --results <file>   Append the times to a results file for perf_compare\n"
+           "  --kernel <file>    Override the embedded histogram.cl\n");
+    exit(1);
+}
+
+void cleanUp();
+
+//Global for clean up convenience
+KernelSource kernelSource;
+BuildManager* buildManager=0;
+cl_program program=0;
+cl_context context=0;
+cl_command_queue cmdQueue=0;
+cl_kernel globalKernel=0;
+cl_kernel localKernel=0;
+cl_uint* hostData=0;
+cl_uint* hostBins=0;
+cl_uint* copiedBackBins=0;
+cl_mem dataBuffer=0;
+cl_mem binsBuffer=0;
+const char* resultsFile=0;
+
+/* Run one histogram (all passes) and return the sum of the kernel times in
+*  seconds or a negative value on failure. passBins of 0 runs histogram_global.
+*/
+static double runHistogram(cl_uint n, cl_uint numBins, cl_uint passBins,
+                           size_t globalSize, size_t localSize)
+{
+    // Bins are accumulated so they must start at zero
+    cl_int err = clEnqueueWriteBuffer(cmdQueue, binsBuffer, CL_TRUE, 0, sizeof(cl_uint) * numBins,
+                                      hostBins, 0, NULL, NULL);
+    if ( err != CL_SUCCESS )
+    {
+        printf("Failed to clear bins: %d\n", err);
+        return -1.0;
+    }
+
+    cl_kernel kernel = ( passBins == 0 )? globalKernel : localKernel;
+    cl_uint passStep = ( passBins == 0 )? numBins : passBins;
+    double total=0.0;
+    for (cl_uint firstBin=0; firstBin < numBins; firstBin += passStep)
+    {
+        cl_uint arg=0;
+        err = clSetKernelArg(kernel, arg++, sizeof(cl_mem), &dataBuffer);
+        if ( err == CL_SUCCESS )
+            err = clSetKernelArg(kernel, arg++, sizeof(cl_mem), &binsBuffer);
+        if ( err == CL_SUCCESS && passBins != 0 )
+            err = clSetKernelArg(kernel, arg++, sizeof(cl_uint) * passBins, NULL);
+        if ( err == CL_SUCCESS )
+            err = clSetKernelArg(kernel, arg++, sizeof(cl_uint), &n);
+        if ( err == CL_SUCCESS )
+            err = clSetKernelArg(kernel, arg++, sizeof(cl_uint), &numBins);
+        if ( passBins != 0 )
+        {
+            cl_uint thisPass = ( numBins - firstBin < passBins )? numBins - firstBin : passBins;
+            if ( err == CL_SUCCESS )
+                err = clSetKernelArg(kernel, arg++, sizeof(cl_uint), &firstBin);
+            if ( err == CL_SUCCESS )
+                err = clSetKernelArg(kernel, arg++, sizeof(cl_uint), &thisPass);
+        }
+
+        if ( err != CL_SUCCESS )
+        {
+            printf("Couldn't set kernel argument.\n");
+            return -1.0;
+        }
+
+        cl_event event=0;
+        err = clEnqueueNDRangeKernel(cmdQueue, kernel, 1, NULL, &globalSize, &localSize,
+                                     0, NULL, &event);
+        if ( err != CL_SUCCESS )
+        {
+            printf("Failed to enqueue kernel: %d\n", err);
+            return -1.0;
+        }
+
+        double seconds=0.0;
+        err = clWaitForEvents(1, &event);
+        if ( err == CL_SUCCESS )
+            err = getEventDuration(event, &seconds);
+        clReleaseEvent(event);
+        if ( err != CL_SUCCESS )
+        {
+            printf("Failed to time kernel: %d\n", err);
+            return -1.0;
+        }
+        total += seconds;
+    }
+
+    return total;
+}
+
+/* Time a variant, check its result and print its throughput.
+*  Returns CL_SUCCESS if the result is correct.
+*/
+static cl_int benchmarkHistogram(const char* name, const char* variant, cl_device_id device,
+                                 cl_uint n, cl_uint numBins, cl_uint passBins,
+                                 size_t globalSize, size_t localSize, unsigned int repetitions,
+                                 const DevicePeaks* peaks, const cl_uint* expectedBins)
+{
+    double best=0.0;
+    std::vector<double> samples;
+    for (unsigned int rep=0; rep < repetitions; ++rep)
+    {
+        double seconds = runHistogram(n, numBins, passBins, globalSize, localSize);
+        if ( seconds < 0.0 )
+            return CL_INVALID_VALUE;
+
+        if ( rep == 0 || seconds < best ) best = seconds;
+        samples.push_back(seconds);
+    }
+
+    cl_int err = clEnqueueReadBuffer(cmdQueue, binsBuffer, CL_TRUE, 0, sizeof(cl_uint) * numBins,
+                                     copiedBackBins, 0, NULL, NULL);
+    if ( err != CL_SUCCESS )
+    {
+        printf("Failed to read back bins: %d\n", err);
+        return err;
+    }
+
+    if ( memcmp(copiedBackBins, expectedBins, sizeof(cl_uint) * numBins) != 0 )
+    {
+        printf("%s: result is WRONG\n", name);
+        return CL_INVALID_VALUE;
+    }
+
+    cl_uint passes = ( passBins == 0 )? 1 : (numBins + passBins -1) / passBins;
+    size_t numGroups = globalSize / localSize;
+    printf("%s (%u pass%s): %.3f ms, %.2f Gelements/s\n", name, passes, (passes == 1)? "" : "es",
+           best * 1.0e3, n / best * 1.0e-9);
+
+    // Each pass reads the input and updates every bin. The local kernel
+    // merges at most one copy of each bin per work group.
+    KernelWork work;
+    work.bytes = passes * sizeof(cl_uint) * (double) n;
+    work.bytes += ( passBins == 0 )? 2.0 * sizeof(cl_uint) * n
+                                   : 2.0 * sizeof(cl_uint) * numBins * numGroups;
+    work.ops = passes * (double) n;
+    work.integerOps = CL_TRUE;
+    printRooflineReport(&work, best, peaks, /*Indent*/ 2);
+
+    if ( resultsFile != NULL )
+        return appendBenchmarkResult(resultsFile, device, "histogram", variant, n, &samples[0], repetitions);
+    return CL_SUCCESS;
+}
+
+int main(int argc, char** argv)
+{
+    const char* peaksFile=0;
+    const char* kernelName="histogram.cl";
+    cl_uint numBins=256;
+    cl_uint maxPassBins=0;
+    unsigned int repetitions=5;
+
+    static struct option longOptions[] =
+    {
+        { "bins", required_argument, 0, 'b' },
+        { "pass-bins", required_argument, 0, 'l' },
+        { "repetitions", required_argument, 0, 'r' },
+        { "peaks", required_argument, 0, 'p' },
+        { "kernel", required_argument, 0, 'k' },
+        { "results", required_argument, 0, 'o' },
+        { 0, 0, 0, 0 }
+    };
+
+    int option=0;
+    while ( (option = getopt_long(argc, argv, "b:l:r:p:k:o:", longOptions, NULL)) != -1 )
+    {
+        switch (option)
+        {
+            case 'b': numBins = atoi(optarg); break;
+            case 'l': maxPassBins = atoi(optarg); break;
+            case 'r': repetitions = atoi(optarg); break;
+            case 'p': peaksFile = optarg; break;
+            case 'k': kernelName = optarg; break;
+            case 'o': resultsFile = optarg; break;
+            default: usage(argv[0]);
+        }
+    }
+
+    if ( argc - optind != 1 || numBins < 1 || repetitions < 1 )
+    {
+        usage(argv[0]);
+        assert(0 && "Unreachable");
+    }
+
+    cl_uint n = atoi(argv[optind]);
+    if ( n < 1 )
+    {
+        printf("Number of elements must be > 0\n");
+        exit(1);
+    }
+
+    cl_int err = getKernelSource( kernelName,
+                                  embeddedKernels,
+                                  sizeof(embeddedKernels)/sizeof(EmbeddedKernel),
+                                  &kernelSource);
+    if ( err != CL_SUCCESS )
+    {
+        printf("Could not open OpenCL kernel: %s\n", kernelName);
+        exit(1);
+    }
+
+    cl_platform_id platform = pickPlatform();
+    cl_device_id device = pickDevice(platform);
+
+    char deviceName[256];
+    if ( clGetDeviceInfo(device, CL_DEVICE_NAME, sizeof(deviceName), deviceName, NULL) == CL_SUCCESS )
+        printf("Using device %s\n", deviceName);
+
+    cl_context_properties cProp[] = { CL_CONTEXT_PLATFORM, (cl_context_properties) platform, 0 };
+    context = clCreateContext(cProp, 1, &device, contextCallBack, NULL, &err);
+    if ( err != CL_SUCCESS )
+    {
+        printf("Failed to create context: %d\n", err);
+        cleanUp();
+        exit(1);
+    }
+
+    /* Profiling is used to time the kernels */
+    cmdQueue = clCreateCommandQueue(context, device, CL_QUEUE_PROFILING_ENABLE, &err);
+    if ( err != CL_SUCCESS )
+    {
+        printf("Couldn't create command queue.\n");
+        cleanUp();
+        exit(1);
+    }
+
+    program = createProgramFromKernelSource(context, device, &kernelSource, /*buildOptions*/ NULL, &err);
+    if ( err != CL_SUCCESS )
+    {
+        printf("Could not create program:%d\n", err);
+        cleanUp();
+        exit(1);
+    }
+
+    /* Build on a worker thread while the input is generated. The build
+    *  log is only printed on failure
+    */
+    buildManager = createBuildManager(/*maxConcurrentBuilds*/ 1, /*printBuildLogs*/ CL_FALSE);
+    if ( buildManager == NULL )
+    {
+        printf("Failed to create build manager\n");
+        cleanUp();
+        exit(1);
+    }
+
+    err = startProgramBuild(buildManager, program, 1, &device, /*options*/ NULL);
+    if ( err != CL_SUCCESS )
+    {
+        printf("Failed to start build\n");
+        cleanUp();
+        exit(1);
+    }
+
+    /* Random input and the expected result */
+    hostData = (cl_uint*) malloc( sizeof(cl_uint) * n );
+    hostBins = (cl_uint*) calloc( numBins, sizeof(cl_uint) );
+    copiedBackBins = (cl_uint*) malloc( sizeof(cl_uint) * numBins );
+    cl_uint* expectedBins = (cl_uint*) calloc( numBins, sizeof(cl_uint) );
+    if ( hostData == 0 || hostBins == 0 || copiedBackBins == 0 || expectedBins == 0 )
+    {
+        printf("Failed to malloc memory for host arrays\n");
+        free(expectedBins);
+        cleanUp();
+        exit(1);
+    }
+
+    srand(1);
+    for (cl_uint index=0; index < n; ++index)
+    {
+        hostData[index] = ( (cl_uint) rand() << 16 ) ^ (cl_uint) rand();
+        expectedBins[ hostData[index] % numBins ]++;
+    }
+
+    dataBuffer = clCreateBuffer(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR,
+                                sizeof(cl_uint) * n, hostData, &err);
+    if ( err == CL_SUCCESS )
+        binsBuffer = clCreateBuffer(context, CL_MEM_READ_WRITE, sizeof(cl_uint) * numBins, NULL, &err);
+
+    if ( err != CL_SUCCESS )
+    {
+        printf("Failed to create buffer. Error:%d\n", err);
+        free(expectedBins);
+        cleanUp();
+        exit(1);
+    }
+
+    err = waitForProgramBuild(buildManager, program);
+    if ( err != CL_SUCCESS )
+    {
+        printf("Build failed\n");
+        printProgramBuildInfo(program, device, /*Indent*/ 0);
+        free(expectedBins);
+        cleanUp();
+        exit(1);
+    }
+
+    globalKernel = clCreateKernel(program, "histogram_global", &err);
+    if ( err == CL_SUCCESS )
+        localKernel = clCreateKernel(program, "histogram_local", &err);
+
+    if ( err != CL_SUCCESS )
+    {
+        printf("Failed to create kernel object.\n");
+        free(expectedBins);
+        cleanUp();
+        exit(1);
+    }
+
+    /* Work group size, number of groups and how many bins fit in local memory */
+    KernelInfo kernelInfo;
+    cl_uint computeUnits=0;
+    err = getKernelInfo(localKernel, device, &kernelInfo);
+    if ( err == CL_SUCCESS )
+        err = clGetDeviceInfo(device, CL_DEVICE_MAX_COMPUTE_UNITS, sizeof(cl_uint), &computeUnits, NULL);
+    if ( err != CL_SUCCESS )
+    {
+        printf("Could not get device limits\n");
+        free(expectedBins);
+        cleanUp();
+        exit(1);
+    }
+
+    size_t localSize = fitWorkGroupSize(&kernelInfo, 256);
+    size_t globalSize = localSize * computeUnits * 4;
+
+    cl_ulong localBinsAvailable = ( kernelInfo.deviceLocalMemSize - kernelInfo.localMemSize ) / sizeof(cl_uint);
+    cl_uint passBins = ( localBinsAvailable < numBins )? (cl_uint) localBinsAvailable : numBins;
+    if ( maxPassBins != 0 && maxPassBins < passBins )
+        passBins = maxPassBins;
+
+    if ( passBins == 0 )
+    {
+        printf("No local memory available for the local histogram\n");
+        free(expectedBins);
+        cleanUp();
+        exit(1);
+    }
+
+    printf("%u elements, %u bins, %lu work groups of %lu, %u bins per pass\n",
+           n, numBins, (unsigned long) (globalSize / localSize), (unsigned long) localSize, passBins);
+
+    DevicePeaks peaks;
+    if ( getDevicePeaks(peaksFile, device, &peaks) != CL_SUCCESS )
+        memset(&peaks, 0, sizeof(peaks));
+    printf("\n");
+
+    int result=0;
+    if ( benchmarkHistogram("Global atomics", "global", device, n, numBins, /*passBins*/ 0, globalSize, localSize,
+                            repetitions, &peaks, expectedBins) != CL_SUCCESS )
+        result = 1;
+
+    if ( benchmarkHistogram("Local privatised", "local", device, n, numBins, passBins, globalSize, localSize,
+                            repetitions, &peaks, expectedBins) != CL_SUCCESS )
+        result = 1;
+
+    free(expectedBins);
+    cleanUp();
+    return result;
+}
+
+void cleanUp()
+{
+    cl_int err=0;
+    releaseKernelSource(&kernelSource);
+
+    // Waits for any outstanding build
+    releaseBuildManager(buildManager);
+
+    if (dataBuffer!=0)
+    {
+        err = clReleaseMemObject(dataBuffer);
+        handleError(err, "Couldn't release buffer", false);
+    }
+
+    if (binsBuffer!=0)
+    {
+        err = clReleaseMemObject(binsBuffer);
+        handleError(err, "Couldn't release buffer", false);
+    }
+
+    if (localKernel!=0)
+    {
+        err = clReleaseKernel(localKernel);
+        handleError(err, "Couldn't release kernel", false);
+    }
+
+    if (globalKernel!=0)
+    {
+        err = clReleaseKernel(globalKernel);
+        handleError(err, "Couldn't release kernel", false);
+    }
+
+    if (program!= 0)
+    {
+        err = clReleaseProgram(program);
+        handleError(err, "Couldn't release program", false);
+    }
+
+    if (cmdQueue != 0 )
+    {
+        err = clReleaseCommandQueue(cmdQueue);
+        handleError(err, "Couldn't release command queue", false);
+    }
+
+    if (context!=0)
+    {
+        err = clReleaseContext(context);
+        handleError(err, "Couldn't release context", false);
+    }
+
+    if (hostData!=0)
+        free(hostData);
+
+    if (hostBins!=0)
+        free(hostBins);
+
+    if (copiedBackBins!=0)
+        free(copiedBackBins);
+}
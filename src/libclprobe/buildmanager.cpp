@@ -0,0 +1,233 @@
+#include <buildmanager.h>
+#include <clprobe.h>
+#include <trace.h>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+namespace
+{
+    struct BuildJob
+    {
+        cl_program program;
+        std::vector<cl_device_id> devices;
+        std::string options;
+        bool hasOptions;
+        bool finished;
+        bool reported; // Returned by waitForAnyProgramBuild()
+        bool logPrinted;
+        cl_int result;
+    };
+}
+
+struct BuildManager
+{
+    std::vector<std::thread> workers;
+    std::deque<BuildJob*> pending;
+    std::vector<BuildJob*> jobs;
+    std::mutex lock;
+    std::condition_variable jobQueued;
+    std::condition_variable jobFinished;
+    bool shuttingDown;
+    bool printBuildLogs;
+};
+
+static void buildWorker(BuildManager* manager)
+{
+    while (true)
+    {
+        BuildJob* job=0;
+        {
+            std::unique_lock<std::mutex> guard(manager->lock);
+            while ( manager->pending.empty() && !manager->shuttingDown )
+                manager->jobQueued.wait(guard);
+
+            if ( manager->pending.empty() )
+                return; // Shutting down and nothing left to do
+
+            job = manager->pending.front();
+            manager->pending.pop_front();
+        }
+
+        TRACE_BEGIN("build program");
+        cl_int err = clBuildProgram( job->program,
+                                     job->devices.size(),
+                                     job->devices.data(),
+                                     /* Compiler options */ job->hasOptions? job->options.c_str() : NULL,
+                                     /* Callback */ NULL,
+                                     /* User Data for call back */ NULL
+                                   );
+        TRACE_END();
+
+        {
+            std::lock_guard<std::mutex> guard(manager->lock);
+            job->result = err;
+            job->finished = true;
+        }
+        manager->jobFinished.notify_all();
+    }
+}
+
+static BuildJob* findJob(BuildManager* manager, cl_program program)
+{
+    for (size_t index=0; index < manager->jobs.size(); ++index)
+    {
+        if ( manager->jobs[index]->program == program )
+            return manager->jobs[index];
+    }
+    return NULL;
+}
+
+/* Print the build log of a finished job the first time it is waited for.
+*  Called with manager->lock held, which is released while printing so
+*  output only comes from the thread that waited.
+*/
+static void printBuildLogOnce(BuildManager* manager, BuildJob* job, std::unique_lock<std::mutex>& guard)
+{
+    if ( !manager->printBuildLogs || job->logPrinted )
+        return;
+
+    job->logPrinted = true;
+    guard.unlock();
+    for (size_t index=0; index < job->devices.size(); ++index)
+        printProgramBuildInfo(job->program, job->devices[index], /*Indent*/ 0);
+    guard.lock();
+}
+
+BuildManager* createBuildManager(cl_uint maxConcurrentBuilds, cl_bool printBuildLogs)
+{
+    if ( maxConcurrentBuilds == 0 )
+        maxConcurrentBuilds = std::thread::hardware_concurrency();
+
+    if ( maxConcurrentBuilds == 0 )
+        maxConcurrentBuilds = 1;
+
+    BuildManager* manager = new BuildManager();
+    manager->shuttingDown = false;
+    manager->printBuildLogs = (printBuildLogs == CL_TRUE);
+
+    for (cl_uint index=0; index < maxConcurrentBuilds; ++index)
+        manager->workers.push_back( std::thread(buildWorker, manager) );
+
+    return manager;
+}
+
+void releaseBuildManager(BuildManager* manager)
+{
+    if ( manager == NULL )
+        return;
+
+    {
+        std::lock_guard<std::mutex> guard(manager->lock);
+        manager->shuttingDown = true;
+    }
+    manager->jobQueued.notify_all();
+
+    for (size_t index=0; index < manager->workers.size(); ++index)
+        manager->workers[index].join();
+
+    for (size_t index=0; index < manager->jobs.size(); ++index)
+    {
+        clReleaseProgram(manager->jobs[index]->program);
+        delete manager->jobs[index];
+    }
+
+    delete manager;
+}
+
+cl_int startProgramBuild(BuildManager* manager,
+                         cl_program program,
+                         cl_uint numDevices,
+                         const cl_device_id* devices,
+                         const char* options)
+{
+    if ( numDevices < 1 || devices == NULL )
+        return CL_INVALID_VALUE;
+
+    cl_int err = clRetainProgram(program);
+    if ( err != CL_SUCCESS )
+        return err;
+
+    BuildJob* job = new BuildJob();
+    job->program = program;
+    job->devices.assign(devices, devices + numDevices);
+    job->hasOptions = (options != NULL);
+    if ( options != NULL )
+        job->options = options;
+    job->finished = false;
+    job->reported = false;
+    job->logPrinted = false;
+    job->result = CL_BUILD_PROGRAM_FAILURE;
+
+    {
+        std::lock_guard<std::mutex> guard(manager->lock);
+        if ( findJob(manager, program) != NULL )
+        {
+            delete job;
+            clReleaseProgram(program);
+            return CL_INVALID_OPERATION;
+        }
+
+        manager->jobs.push_back(job);
+        manager->pending.push_back(job);
+    }
+    manager->jobQueued.notify_one();
+
+    return CL_SUCCESS;
+}
+
+cl_int waitForProgramBuild(BuildManager* manager, cl_program program)
+{
+    TRACE_SCOPE("wait for build");
+    std::unique_lock<std::mutex> guard(manager->lock);
+    BuildJob* job = findJob(manager, program);
+    if ( job == NULL )
+        return CL_INVALID_PROGRAM;
+
+    while ( !job->finished )
+        manager->jobFinished.wait(guard);
+
+    printBuildLogOnce(manager, job, guard);
+    return job->result;
+}
+
+cl_int waitForAnyProgramBuild(BuildManager* manager, cl_program* program)
+{
+    std::unique_lock<std::mutex> guard(manager->lock);
+    while (true)
+    {
+        bool outstanding=false;
+        for (size_t index=0; index < manager->jobs.size(); ++index)
+        {
+            BuildJob* job = manager->jobs[index];
+            if ( job->reported )
+                continue;
+
+            if ( job->finished )
+            {
+                job->reported = true;
+                *program = job->program;
+                printBuildLogOnce(manager, job, guard);
+                return job->result;
+            }
+
+            outstanding = true;
+        }
+
+        if ( !outstanding )
+            return CL_INVALID_PROGRAM;
+
+        manager->jobFinished.wait(guard);
+    }
+}
+
+cl_bool isProgramBuildFinished(BuildManager* manager, cl_program program)
+{
+    std::lock_guard<std::mutex> guard(manager->lock);
+    BuildJob* job = findJob(manager, program);
+    return ( job != NULL && job->finished )? CL_TRUE : CL_FALSE;
+}
@@ -0,0 +1,68 @@
+#ifndef CLPROBE_BUILDMANAGER_H
+#define CLPROBE_BUILDMANAGER_H
+#include <CL/opencl.h>
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*! Builds several programs (e.g. kernel variants or the same kernel for
+ *  different devices) concurrently.
+ *
+ *  Builds are run by a pool of worker threads calling clBuildProgram()
+ *  because many implementations ignore the pfn_notify callback and build
+ *  synchronously anyway. Clients wait for the program they need so work
+ *  can be launched as soon as that particular program is ready.
+ */
+typedef struct BuildManager BuildManager;
+
+/*! Create a build manager.
+ *
+ *  \param[in] maxConcurrentBuilds maximum number of builds to run at once,
+ *             one worker thread each, so pass the number of builds if it
+ *             is small. 0 means use the number of hardware threads.
+ *  \param[in] printBuildLogs if CL_TRUE printProgramBuildInfo() is called
+ *             for every device when a build is first waited for, on the
+ *             thread waiting for it.
+ *
+ *  \returns NULL on failure.
+ */
+BuildManager* createBuildManager(cl_uint maxConcurrentBuilds, cl_bool printBuildLogs);
+
+/*! Wait for all outstanding builds then free \p manager. */
+void releaseBuildManager(BuildManager* manager);
+
+/*! Queue a build of \p program. Arguments are as for clBuildProgram().
+ *  \p devices and \p options are copied and the program is retained until
+ *  the manager is released.
+ *
+ *  \returns CL_SUCCESS if the build was queued.
+ */
+cl_int startProgramBuild(BuildManager* manager,
+                         cl_program program,
+                         cl_uint numDevices,
+                         const cl_device_id* devices,
+                         const char* options);
+
+/*! Block until the build of \p program has finished.
+ *
+ *  \returns the value returned by clBuildProgram() or CL_INVALID_PROGRAM
+ *  if \p program was never passed to startProgramBuild().
+ */
+cl_int waitForProgramBuild(BuildManager* manager, cl_program program);
+
+/*! Block until any build not yet returned by this function has finished.
+ *
+ *  \param[out] program set to the program whose build finished.
+ *
+ *  \returns the value returned by clBuildProgram() for \p program or
+ *  CL_INVALID_PROGRAM if there are no builds left to wait for.
+ */
+cl_int waitForAnyProgramBuild(BuildManager* manager, cl_program* program);
+
+/*! \returns CL_TRUE if the build of \p program has finished (non-blocking). */
+cl_bool isProgramBuildFinished(BuildManager* manager, cl_program program);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -1,5 +1,6 @@
 /* */
 #include <clprobe.h>
+#include <infoquery.h>
 #include <cstdio>
 #include <cstdlib>
 #include <cassert>
@@ -8,6 +9,11 @@
 #define __STDC_FORMAT_MACROS
 #include <inttypes.h>
 
+using clprobe::InfoArray;
+using clprobe::InfoString;
+using clprobe::getInfo;
+using clprobe::getBuildInfo;
+
 cl_int getPlatformIDs(cl_platform_id** platforms, cl_uint* numberOfPlatforms)
 {
     cl_int err = clGetPlatformIDs(0, NULL, numberOfPlatforms);
@@ -74,14 +80,8 @@ cl_int printPlatformInfo(cl_platform_id platform, cl_uint indent)
     cl_int lastError=CL_SUCCESS;
     for(; pI < sizeof(pInfos)/sizeof(PlatformInfoPair); ++pI)
     {
-        size_t stringSize;
-        char* info;
-        err = clGetPlatformInfo( platform,
-                              pInfos[pI].id,
-                              0,
-                              NULL,
-                              &stringSize
-                            );
+        InfoString info;
+        err = getInfo(platform, pInfos[pI].id, &info);
         if ( err != CL_SUCCESS )
         {
             printf("Problem querying platform property\n");
@@ -89,38 +89,8 @@ cl_int printPlatformInfo(cl_platform_id platform, cl_uint indent)
             continue;
         }
 
-        if (stringSize < 1)
-        {
-            printf("Bad malloc size, skiping property:%s\n", pInfos[pI].name);
-            lastError = CL_INVALID_PROPERTY;
-            continue;
-        }
-
-        info = (char*) malloc(stringSize * sizeof(char));
-        if (info == 0)
-        {
-            printf("Failed to malloc\n");
-            lastError = CL_OUT_OF_HOST_MEMORY;
-            continue;
-        }
-
-        err = clGetPlatformInfo( platform,
-                              pInfos[pI].id,
-                              stringSize,
-                              info,
-                              0
-                            );
-        if ( err != CL_SUCCESS)
-        {
-            printf("Got string size but couldn't get string querying platform info.\n");
-            free(info);
-            lastError = CL_INVALID_PLATFORM;
-            continue;
-        }
-       
         for (cl_uint i=0; i < indent; ++i) printf(" ");
-        printf("%s: %s\n", pInfos[pI].name, info);
-        free(info);
+        printf("%s: %s\n", pInfos[pI].name, info.get());
     }
 
     return lastError;
@@ -174,52 +144,109 @@ cl_int getDeviceIDs(cl_platform_id platform, cl_device_id** devices, cl_uint* nu
     return CL_SUCCESS;
 }
 
-static cl_int printDI_cstring(cl_device_id did, cl_device_info info)
+cl_int createSubDevices(cl_device_id device, cl_uint count,
+                        cl_device_id** subDevices, cl_uint* numberOfSubDevices)
 {
-    size_t stringSize=0;
-    cl_int err=0;
-    err = clGetDeviceInfo(did,
-                          info,
-                          0,
-                          NULL,
-                          &stringSize
-                         );
+    #ifdef CL_VERSION_1_2
+    *subDevices = 0;
+    *numberOfSubDevices = 0;
+
+    // BY_COUNTS needs the property, one count per sub-device and two terminators
+    cl_device_partition_property* properties =
+        (cl_device_partition_property*) calloc(count + 3, sizeof(cl_device_partition_property));
+    if ( properties == 0 )
+    {
+        printf("Failed to malloc\n");
+        return CL_OUT_OF_HOST_MEMORY;
+    }
 
+    if ( count == 0 )
+    {
+        properties[0] = CL_DEVICE_PARTITION_BY_AFFINITY_DOMAIN;
+        properties[1] = CL_DEVICE_AFFINITY_DOMAIN_NUMA;
+    }
+    else
+    {
+        cl_uint computeUnits=0;
+        cl_uint maxSubDevices=0;
+        cl_int err = clGetDeviceInfo(device, CL_DEVICE_MAX_COMPUTE_UNITS, sizeof(cl_uint), &computeUnits, NULL);
+        if ( err == CL_SUCCESS )
+            err = clGetDeviceInfo(device, CL_DEVICE_PARTITION_MAX_SUB_DEVICES, sizeof(cl_uint), &maxSubDevices, NULL);
+        if ( err != CL_SUCCESS )
+        {
+            free(properties);
+            return err;
+        }
+
+        if ( computeUnits < count || maxSubDevices < count )
+        {
+            printf("Device has %u compute units and allows %u sub-devices\n", computeUnits, maxSubDevices);
+            free(properties);
+            return CL_INVALID_VALUE;
+        }
+
+        // PARTITION_EQUALLY takes units per sub-device and may make more than
+        // count sub-devices, so give each its share explicitly
+        properties[0] = CL_DEVICE_PARTITION_BY_COUNTS;
+        for (cl_uint index=0; index < count; ++index)
+            properties[index + 1] = computeUnits / count + ( (index < computeUnits % count)? 1 : 0 );
+        properties[count + 1] = CL_DEVICE_PARTITION_BY_COUNTS_LIST_END;
+    }
+
+    cl_int err = clCreateSubDevices(device, properties, 0, NULL, numberOfSubDevices);
     if ( err != CL_SUCCESS )
     {
-        printf("Couldn't determine string size");
+        printf("Couldn't partition device: %d\n", err);
+        free(properties);
         return err;
     }
 
-    if (stringSize < 1)
+    *subDevices = (cl_device_id*) malloc(sizeof(cl_device_id) * (*numberOfSubDevices));
+    if ( *subDevices == 0 )
     {
-        printf("Error: String size cannot be < 1");
-        return CL_INVALID_VALUE;
+        printf("Failed to malloc\n");
+        free(properties);
+        return CL_OUT_OF_HOST_MEMORY;
     }
 
-    char* str = (char*) malloc(sizeof(char)*stringSize);
+    err = clCreateSubDevices(device, properties, *numberOfSubDevices, *subDevices, NULL);
+    free(properties);
+    if ( err != CL_SUCCESS )
+    {
+        printf("Couldn't create sub-devices: %d\n", err);
+        free(*subDevices);
+        *subDevices = 0;
+        return err;
+    }
 
-    if (str == 0)
+    if ( count != 0 && *numberOfSubDevices != count )
     {
-        printf("Failed to malloc.");
-        return CL_OUT_OF_HOST_MEMORY;
+        printf("Asked for %u sub-devices but got %u\n", count, *numberOfSubDevices);
+        for (cl_uint index=0; index < *numberOfSubDevices; ++index)
+            clReleaseDevice((*subDevices)[index]);
+        free(*subDevices);
+        *subDevices = 0;
+        return CL_DEVICE_PARTITION_FAILED;
     }
 
-    err = clGetDeviceInfo(did,
-                          info,
-                          stringSize,
-                          str,
-                          NULL
-                         );
+    return CL_SUCCESS;
+    #else
+    (void) device; (void) count; (void) subDevices; (void) numberOfSubDevices;
+    return CL_INVALID_OPERATION;
+    #endif
+}
 
+static cl_int printDI_cstring(cl_device_id did, cl_device_info info)
+{
+    InfoString str;
+    cl_int err = getInfo(did, info, &str);
     if ( err != CL_SUCCESS )
     {
         printf("Failed to get property info.");
         return err;
     }
 
-    printf("%s",str);
-    free(str);
+    printf("%s", str.get());
     return CL_SUCCESS;
 }
 
@@ -294,10 +321,78 @@ static cl_int printDI_FPflag(cl_device_id did, cl_device_info info)
     return CL_SUCCESS;
 }
 
+cl_int getDeviceSVMCapabilities(cl_device_id did, cl_bitfield* capabilities)
+{
+    *capabilities = 0;
+    #ifdef CL_VERSION_2_0
+    cl_device_svm_capabilities svm=0;
+    cl_int err = clGetDeviceInfo(did, CL_DEVICE_SVM_CAPABILITIES, sizeof(svm), &svm, NULL);
+    // OpenCL 1.x devices do not know the query
+    if ( err == CL_INVALID_VALUE )
+        return CL_SUCCESS;
+    if ( err != CL_SUCCESS )
+        return err;
+
+    *capabilities = svm;
+    #endif
+    return CL_SUCCESS;
+}
+
+#ifdef CL_VERSION_1_2
+static cl_int printDI_AffinityDomain(cl_device_id did, cl_device_info info)
+{
+    assert( info == CL_DEVICE_PARTITION_AFFINITY_DOMAIN );
+    cl_device_affinity_domain domains=0;
+    cl_int err = clGetDeviceInfo(did, info, sizeof(domains), &domains, NULL);
+    if ( err != CL_SUCCESS )
+    {
+        printf("Could not get affinity domains");
+        return err;
+    }
+
+    if ( domains == 0 )
+        printf("None");
+
+    #define CHK_FLAG(A) if (domains & A) printf(#A " ")
+    CHK_FLAG(CL_DEVICE_AFFINITY_DOMAIN_NUMA);
+    CHK_FLAG(CL_DEVICE_AFFINITY_DOMAIN_L4_CACHE);
+    CHK_FLAG(CL_DEVICE_AFFINITY_DOMAIN_L3_CACHE);
+    CHK_FLAG(CL_DEVICE_AFFINITY_DOMAIN_L2_CACHE);
+    CHK_FLAG(CL_DEVICE_AFFINITY_DOMAIN_L1_CACHE);
+    CHK_FLAG(CL_DEVICE_AFFINITY_DOMAIN_NEXT_PARTITIONABLE);
+    #undef CHK_FLAG
+    return CL_SUCCESS;
+}
+#endif
+
+#ifdef CL_VERSION_2_0
+static cl_int printDI_SVMflag(cl_device_id did, cl_device_info info)
+{
+    assert( info == CL_DEVICE_SVM_CAPABILITIES );
+    cl_bitfield svm=0;
+    cl_int err = getDeviceSVMCapabilities(did, &svm);
+    if ( err != CL_SUCCESS )
+    {
+        printf("Could not get SVM capabilities");
+        return err;
+    }
+
+    if ( svm == 0 )
+        printf("None");
+
+    #define CHK_FLAG(A) if (svm & A) printf(#A " ")
+    CHK_FLAG(CL_DEVICE_SVM_COARSE_GRAIN_BUFFER);
+    CHK_FLAG(CL_DEVICE_SVM_FINE_GRAIN_BUFFER);
+    CHK_FLAG(CL_DEVICE_SVM_FINE_GRAIN_SYSTEM);
+    CHK_FLAG(CL_DEVICE_SVM_ATOMICS);
+    #undef CHK_FLAG
+    return CL_SUCCESS;
+}
+#endif
+
 static void printT(cl_uint t) { printf( "%" PRIu32 ,t); assert(sizeof(cl_uint) == 32/8 && "Size mistmatch");}
 static void printT(cl_int t) { printf( "%" PRIi32 ,t); assert(sizeof(cl_int) == 32/8 && "Size mistmatch");}
 static void printT(cl_ulong t) { printf( "%" PRIu64 ,t); assert(sizeof(cl_ulong) == 64/8 && "Size mistmatch");}
-static void printT(char* t) { printf( "%s" ,t);}
 /*
   // One of the cl_* types has same effective type as size_t, so we don't need it
   static void printT(size_t t) { printf("%lu", (unsigned long) t); }
@@ -356,11 +451,8 @@ static cl_int printDI_cl_bool(cl_device_id did, cl_device_info info)
     return CL_SUCCESS;
 }
 
-static cl_int printDI_workItemSizes(cl_device_id did, cl_device_info info)
+cl_int getMaxWorkItemSizes(cl_device_id did, size_t** sizes, cl_uint* numberOfDimensions)
 {
-    assert( info == CL_DEVICE_MAX_WORK_ITEM_SIZES &&
-           "Wrong handler");
-
     // Get number of dimensions (expect 3)
     cl_uint numDim=0;
     cl_int err;
@@ -390,7 +482,7 @@ static cl_int printDI_workItemSizes(cl_device_id did, cl_device_info info)
     }
 
     err = clGetDeviceInfo(did,
-                          info,
+                          CL_DEVICE_MAX_WORK_ITEM_SIZES,
                           sizeof(size_t) * numDim,
                           dimMax,
                           0
@@ -399,17 +491,37 @@ static cl_int printDI_workItemSizes(cl_device_id did, cl_device_info info)
     if ( err != CL_SUCCESS )
     {
         printf("Failed to get CL_DEVICE_MAX_WORK_ITEM_SIZES\n");
+        free(dimMax);
+        return err;
+    }
+
+    *sizes = dimMax;
+    *numberOfDimensions = numDim;
+    return CL_SUCCESS;
+}
+
+static cl_int printDI_workItemSizes(cl_device_id did, cl_device_info info)
+{
+    assert( info == CL_DEVICE_MAX_WORK_ITEM_SIZES &&
+           "Wrong handler");
+
+    // Almost always 3 dimensions
+    InfoArray<size_t, 4> dimMax;
+    cl_int err = getInfo(did, info, &dimMax);
+    if ( err != CL_SUCCESS )
+    {
+        printf("Failed to get CL_DEVICE_MAX_WORK_ITEM_SIZES");
         return err;
     }
+
     cl_uint d=0;
+    cl_uint numDim = dimMax.size();
     printf("[ ");
     for( ; d < numDim ; ++d)
     {
         printf("%lu ", (unsigned long) dimMax[d]);
     }
     printf("]");
-   
-    free(dimMax);
     return CL_SUCCESS;
 }
 
@@ -448,6 +560,14 @@ cl_int printDeviceInfo(cl_device_id did, cl_uint indent)
         #ifdef CL_VERSION_1_2
         DEVINFO(CL_DEVICE_LINKER_AVAILABLE, cl_bool),
         DEVINFO(CL_DEVICE_BUILT_IN_KERNELS, cstring),
+        DEVINFO(CL_DEVICE_PARTITION_MAX_SUB_DEVICES, t<cl_uint>),
+        DEVINFO(CL_DEVICE_PARTITION_AFFINITY_DOMAIN, AffinityDomain),
+        #endif
+        #ifdef CL_VERSION_2_0
+        DEVINFO(CL_DEVICE_SVM_CAPABILITIES, SVMflag),
+        #endif
+        #ifdef CL_VERSION_2_1
+        DEVINFO(CL_DEVICE_IL_VERSION, cstring),
         #endif
         DEVINFO(CL_DEVICE_HOST_UNIFIED_MEMORY, cl_bool),
         DEVINFO(CL_DEVICE_ERROR_CORRECTION_SUPPORT, cl_bool),
@@ -545,49 +665,16 @@ static cl_int printPBI_cstring(cl_program program,
                                cl_device_id device, 
                                cl_program_build_info buildInfo)
 {
-    cl_int err;
-
-    size_t stringSize=0;
-    char* string=0;
-    err = clGetProgramBuildInfo( program, 
-                                 device, 
-                                 buildInfo,
-                                 0,
-                                 NULL,
-                                 &stringSize
-                                );
-
-    if ( err != CL_SUCCESS )
-    {
-        printf("Could not get string size.");
-        return err;
-    }
-
-    string = (char*) malloc( sizeof(char)*stringSize );
-
-    if (string == 0)
-    {
-        printf("Failed to malloc.");
-        return CL_OUT_OF_HOST_MEMORY;
-    }
-
-    err = clGetProgramBuildInfo( program, 
-                                 device, 
-                                 buildInfo,
-                                 stringSize,
-                                 string,
-                                 NULL
-                                );
-
+    // Long build logs spill to the heap
+    InfoString string;
+    cl_int err = getBuildInfo(program, device, buildInfo, &string);
     if ( err != CL_SUCCESS )
     {
         printf("Failed to retrieve string.");
-        free(string);
         return err;
     }
 
-    printf("%s", string);
-    free(string);
+    printf("%s", string.get());
     return CL_SUCCESS;
 }
 template<typename T>
@@ -675,114 +762,56 @@ cl_int printProgramBuildInfo(cl_program program, cl_device_id device, cl_uint in
     return lastError;
 }
 
-template<typename T, cl_program_info I, bool isArray>
+template<typename T, cl_program_info I>
 static cl_int printPI_t(cl_program program)
 {
-    cl_int err;
-    T* value;
-    size_t size=0;
-    //Get size
-    err = clGetProgramInfo( program,
-                            I,
-                            0,
-                            0,
-                            &size
-                          );
-   
-    if ( err != CL_SUCCESS )
-    {
-        printf("Couldn't get Program property size.");
-        return err;
-    }
-
-    value = (T*) malloc(size);
-    if ( value == 0 )
-    {
-        printf("Failed to malloc");
-        return CL_OUT_OF_HOST_MEMORY;
-    }
-
-    err = clGetProgramInfo( program,
-                            I,
-                            size,
-                            value,
-                            0
-                          );
-
+    T value;
+    cl_int err = getInfo(program, I, &value);
     if ( err != CL_SUCCESS )
     {
         printf("Failed to get program info property.");
-        free(value);
         return err;
     }
 
     // Use Overloaded printT
-    if (! isArray ) printT(*value);
-    else
-    {
-        for(unsigned int i=0; i < size/sizeof(T); ++i)
-        {
-            printT(value[i]);
-            printf(", ");
-        }
-    }
-    free(value);
-
+    printT(value);
     return CL_SUCCESS;
 }
 
-#ifdef CL_VERSION_1_2
-// Specialised template for CL_PROGRAM_KERNEL_NAMES
-// THIS IS A HACK!
-template<>
-cl_int printPI_t<char*, CL_PROGRAM_KERNEL_NAMES, false>(cl_program program)
+template<typename T, cl_program_info I>
+static cl_int printPI_array(cl_program program)
 {
-
-    cl_int err;
-    char* value;
-    size_t size=0;
-    //Get size
-    err = clGetProgramInfo( program,
-                            CL_PROGRAM_KERNEL_NAMES,
-                            0,
-                            0,
-                            &size
-                          );
-
+    // One entry per device of the program
+    InfoArray<T, 8> values;
+    cl_int err = getInfo(program, I, &values);
     if ( err != CL_SUCCESS )
     {
-        printf("Couldn't get Program property size.");
+        printf("Failed to get program info property.");
         return err;
     }
 
-    value = (char*) malloc(size);
-    if ( value == 0 )
+    for(unsigned int i=0; i < values.size(); ++i)
     {
-        printf("Failed to malloc");
-        return CL_OUT_OF_HOST_MEMORY;
+        printT(values[i]);
+        printf(", ");
     }
+    return CL_SUCCESS;
+}
 
-    err = clGetProgramInfo( program,
-                            CL_PROGRAM_KERNEL_NAMES,
-                            size,
-                            value,
-                            0
-                          );
-
+template<cl_program_info I>
+static cl_int printPI_cstring(cl_program program)
+{
+    InfoString value;
+    cl_int err = getInfo(program, I, &value);
     if ( err != CL_SUCCESS )
     {
         printf("Failed to get program info property.");
-        free(value);
         return err;
     }
 
-    // Use Overloaded printT
-    printT(value);
-    free(value);
-
+    printf("%s", value.get());
     return CL_SUCCESS;
 }
-#endif
 
 
 cl_int printProgramInfo(cl_program program, cl_uint indent)
@@ -794,20 +823,22 @@ cl_int printProgramInfo(cl_program program, cl_uint indent)
         cl_int (*handler) (cl_program);
     } ProgInfo;
 
-    #define PINFO(A,TYPE) { A, #A, printPI_t< TYPE ,A, false > }
-    #define PINFO_ARRAY(A,TYPE) { A, #A, printPI_t< TYPE, A, true > }
+    #define PINFO(A,TYPE) { A, #A, printPI_t< TYPE ,A > }
+    #define PINFO_ARRAY(A,TYPE) { A, #A, printPI_array< TYPE, A > }
+    #define PINFO_STRING(A) { A, #A, printPI_cstring< A > }
     ProgInfo pInfos[] = 
     {
         PINFO(CL_PROGRAM_REFERENCE_COUNT, cl_uint),
         #ifdef CL_VERSION_1_2
         PINFO(CL_PROGRAM_NUM_KERNELS, size_t),
-        PINFO(CL_PROGRAM_KERNEL_NAMES, char*), // FIXME: This is handled using a hack. Fix it properly!
+        PINFO_STRING(CL_PROGRAM_KERNEL_NAMES),
         #endif
         PINFO(CL_PROGRAM_NUM_DEVICES, cl_uint),
         PINFO_ARRAY(CL_PROGRAM_BINARY_SIZES, size_t) /* In Bytes */
     };
     #undef PINFO
     #undef PINFO_ARRAY
+    #undef PINFO_STRING
 
     /* Iterate through properties */
     cl_uint index=0;
@@ -825,3 +856,184 @@ cl_int printProgramInfo(cl_program program, cl_uint indent)
     //FIXME: Not actually returning last error!
     return lastError;
 }
+
+cl_int getKernelInfo(cl_kernel kernel, cl_device_id device, KernelInfo* info)
+{
+    using clprobe::getWorkGroupInfo;
+    cl_int err;
+
+    #define KWGINFO(PARAM, FIELD) \
+        err = getWorkGroupInfo(kernel, device, PARAM, FIELD); \
+        if ( err != CL_SUCCESS ) \
+        { \
+            printf("Failed to get " #PARAM "\n"); \
+            return err; \
+        }
+    KWGINFO(CL_KERNEL_WORK_GROUP_SIZE, &info->workGroupSize);
+    KWGINFO(CL_KERNEL_COMPILE_WORK_GROUP_SIZE, &info->compileWorkGroupSize);
+    KWGINFO(CL_KERNEL_PREFERRED_WORK_GROUP_SIZE_MULTIPLE, &info->preferredWorkGroupSizeMultiple);
+    KWGINFO(CL_KERNEL_LOCAL_MEM_SIZE, &info->localMemSize);
+    KWGINFO(CL_KERNEL_PRIVATE_MEM_SIZE, &info->privateMemSize);
+    #undef KWGINFO
+
+    err = getInfo(device, CL_DEVICE_LOCAL_MEM_SIZE, &info->deviceLocalMemSize);
+    if ( err != CL_SUCCESS )
+    {
+        printf("Failed to get CL_DEVICE_LOCAL_MEM_SIZE\n");
+        return err;
+    }
+
+    err = getInfo(kernel, CL_KERNEL_NUM_ARGS, &info->numArgs);
+    if ( err != CL_SUCCESS )
+    {
+        printf("Failed to get CL_KERNEL_NUM_ARGS\n");
+        return err;
+    }
+    return CL_SUCCESS;
+}
+
+#ifdef CL_VERSION_1_2
+/* Print argument index of kernel as it is declared, e.g.
+*  "__global const int* restrict A".
+*/
+static cl_int printKernelArg(cl_kernel kernel, cl_uint index)
+{
+    using clprobe::getArgInfo;
+    cl_kernel_arg_address_qualifier address;
+    cl_kernel_arg_type_qualifier typeQualifier;
+    InfoString typeName;
+    InfoString name;
+    cl_int err = getArgInfo(kernel, index, CL_KERNEL_ARG_ADDRESS_QUALIFIER, &address);
+    if ( err == CL_SUCCESS )
+        err = getArgInfo(kernel, index, CL_KERNEL_ARG_TYPE_QUALIFIER, &typeQualifier);
+    if ( err == CL_SUCCESS )
+        err = getArgInfo(kernel, index, CL_KERNEL_ARG_TYPE_NAME, &typeName);
+    if ( err == CL_SUCCESS )
+        err = getArgInfo(kernel, index, CL_KERNEL_ARG_NAME, &name);
+    if ( err != CL_SUCCESS )
+        return err;
+
+    #define AQUAL(A, S) if ( address == A ) printf(S " ")
+    AQUAL(CL_KERNEL_ARG_ADDRESS_GLOBAL, "__global");
+    AQUAL(CL_KERNEL_ARG_ADDRESS_LOCAL, "__local");
+    AQUAL(CL_KERNEL_ARG_ADDRESS_CONSTANT, "__constant");
+    #undef AQUAL
+    if ( typeQualifier & CL_KERNEL_ARG_TYPE_CONST ) printf("const ");
+    if ( typeQualifier & CL_KERNEL_ARG_TYPE_VOLATILE ) printf("volatile ");
+    printf("%s", typeName.get());
+    if ( typeQualifier & CL_KERNEL_ARG_TYPE_RESTRICT ) printf(" restrict");
+    printf(" %s", name.get());
+    return CL_SUCCESS;
+}
+#endif
+
+cl_int printKernelWorkGroupInfo(cl_kernel kernel, cl_device_id device, cl_uint indent)
+{
+    KernelInfo info;
+    cl_int err = getKernelInfo(kernel, device, &info);
+    if ( err != CL_SUCCESS )
+        return err;
+
+    InfoString name;
+    err = getInfo(kernel, CL_KERNEL_FUNCTION_NAME, &name);
+    if ( err != CL_SUCCESS )
+    {
+        printf("Failed to get CL_KERNEL_FUNCTION_NAME\n");
+        return err;
+    }
+
+    cl_device_type deviceType=0;
+    getInfo(device, CL_DEVICE_TYPE, &deviceType);
+
+    #define INDENT() for (cl_uint i=0; i < indent; ++i) printf(" ")
+    INDENT(); printf("CL_KERNEL_FUNCTION_NAME: %s\n", name.get());
+    INDENT(); printf("CL_KERNEL_NUM_ARGS: %u\n", info.numArgs);
+    INDENT(); printf("CL_KERNEL_WORK_GROUP_SIZE: %lu\n", (unsigned long) info.workGroupSize);
+    INDENT(); printf("CL_KERNEL_COMPILE_WORK_GROUP_SIZE: [ %lu %lu %lu ]\n",
+                     (unsigned long) info.compileWorkGroupSize[0],
+                     (unsigned long) info.compileWorkGroupSize[1],
+                     (unsigned long) info.compileWorkGroupSize[2]);
+    INDENT(); printf("CL_KERNEL_PREFERRED_WORK_GROUP_SIZE_MULTIPLE: %lu\n",
+                     (unsigned long) info.preferredWorkGroupSizeMultiple);
+    INDENT(); printf("CL_KERNEL_LOCAL_MEM_SIZE: %" PRIu64 " (device has %" PRIu64 ")\n",
+                     info.localMemSize, info.deviceLocalMemSize);
+    INDENT(); printf("CL_KERNEL_PRIVATE_MEM_SIZE: %" PRIu64, info.privateMemSize);
+    // GPUs keep private variables in registers, private memory means they spilled
+    if ( info.privateMemSize > 0 && (deviceType & CL_DEVICE_TYPE_GPU) )
+        printf(" (registers may be spilling)");
+    printf("\n");
+
+    #ifdef CL_VERSION_1_2
+    for (cl_uint index=0; index < info.numArgs; ++index)
+    {
+        INDENT(); printf("Argument %u: ", index);
+        err = printKernelArg(kernel, index);
+        if ( err == CL_KERNEL_ARG_INFO_NOT_AVAILABLE )
+        {
+            printf("not available (build with -cl-kernel-arg-info)\n");
+            break;
+        }
+        else if ( err != CL_SUCCESS )
+            printf("Failed to get argument info");
+        printf("\n");
+    }
+    #endif
+    #undef INDENT
+
+    return CL_SUCCESS;
+}
+
+cl_int checkWorkGroupSize(cl_kernel kernel, cl_device_id device, cl_uint workDim,
+                          const size_t* localWorkSize)
+{
+    KernelInfo info;
+    cl_int err = getKernelInfo(kernel, device, &info);
+    if ( err != CL_SUCCESS )
+        return err;
+
+    if ( info.localMemSize > info.deviceLocalMemSize )
+    {
+        printf("Kernel uses %" PRIu64 " bytes of local memory but the device has %" PRIu64 "\n",
+               info.localMemSize, info.deviceLocalMemSize);
+        return CL_OUT_OF_RESOURCES;
+    }
+
+    // The runtime picks the work group size
+    if ( localWorkSize == NULL )
+        return CL_SUCCESS;
+
+    size_t workItems=1;
+    bool required = info.compileWorkGroupSize[0] != 0;
+    for (cl_uint d=0; d < 3; ++d)
+    {
+        size_t size = ( d < workDim )? localWorkSize[d] : 1;
+        workItems *= size;
+        if ( required && size != info.compileWorkGroupSize[d] )
+        {
+            printf("Work group size in dimension %u is %lu but the kernel requires %lu\n",
+                   d, (unsigned long) size, (unsigned long) info.compileWorkGroupSize[d]);
+            return CL_INVALID_WORK_GROUP_SIZE;
+        }
+    }
+
+    if ( workItems > info.workGroupSize )
+    {
+        printf("Work group of %lu work items exceeds the kernel's limit of %lu on this device\n",
+               (unsigned long) workItems, (unsigned long) info.workGroupSize);
+        return CL_INVALID_WORK_GROUP_SIZE;
+    }
+    return CL_SUCCESS;
+}
+
+size_t fitWorkGroupSize(const KernelInfo* info, size_t requested)
+{
+    size_t limit = ( requested < info->workGroupSize )? requested : info->workGroupSize;
+    size_t multiple = info->preferredWorkGroupSizeMultiple;
+    if ( multiple > 0 && limit >= multiple )
+        return limit - limit % multiple;
+
+    size_t size=1;
+    while ( size * 2 <= limit )
+        size *= 2;
+    return size;
+}
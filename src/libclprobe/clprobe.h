@@ -18,13 +18,92 @@ cl_int printPlatformInfo(cl_platform_id platform, cl_uint indent);
 
 cl_int getDeviceIDs(cl_platform_id platform, cl_device_id** devices, cl_uint* numberOfDevices);
 
+/*! Partition \p device into sub-devices (OpenCL 1.2). If Successful the
+ *  client is responsible for releasing each sub-device with
+ *  clReleaseDevice() and freeing the list.
+ *
+ *  \param[in] count is the number of sub-devices wanted, with the compute
+ *         units shared out as evenly as possible
+ *         (CL_DEVICE_PARTITION_BY_COUNTS), or 0 to split the device by NUMA
+ *         node (CL_DEVICE_PARTITION_BY_AFFINITY_DOMAIN).
+ *  \param[in,out] subDevices will be set to point to the sub-devices.
+ *  \param[in,out] numberOfSubDevices will be set to the number created.
+ *
+ *  \returns CL_SUCCESS on success, CL_INVALID_OPERATION if built without
+ *  OpenCL 1.2.
+ */
+cl_int createSubDevices(cl_device_id device, cl_uint count,
+                        cl_device_id** subDevices, cl_uint* numberOfSubDevices);
+
 cl_int printDeviceInfo(cl_device_id did, cl_uint indent);
 
+/*! Get the shared virtual memory support of \p did
+ *  (CL_DEVICE_SVM_CAPABILITIES flags). Devices (or headers) older than
+ *  OpenCL 2.0 have none and \p capabilities is set to 0.
+ *
+ *  \returns CL_SUCCESS on success.
+ */
+cl_int getDeviceSVMCapabilities(cl_device_id did, cl_bitfield* capabilities);
+
+/*! Retrieve CL_DEVICE_MAX_WORK_ITEM_SIZES. If Successful the client is
+ *  responsible for freeing the memory allocated.
+ *
+ *  \param[in,out] sizes will be set to point to the maximum work items in
+ *         each dimension.
+ *  \param[in,out] numberOfDimensions will be set to
+ *         CL_DEVICE_MAX_WORK_ITEM_DIMENSIONS.
+ *
+ *  \returns CL_SUCCESS on success.
+ */
+cl_int getMaxWorkItemSizes(cl_device_id did, size_t** sizes, cl_uint* numberOfDimensions);
+
 cl_int printContextInfo(cl_context context, cl_uint indent);
 
 cl_int printProgramBuildInfo(cl_program program, cl_device_id device, cl_uint indent);
 
 cl_int printProgramInfo(cl_program program, cl_uint indent);
+
+/*! Work group limits and resource usage of a kernel on a device. */
+typedef struct
+{
+    size_t workGroupSize; /*!< CL_KERNEL_WORK_GROUP_SIZE, the largest work group */
+    size_t compileWorkGroupSize[3]; /*!< reqd_work_group_size or all 0 */
+    size_t preferredWorkGroupSizeMultiple; /*!< CL_KERNEL_PREFERRED_WORK_GROUP_SIZE_MULTIPLE */
+    cl_ulong localMemSize; /*!< Bytes of __local used, including __local arguments set so far */
+    cl_ulong privateMemSize; /*!< Bytes of private memory per work item */
+    cl_ulong deviceLocalMemSize; /*!< CL_DEVICE_LOCAL_MEM_SIZE */
+    cl_uint numArgs;
+} KernelInfo;
+
+/*! Get the work group limits and resource usage of \p kernel on \p device.
+ *
+ *  \returns CL_SUCCESS on success.
+ */
+cl_int getKernelInfo(cl_kernel kernel, cl_device_id device, KernelInfo* info);
+
+/*! Print the work group limits and memory usage of \p kernel on \p device
+ *  and its arguments (names and types where the runtime keeps argument
+ *  info).
+ */
+cl_int printKernelWorkGroupInfo(cl_kernel kernel, cl_device_id device, cl_uint indent);
+
+/*! Check a launch of \p kernel on \p device with \p localWorkSize
+ *  (\p workDim entries) against the kernel's limits: its maximum work group
+ *  size, any reqd_work_group_size and the device's local memory. Prints
+ *  why a launch is rejected. Call it after the __local arguments are set.
+ *
+ *  \returns CL_SUCCESS if the launch fits, CL_INVALID_WORK_GROUP_SIZE or
+ *  CL_OUT_OF_RESOURCES if it does not.
+ */
+cl_int checkWorkGroupSize(cl_kernel kernel, cl_device_id device, cl_uint workDim,
+                          const size_t* localWorkSize);
+
+/*! \returns the largest multiple of the kernel's preferred work group size
+ *  multiple (or power of two below it) that is at most \p requested and
+ *  fits \p info's work group size. Use it to adjust a launch instead of
+ *  rejecting it.
+ */
+size_t fitWorkGroupSize(const KernelInfo* info, size_t requested);
 #ifdef __cplusplus
 }
 #endif
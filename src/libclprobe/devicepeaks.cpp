@@ -0,0 +1,238 @@
+#include <devicepeaks.h>
+#include <recordfile.h>
+#include <infoquery.h>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cstddef>
+
+using clprobe::InfoString;
+
+/* Map the fields of DevicePeaks to the names used in the file */
+typedef struct
+{
+    const char* name;
+    size_t offset;
+} PeakField;
+
+#define PEAKFIELD(A) { #A, offsetof(DevicePeaks, A) }
+static const PeakField peakFields[] =
+{
+    PEAKFIELD(hostToDeviceGBs),
+    PEAKFIELD(deviceToHostGBs),
+    PEAKFIELD(globalReadGBs),
+    PEAKFIELD(globalWriteGBs),
+    PEAKFIELD(globalCopyGBs),
+    PEAKFIELD(localGBs),
+    PEAKFIELD(launchLatencyUs),
+    PEAKFIELD(floatGFLOPs),
+    PEAKFIELD(intGOPs)
+};
+#undef PEAKFIELD
+
+static const unsigned int numPeakFields = sizeof(peakFields)/sizeof(PeakField);
+
+/* Device name and driver version of size bytes each, with the separators
+*  replaced as they are written to the file
+*/
+static cl_int getDeviceStrings(cl_device_id device, char* deviceName, char* driverVersion, size_t size)
+{
+    InfoString name;
+    InfoString driver;
+    if ( clprobe::getInfo(device, CL_DEVICE_NAME, &name) != CL_SUCCESS ||
+         clprobe::getInfo(device, CL_DRIVER_VERSION, &driver) != CL_SUCCESS )
+    {
+        printf("Could not get device name or driver version\n");
+        return CL_INVALID_DEVICE;
+    }
+
+    snprintf(deviceName, size, "%s", name.get());
+    snprintf(driverVersion, size, "%s", driver.get());
+    sanitizeRecordValue(deviceName);
+    sanitizeRecordValue(driverVersion);
+    return CL_SUCCESS;
+}
+
+cl_int saveDevicePeaks(const char* path, cl_device_id device, const DevicePeaks* peaks)
+{
+    char deviceName[256];
+    char driverVersion[256];
+    if ( getDeviceStrings(device, deviceName, driverVersion, sizeof(deviceName)) != CL_SUCCESS )
+        return CL_INVALID_DEVICE;
+
+    FILE* f = fopen(path, "a");
+    if ( f == NULL )
+    {
+        perror("Could not open device peaks file");
+        return CL_INVALID_VALUE;
+    }
+
+    fprintf(f, "device=%s\tdriver=%s", deviceName, driverVersion);
+    for (unsigned int index=0; index < numPeakFields; ++index)
+    {
+        double value = *(const double*) ( ((const char*) peaks) + peakFields[index].offset );
+        fprintf(f, "\t%s=%g", peakFields[index].name, value);
+    }
+    fprintf(f, "\n");
+
+    fclose(f);
+    return CL_SUCCESS;
+}
+
+cl_int loadDevicePeaks(const char* path, cl_device_id device, DevicePeaks* peaks)
+{
+    char deviceName[256];
+    char driverVersion[256];
+    if ( getDeviceStrings(device, deviceName, driverVersion, sizeof(deviceName)) != CL_SUCCESS )
+        return CL_INVALID_DEVICE;
+
+    RecordReader reader;
+    if ( openRecordReader(&reader, path) != CL_SUCCESS )
+        return CL_INVALID_VALUE;
+
+    cl_int result = CL_DEVICE_NOT_FOUND;
+    while ( nextRecord(&reader) )
+    {
+        // Only the last matching line is used so parse into a temporary
+        DevicePeaks linePeaks;
+        memset(&linePeaks, 0, sizeof(DevicePeaks));
+        bool nameMatches=false;
+        bool driverMatches=false;
+
+        const char* field=0;
+        const char* value=0;
+        while ( nextRecordField(&reader, &field, &value) )
+        {
+            if ( strcmp(field, "device") == 0 )
+                nameMatches = ( strcmp(value, deviceName) == 0 );
+            else if ( strcmp(field, "driver") == 0 )
+                driverMatches = ( strcmp(value, driverVersion) == 0 );
+            else
+            {
+                for (unsigned int index=0; index < numPeakFields; ++index)
+                {
+                    if ( strcmp(field, peakFields[index].name) == 0 )
+                        *(double*) ( ((char*) &linePeaks) + peakFields[index].offset ) = atof(value);
+                }
+            }
+        }
+
+        if ( nameMatches && driverMatches )
+        {
+            *peaks = linePeaks;
+            result = CL_SUCCESS;
+        }
+    }
+
+    closeRecordReader(&reader);
+    return result;
+}
+
+cl_int estimateDevicePeaks(cl_device_id device, DevicePeaks* peaks)
+{
+    memset(peaks, 0, sizeof(DevicePeaks));
+
+    /* Map id and destination together */
+    typedef struct
+    {
+        cl_device_info id;
+        cl_uint* value;
+    } DeviceUIntQuery;
+
+    cl_uint computeUnits=0;
+    cl_uint clockMHz=0;
+    cl_uint floatWidth=0;
+    cl_uint intWidth=0;
+    DeviceUIntQuery queries[] =
+    {
+        { CL_DEVICE_MAX_COMPUTE_UNITS, &computeUnits },
+        { CL_DEVICE_MAX_CLOCK_FREQUENCY, &clockMHz },
+        { CL_DEVICE_NATIVE_VECTOR_WIDTH_FLOAT, &floatWidth },
+        { CL_DEVICE_NATIVE_VECTOR_WIDTH_INT, &intWidth }
+    };
+
+    for (unsigned int index=0; index < sizeof(queries)/sizeof(DeviceUIntQuery); ++index)
+    {
+        cl_int err = clGetDeviceInfo(device,
+                                     queries[index].id,
+                                     sizeof(cl_uint),
+                                     queries[index].value,
+                                     NULL
+                                    );
+        if ( err != CL_SUCCESS )
+        {
+            printf("Could not get device property for peak estimate\n");
+            return err;
+        }
+    }
+
+    if ( floatWidth == 0 ) floatWidth = 1;
+    if ( intWidth == 0 ) intWidth = 1;
+
+    /* A multiply-add counts as 2 operations */
+    peaks->floatGFLOPs = computeUnits * (clockMHz * 1.0e-3) * floatWidth * 2;
+    peaks->intGOPs = computeUnits * (clockMHz * 1.0e-3) * intWidth * 2;
+    return CL_SUCCESS;
+}
+
+cl_int getDevicePeaks(const char* path, cl_device_id device, DevicePeaks* peaks)
+{
+    if ( path != NULL )
+    {
+        if ( loadDevicePeaks(path, device, peaks) == CL_SUCCESS )
+        {
+            printf("Using measured device peaks from %s\n", path);
+            return CL_SUCCESS;
+        }
+
+        printf("No device peaks for this device and driver in %s\n", path);
+    }
+
+    printf("Using device peaks estimated from compute units and clock frequency\n");
+    return estimateDevicePeaks(device, peaks);
+}
+
+void printRooflineReport(const KernelWork* work, double seconds, const DevicePeaks* peaks, cl_uint indent)
+{
+    if ( seconds <= 0.0 )
+    {
+        printf("Kernel time is zero, cannot compute roofline report\n");
+        return;
+    }
+
+    double achievedGBs = work->bytes / seconds * 1.0e-9;
+    double achievedGOPs = work->ops / seconds * 1.0e-9;
+
+    // A copy mixes reads and writes like most kernels do
+    double peakGBs = (peaks->globalCopyGBs > 0.0)? peaks->globalCopyGBs : peaks->globalReadGBs;
+    double peakGOPs = (work->integerOps == CL_TRUE)? peaks->intGOPs : peaks->floatGFLOPs;
+    const char* opsUnit = (work->integerOps == CL_TRUE)? "GOP/s" : "GFLOP/s";
+
+    for (cl_uint i=0; i < indent; ++i) printf(" ");
+    printf("Bandwidth: %.3f GB/s", achievedGBs);
+    if ( peakGBs > 0.0 )
+        printf(" (%.1f%% of %.2f GB/s peak)\n", 100.0 * achievedGBs / peakGBs, peakGBs);
+    else
+        printf(" (peak unknown, run device_benchmark)\n");
+
+    for (cl_uint i=0; i < indent; ++i) printf(" ");
+    printf("Throughput: %.3f %s", achievedGOPs, opsUnit);
+    if ( peakGOPs > 0.0 )
+        printf(" (%.1f%% of %.2f %s peak)\n", 100.0 * achievedGOPs / peakGOPs, peakGOPs, opsUnit);
+    else
+        printf(" (peak unknown)\n");
+
+    double intensity = (work->bytes > 0.0)? work->ops / work->bytes : 0.0;
+    for (cl_uint i=0; i < indent; ++i) printf(" ");
+    printf("Arithmetic intensity: %.3f ops/byte", intensity);
+    if ( peakGBs > 0.0 && peakGOPs > 0.0 )
+    {
+        // The ridge point is the intensity at which both limits are reached
+        double ridge = peakGOPs / peakGBs;
+        printf(", ridge point %.3f ops/byte: %s bound\n",
+               ridge,
+               (intensity < ridge)? "memory" : "compute");
+    }
+    else
+        printf("\n");
+}
@@ -0,0 +1,71 @@
+#ifndef CLPROBE_DEVICEPEAKS_H
+#define CLPROBE_DEVICEPEAKS_H
+#include <CL/opencl.h>
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*! Measured capabilities of a device (see device_benchmark). */
+typedef struct
+{
+    double hostToDeviceGBs; /*!< Best host to device bandwidth (GB/s) */
+    double deviceToHostGBs; /*!< Best device to host bandwidth (GB/s) */
+    double globalReadGBs; /*!< Global memory read bandwidth (GB/s) */
+    double globalWriteGBs; /*!< Global memory write bandwidth (GB/s) */
+    double globalCopyGBs; /*!< Global memory copy bandwidth (GB/s, read + write) */
+    double localGBs; /*!< Local memory read bandwidth (GB/s) */
+    double launchLatencyUs; /*!< Kernel launch latency (microseconds) */
+    double floatGFLOPs; /*!< Peak single precision throughput (GFLOP/s) */
+    double intGOPs; /*!< Peak 32-bit integer throughput (GOP/s) */
+} DevicePeaks;
+
+/*! Append \p peaks to the file at \p path. Each line of the file holds the
+ *  results for one device keyed by CL_DEVICE_NAME and CL_DRIVER_VERSION.
+ *
+ *  \returns CL_SUCCESS on success.
+ */
+cl_int saveDevicePeaks(const char* path, cl_device_id device, const DevicePeaks* peaks);
+
+/*! Load the most recent results for \p device (matching CL_DEVICE_NAME and
+ *  CL_DRIVER_VERSION) from the file at \p path.
+ *
+ *  \returns CL_SUCCESS on success or CL_DEVICE_NOT_FOUND if the file has no
+ *  results for \p device.
+ */
+cl_int loadDevicePeaks(const char* path, cl_device_id device, DevicePeaks* peaks);
+
+/*! Estimate the arithmetic peaks of \p device from CL_DEVICE_MAX_COMPUTE_UNITS,
+ *  CL_DEVICE_MAX_CLOCK_FREQUENCY and the native vector widths assuming one
+ *  multiply-add per lane per cycle. Memory bandwidth cannot be derived from
+ *  device queries so the bandwidth fields are set to 0 (unknown).
+ *
+ *  \returns CL_SUCCESS on success.
+ */
+cl_int estimateDevicePeaks(cl_device_id device, DevicePeaks* peaks);
+
+/*! Get the peaks of \p device from \p path (see loadDevicePeaks()) falling
+ *  back to estimateDevicePeaks() if \p path is NULL or has no results for
+ *  \p device. The source of the peaks is printed.
+ *
+ *  \returns CL_SUCCESS on success.
+ */
+cl_int getDevicePeaks(const char* path, cl_device_id device, DevicePeaks* peaks);
+
+/*! Global memory traffic and arithmetic of a kernel run. */
+typedef struct
+{
+    double bytes; /*!< Bytes read from and written to global memory */
+    double ops; /*!< Arithmetic operations performed */
+    cl_bool integerOps; /*!< CL_TRUE if ops are integer, CL_FALSE if floating point */
+} KernelWork;
+
+/*! Print the achieved bandwidth and throughput of a kernel run that took
+ *  \p seconds, their fraction of \p peaks and whether the kernel is
+ *  memory or compute bound. Peaks of 0 are treated as unknown.
+ */
+void printRooflineReport(const KernelWork* work, double seconds, const DevicePeaks* peaks, cl_uint indent);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
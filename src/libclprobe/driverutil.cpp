@@ -0,0 +1,98 @@
+#include <driverutil.h>
+#include <clprobe.h>
+#include <timing.h>
+#include <cstdio>
+#include <cstdlib>
+#include <cassert>
+
+void showError(const char* msg, bool quit)
+{
+    printf("Error: %s\n", msg);
+    if (quit) exit(1);
+}
+
+void handleError(cl_int error, const char* msg, bool quit)
+{
+    if ( error != CL_SUCCESS)
+    {
+        showError(msg, quit);
+        if (quit) assert(0 && "Unreachable");
+    }
+}
+
+cl_platform_id pickPlatform(double* icdLoadSeconds)
+{
+    cl_uint numPlatforms=0;
+    double start = getHostTime();
+    cl_int err = clGetPlatformIDs(0, 0, &numPlatforms);
+    if ( icdLoadSeconds != NULL )
+        *icdLoadSeconds = getHostTime() - start;
+    handleError(err, "Could not get number of platforms");
+
+    if ( numPlatforms < 1 )
+        showError("Couldn't find a platform");
+
+    cl_platform_id* platforms=0;
+    cl_uint numberOfPlatforms;
+    err = getPlatformIDs(&platforms, &numberOfPlatforms);
+    handleError(err, "Could not get platform ID");
+
+    // Just pick first platform
+    cl_platform_id platform = platforms[0];
+    free(platforms);
+    return platform;
+}
+
+cl_device_id pickDevice(cl_platform_id platform)
+{
+    cl_device_id* devices;
+    cl_uint numberOfDevices;
+
+    cl_int err = getDeviceIDs(platform, &devices, &numberOfDevices);
+
+    handleError(err, "Could not get device IDs");
+
+    // Just pick first device
+    cl_device_id device = devices[0];
+    free(devices);
+    return device;
+}
+
+void printStartupTimings(const StartupTimings* timings, double totalSeconds)
+{
+    typedef struct
+    {
+        const char* name;
+        double seconds;
+    } Phase;
+
+    Phase phases[] =
+    {
+        { "ICD load", timings->icdLoad },
+        { "Platform enumeration", timings->platformEnumeration },
+        { "Kernel load", timings->kernelLoad },
+        { "Context creation", timings->contextCreation },
+        { "Program build", timings->build },
+        { "First launch", timings->firstLaunch }
+    };
+
+    printf("\nStartup timings:\n");
+    for (unsigned int index=0; index < sizeof(phases)/sizeof(Phase); ++index)
+    {
+        printf("  %-22s %10.3f ms", phases[index].name, phases[index].seconds * 1.0e3);
+        if ( totalSeconds > 0.0 )
+            printf(" (%5.1f%%)", 100.0 * phases[index].seconds / totalSeconds);
+        printf("\n");
+    }
+    printf("  %-22s %10.3f ms\n", "Total", totalSeconds * 1.0e3);
+}
+
+void contextCallBack(const char* errInfo,
+                     const void* privateInfo,
+                     size_t cb,
+                     void* userData)
+{
+    static unsigned int count=0;
+    count++;
+    printf("Context Error (#%u): %s\n", count, errInfo);
+}
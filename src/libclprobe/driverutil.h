@@ -0,0 +1,46 @@
+#ifndef CLPROBE_DRIVERUTIL_H
+#define CLPROBE_DRIVERUTIL_H
+#include <CL/opencl.h>
+
+/* Helpers shared by the example programs. */
+
+/*! Print \p msg and exit if \p quit is true. */
+void showError(const char* msg, bool quit=true);
+
+/*! If \p error is not CL_SUCCESS print \p msg and exit if \p quit is true. */
+void handleError(cl_int error, const char* msg, bool quit=true);
+
+/*! \returns the first OpenCL platform. Exits on failure.
+ *
+ *  If \p icdLoadSeconds is not NULL it is set to the time taken by the
+ *  first clGetPlatformIDs() call, which loads the ICDs when it is the
+ *  first OpenCL call of the process.
+ */
+cl_platform_id pickPlatform(double* icdLoadSeconds=NULL);
+
+/*! \returns the first device of \p platform. Exits on failure. */
+cl_device_id pickDevice(cl_platform_id platform);
+
+/*! Wall time of each start up phase of a program (seconds). */
+typedef struct
+{
+    double icdLoad; /*!< First OpenCL call, loads the ICDs */
+    double platformEnumeration; /*!< Picking the platform and device */
+    double kernelLoad; /*!< Loading the kernel source */
+    double contextCreation; /*!< Creating the context and command queue */
+    double build; /*!< From starting the build until the program is ready */
+    double firstLaunch; /*!< From enqueueing the first kernel until its results are read back */
+} StartupTimings;
+
+/*! Print \p timings with their share of \p totalSeconds (the time from
+ *  the start of the program). Phases may overlap (e.g. the build runs
+ *  while buffers are set up) so the shares may not add up.
+ */
+void printStartupTimings(const StartupTimings* timings, double totalSeconds);
+
+/*! Context error callback that prints the error. */
+void contextCallBack(const char* errInfo,
+                     const void* privateInfo,
+                     size_t cb,
+                     void* userData);
+#endif
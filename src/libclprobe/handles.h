@@ -0,0 +1,431 @@
+#ifndef CLPROBE_HANDLES_H
+#define CLPROBE_HANDLES_H
+#ifndef __cplusplus
+#error "handles.h is a C++ header"
+#endif
+#include <CL/opencl.h>
+#include <stddef.h>
+#include <vector>
+#include <utility>
+#include "kernelsource.h"
+#include "timing.h"
+
+/*! Header only C++ wrappers over the OpenCL objects used by libclprobe.
+ *
+ *  Contexts, queues, programs, kernels, buffers and events are move-only
+ *  handles that own one reference and release it when destroyed. They are
+ *  never copied so passing them around does not retain or release
+ *  anything; share() takes an extra reference when one is really needed.
+ *  Errors are reported through cl_int return values and \p err out
+ *  parameters like the rest of libclprobe.
+ *
+ *  Everything is inline and forwards straight to the OpenCL calls so the
+ *  launch path (setArgs() and enqueueKernel()) costs the same as calling
+ *  clSetKernelArg() and clEnqueueNDRangeKernel() by hand and allocates
+ *  nothing.
+ */
+namespace clprobe
+{
+
+/*! Release/retain functions for each owned OpenCL object type. */
+template <typename T> struct HandleTraits;
+
+#define CLPROBE_HANDLE_TRAITS(TYPE, RETAIN, RELEASE) \
+    template <> struct HandleTraits<TYPE> \
+    { \
+        static cl_int retain(TYPE object) { return RETAIN(object); } \
+        static cl_int release(TYPE object) { return RELEASE(object); } \
+    }
+
+CLPROBE_HANDLE_TRAITS(cl_context, clRetainContext, clReleaseContext);
+CLPROBE_HANDLE_TRAITS(cl_command_queue, clRetainCommandQueue, clReleaseCommandQueue);
+CLPROBE_HANDLE_TRAITS(cl_program, clRetainProgram, clReleaseProgram);
+CLPROBE_HANDLE_TRAITS(cl_kernel, clRetainKernel, clReleaseKernel);
+CLPROBE_HANDLE_TRAITS(cl_mem, clRetainMemObject, clReleaseMemObject);
+CLPROBE_HANDLE_TRAITS(cl_event, clRetainEvent, clReleaseEvent);
+
+#undef CLPROBE_HANDLE_TRAITS
+
+/*! Owns one reference to an OpenCL object of type \p T. */
+template <typename T>
+class Handle
+{
+    public:
+        Handle() : object(0) {}
+
+        /*! Take ownership of \p object (no retain). */
+        explicit Handle(T object) : object(object) {}
+
+        Handle(Handle&& other) : object(other.object) { other.object = 0; }
+
+        Handle& operator=(Handle&& other)
+        {
+            if ( this != &other )
+            {
+                reset();
+                object = other.object;
+                other.object = 0;
+            }
+            return *this;
+        }
+
+        ~Handle() { reset(); }
+
+        Handle(const Handle&) = delete;
+        Handle& operator=(const Handle&) = delete;
+
+        /*! \returns the object without transferring ownership. */
+        T get() const { return object; }
+
+        explicit operator bool() const { return object != 0; }
+
+        /*! Give up ownership of the object and return it. */
+        T detach()
+        {
+            T result = object;
+            object = 0;
+            return result;
+        }
+
+        /*! Release the object (if any). */
+        void reset()
+        {
+            if ( object != 0 )
+                HandleTraits<T>::release(object);
+            object = 0;
+        }
+
+    protected:
+        /*! Release the current object and return where a new one should be
+         *  written, e.g. the event out parameter of an enqueue call.
+         */
+        T* receive()
+        {
+            reset();
+            return &object;
+        }
+
+        /*! \returns the object with an extra reference, for a new handle. */
+        T retained() const
+        {
+            if ( object != 0 )
+                HandleTraits<T>::retain(object);
+            return object;
+        }
+
+        T object;
+};
+
+/*! A device. Root devices are not reference counted so this is a plain,
+ *  copyable value.
+ */
+class Device
+{
+    public:
+        Device() : id(0) {}
+        explicit Device(cl_device_id id) : id(id) {}
+
+        cl_device_id get() const { return id; }
+
+        /*! \returns the device's platform or 0 on failure. */
+        cl_platform_id platform() const
+        {
+            cl_platform_id result = 0;
+            clGetDeviceInfo(id, CL_DEVICE_PLATFORM, sizeof(result), &result, NULL);
+            return result;
+        }
+
+    private:
+        cl_device_id id;
+};
+
+/*! A platform, a plain copyable value like Device. */
+class Platform
+{
+    public:
+        Platform() : id(0) {}
+        explicit Platform(cl_platform_id id) : id(id) {}
+
+        cl_platform_id get() const { return id; }
+
+        /*! Get the platform's devices of \p type.
+         *
+         *  \returns CL_SUCCESS on success.
+         */
+        cl_int getDevices(cl_device_type type, std::vector<Device>* devices) const
+        {
+            cl_uint numDevices = 0;
+            devices->clear();
+            cl_int err = clGetDeviceIDs(id, type, 0, NULL, &numDevices);
+            if ( err != CL_SUCCESS || numDevices == 0 )
+                return err;
+
+            // Device is layout compatible with cl_device_id
+            static_assert(sizeof(Device) == sizeof(cl_device_id), "Device must wrap only its id");
+            devices->resize(numDevices);
+            return clGetDeviceIDs(id, type, numDevices,
+                                  reinterpret_cast<cl_device_id*>(&(*devices)[0]), NULL);
+        }
+
+    private:
+        cl_platform_id id;
+};
+
+/*! Get all platforms.
+ *
+ *  \returns CL_SUCCESS on success.
+ */
+inline cl_int getPlatforms(std::vector<Platform>* platforms)
+{
+    cl_uint numPlatforms = 0;
+    platforms->clear();
+    cl_int err = clGetPlatformIDs(0, NULL, &numPlatforms);
+    if ( err != CL_SUCCESS || numPlatforms == 0 )
+        return err;
+
+    // Platform is layout compatible with cl_platform_id
+    static_assert(sizeof(Platform) == sizeof(cl_platform_id), "Platform must wrap only its id");
+    platforms->resize(numPlatforms);
+    return clGetPlatformIDs(numPlatforms,
+                            reinterpret_cast<cl_platform_id*>(&(*platforms)[0]), NULL);
+}
+
+/*! An owned cl_context. */
+class Context : public Handle<cl_context>
+{
+    public:
+        Context() {}
+        explicit Context(cl_context context) : Handle<cl_context>(context) {}
+
+        /*! Create a context for \p device on its platform. Check the result
+         *  or \p err for failure.
+         */
+        static Context create(const Device& device, cl_int* err,
+                              void (CL_CALLBACK* callBack)(const char*, const void*, size_t, void*) = NULL,
+                              void* userData = NULL)
+        {
+            cl_context_properties properties[] =
+            {
+                CL_CONTEXT_PLATFORM, (cl_context_properties) device.platform(), 0
+            };
+            cl_device_id id = device.get();
+            return Context(clCreateContext(properties, 1, &id, callBack, userData, err));
+        }
+
+        Context share() const { return Context(retained()); }
+};
+
+/*! An owned cl_event. */
+class Event : public Handle<cl_event>
+{
+    public:
+        Event() {}
+        explicit Event(cl_event event) : Handle<cl_event>(event) {}
+
+        /*! \returns where an enqueue call should write a new event. Any
+         *  event held so far is released.
+         */
+        cl_event* out() { return receive(); }
+
+        cl_int wait() const { return clWaitForEvents(1, &object); }
+
+        /*! Get the device execution time of the event, see getEventDuration(). */
+        cl_int duration(double* seconds) const { return getEventDuration(object, seconds); }
+
+        Event share() const { return Event(retained()); }
+};
+
+/*! An owned buffer of \p count elements of type \p T. */
+template <typename T>
+class Buffer : public Handle<cl_mem>
+{
+    public:
+        Buffer() : count(0) {}
+
+        /*! Take ownership of \p buffer which holds \p count elements. */
+        Buffer(cl_mem buffer, size_t count) : Handle<cl_mem>(buffer), count(count) {}
+
+        Buffer(Buffer&& other) : Handle<cl_mem>(std::move(other)), count(other.count) { other.count = 0; }
+
+        Buffer& operator=(Buffer&& other)
+        {
+            if ( this != &other )
+            {
+                count = other.count;
+                Handle<cl_mem>::operator=(std::move(other));
+                other.count = 0;
+            }
+            return *this;
+        }
+
+        /*! Create a buffer of \p count elements. \p hostData is passed to
+         *  clCreateBuffer() (e.g. with CL_MEM_COPY_HOST_PTR).
+         */
+        static Buffer create(const Context& context, cl_mem_flags flags, size_t count,
+                             cl_int* err, T* hostData = NULL)
+        {
+            cl_mem buffer = clCreateBuffer(context.get(), flags, count * sizeof(T), hostData, err);
+            return Buffer(buffer, (buffer != 0)? count : 0);
+        }
+
+        size_t size() const { return count; }
+        size_t bytes() const { return count * sizeof(T); }
+
+        Buffer share() const { return Buffer(retained(), count); }
+
+    private:
+        size_t count;
+};
+
+/*! Size of a __local kernel argument for Kernel::setArgs(). */
+struct LocalMemory
+{
+    explicit LocalMemory(size_t bytes) : bytes(bytes) {}
+    size_t bytes;
+};
+
+/*! An owned cl_kernel. */
+class Kernel : public Handle<cl_kernel>
+{
+    public:
+        Kernel() {}
+        explicit Kernel(cl_kernel kernel) : Handle<cl_kernel>(kernel) {}
+
+        /*! Set argument \p index to \p value. Buffers are passed as their
+         *  cl_mem, LocalMemory as a __local allocation and anything else
+         *  by value.
+         */
+        template <typename T>
+        cl_int setArg(cl_uint index, const T& value)
+        {
+            return clSetKernelArg(object, index, sizeof(T), &value);
+        }
+
+        template <typename T>
+        cl_int setArg(cl_uint index, const Buffer<T>& buffer)
+        {
+            cl_mem mem = buffer.get();
+            return clSetKernelArg(object, index, sizeof(cl_mem), &mem);
+        }
+
+        cl_int setArg(cl_uint index, const LocalMemory& local)
+        {
+            return clSetKernelArg(object, index, local.bytes, NULL);
+        }
+
+        /*! Set the arguments from index 0 in order.
+         *
+         *  \returns CL_SUCCESS or the error of the first argument that
+         *  could not be set.
+         */
+        template <typename... Args>
+        cl_int setArgs(const Args&... args)
+        {
+            return setArgsFrom(0, args...);
+        }
+
+        Kernel share() const { return Kernel(retained()); }
+
+    private:
+        cl_int setArgsFrom(cl_uint) { return CL_SUCCESS; }
+
+        template <typename First, typename... Rest>
+        cl_int setArgsFrom(cl_uint index, const First& first, const Rest&... rest)
+        {
+            cl_int err = setArg(index, first);
+            if ( err != CL_SUCCESS )
+                return err;
+            return setArgsFrom(index + 1, rest...);
+        }
+};
+
+/*! An owned cl_program. */
+class Program : public Handle<cl_program>
+{
+    public:
+        Program() {}
+        explicit Program(cl_program program) : Handle<cl_program>(program) {}
+
+        /*! Create a program from \p source to be built with \p options, see
+         *  createProgramFromKernelSource().
+         */
+        static Program create(const Context& context, const Device& device,
+                              KernelSource* source, cl_int* err, const char* options = NULL)
+        {
+            return Program(createProgramFromKernelSource(context.get(), device.get(), source, options, err));
+        }
+
+        /*! Build the program for \p device (blocking). */
+        cl_int build(const Device& device, const char* options = NULL) const
+        {
+            cl_device_id id = device.get();
+            return clBuildProgram(object, 1, &id, options, NULL, NULL);
+        }
+
+        Kernel createKernel(const char* name, cl_int* err) const
+        {
+            return Kernel(clCreateKernel(object, name, err));
+        }
+
+        Program share() const { return Program(retained()); }
+};
+
+/*! An owned cl_command_queue. */
+class CommandQueue : public Handle<cl_command_queue>
+{
+    public:
+        CommandQueue() {}
+        explicit CommandQueue(cl_command_queue queue) : Handle<cl_command_queue>(queue) {}
+
+        static CommandQueue create(const Context& context, const Device& device,
+                                   cl_command_queue_properties properties, cl_int* err)
+        {
+            return CommandQueue(clCreateCommandQueue(context.get(), device.get(), properties, err));
+        }
+
+        /*! Enqueue \p kernel over \p workDim dimensions. If \p event is not
+         *  NULL it receives the launch's event.
+         */
+        cl_int enqueueKernel(const Kernel& kernel, cl_uint workDim,
+                             const size_t* globalWorkSize, const size_t* localWorkSize,
+                             Event* event = NULL,
+                             cl_uint numWait = 0, const cl_event* waitList = NULL) const
+        {
+            return clEnqueueNDRangeKernel(object, kernel.get(), workDim, NULL,
+                                          globalWorkSize, localWorkSize,
+                                          numWait, waitList,
+                                          (event != NULL)? event->out() : NULL);
+        }
+
+        /*! Write \p count elements from \p data to \p buffer starting at
+         *  element \p offset.
+         */
+        template <typename T>
+        cl_int write(const Buffer<T>& buffer, cl_bool blocking, size_t offset, size_t count,
+                     const T* data, Event* event = NULL) const
+        {
+            return clEnqueueWriteBuffer(object, buffer.get(), blocking,
+                                        offset * sizeof(T), count * sizeof(T), data,
+                                        0, NULL, (event != NULL)? event->out() : NULL);
+        }
+
+        /*! Read \p count elements of \p buffer starting at element \p offset
+         *  into \p data.
+         */
+        template <typename T>
+        cl_int read(const Buffer<T>& buffer, cl_bool blocking, size_t offset, size_t count,
+                    T* data, Event* event = NULL) const
+        {
+            return clEnqueueReadBuffer(object, buffer.get(), blocking,
+                                       offset * sizeof(T), count * sizeof(T), data,
+                                       0, NULL, (event != NULL)? event->out() : NULL);
+        }
+
+        cl_int flush() const { return clFlush(object); }
+        cl_int finish() const { return clFinish(object); }
+
+        CommandQueue share() const { return CommandQueue(retained()); }
+};
+
+} // namespace clprobe
+#endif
@@ -0,0 +1,192 @@
+#include "hybridscheduler.h"
+#include "timing.h"
+#include <cstdio>
+#include <deque>
+#include <vector>
+#include <mutex>
+#include <thread>
+#include <atomic>
+
+/* Chunk indices waiting to be processed by one worker. The owner takes
+*  from the front and thieves take from the back.
+*/
+struct ChunkDeque
+{
+    std::mutex mutex;
+    std::deque<size_t> chunks;
+};
+
+/* Move half (rounded up) of the chunks of the fullest other deque to
+*  deques[self]. Returns false if there was nothing to steal.
+*/
+static bool stealChunks(std::vector<ChunkDeque>& deques, size_t self, size_t* stolen)
+{
+    while ( true )
+    {
+        // The sizes may change before the victim is locked again which
+        // only makes the choice less good.
+        size_t victim = self;
+        size_t victimSize = 0;
+        for (size_t index=0; index < deques.size(); ++index)
+        {
+            if ( index == self )
+                continue;
+
+            std::lock_guard<std::mutex> lock(deques[index].mutex);
+            if ( deques[index].chunks.size() > victimSize )
+            {
+                victim = index;
+                victimSize = deques[index].chunks.size();
+            }
+        }
+
+        if ( victim == self )
+            return false;
+
+        std::vector<size_t> taken;
+        {
+            std::lock_guard<std::mutex> lock(deques[victim].mutex);
+            size_t count = ( deques[victim].chunks.size() + 1 ) / 2;
+            for (size_t index=0; index < count; ++index)
+            {
+                taken.push_back(deques[victim].chunks.back());
+                deques[victim].chunks.pop_back();
+            }
+        }
+
+        // The victim may have emptied its deque meanwhile so look again
+        if ( taken.empty() )
+            continue;
+
+        std::lock_guard<std::mutex> lock(deques[self].mutex);
+        // Keep the stolen chunks in ascending order
+        for (size_t index=taken.size(); index > 0; --index)
+            deques[self].chunks.push_back(taken[index -1]);
+
+        *stolen += taken.size();
+        return true;
+    }
+}
+
+cl_int runHybridSchedule(size_t n,
+                         size_t chunkSize,
+                         cl_uint numWorkers,
+                         const HybridWorker* workers,
+                         HybridWorkerStats* stats)
+{
+    if ( numWorkers == 0 || chunkSize == 0 )
+        return CL_INVALID_VALUE;
+
+    size_t numChunks = (n + chunkSize -1) / chunkSize;
+
+    /* Initial split in proportion to each worker's previous throughput */
+    std::vector<double> weights(numWorkers, 1.0);
+    bool havePrevious = true;
+    double totalWeight = 0.0;
+    for (cl_uint index=0; index < numWorkers; ++index)
+    {
+        if ( stats[index].busySeconds <= 0.0 || stats[index].elements == 0 )
+            havePrevious = false;
+        else
+            weights[index] = stats[index].elements / stats[index].busySeconds;
+    }
+
+    for (cl_uint index=0; index < numWorkers; ++index)
+    {
+        if ( !havePrevious )
+            weights[index] = 1.0;
+        totalWeight += weights[index];
+    }
+
+    std::vector<ChunkDeque> deques(numWorkers);
+    size_t assigned = 0;
+    double cumulative = 0.0;
+    for (cl_uint index=0; index < numWorkers; ++index)
+    {
+        cumulative += weights[index];
+        size_t last = ( index == numWorkers -1 )? numChunks
+                                                : (size_t) (numChunks * cumulative / totalWeight + 0.5);
+        for ( ; assigned < last; ++assigned)
+            deques[index].chunks.push_back(assigned);
+
+        stats[index].chunks = 0;
+        stats[index].elements = 0;
+        stats[index].stolen = 0;
+        stats[index].busySeconds = 0.0;
+    }
+
+    std::atomic<cl_int> firstError(CL_SUCCESS);
+    std::vector<std::thread> threads;
+    for (cl_uint index=0; index < numWorkers; ++index)
+    {
+        threads.push_back( std::thread( [index, n, chunkSize, workers, stats, &deques, &firstError]()
+        {
+            const HybridWorker& worker = workers[index];
+            HybridWorkerStats& workerStats = stats[index];
+            while ( firstError == CL_SUCCESS )
+            {
+                size_t chunk=0;
+                bool haveChunk=false;
+                {
+                    std::lock_guard<std::mutex> lock(deques[index].mutex);
+                    if ( !deques[index].chunks.empty() )
+                    {
+                        chunk = deques[index].chunks.front();
+                        deques[index].chunks.pop_front();
+                        haveChunk = true;
+                    }
+                }
+
+                if ( !haveChunk )
+                {
+                    if ( stealChunks(deques, index, &workerStats.stolen) )
+                        continue;
+
+                    // Every deque is empty so no more work will appear. Chunks
+                    // being moved by a thief are processed by that thief.
+                    return;
+                }
+
+                size_t begin = chunk * chunkSize;
+                size_t end = ( begin + chunkSize < n )? begin + chunkSize : n;
+                double start = getHostTime();
+                cl_int err = worker.process(chunk, begin, end, worker.userData);
+                workerStats.busySeconds += getHostTime() - start;
+                if ( err != CL_SUCCESS )
+                {
+                    cl_int expected = CL_SUCCESS;
+                    firstError.compare_exchange_strong(expected, err);
+                    return;
+                }
+
+                workerStats.chunks++;
+                workerStats.elements += end - begin;
+            }
+        }));
+    }
+
+    for (size_t index=0; index < threads.size(); ++index)
+        threads[index].join();
+
+    return firstError;
+}
+
+void printHybridStats(cl_uint numWorkers, const HybridWorker* workers, const HybridWorkerStats* stats, cl_uint indent)
+{
+    size_t totalElements = 0;
+    for (cl_uint index=0; index < numWorkers; ++index)
+        totalElements += stats[index].elements;
+
+    for (cl_uint index=0; index < numWorkers; ++index)
+    {
+        double share = (totalElements > 0)? 100.0 * stats[index].elements / totalElements : 0.0;
+        double rate = (stats[index].busySeconds > 0.0)? stats[index].elements / stats[index].busySeconds : 0.0;
+
+        for (cl_uint i=0; i < indent; ++i) printf(" ");
+        printf("%-12s %6lu chunks (%lu stolen) %5.1f%% of elements, %.2f Melements/s\n",
+               workers[index].name,
+               (unsigned long) stats[index].chunks,
+               (unsigned long) stats[index].stolen,
+               share, rate * 1.0e-6);
+    }
+}
@@ -0,0 +1,69 @@
+#ifndef CLPROBE_HYBRIDSCHEDULER_H
+#define CLPROBE_HYBRIDSCHEDULER_H
+#include <stddef.h>
+#include <CL/opencl.h>
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*! Work-stealing scheduler that splits an array of n elements into chunks
+ *  and processes them with a mix of workers. Typically these are a thread
+ *  driving an OpenCL queue and some threads running host reference code.
+ *
+ *  Each worker runs on its own thread with its own deque of chunks. The
+ *  deques are initially filled in proportion to each worker's throughput
+ *  (taken from the stats of a previous run if there are any). A worker
+ *  takes chunks from the front of its deque. When the deque is empty it
+ *  steals half of the remaining chunks from the back of the fullest
+ *  deque. Faster workers therefore end up processing more chunks.
+ */
+
+/*! Process elements [begin, end) of chunk number \p chunk.
+ *  \returns CL_SUCCESS on success. Any other value stops the schedule.
+ */
+typedef cl_int (*ChunkFunction)(size_t chunk, size_t begin, size_t end, void* userData);
+
+typedef struct
+{
+    const char* name; /*!< Used when printing stats */
+    ChunkFunction process;
+    void* userData;
+} HybridWorker;
+
+/*! What each worker did in a run. Passing the stats of one run to the
+ *  next run seeds its initial split.
+ */
+typedef struct
+{
+    size_t chunks; /*!< Chunks processed */
+    size_t elements; /*!< Elements processed */
+    size_t stolen; /*!< Chunks stolen from other workers */
+    double busySeconds; /*!< Time spent processing chunks */
+} HybridWorkerStats;
+
+/*! Process \p n elements in chunks of \p chunkSize elements (the last may
+ *  be smaller) with \p workers.
+ *
+ *  \param[in,out] stats array of \p numWorkers. If the stats of a worker
+ *         have a non zero busySeconds, elements / busySeconds is used as
+ *         that worker's initial throughput. Otherwise all workers are
+ *         assumed to be equal. On return they hold the stats of this run.
+ *
+ *  \returns CL_SUCCESS if every chunk was processed successfully or the
+ *  first error returned by a ChunkFunction.
+ */
+cl_int runHybridSchedule(size_t n,
+                         size_t chunkSize,
+                         cl_uint numWorkers,
+                         const HybridWorker* workers,
+                         HybridWorkerStats* stats);
+
+/*! Print \p stats for each worker including their share of the work and
+ *  throughput.
+ */
+void printHybridStats(cl_uint numWorkers, const HybridWorker* workers, const HybridWorkerStats* stats, cl_uint indent);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
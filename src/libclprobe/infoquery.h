@@ -0,0 +1,180 @@
+#ifndef CLPROBE_INFOQUERY_H
+#define CLPROBE_INFOQUERY_H
+#ifndef __cplusplus
+#error "infoquery.h is a C++ header"
+#endif
+#include <CL/opencl.h>
+#include <stddef.h>
+#include <stdlib.h>
+
+/*! Typed clGet*Info() queries without heap allocation for common sizes.
+ *
+ *  getInfo(object, param, &value) reads a fixed size value with a single
+ *  call. Arrays and strings are read into an InfoArray which holds up to
+ *  \p InlineCount elements inside itself (normally on the stack); the
+ *  query is first made straight into that storage so values that fit
+ *  take one call and no allocation. Only larger values fall back to the
+ *  usual size query, malloc and second query.
+ *
+ *  \code
+ *  InfoString name;
+ *  if ( getInfo(device, CL_DEVICE_NAME, &name) == CL_SUCCESS )
+ *      printf("%s\n", name.get());
+ *  \endcode
+ */
+namespace clprobe
+{
+
+/*! Result of an array or string query. Holds \p InlineCount elements
+ *  without allocating.
+ */
+template <typename T, size_t InlineCount>
+class InfoArray
+{
+    public:
+        InfoArray() : data(inlineData), count(0) {}
+        ~InfoArray() { releaseHeap(); }
+
+        InfoArray(const InfoArray&) = delete;
+        InfoArray& operator=(const InfoArray&) = delete;
+
+        /*! \returns the elements. Strings include their NULL terminator. */
+        const T* get() const { return data; }
+        const T& operator[](size_t index) const { return data[index]; }
+
+        /*! \returns the number of elements. */
+        size_t size() const { return count; }
+
+        /*! \returns true if the value did not fit inline and was allocated. */
+        bool onHeap() const { return data != inlineData; }
+
+        static const size_t inlineBytes = sizeof(T) * InlineCount;
+
+        /*! Query \p getInfo, a callable with the last three parameters of a
+         *  clGet*Info() function, into this array.
+         *
+         *  \returns CL_SUCCESS on success.
+         */
+        template <typename Getter>
+        cl_int query(Getter getInfo)
+        {
+            releaseHeap();
+            count = 0;
+
+            // Try the inline storage first, one call if the value fits
+            size_t bytes = 0;
+            if ( getInfo(inlineBytes, inlineData, &bytes) == CL_SUCCESS )
+            {
+                count = bytes / sizeof(T);
+                return CL_SUCCESS;
+            }
+
+            // Too small (or a real error which the size query reports)
+            cl_int err = getInfo(0, NULL, &bytes);
+            if ( err != CL_SUCCESS )
+                return err;
+
+            if ( bytes > inlineBytes )
+            {
+                data = (T*) malloc(bytes);
+                if ( data == NULL )
+                {
+                    data = inlineData;
+                    return CL_OUT_OF_HOST_MEMORY;
+                }
+            }
+
+            err = getInfo(bytes, data, NULL);
+            if ( err != CL_SUCCESS )
+            {
+                releaseHeap();
+                return err;
+            }
+            count = bytes / sizeof(T);
+            return CL_SUCCESS;
+        }
+
+    private:
+        void releaseHeap()
+        {
+            if ( data != inlineData )
+                free(data);
+            data = inlineData;
+        }
+
+        T inlineData[InlineCount];
+        T* data;
+        size_t count;
+};
+
+/*! String result, most info strings fit inline. Extension lists and build
+ *  logs may not.
+ */
+typedef InfoArray<char, 256> InfoString;
+
+/* getInfo() overloads for every object type. The param types are all
+ * cl_uint so the object type picks the OpenCL function.
+ */
+#define CLPROBE_INFO_QUERY(NAME, OBJECT, PARAM, FUNCTION) \
+    template <typename T> \
+    inline cl_int NAME(OBJECT object, PARAM param, T* value) \
+    { \
+        return FUNCTION(object, param, sizeof(T), value, NULL); \
+    } \
+    template <typename T, size_t N> \
+    inline cl_int NAME(OBJECT object, PARAM param, InfoArray<T, N>* values) \
+    { \
+        return values->query([=](size_t size, void* value, size_t* sizeRet) \
+                             { return FUNCTION(object, param, size, value, sizeRet); }); \
+    }
+
+CLPROBE_INFO_QUERY(getInfo, cl_platform_id, cl_platform_info, clGetPlatformInfo)
+CLPROBE_INFO_QUERY(getInfo, cl_device_id, cl_device_info, clGetDeviceInfo)
+CLPROBE_INFO_QUERY(getInfo, cl_context, cl_context_info, clGetContextInfo)
+CLPROBE_INFO_QUERY(getInfo, cl_command_queue, cl_command_queue_info, clGetCommandQueueInfo)
+CLPROBE_INFO_QUERY(getInfo, cl_program, cl_program_info, clGetProgramInfo)
+CLPROBE_INFO_QUERY(getInfo, cl_kernel, cl_kernel_info, clGetKernelInfo)
+CLPROBE_INFO_QUERY(getInfo, cl_mem, cl_mem_info, clGetMemObjectInfo)
+CLPROBE_INFO_QUERY(getInfo, cl_event, cl_event_info, clGetEventInfo)
+
+#undef CLPROBE_INFO_QUERY
+
+/* Queries about an object on a particular device. */
+#define CLPROBE_DEVICE_INFO_QUERY(NAME, OBJECT, PARAM, FUNCTION) \
+    template <typename T> \
+    inline cl_int NAME(OBJECT object, cl_device_id device, PARAM param, T* value) \
+    { \
+        return FUNCTION(object, device, param, sizeof(T), value, NULL); \
+    } \
+    template <typename T, size_t N> \
+    inline cl_int NAME(OBJECT object, cl_device_id device, PARAM param, InfoArray<T, N>* values) \
+    { \
+        return values->query([=](size_t size, void* value, size_t* sizeRet) \
+                             { return FUNCTION(object, device, param, size, value, sizeRet); }); \
+    }
+
+CLPROBE_DEVICE_INFO_QUERY(getBuildInfo, cl_program, cl_program_build_info, clGetProgramBuildInfo)
+CLPROBE_DEVICE_INFO_QUERY(getWorkGroupInfo, cl_kernel, cl_kernel_work_group_info, clGetKernelWorkGroupInfo)
+
+#undef CLPROBE_DEVICE_INFO_QUERY
+
+#ifdef CL_VERSION_1_2
+/*! Query argument \p index of \p kernel (OpenCL 1.2, needs the program
+ *  to keep argument info, e.g. built with -cl-kernel-arg-info).
+ */
+template <typename T>
+inline cl_int getArgInfo(cl_kernel kernel, cl_uint index, cl_kernel_arg_info param, T* value)
+{
+    return clGetKernelArgInfo(kernel, index, param, sizeof(T), value, NULL);
+}
+
+template <typename T, size_t N>
+inline cl_int getArgInfo(cl_kernel kernel, cl_uint index, cl_kernel_arg_info param, InfoArray<T, N>* values)
+{
+    return values->query([=](size_t size, void* value, size_t* sizeRet)
+                         { return clGetKernelArgInfo(kernel, index, param, size, value, sizeRet); });
+}
+#endif
+
+} // namespace clprobe
+#endif
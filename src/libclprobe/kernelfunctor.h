@@ -0,0 +1,314 @@
+#ifndef CLPROBE_KERNELFUNCTOR_H
+#define CLPROBE_KERNELFUNCTOR_H
+#ifndef __cplusplus
+#error "kernelfunctor.h is a C++ header"
+#endif
+#include <CL/opencl.h>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <tuple>
+#include <type_traits>
+#include "handles.h"
+#include "infoquery.h"
+
+namespace clprobe
+{
+
+/*! OpenCL C type name of a kernel argument of host type \p T as reported
+ *  by CL_KERNEL_ARG_TYPE_NAME, or NULL if it is not checked.
+ */
+template <typename T> struct ArgTypeName { static const char* get() { return NULL; } };
+
+#define CLPROBE_ARG_TYPE_NAME(TYPE, NAME) \
+    template <> struct ArgTypeName<TYPE> { static const char* get() { return NAME; } }
+
+CLPROBE_ARG_TYPE_NAME(cl_char, "char");
+CLPROBE_ARG_TYPE_NAME(cl_uchar, "uchar");
+CLPROBE_ARG_TYPE_NAME(cl_short, "short");
+CLPROBE_ARG_TYPE_NAME(cl_ushort, "ushort");
+CLPROBE_ARG_TYPE_NAME(cl_int, "int");
+CLPROBE_ARG_TYPE_NAME(cl_uint, "uint");
+CLPROBE_ARG_TYPE_NAME(cl_long, "long");
+CLPROBE_ARG_TYPE_NAME(cl_ulong, "ulong");
+CLPROBE_ARG_TYPE_NAME(cl_float, "float");
+CLPROBE_ARG_TYPE_NAME(cl_double, "double");
+
+#undef CLPROBE_ARG_TYPE_NAME
+
+/*! Last value set for one kernel argument of host type \p T, so that
+ *  unchanged arguments are not set again. Values are passed by value and
+ *  compared bytewise.
+ */
+template <typename T>
+struct ArgCache
+{
+    static_assert(std::is_trivially_copyable<T>::value,
+                  "Kernel arguments passed by value must be trivially copyable");
+
+    ArgCache() : valid(false) {}
+
+    cl_int set(cl_kernel kernel, cl_uint index, const T& newValue)
+    {
+        if ( valid && memcmp(&value, &newValue, sizeof(T)) == 0 )
+            return CL_SUCCESS;
+        valid = false;
+        cl_int err = clSetKernelArg(kernel, index, sizeof(T), &newValue);
+        if ( err == CL_SUCCESS )
+        {
+            memcpy(&value, &newValue, sizeof(T));
+            valid = true;
+        }
+        return err;
+    }
+
+    /*! \returns true if \p reportedName (CL_KERNEL_ARG_TYPE_NAME) is the
+     *  type of \p T. Types without a known name always match.
+     */
+    static bool matches(const std::string& reportedName)
+    {
+        const char* name = ArgTypeName<T>::get();
+        if ( name == NULL )
+            return true;
+        // Some runtimes spell out the unsigned types
+        return reportedName == name ||
+               ( name[0] == 'u' && reportedName == std::string("unsigned ") + (name + 1) );
+    }
+
+    T value;
+    bool valid;
+};
+
+/*! A global or constant buffer argument. It is set on every launch, not
+ *  cached: once a buffer is released a new one may get the same cl_mem, so
+ *  an equal handle does not mean the kernel is still bound to a live object.
+ */
+struct MemArgCache
+{
+    cl_int set(cl_kernel kernel, cl_uint index, cl_mem mem)
+    {
+        return clSetKernelArg(kernel, index, sizeof(cl_mem), &mem);
+    }
+
+    /*! \returns true if \p reportedName is a pointer to \p elementName
+     *  (any pointer if \p elementName is NULL).
+     */
+    static bool matchesPointer(const std::string& reportedName, const char* elementName)
+    {
+        if ( reportedName.empty() || reportedName[reportedName.size() - 1] != '*' )
+            return false;
+        return elementName == NULL || reportedName == std::string(elementName) + "*";
+    }
+};
+
+template <typename T>
+struct ArgCache< Buffer<T> > : MemArgCache
+{
+    cl_int set(cl_kernel kernel, cl_uint index, const Buffer<T>& buffer)
+    {
+        return MemArgCache::set(kernel, index, buffer.get());
+    }
+
+    static bool matches(const std::string& reportedName)
+    {
+        return matchesPointer(reportedName, ArgTypeName<T>::get());
+    }
+};
+
+/*! A raw cl_mem argument, any pointer type matches. */
+template <>
+struct ArgCache<cl_mem> : MemArgCache
+{
+    static bool matches(const std::string& reportedName)
+    {
+        return matchesPointer(reportedName, NULL);
+    }
+};
+
+/*! A __local argument, compared by its size. Any pointer type matches. */
+template <>
+struct ArgCache<LocalMemory>
+{
+    ArgCache() : bytes(0), valid(false) {}
+
+    cl_int set(cl_kernel kernel, cl_uint index, const LocalMemory& local)
+    {
+        if ( valid && local.bytes == bytes )
+            return CL_SUCCESS;
+        valid = false;
+        cl_int err = clSetKernelArg(kernel, index, local.bytes, NULL);
+        if ( err == CL_SUCCESS )
+        {
+            bytes = local.bytes;
+            valid = true;
+        }
+        return err;
+    }
+
+    static bool matches(const std::string& reportedName)
+    {
+        return !reportedName.empty() && reportedName[reportedName.size() - 1] == '*';
+    }
+
+    size_t bytes;
+    bool valid;
+};
+
+/*! A kernel whose signature is fixed at compile time.
+ *
+ *  \p Args are the host types of the kernel's arguments in order: OpenCL
+ *  scalar types (cl_int, cl_float, ...) or other trivially copyable types
+ *  passed by value, Buffer<T> or cl_mem for global and constant buffers and
+ *  LocalMemory for __local buffers. Calls with any other argument types do
+ *  not compile.
+ *
+ *  create() checks the number of arguments against the kernel and, where
+ *  the runtime reports CL_KERNEL_ARG_TYPE_NAME (always if the program was
+ *  built with -cl-kernel-arg-info), their types.
+ *
+ *  The last value of each scalar and __local argument is cached and
+ *  clSetKernelArg() is only called for those that changed since the
+ *  previous launch, which saves driver calls in tight launch loops. Buffer
+ *  arguments are always set (see MemArgCache). The functor owns its
+ *  kernel; setting its arguments any other way requires invalidate().
+ */
+template <typename... Args>
+class KernelFunctor
+{
+    public:
+        KernelFunctor() {}
+
+        /*! Create kernel \p name from the built \p program and check its
+         *  signature against \p Args.
+         *
+         *  \returns an empty functor on failure in which case \p err is set
+         *  (CL_INVALID_KERNEL_ARGS if the signature does not match).
+         */
+        static KernelFunctor create(cl_program program, const char* name, cl_int* err)
+        {
+            KernelFunctor functor;
+            functor.kernel = Kernel(clCreateKernel(program, name, err));
+            if ( *err != CL_SUCCESS )
+                return KernelFunctor();
+
+            *err = functor.checkSignature(name);
+            if ( *err != CL_SUCCESS )
+                return KernelFunctor();
+            return functor;
+        }
+
+        cl_kernel get() const { return kernel.get(); }
+        explicit operator bool() const { return static_cast<bool>(kernel); }
+
+        /*! Release the kernel. */
+        void reset()
+        {
+            kernel.reset();
+            invalidate();
+        }
+
+        /*! Forget the cached arguments so the next launch sets them all. */
+        void invalidate()
+        {
+            cache = std::tuple< ArgCache<Args>... >();
+        }
+
+        /*! Set the arguments that differ from the previous call.
+         *
+         *  \returns CL_SUCCESS or the error of the first argument that
+         *  could not be set.
+         */
+        cl_int setArgs(const Args&... args)
+        {
+            return setArgsFrom<0>(args...);
+        }
+
+        /*! Set the arguments (see setArgs()) and enqueue the kernel on
+         *  \p queue. If \p event is not NULL it receives the launch's event.
+         */
+        cl_int enqueue(cl_command_queue queue, cl_uint workDim,
+                       const size_t* globalWorkSize, const size_t* localWorkSize,
+                       cl_event* event, const Args&... args)
+        {
+            cl_int err = setArgs(args...);
+            if ( err != CL_SUCCESS )
+                return err;
+            return clEnqueueNDRangeKernel(queue, kernel.get(), workDim, NULL,
+                                          globalWorkSize, localWorkSize, 0, NULL, event);
+        }
+
+        cl_int operator()(const CommandQueue& queue, cl_uint workDim,
+                          const size_t* globalWorkSize, const size_t* localWorkSize,
+                          Event* event, const Args&... args)
+        {
+            return enqueue(queue.get(), workDim, globalWorkSize, localWorkSize,
+                           (event != NULL)? event->out() : NULL, args...);
+        }
+
+    private:
+        template <size_t Index>
+        cl_int setArgsFrom() { return CL_SUCCESS; }
+
+        template <size_t Index, typename First, typename... Rest>
+        cl_int setArgsFrom(const First& first, const Rest&... rest)
+        {
+            cl_int err = std::get<Index>(cache).set(kernel.get(), Index, first);
+            if ( err != CL_SUCCESS )
+                return err;
+            return setArgsFrom<Index + 1>(rest...);
+        }
+
+        cl_int checkSignature(const char* name)
+        {
+            cl_uint numArgs = 0;
+            cl_int err = clGetKernelInfo(kernel.get(), CL_KERNEL_NUM_ARGS, sizeof(numArgs), &numArgs, NULL);
+            if ( err != CL_SUCCESS )
+                return err;
+
+            if ( numArgs != sizeof...(Args) )
+            {
+                printf("Kernel %s takes %u arguments but is called with %u\n",
+                       name, numArgs, (cl_uint) sizeof...(Args));
+                return CL_INVALID_KERNEL_ARGS;
+            }
+            return checkTypes<0, Args...>(name);
+        }
+
+        template <size_t Index>
+        cl_int checkTypes(const char*) { return CL_SUCCESS; }
+
+        template <size_t Index, typename First, typename... Rest>
+        cl_int checkTypes(const char* name)
+        {
+#ifdef CL_VERSION_1_2
+            clprobe::InfoString typeName;
+            cl_int err = clprobe::getArgInfo(kernel.get(), Index, CL_KERNEL_ARG_TYPE_NAME, &typeName);
+            // Not built with -cl-kernel-arg-info
+            if ( err == CL_KERNEL_ARG_INFO_NOT_AVAILABLE )
+                return CL_SUCCESS;
+            if ( err != CL_SUCCESS )
+            {
+                printf("Could not get the type of kernel %s argument %u. Error:%d\n",
+                       name, (cl_uint) Index, err);
+                return err;
+            }
+
+            if ( !ArgCache<First>::matches(typeName.get()) )
+            {
+                printf("Kernel %s argument %u is %s which does not match the host type\n",
+                       name, (cl_uint) Index, typeName.get());
+                return CL_INVALID_KERNEL_ARGS;
+            }
+            return checkTypes<Index + 1, Rest...>(name);
+#else
+            (void) name;
+            return CL_SUCCESS;
+#endif
+        }
+
+        Kernel kernel;
+        std::tuple< ArgCache<Args>... > cache;
+};
+
+} // namespace clprobe
+#endif
@@ -0,0 +1,241 @@
+#include <kernelsource.h>
+#include <trace.h>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <sys/stat.h>
+
+/* Load a file into memory, NULL terminated. Sets *size to the file
+*  size in bytes (excluding the terminator).
+*/
+static char* loadFile(const char* path, size_t* size)
+{
+    char* source=0;
+
+    struct stat fileInfo;
+    if( stat(path, &fileInfo) !=  0)
+    {
+        perror("Could not access file");
+        return NULL;
+    }
+
+    /* File size in bytes */
+    off_t fileSize = fileInfo.st_size;
+    if ( fileSize < 1 )
+    {
+        printf("Reported file size of %ld bytes is invalid.\n", (long) fileSize);
+        return NULL;
+    }
+
+    FILE* f = fopen(path,"rb");
+
+    if (f == NULL)
+    {
+        perror("Failed to open file.");
+        return NULL;
+    }
+
+    // Allocated memory for file
+    source = (char*) malloc(  fileSize +
+                            /* For '\0' terminator */ 1);
+
+    if (source == 0)
+    {
+        printf("Could not allocated memory for kernel file.");
+        fclose(f);
+        return NULL;
+    }
+
+    if ( fread(/*ptr*/ source, /* no of bytes */ 1 , fileSize , /*FILE*/ f) != ( (size_t) fileSize) )
+    {
+        printf("Failed to read %s into memory.", path);
+        fclose(f);
+        free(source);
+        return NULL;
+    }
+    fclose(f);
+
+    // Write NULL terminator
+    source[fileSize] = '\0';
+    *size = fileSize;
+
+    return source;
+}
+
+char* loadKernelFromFile(const char* path)
+{
+    size_t size=0;
+    return loadFile(path, &size);
+}
+
+static const EmbeddedKernel* findEmbeddedKernel(const char* name,
+                                                const EmbeddedKernel* embedded,
+                                                size_t numEmbedded)
+{
+    // Only the file name component is significant
+    const char* baseName = strrchr(name, '/');
+    baseName = (baseName == NULL)? name : baseName + 1;
+
+    for (size_t index=0; index < numEmbedded; ++index)
+    {
+        if ( strcmp(embedded[index].name, baseName) == 0 )
+            return &(embedded[index]);
+    }
+
+    return NULL;
+}
+
+static bool hasSuffix(const char* str, const char* suffix)
+{
+    size_t strLength = strlen(str);
+    size_t suffixLength = strlen(suffix);
+    return strLength >= suffixLength &&
+           strcmp(str + strLength - suffixLength, suffix) == 0;
+}
+
+cl_int getKernelSource(const char* name,
+                       const EmbeddedKernel* embedded,
+                       size_t numEmbedded,
+                       KernelSource* kernelSource)
+{
+    TRACE_SCOPE("load kernel source");
+    kernelSource->source = NULL;
+    kernelSource->il = NULL;
+    kernelSource->ilSize = 0;
+    kernelSource->fileBuffer = NULL;
+
+    // A file on disk overrides the embedded copy
+    struct stat fileInfo;
+    if ( stat(name, &fileInfo) == 0 && S_ISREG(fileInfo.st_mode) )
+    {
+        printf("Loading kernel from file %s\n", name);
+        size_t size=0;
+        kernelSource->fileBuffer = loadFile(name, &size);
+        if ( kernelSource->fileBuffer == NULL )
+            return CL_INVALID_VALUE;
+
+        if ( hasSuffix(name, ".spv") )
+        {
+            kernelSource->il = (const unsigned char*) kernelSource->fileBuffer;
+            kernelSource->ilSize = size;
+        }
+        else
+            kernelSource->source = kernelSource->fileBuffer;
+
+        return CL_SUCCESS;
+    }
+
+    const EmbeddedKernel* kernel = findEmbeddedKernel(name, embedded, numEmbedded);
+    if ( kernel == NULL )
+    {
+        printf("%s is not a file or an embedded kernel. Embedded kernels:\n", name);
+        for (size_t index=0; index < numEmbedded; ++index)
+            printf("  %s\n", embedded[index].name);
+
+        return CL_INVALID_VALUE;
+    }
+
+    printf("Using embedded kernel %s%s\n", kernel->name,
+           (kernel->il != NULL)? " (SPIR-V available)" : "");
+    kernelSource->source = (const char*) kernel->data;
+    kernelSource->il = kernel->il;
+    kernelSource->ilSize = kernel->ilSize;
+    return CL_SUCCESS;
+}
+
+void releaseKernelSource(KernelSource* kernelSource)
+{
+    free(kernelSource->fileBuffer);
+    kernelSource->fileBuffer = NULL;
+    kernelSource->source = NULL;
+    kernelSource->il = NULL;
+    kernelSource->ilSize = 0;
+}
+
+#ifdef CL_VERSION_2_1
+/* Returns true if the device can create programs from the (spir64)
+*  SPIR-V modules built by embed_kernels()
+*/
+static bool deviceSupportsSPIRV(cl_device_id device)
+{
+    cl_uint addressBits=0;
+    cl_int err = clGetDeviceInfo(device,
+                                 CL_DEVICE_ADDRESS_BITS,
+                                 sizeof(addressBits),
+                                 &addressBits,
+                                 NULL
+                                );
+    if ( err != CL_SUCCESS || addressBits != 64 )
+        return false;
+
+    // Pre OpenCL 2.1 devices reject this query
+    size_t stringSize=0;
+    err = clGetDeviceInfo(device, CL_DEVICE_IL_VERSION, 0, NULL, &stringSize);
+    if ( err != CL_SUCCESS || stringSize < 1 )
+        return false;
+
+    char* ilVersion = (char*) malloc(stringSize);
+    if ( ilVersion == 0 )
+        return false;
+
+    err = clGetDeviceInfo(device, CL_DEVICE_IL_VERSION, stringSize, ilVersion, NULL);
+    bool supported = ( err == CL_SUCCESS && strstr(ilVersion, "SPIR-V") != NULL );
+    free(ilVersion);
+    return supported;
+}
+#endif
+
+cl_program createProgramFromKernelSource(cl_context context,
+                                         cl_device_id device,
+                                         const KernelSource* kernelSource,
+                                         const char* buildOptions,
+                                         cl_int* err)
+{
+    TRACE_SCOPE("create program");
+    cl_program program=0;
+
+    // The module was compiled with the default macros
+    bool definesMacros = ( buildOptions != NULL && strstr(buildOptions, "-D") != NULL );
+    if ( kernelSource->il != NULL && definesMacros && kernelSource->source != NULL )
+        printf("Build options define macros, not using SPIR-V.\n");
+    else if ( kernelSource->il != NULL )
+    {
+        #ifdef CL_VERSION_2_1
+        if ( deviceSupportsSPIRV(device) )
+        {
+            program = clCreateProgramWithIL(context,
+                                            kernelSource->il,
+                                            kernelSource->ilSize,
+                                            err
+                                           );
+            if ( *err == CL_SUCCESS )
+            {
+                printf("Created program from SPIR-V.\n");
+                return program;
+            }
+
+            printf("Could not create program from SPIR-V:%d\n", *err);
+        }
+        else
+            printf("Device cannot ingest SPIR-V.\n");
+        #else
+        printf("Built without OpenCL 2.1 headers, cannot use SPIR-V.\n");
+        #endif
+    }
+
+    if ( kernelSource->source == NULL )
+    {
+        printf("No OpenCL C source to fall back to.\n");
+        *err = CL_INVALID_BINARY;
+        return 0;
+    }
+
+    const char* source = kernelSource->source;
+    program = clCreateProgramWithSource( context,
+                                         /*number of strings*/ 1,
+                                         &source,
+                                         /* NULL terminated, don't need lengths*/ NULL,
+                                         err
+                                       );
+    return program;
+}
@@ -0,0 +1,89 @@
+#ifndef CLPROBE_KERNELSOURCE_H
+#define CLPROBE_KERNELSOURCE_H
+#include <stddef.h>
+#include <CL/opencl.h>
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*! A kernel file that was compiled into the executable
+ *  (see embed_kernels() in cmake/embedKernels.cmake).
+ */
+typedef struct
+{
+    const char* name; /*!< File name of the kernel (e.g. "add.cl") */
+    const unsigned char* data; /*!< File contents, NULL terminated */
+    size_t size; /*!< Size of data in bytes excluding the NULL terminator */
+    const unsigned char* il; /*!< SPIR-V module. NULL if not built */
+    size_t ilSize; /*!< Size of il in bytes */
+} EmbeddedKernel;
+
+/*! Helper for building an EmbeddedKernel table entry from a header
+ *  generated by embed_kernels(). E.g. EMBEDDED_KERNEL("add.cl", add_cl)
+ */
+#define EMBEDDED_KERNEL(NAME, VAR) { NAME, VAR, VAR ## _size, VAR ## _il, VAR ## _il_size }
+
+/*! The OpenCL C source and/or SPIR-V module of a kernel. */
+typedef struct
+{
+    const char* source; /*!< NULL terminated OpenCL C source or NULL */
+    const unsigned char* il; /*!< SPIR-V module or NULL */
+    size_t ilSize; /*!< Size of il in bytes */
+    char* fileBuffer; /*!< Memory owned by this structure if loaded from a file */
+} KernelSource;
+
+/*! Load the file at \p path into memory. The client is responsible for
+ *  freeing the memory allocated.
+ *
+ *  \returns a NULL terminated string or NULL if the file cannot be read.
+ */
+char* loadKernelFromFile(const char* path);
+
+/*! Get the source of a kernel.
+ *
+ *  If \p name is the path of a readable file then the file is loaded
+ *  (this allows the embedded copy to be overridden). Files ending in ".spv"
+ *  are treated as SPIR-V modules. Otherwise the file name component of
+ *  \p name is looked up in \p embedded.
+ *
+ *  \param[in] name path or file name of the kernel.
+ *  \param[in] embedded table of kernels compiled into the executable.
+ *  \param[in] numEmbedded number of entries in \p embedded.
+ *  \param[out] kernelSource will be filled in. The client must call
+ *              releaseKernelSource() when it is no longer needed.
+ *
+ *  \returns CL_SUCCESS on success.
+ */
+cl_int getKernelSource(const char* name,
+                       const EmbeddedKernel* embedded,
+                       size_t numEmbedded,
+                       KernelSource* kernelSource);
+
+/*! Free any memory held by \p kernelSource. */
+void releaseKernelSource(KernelSource* kernelSource);
+
+/*! Create a program from \p kernelSource for \p device.
+ *
+ *  If a SPIR-V module is available and \p device can ingest it
+ *  (CL_DEVICE_IL_VERSION reports SPIR-V and the device is 64-bit) the
+ *  program is created with clCreateProgramWithIL which skips the OpenCL C
+ *  front-end. Otherwise (or if that fails) the program is created from
+ *  source.
+ *
+ *  \param[in] buildOptions the options the program will be built with, or
+ *             NULL. The embedded SPIR-V was compiled with the default macros
+ *             and clBuildProgram() ignores -D for IL programs, so if these
+ *             define macros the program is created from source.
+ *
+ *  The program still needs to be built with clBuildProgram.
+ */
+cl_program createProgramFromKernelSource(cl_context context,
+                                         cl_device_id device,
+                                         const KernelSource* kernelSource,
+                                         const char* buildOptions,
+                                         cl_int* err);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
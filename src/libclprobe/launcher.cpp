@@ -0,0 +1,194 @@
+#include "launcher.h"
+#include <cstdio>
+#include <map>
+#include <string>
+#include <vector>
+#include <mutex>
+#include <atomic>
+
+/* State owned by one thread */
+struct LauncherThread
+{
+    cl_command_queue queue;
+    std::map<std::string, cl_kernel> kernels;
+};
+
+struct Launcher
+{
+    unsigned long id; /* Unique for the life of the process */
+    cl_context context;
+    cl_device_id device;
+    cl_command_queue_properties properties;
+    std::vector<cl_program> programs; /* Not modified after creation */
+
+    /* Every thread's state so it can be released. Only locked when a thread
+    *  first uses the launcher.
+    */
+    std::mutex threadsMutex;
+    std::vector<LauncherThread*> threads;
+};
+
+static std::atomic<unsigned long> nextLauncherId(1);
+
+/* The calling thread's state for each launcher it has used, keyed by
+*  launcher id so a released launcher's entry is never found again.
+*/
+static thread_local std::map<unsigned long, LauncherThread*> threadStates;
+
+Launcher* createLauncher(cl_context context,
+                         cl_device_id device,
+                         cl_uint numPrograms,
+                         const cl_program* programs,
+                         cl_command_queue_properties properties,
+                         cl_int* err)
+{
+    *err = clRetainContext(context);
+    if ( *err != CL_SUCCESS )
+        return NULL;
+
+    Launcher* launcher = new Launcher();
+    launcher->id = nextLauncherId++;
+    launcher->context = context;
+    launcher->device = device;
+    launcher->properties = properties;
+
+    for (cl_uint index=0; index < numPrograms; ++index)
+    {
+        *err = clRetainProgram(programs[index]);
+        if ( *err != CL_SUCCESS )
+        {
+            releaseLauncher(launcher);
+            return NULL;
+        }
+        launcher->programs.push_back(programs[index]);
+    }
+
+    return launcher;
+}
+
+void releaseLauncher(Launcher* launcher)
+{
+    if ( launcher == NULL )
+        return;
+
+    for (size_t index=0; index < launcher->threads.size(); ++index)
+    {
+        LauncherThread* thread = launcher->threads[index];
+        clFinish(thread->queue);
+        clReleaseCommandQueue(thread->queue);
+
+        std::map<std::string, cl_kernel>::iterator kernel;
+        for (kernel = thread->kernels.begin(); kernel != thread->kernels.end(); ++kernel)
+            clReleaseKernel(kernel->second);
+
+        delete thread;
+    }
+
+    for (size_t index=0; index < launcher->programs.size(); ++index)
+        clReleaseProgram(launcher->programs[index]);
+
+    clReleaseContext(launcher->context);
+    delete launcher;
+}
+
+/* Returns the calling thread's state, creating it on first use */
+static LauncherThread* getLauncherThread(Launcher* launcher, cl_int* err)
+{
+    std::map<unsigned long, LauncherThread*>::iterator state = threadStates.find(launcher->id);
+    if ( state != threadStates.end() )
+    {
+        *err = CL_SUCCESS;
+        return state->second;
+    }
+
+    cl_command_queue queue = clCreateCommandQueue(launcher->context, launcher->device,
+                                                  launcher->properties, err);
+    if ( *err != CL_SUCCESS )
+    {
+        printf("Couldn't create command queue for thread: %d\n", *err);
+        return NULL;
+    }
+
+    LauncherThread* thread = new LauncherThread();
+    thread->queue = queue;
+    {
+        std::lock_guard<std::mutex> lock(launcher->threadsMutex);
+        launcher->threads.push_back(thread);
+    }
+    threadStates[launcher->id] = thread;
+    return thread;
+}
+
+cl_command_queue getThreadQueue(Launcher* launcher)
+{
+    cl_int err;
+    LauncherThread* thread = getLauncherThread(launcher, &err);
+    return ( thread != NULL )? thread->queue : NULL;
+}
+
+/* Returns thread's clone of kernelName, creating it on first use */
+static cl_kernel findThreadKernel(Launcher* launcher, LauncherThread* thread, const char* kernelName, cl_int* err)
+{
+    std::map<std::string, cl_kernel>::iterator found = thread->kernels.find(kernelName);
+    if ( found != thread->kernels.end() )
+    {
+        *err = CL_SUCCESS;
+        return found->second;
+    }
+
+    // clCreateKernel is thread safe so each thread makes its own clone
+    *err = CL_INVALID_KERNEL_NAME;
+    for (size_t index=0; index < launcher->programs.size(); ++index)
+    {
+        cl_kernel kernel = clCreateKernel(launcher->programs[index], kernelName, err);
+        if ( *err == CL_SUCCESS )
+        {
+            thread->kernels[kernelName] = kernel;
+            return kernel;
+        }
+    }
+
+    printf("Could not create kernel %s: %d\n", kernelName, *err);
+    return NULL;
+}
+
+cl_kernel getThreadKernel(Launcher* launcher, const char* kernelName, cl_int* err)
+{
+    LauncherThread* thread = getLauncherThread(launcher, err);
+    if ( thread == NULL )
+        return NULL;
+
+    return findThreadKernel(launcher, thread, kernelName, err);
+}
+
+cl_int launchKernel(Launcher* launcher,
+                    const char* kernelName,
+                    cl_uint numArgs,
+                    const KernelArg* args,
+                    cl_uint workDim,
+                    const size_t* globalWorkSize,
+                    const size_t* localWorkSize,
+                    cl_uint numEventsInWaitList,
+                    const cl_event* eventWaitList,
+                    cl_event* event)
+{
+    cl_int err;
+    LauncherThread* thread = getLauncherThread(launcher, &err);
+    if ( thread == NULL )
+        return err;
+
+    cl_kernel kernel = findThreadKernel(launcher, thread, kernelName, &err);
+    if ( kernel == NULL )
+        return err;
+
+    for (cl_uint index=0; index < numArgs; ++index)
+    {
+        err = clSetKernelArg(kernel, index, args[index].size, args[index].value);
+        if ( err != CL_SUCCESS )
+            return err;
+    }
+
+    return clEnqueueNDRangeKernel(thread->queue, kernel, workDim, NULL,
+                                  globalWorkSize, localWorkSize,
+                                  numEventsInWaitList, eventWaitList, event);
+}
@@ -0,0 +1,76 @@
+#ifndef CLPROBE_LAUNCHER_H
+#define CLPROBE_LAUNCHER_H
+#include <CL/opencl.h>
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*! Launches kernels from many host threads at once.
+ *
+ *  The context and built programs are shared by all threads. Setting
+ *  kernel arguments is not thread safe so every thread gets its own clone
+ *  of each cl_kernel (created on first use) and its own in-order command
+ *  queue. After a thread's first launch of a kernel, launching takes no
+ *  locks. Only a thread's first use of a launcher takes a lock, to
+ *  register its queue.
+ */
+typedef struct Launcher Launcher;
+
+/*! Kernel argument for launchKernel(), as passed to clSetKernelArg(). */
+typedef struct
+{
+    size_t size;
+    const void* value;
+} KernelArg;
+
+/*! Create a launcher for \p device using the already built \p programs.
+ *  The context and programs are retained.
+ *
+ *  \param[in] properties properties of the per thread queues.
+ *
+ *  \returns NULL on failure in which case \p err is set.
+ */
+Launcher* createLauncher(cl_context context,
+                         cl_device_id device,
+                         cl_uint numPrograms,
+                         const cl_program* programs,
+                         cl_command_queue_properties properties,
+                         cl_int* err);
+
+/*! Finish every thread's queue and release all resources. No thread may
+ *  use \p launcher during or after this call.
+ */
+void releaseLauncher(Launcher* launcher);
+
+/*! \returns the calling thread's command queue, creating it on first use
+ *  (or NULL on failure). Use it to enqueue transfers ordered with the
+ *  thread's launches.
+ */
+cl_command_queue getThreadQueue(Launcher* launcher);
+
+/*! \returns the calling thread's clone of \p kernelName, creating it from
+ *  the first program that has it on first use (or NULL on failure). It
+ *  must not be used by other threads.
+ */
+cl_kernel getThreadKernel(Launcher* launcher, const char* kernelName, cl_int* err);
+
+/*! Set the arguments of the calling thread's clone of \p kernelName and
+ *  enqueue it on the calling thread's queue.
+ *
+ *  \returns CL_SUCCESS on success.
+ */
+cl_int launchKernel(Launcher* launcher,
+                    const char* kernelName,
+                    cl_uint numArgs,
+                    const KernelArg* args,
+                    cl_uint workDim,
+                    const size_t* globalWorkSize,
+                    const size_t* localWorkSize,
+                    cl_uint numEventsInWaitList,
+                    const cl_event* eventWaitList,
+                    cl_event* event);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
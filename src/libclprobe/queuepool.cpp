@@ -0,0 +1,123 @@
+#include "queuepool.h"
+#include <cstdio>
+#include <vector>
+
+struct QueuePool
+{
+    std::vector<cl_command_queue> queues;
+    size_t next; /* Index of the queue handed out next */
+    cl_bool outOfOrder;
+};
+
+void releaseQueuePool(QueuePool* pool)
+{
+    if ( pool == NULL )
+        return;
+
+    for (size_t index=0; index < pool->queues.size(); ++index)
+    {
+        clFinish(pool->queues[index]);
+        clReleaseCommandQueue(pool->queues[index]);
+    }
+    delete pool;
+}
+
+QueuePool* createQueuePool(cl_context context,
+                           cl_device_id device,
+                           cl_command_queue_properties properties,
+                           cl_uint numInOrderQueues,
+                           cl_int* err)
+{
+    cl_command_queue_properties supported=0;
+    *err = clGetDeviceInfo(device, CL_DEVICE_QUEUE_PROPERTIES,
+                           sizeof(cl_command_queue_properties), &supported, NULL);
+    if ( *err != CL_SUCCESS )
+    {
+        printf("Could not get CL_DEVICE_QUEUE_PROPERTIES\n");
+        return NULL;
+    }
+
+    QueuePool* pool = new QueuePool();
+    pool->next = 0;
+    pool->outOfOrder = ( supported & CL_QUEUE_OUT_OF_ORDER_EXEC_MODE_ENABLE )? CL_TRUE : CL_FALSE;
+
+    if ( pool->outOfOrder == CL_TRUE )
+    {
+        cl_command_queue queue = clCreateCommandQueue(context, device,
+                                                      properties | CL_QUEUE_OUT_OF_ORDER_EXEC_MODE_ENABLE,
+                                                      err);
+        if ( *err == CL_SUCCESS )
+        {
+            pool->queues.push_back(queue);
+            return pool;
+        }
+
+        // Some drivers report support but still refuse the queue
+        printf("Could not create an out-of-order queue (%d), using in-order queues\n", *err);
+        pool->outOfOrder = CL_FALSE;
+    }
+
+    if ( numInOrderQueues < 1 )
+        numInOrderQueues = 1;
+
+    for (cl_uint index=0; index < numInOrderQueues; ++index)
+    {
+        cl_command_queue queue = clCreateCommandQueue(context, device,
+                                                      properties & ~CL_QUEUE_OUT_OF_ORDER_EXEC_MODE_ENABLE,
+                                                      err);
+        if ( *err != CL_SUCCESS )
+        {
+            printf("Couldn't create command queue.\n");
+            releaseQueuePool(pool);
+            return NULL;
+        }
+        pool->queues.push_back(queue);
+    }
+
+    return pool;
+}
+
+cl_bool isOutOfOrderQueuePool(const QueuePool* pool)
+{
+    return pool->outOfOrder;
+}
+
+cl_uint getQueuePoolSize(const QueuePool* pool)
+{
+    return pool->queues.size();
+}
+
+cl_command_queue getNextQueue(QueuePool* pool)
+{
+    cl_command_queue queue = pool->queues[pool->next];
+    pool->next = (pool->next + 1) % pool->queues.size();
+    return queue;
+}
+
+cl_int flushQueuePool(QueuePool* pool)
+{
+    cl_int err = CL_SUCCESS;
+    for (size_t index=0; index < pool->queues.size(); ++index)
+    {
+        // Every queue is still flushed but the first error is returned
+        cl_int queueErr = clFlush(pool->queues[index]);
+        if ( err == CL_SUCCESS )
+            err = queueErr;
+    }
+
+    return err;
+}
+
+cl_int finishQueuePool(QueuePool* pool)
+{
+    cl_int err = CL_SUCCESS;
+    for (size_t index=0; index < pool->queues.size(); ++index)
+    {
+        // Every queue is still finished but the first error is returned
+        cl_int queueErr = clFinish(pool->queues[index]);
+        if ( err == CL_SUCCESS )
+            err = queueErr;
+    }
+
+    return err;
+}
@@ -0,0 +1,60 @@
+#ifndef CLPROBE_QUEUEPOOL_H
+#define CLPROBE_QUEUEPOOL_H
+#include <CL/opencl.h>
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*! Command queues for running independent batches of commands
+ *  concurrently.
+ *
+ *  If the device supports CL_QUEUE_OUT_OF_ORDER_EXEC_MODE_ENABLE the pool
+ *  holds a single out-of-order queue. Otherwise it holds several in-order
+ *  queues handed out round-robin. Either way, commands within a batch must
+ *  be ordered with explicit event dependencies. The runtime is then free
+ *  to overlap the transfers and kernels of different batches.
+ */
+typedef struct QueuePool QueuePool;
+
+/*! Create a queue pool for \p device.
+ *
+ *  \param[in] properties extra queue properties (e.g. CL_QUEUE_PROFILING_ENABLE).
+ *  \param[in] numInOrderQueues number of in-order queues to create if the
+ *             device does not support out-of-order execution.
+ *
+ *  \returns NULL on failure in which case \p err is set.
+ */
+QueuePool* createQueuePool(cl_context context,
+                           cl_device_id device,
+                           cl_command_queue_properties properties,
+                           cl_uint numInOrderQueues,
+                           cl_int* err);
+
+/*! Finish and release all queues then free \p pool. */
+void releaseQueuePool(QueuePool* pool);
+
+/*! \returns CL_TRUE if \p pool uses an out-of-order queue. */
+cl_bool isOutOfOrderQueuePool(const QueuePool* pool);
+
+/*! \returns the number of queues in \p pool. */
+cl_uint getQueuePoolSize(const QueuePool* pool);
+
+/*! \returns the queue to use for the next batch of commands. */
+cl_command_queue getNextQueue(QueuePool* pool);
+
+/*! Flush every queue so their commands start.
+ *
+ *  \returns CL_SUCCESS or the first error returned by clFlush().
+ */
+cl_int flushQueuePool(QueuePool* pool);
+
+/*! Wait for every command on every queue to complete.
+ *
+ *  \returns CL_SUCCESS or the first error returned by clFinish().
+ */
+cl_int finishQueuePool(QueuePool* pool);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -0,0 +1,62 @@
+#include <recordfile.h>
+#include <cstring>
+#include <cerrno>
+
+cl_int openRecordReader(RecordReader* reader, const char* path)
+{
+    reader->file = fopen(path, "r");
+    reader->line[0] = '\0';
+    reader->savePtr = 0;
+    reader->started = CL_FALSE;
+    if ( reader->file == NULL )
+    {
+        printf("Could not open %s: %s\n", path, strerror(errno));
+        return CL_INVALID_VALUE;
+    }
+
+    return CL_SUCCESS;
+}
+
+cl_bool nextRecord(RecordReader* reader)
+{
+    if ( fgets(reader->line, sizeof(reader->line), reader->file) == NULL )
+        return CL_FALSE;
+
+    reader->line[strcspn(reader->line, "\n")] = '\0';
+    reader->savePtr = 0;
+    reader->started = CL_FALSE;
+    return CL_TRUE;
+}
+
+cl_bool nextRecordField(RecordReader* reader, const char** key, const char** value)
+{
+    while ( true )
+    {
+        char* field = strtok_r(reader->started? NULL : reader->line, "\t", &(reader->savePtr));
+        reader->started = CL_TRUE;
+        if ( field == NULL )
+            return CL_FALSE;
+
+        char* separator = strchr(field, '=');
+        if ( separator == NULL )
+            continue;
+
+        *separator = '\0';
+        *key = field;
+        *value = separator + 1;
+        return CL_TRUE;
+    }
+}
+
+void closeRecordReader(RecordReader* reader)
+{
+    if ( reader->file != NULL )
+        fclose(reader->file);
+    reader->file = NULL;
+}
+
+void sanitizeRecordValue(char* str)
+{
+    for (char* c = str; *c != '\0'; ++c)
+        if ( *c == '\t' || *c == '\n' ) *c = ' ';
+}
@@ -0,0 +1,65 @@
+#ifndef CLPROBE_RECORDFILE_H
+#define CLPROBE_RECORDFILE_H
+#include <stdio.h>
+#include <CL/opencl.h>
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*! Reader for the record files used by the device peaks file (see
+ *  devicepeaks.h) and the results store (see resultstore.h). Each line is
+ *  one record of tab separated key=value fields.
+ *
+ *  \code
+ *  RecordReader reader;
+ *  if ( openRecordReader(&reader, path) == CL_SUCCESS )
+ *  {
+ *      while ( nextRecord(&reader) )
+ *      {
+ *          const char* key; const char* value;
+ *          while ( nextRecordField(&reader, &key, &value) )
+ *              ...
+ *      }
+ *      closeRecordReader(&reader);
+ *  }
+ *  \endcode
+ */
+typedef struct
+{
+    FILE* file;
+    char line[4096]; /*!< Current record, split in place */
+    char* savePtr; /*!< strtok_r() state */
+    cl_bool started; /*!< CL_TRUE once a field of line has been read */
+} RecordReader;
+
+/*! Open the file at \p path for reading.
+ *
+ *  \returns CL_SUCCESS on success.
+ */
+cl_int openRecordReader(RecordReader* reader, const char* path);
+
+/*! Read the next record.
+ *
+ *  \returns CL_FALSE at the end of the file.
+ */
+cl_bool nextRecord(RecordReader* reader);
+
+/*! Get the next key=value field of the current record. Fields without an
+ *  '=' are skipped. \p key and \p value are valid until the next call to
+ *  nextRecord().
+ *
+ *  \returns CL_FALSE when the record has no more fields.
+ */
+cl_bool nextRecordField(RecordReader* reader, const char** key, const char** value);
+
+void closeRecordReader(RecordReader* reader);
+
+/*! Replace the tabs and new lines in \p str, which separate fields and
+ *  records, with spaces so it can be written as a value.
+ */
+void sanitizeRecordValue(char* str);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
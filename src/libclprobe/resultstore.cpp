@@ -0,0 +1,243 @@
+#include <resultstore.h>
+#include <recordfile.h>
+#include <infoquery.h>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <ctime>
+
+using clprobe::InfoString;
+
+const char* getBenchmarkRunId(void)
+{
+    static char runId[64] = "";
+    if ( runId[0] != '\0' )
+        return runId;
+
+    const char* label = getenv("CLPROBE_RUN_ID");
+    if ( label != NULL && label[0] != '\0' )
+    {
+        snprintf(runId, sizeof(runId), "%s", label);
+    }
+    else
+    {
+        time_t now = time(NULL);
+        struct tm utc;
+        gmtime_r(&now, &utc);
+        strftime(runId, sizeof(runId), "%Y-%m-%dT%H:%M:%SZ", &utc);
+    }
+
+    sanitizeRecordValue(runId);
+    return runId;
+}
+
+/* Copy src to the field dst of size bytes, replacing the separators */
+static void copyField(char* dst, size_t size, const char* src)
+{
+    snprintf(dst, size, "%s", src);
+    sanitizeRecordValue(dst);
+}
+
+cl_int appendBenchmarkResult(const char* path,
+                             cl_device_id device,
+                             const char* benchmark,
+                             const char* variant,
+                             cl_ulong size,
+                             const double* seconds,
+                             cl_uint numSamples)
+{
+    if ( numSamples < 1 )
+        return CL_INVALID_VALUE;
+
+    InfoString deviceName;
+    InfoString driverVersion;
+    if ( clprobe::getInfo(device, CL_DEVICE_NAME, &deviceName) != CL_SUCCESS ||
+         clprobe::getInfo(device, CL_DRIVER_VERSION, &driverVersion) != CL_SUCCESS )
+    {
+        printf("Could not get device name or driver version\n");
+        return CL_INVALID_DEVICE;
+    }
+
+    BenchmarkResult result;
+    memset(&result, 0, sizeof(result));
+    copyField(result.run, sizeof(result.run), getBenchmarkRunId());
+    copyField(result.device, sizeof(result.device), deviceName.get());
+    copyField(result.driver, sizeof(result.driver), driverVersion.get());
+    copyField(result.benchmark, sizeof(result.benchmark), benchmark);
+    copyField(result.variant, sizeof(result.variant), variant);
+    result.size = size;
+    result.samples = numSamples;
+
+    result.min = seconds[0];
+    for (cl_uint index=0; index < numSamples; ++index)
+    {
+        result.mean += seconds[index];
+        if ( seconds[index] < result.min ) result.min = seconds[index];
+    }
+    result.mean /= numSamples;
+
+    for (cl_uint index=0; index < numSamples; ++index)
+        result.stddev += (seconds[index] - result.mean) * (seconds[index] - result.mean);
+    result.stddev = ( numSamples > 1 )? sqrt(result.stddev / (numSamples - 1)) : 0.0;
+
+    FILE* f = fopen(path, "a");
+    if ( f == NULL )
+    {
+        perror("Could not open results file");
+        return CL_INVALID_VALUE;
+    }
+
+    fprintf(f, "run=%s\tdevice=%s\tdriver=%s\tbenchmark=%s\tvariant=%s\tsize=%llu"
+               "\tsamples=%u\tmean=%.9g\tstddev=%.9g\tmin=%.9g\n",
+            result.run, result.device, result.driver, result.benchmark, result.variant,
+            (unsigned long long) result.size, result.samples, result.mean, result.stddev, result.min);
+    fclose(f);
+    return CL_SUCCESS;
+}
+
+cl_int loadBenchmarkResults(const char* path, BenchmarkResult** results, cl_uint* numResults)
+{
+    *results = NULL;
+    *numResults = 0;
+
+    RecordReader reader;
+    if ( openRecordReader(&reader, path) != CL_SUCCESS )
+        return CL_INVALID_VALUE;
+
+    cl_uint capacity=0;
+    while ( nextRecord(&reader) )
+    {
+        BenchmarkResult result;
+        memset(&result, 0, sizeof(result));
+
+        const char* field=0;
+        const char* value=0;
+        while ( nextRecordField(&reader, &field, &value) )
+        {
+            #define STRING_FIELD(NAME) \
+                if ( strcmp(field, #NAME) == 0 ) copyField(result.NAME, sizeof(result.NAME), value)
+            STRING_FIELD(run);
+            else STRING_FIELD(device);
+            else STRING_FIELD(driver);
+            else STRING_FIELD(benchmark);
+            else STRING_FIELD(variant);
+            else if ( strcmp(field, "size") == 0 ) result.size = strtoull(value, NULL, 10);
+            else if ( strcmp(field, "samples") == 0 ) result.samples = strtoul(value, NULL, 10);
+            else if ( strcmp(field, "mean") == 0 ) result.mean = atof(value);
+            else if ( strcmp(field, "stddev") == 0 ) result.stddev = atof(value);
+            else if ( strcmp(field, "min") == 0 ) result.min = atof(value);
+            #undef STRING_FIELD
+        }
+
+        // Skip lines that are not benchmark results
+        if ( result.benchmark[0] == '\0' || result.samples == 0 )
+            continue;
+
+        if ( *numResults == capacity )
+        {
+            capacity = ( capacity == 0 )? 64 : 2 * capacity;
+            BenchmarkResult* grown = (BenchmarkResult*) realloc(*results, sizeof(BenchmarkResult) * capacity);
+            if ( grown == NULL )
+            {
+                printf("Failed to malloc\n");
+                free(*results);
+                *results = NULL;
+                *numResults = 0;
+                closeRecordReader(&reader);
+                return CL_OUT_OF_HOST_MEMORY;
+            }
+            *results = grown;
+        }
+        (*results)[(*numResults)++] = result;
+    }
+
+    closeRecordReader(&reader);
+    return CL_SUCCESS;
+}
+
+/* Continued fraction of the incomplete beta function (modified Lentz) */
+static double betaContinuedFraction(double a, double b, double x)
+{
+    const int maxIterations=300;
+    const double epsilon=1.0e-12;
+    const double tiny=1.0e-300;
+
+    double c = 1.0;
+    double d = 1.0 - (a + b) * x / (a + 1.0);
+    if ( fabs(d) < tiny ) d = tiny;
+    d = 1.0 / d;
+    double h = d;
+    for (int m=1; m <= maxIterations; ++m)
+    {
+        // Even then odd step of the fraction
+        double aa = m * (b - m) * x / ((a + 2 * m - 1.0) * (a + 2 * m));
+        d = 1.0 + aa * d;
+        if ( fabs(d) < tiny ) d = tiny;
+        c = 1.0 + aa / c;
+        if ( fabs(c) < tiny ) c = tiny;
+        d = 1.0 / d;
+        h *= d * c;
+
+        aa = -(a + m) * (a + b + m) * x / ((a + 2 * m) * (a + 2 * m + 1.0));
+        d = 1.0 + aa * d;
+        if ( fabs(d) < tiny ) d = tiny;
+        c = 1.0 + aa / c;
+        if ( fabs(c) < tiny ) c = tiny;
+        d = 1.0 / d;
+        double delta = d * c;
+        h *= delta;
+        if ( fabs(delta - 1.0) < epsilon )
+            break;
+    }
+    return h;
+}
+
+/* Regularized incomplete beta function I_x(a, b) */
+static double incompleteBeta(double a, double b, double x)
+{
+    if ( x <= 0.0 ) return 0.0;
+    if ( x >= 1.0 ) return 1.0;
+
+    double front = exp(lgamma(a + b) - lgamma(a) - lgamma(b) + a * log(x) + b * log(1.0 - x));
+    if ( x < (a + 1.0) / (a + b + 2.0) )
+        return front * betaContinuedFraction(a, b, x) / a;
+    return 1.0 - front * betaContinuedFraction(b, a, 1.0 - x) / b;
+}
+
+/* P(T >= t) for Student's t distribution with df degrees of freedom */
+static double studentTUpperTail(double t, double df)
+{
+    double tail = 0.5 * incompleteBeta(0.5 * df, 0.5, df / (df + t * t));
+    return ( t > 0.0 )? tail : 1.0 - tail;
+}
+
+double compareBenchmarkResults(const BenchmarkResult* baseline,
+                               const BenchmarkResult* candidate,
+                               double* pValue)
+{
+    double change = ( baseline->mean > 0.0 )? (candidate->mean - baseline->mean) / baseline->mean : 0.0;
+
+    if ( baseline->samples < 2 || candidate->samples < 2 )
+    {
+        *pValue = -1.0;
+        return change;
+    }
+
+    // Welch's t-test, the variances of the runs need not be equal
+    double baselineVar = baseline->stddev * baseline->stddev / baseline->samples;
+    double candidateVar = candidate->stddev * candidate->stddev / candidate->samples;
+    double standardError2 = baselineVar + candidateVar;
+    if ( standardError2 <= 0.0 )
+    {
+        *pValue = ( candidate->mean > baseline->mean )? 0.0 : 1.0;
+        return change;
+    }
+
+    double t = (candidate->mean - baseline->mean) / sqrt(standardError2);
+    double df = standardError2 * standardError2 /
+                ( baselineVar * baselineVar / (baseline->samples - 1) +
+                  candidateVar * candidateVar / (candidate->samples - 1) );
+    *pValue = studentTUpperTail(t, df);
+    return change;
+}
@@ -0,0 +1,76 @@
+#ifndef CLPROBE_RESULTSTORE_H
+#define CLPROBE_RESULTSTORE_H
+#include <CL/opencl.h>
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*! Benchmark results store.
+ *
+ *  Benchmarks append a summary of their timed repetitions to a results
+ *  file, one line per configuration in the same tab separated key=value
+ *  format as the device peaks file (see devicepeaks.h). Lines are keyed by
+ *  run, device, driver version, benchmark, variant and size so results of
+ *  different driver versions can be compared with perf_compare.
+ */
+
+/*! Summary of the timed repetitions of one benchmark configuration. */
+typedef struct
+{
+    char run[64]; /*!< Run id, see getBenchmarkRunId() */
+    char device[256]; /*!< CL_DEVICE_NAME */
+    char driver[256]; /*!< CL_DRIVER_VERSION */
+    char benchmark[64]; /*!< Program, e.g. histogram */
+    char variant[64]; /*!< Kernel or mode within the benchmark */
+    cl_ulong size; /*!< Problem size, normally in elements */
+    cl_uint samples; /*!< Number of timed repetitions */
+    double mean; /*!< Mean time in seconds */
+    double stddev; /*!< Sample standard deviation in seconds */
+    double min; /*!< Best time in seconds */
+} BenchmarkResult;
+
+/*! \returns the id of this run: $CLPROBE_RUN_ID if it is set (to label
+ *  runs of several benchmarks, e.g. by driver), otherwise the UTC time of
+ *  the first call. The same for the whole process.
+ */
+const char* getBenchmarkRunId(void);
+
+/*! Append the summary of \p numSamples times (in seconds) of \p variant
+ *  of \p benchmark on \p device with problem size \p size to the file at
+ *  \p path.
+ *
+ *  \returns CL_SUCCESS on success.
+ */
+cl_int appendBenchmarkResult(const char* path,
+                             cl_device_id device,
+                             const char* benchmark,
+                             const char* variant,
+                             cl_ulong size,
+                             const double* seconds,
+                             cl_uint numSamples);
+
+/*! Load all the results in the file at \p path in file order. If
+ *  Successful the client is responsible for freeing \p results.
+ *
+ *  \returns CL_SUCCESS on success.
+ */
+cl_int loadBenchmarkResults(const char* path, BenchmarkResult** results, cl_uint* numResults);
+
+/*! Compare \p candidate against \p baseline with a one sided Welch's
+ *  t-test.
+ *
+ *  \param[out] pValue will be set to the probability of \p candidate's
+ *         mean being at least as slow if the true times were equal, or to
+ *         -1 if either has fewer than two samples.
+ *
+ *  \returns the relative change of the mean time, positive if
+ *  \p candidate is slower.
+ */
+double compareBenchmarkResults(const BenchmarkResult* baseline,
+                               const BenchmarkResult* candidate,
+                               double* pValue);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -0,0 +1,36 @@
+#include <timing.h>
+#include <time.h>
+
+double getHostTime(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec * 1.0e-9;
+}
+
+cl_int getEventDuration(cl_event event, double* seconds)
+{
+    cl_ulong start=0;
+    cl_ulong end=0;
+    cl_int err = clGetEventProfilingInfo( event,
+                                          CL_PROFILING_COMMAND_START,
+                                          sizeof(cl_ulong),
+                                          &start,
+                                          NULL
+                                        );
+    if ( err != CL_SUCCESS )
+        return err;
+
+    err = clGetEventProfilingInfo( event,
+                                   CL_PROFILING_COMMAND_END,
+                                   sizeof(cl_ulong),
+                                   &end,
+                                   NULL
+                                 );
+    if ( err != CL_SUCCESS )
+        return err;
+
+    /* Profiling counters are in nanoseconds */
+    *seconds = (end - start) * 1.0e-9;
+    return CL_SUCCESS;
+}
@@ -0,0 +1,24 @@
+#ifndef CLPROBE_TIMING_H
+#define CLPROBE_TIMING_H
+#include <CL/opencl.h>
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*! \returns the time in seconds from a monotonic host clock. */
+double getHostTime(void);
+
+/*! Get the time \p event spent executing on the device
+ *  (CL_PROFILING_COMMAND_END - CL_PROFILING_COMMAND_START).
+ *  The event's queue must have been created with CL_QUEUE_PROFILING_ENABLE.
+ *
+ *  \param[out] seconds set to the execution time in seconds.
+ *
+ *  \returns CL_SUCCESS on success.
+ */
+cl_int getEventDuration(cl_event event, double* seconds);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -0,0 +1,193 @@
+#include "trace.h"
+
+#ifdef CLPROBE_TRACING
+#include "timing.h"
+#include <cstdio>
+#include <vector>
+#include <mutex>
+
+namespace
+{
+    /* A completed host span or an open one (end < 0) */
+    struct HostSpan
+    {
+        const char* name;
+        double begin; /* Host time in seconds */
+        double end;
+    };
+
+    struct DeviceSpan
+    {
+        const char* name;
+        cl_event event;
+        double recorded; /* Host time when recorded */
+    };
+
+    struct ThreadTrace
+    {
+        unsigned int id;
+        std::vector<HostSpan> spans;
+        std::vector<size_t> open; /* Indices of spans without an end */
+    };
+
+    /* Only locked when a thread records its first span, when a device
+    *  event is recorded and when the trace is written.
+    */
+    std::mutex traceMutex;
+    std::vector<ThreadTrace*> threadTraces;
+    std::vector<DeviceSpan> deviceSpans;
+
+    ThreadTrace* getThreadTrace()
+    {
+        static thread_local ThreadTrace* trace = 0;
+        if ( trace == 0 )
+        {
+            trace = new ThreadTrace();
+            trace->spans.reserve(1024);
+            std::lock_guard<std::mutex> lock(traceMutex);
+            trace->id = threadTraces.size() + 1;
+            threadTraces.push_back(trace);
+        }
+        return trace;
+    }
+
+    /* JSON string without escaping. Span names are literals chosen by us */
+    void writeEvent(FILE* file, bool* first, const char* name, unsigned int tid, double begin, double end)
+    {
+        fprintf(file, "%s\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}",
+                (*first)? "" : ",", name, tid, begin * 1.0e6, (end - begin) * 1.0e6);
+        *first = false;
+    }
+
+    void writeThreadName(FILE* file, bool* first, unsigned int tid, const char* name)
+    {
+        fprintf(file, "%s\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":\"%s\"}}",
+                (*first)? "" : ",", tid, name);
+        *first = false;
+    }
+}
+
+void traceBegin(const char* name)
+{
+    ThreadTrace* trace = getThreadTrace();
+    HostSpan span = { name, getHostTime(), -1.0 };
+    trace->open.push_back(trace->spans.size());
+    trace->spans.push_back(span);
+}
+
+void traceEnd(void)
+{
+    ThreadTrace* trace = getThreadTrace();
+    if ( trace->open.empty() )
+        return;
+
+    trace->spans[trace->open.back()].end = getHostTime();
+    trace->open.pop_back();
+}
+
+void traceDeviceEvent(const char* name, cl_event event)
+{
+    if ( event == 0 || clRetainEvent(event) != CL_SUCCESS )
+        return;
+
+    DeviceSpan span = { name, event, getHostTime() };
+    std::lock_guard<std::mutex> lock(traceMutex);
+    deviceSpans.push_back(span);
+}
+
+cl_int traceWrite(const char* path)
+{
+    FILE* file = fopen(path, "w");
+    if ( file == NULL )
+    {
+        printf("Could not open trace file %s\n", path);
+        return CL_INVALID_VALUE;
+    }
+
+    std::lock_guard<std::mutex> lock(traceMutex);
+    bool first = true;
+    fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+
+    /* Host spans. Spans still open are not written */
+    for (size_t index=0; index < threadTraces.size(); ++index)
+    {
+        ThreadTrace* trace = threadTraces[index];
+        char threadName[32];
+        snprintf(threadName, sizeof(threadName), "host thread %u", trace->id);
+        writeThreadName(file, &first, trace->id, threadName);
+
+        for (size_t span=0; span < trace->spans.size(); ++span)
+        {
+            if ( trace->spans[span].end >= 0.0 )
+                writeEvent(file, &first, trace->spans[span].name, trace->id,
+                           trace->spans[span].begin, trace->spans[span].end);
+        }
+
+        // Only the open spans are kept, in the order they were begun
+        std::vector<HostSpan> stillOpen;
+        for (size_t open=0; open < trace->open.size(); ++open)
+        {
+            stillOpen.push_back(trace->spans[trace->open[open]]);
+            trace->open[open] = open;
+        }
+        trace->spans.clear();
+        trace->spans.insert(trace->spans.end(), stillOpen.begin(), stillOpen.end());
+    }
+
+    /* Device commands go on their own track (tid 0). Commands that have
+    *  not completed yet are kept for the next write, commands that lack
+    *  profiling info are skipped.
+    */
+    writeThreadName(file, &first, 0, "device");
+    cl_uint skipped=0;
+    std::vector<DeviceSpan> pending;
+    for (size_t index=0; index < deviceSpans.size(); ++index)
+    {
+        cl_int status=CL_COMPLETE;
+        cl_int err = clGetEventInfo(deviceSpans[index].event, CL_EVENT_COMMAND_EXECUTION_STATUS,
+                                    sizeof(cl_int), &status, NULL);
+        if ( err == CL_SUCCESS && status > CL_COMPLETE )
+        {
+            pending.push_back(deviceSpans[index]);
+            continue;
+        }
+
+        cl_ulong queued=0, start=0, end=0;
+        if ( err == CL_SUCCESS )
+            err = clGetEventProfilingInfo(deviceSpans[index].event, CL_PROFILING_COMMAND_QUEUED,
+                                          sizeof(cl_ulong), &queued, NULL);
+        if ( err == CL_SUCCESS )
+            err = clGetEventProfilingInfo(deviceSpans[index].event, CL_PROFILING_COMMAND_START,
+                                          sizeof(cl_ulong), &start, NULL);
+        if ( err == CL_SUCCESS )
+            err = clGetEventProfilingInfo(deviceSpans[index].event, CL_PROFILING_COMMAND_END,
+                                          sizeof(cl_ulong), &end, NULL);
+        if ( err != CL_SUCCESS || start < queued || end < start )
+        {
+            ++skipped;
+            continue;
+        }
+
+        double begin = deviceSpans[index].recorded + (start - queued) * 1.0e-9;
+        writeEvent(file, &first, deviceSpans[index].name, 0, begin, begin + (end - start) * 1.0e-9);
+    }
+
+    fprintf(file, "\n]}\n");
+    fclose(file);
+
+    // Written (or skipped) device commands are not needed any more
+    for (size_t index=0, kept=0; index < deviceSpans.size(); ++index)
+    {
+        if ( kept < pending.size() && pending[kept].event == deviceSpans[index].event )
+            ++kept;
+        else
+            clReleaseEvent(deviceSpans[index].event);
+    }
+    deviceSpans.swap(pending);
+
+    if ( skipped != 0 )
+        printf("Skipped %u device events without profiling info\n", skipped);
+    printf("Trace written to %s\n", path);
+    return CL_SUCCESS;
+}
+#endif
@@ -0,0 +1,75 @@
+#ifndef CLPROBE_TRACE_H
+#define CLPROBE_TRACE_H
+#include <CL/opencl.h>
+
+/*! Tracing of host side spans and device commands written as Chrome
+ *  trace_event JSON (load it in chrome://tracing or ui.perfetto.dev).
+ *
+ *  Tracing is only compiled in when CLPROBE_TRACING is defined (cmake
+ *  -DENABLE_TRACING=ON). Otherwise every macro below expands to nothing.
+ *
+ *  Spans are appended to a per thread buffer so recording takes no locks.
+ *  Device commands are recorded from their cl_event, which must come from
+ *  a queue with CL_QUEUE_PROFILING_ENABLE. Their profiling timestamps are
+ *  moved onto the host timeline when the trace is written, using the host
+ *  time at which the command was recorded as its CL_PROFILING_COMMAND_QUEUED
+ *  time, so record them straight after enqueueing.
+ *
+ *  TRACE_SCOPE(name)              Span from here to the end of the scope
+ *  TRACE_BEGIN(name) / TRACE_END() Span between two points in one thread
+ *  TRACE_DEVICE_EVENT(name, event) Device command (the event is retained)
+ *  TRACE_WRITE(path)              Write everything recorded so far and
+ *                                 forget it, so a later write only has
+ *                                 newer spans. Open spans and commands
+ *                                 that have not completed are kept for
+ *                                 the next write. No other thread may be
+ *                                 recording spans.
+ *
+ *  name must be a string that outlives the trace (e.g. a literal).
+ */
+
+#ifdef CLPROBE_TRACING
+#define CLPROBE_TRACING_ENABLED 1
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void traceBegin(const char* name);
+void traceEnd(void);
+void traceDeviceEvent(const char* name, cl_event event);
+
+/*! \returns CL_SUCCESS on success. */
+cl_int traceWrite(const char* path);
+
+#ifdef __cplusplus
+}
+
+/* Ends the span when it goes out of scope */
+class TraceScope
+{
+    public:
+    TraceScope(const char* name) { traceBegin(name); }
+    ~TraceScope() { traceEnd(); }
+};
+#endif
+
+#define TRACE_CONCAT_(A, B) A ## B
+#define TRACE_CONCAT(A, B) TRACE_CONCAT_(A, B)
+#define TRACE_SCOPE(NAME) TraceScope TRACE_CONCAT(traceScope, __LINE__)(NAME)
+#define TRACE_BEGIN(NAME) traceBegin(NAME)
+#define TRACE_END() traceEnd()
+#define TRACE_DEVICE_EVENT(NAME, EVENT) traceDeviceEvent((NAME), (EVENT))
+#define TRACE_WRITE(PATH) traceWrite(PATH)
+
+#else
+#define CLPROBE_TRACING_ENABLED 0
+
+#define TRACE_SCOPE(NAME)
+#define TRACE_BEGIN(NAME) do { } while (0)
+#define TRACE_END() do { } while (0)
+#define TRACE_DEVICE_EVENT(NAME, EVENT) do { } while (0)
+#define TRACE_WRITE(PATH) ((void) (PATH))
+#endif
+
+#endif
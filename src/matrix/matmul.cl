@@ -0,0 +1,93 @@
+// Single precision matrix multiply C = A * B of row major matrices where
+// A is M x K, B is K x N and C is M x N.
+//
+// Build options:
+//   -DTILE=T  Edge of the square tiles of A and B held in local memory
+//   -DWPT=W   Rows of C computed by each work item (register blocking).
+//             Must divide TILE.
+//
+// matmul_tiled must be run with a local size of (TILE, TILE / WPT) and a
+// global size of (N, M / WPT) rounded up to multiples of it.
+
+#ifndef TILE
+#define TILE 16
+#endif
+
+#ifndef WPT
+#define WPT 4
+#endif
+
+// Work items per tile in dimension 1
+#define RTS (TILE / WPT)
+
+// Reference version, one work item per element of C
+__kernel void matmul_naive(uint M,
+                           uint N,
+                           uint K,
+                           __global const float* A,
+                           __global const float* B,
+                           __global float* C)
+{
+    size_t col = get_global_id(0);
+    size_t row = get_global_id(1);
+    if ( row >= M || col >= N )
+        return;
+
+    float acc = 0.0f;
+    for (uint k=0; k < K; ++k)
+        acc += A[row * K + k] * B[k * N + col];
+
+    C[row * N + col] = acc;
+}
+
+__kernel void matmul_tiled(uint M,
+                           uint N,
+                           uint K,
+                           __global const float* A,
+                           __global const float* B,
+                           __global float* C)
+{
+    size_t localCol = get_local_id(0);
+    size_t localRow = get_local_id(1);
+    size_t tileRow = get_group_id(1) * TILE;
+    size_t col = get_group_id(0) * TILE + localCol;
+
+    // A is padded by a column to avoid bank conflicts
+    __local float Asub[TILE][TILE + 1];
+    __local float Bsub[TILE][TILE];
+
+    float acc[WPT];
+    for (int w=0; w < WPT; ++w)
+        acc[w] = 0.0f;
+
+    for (uint t=0; t < K; t += TILE)
+    {
+        // Each work item loads WPT elements of each tile. Elements outside
+        // the matrices are zero so they do not change the result.
+        for (int w=0; w < WPT; ++w)
+        {
+            size_t r = localRow + w * RTS;
+            size_t aRow = tileRow + r;
+            size_t aCol = t + localCol;
+            size_t bRow = t + r;
+            Asub[r][localCol] = ( aRow < M && aCol < K )? A[aRow * K + aCol] : 0.0f;
+            Bsub[r][localCol] = ( bRow < K && col < N )? B[bRow * N + col] : 0.0f;
+        }
+        barrier(CLK_LOCAL_MEM_FENCE);
+
+        for (int k=0; k < TILE; ++k)
+        {
+            float b = Bsub[k][localCol];
+            for (int w=0; w < WPT; ++w)
+                acc[w] += Asub[localRow + w * RTS][k] * b;
+        }
+        barrier(CLK_LOCAL_MEM_FENCE);
+    }
+
+    for (int w=0; w < WPT; ++w)
+    {
+        size_t row = tileRow + localRow + w * RTS;
+        if ( row < M && col < N )
+            C[row * N + col] = acc[w];
+    }
+}
@@ -0,0 +1,594 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <assert.h>
+#include <string.h>
+#include <math.h>
+#include <getopt.h>
+#include <CL/opencl.h>
+#include <libclprobe/clprobe.h>
+#include <libclprobe/driverutil.h>
+#include <libclprobe/kernelsource.h>
+#include <libclprobe/buildmanager.h>
+#include <libclprobe/timing.h>
+#include <libclprobe/devicepeaks.h>
+#include <libclprobe/resultstore.h>
+#include <vector>
+#include "matmul.cl.h"
+#include "transpose.cl.h"
+
+/* Kernels compiled into the executable */
+static const EmbeddedKernel embeddedKernels[] =
+{
+    EMBEDDED_KERNEL("matmul.cl", matmul_cl),
+    EMBEDDED_KERNEL("transpose.cl", transpose_cl)
+};
+
+void usage(const char* progName)
+{
+    printf("Usage: %s [options] matmul <M> <N> <K>\n", progName);
+    printf("       %s [options] transpose <rows> <cols>\n\n", progName);
+    printf("Runs a naive and a tiled 2-D kernel, checks them against the host and\n"
+           "reports their performance.\n\n"
+           "Options:\n"
+           "  --tile <n>         Tile edge (default: the largest of 32, 16, 8, ...\n"
+           "                     the device allows)\n"
+           "  --wpt <n>          Rows per work item for register blocking (default 4)\n"
+           "  --repetitions <n>  Number of timed runs, the best is reported (default 5)\n"
+           "  --peaks <file>     Device peaks measured by device_benchmark used for the\n"
+           "                     roofline report (default: estimate from device info)\n"
+           "  --results <file>   Append the times to a results file for perf_compare\n"
+           "  --kernel <file>    Override the embedded matmul.cl or transpose.cl\n");
+    exit(1);
+}
+
+void cleanUp();
+
+//Global for clean up convenience
+KernelSource kernelSource;
+BuildManager* buildManager=0;
+cl_program program=0;
+cl_context context=0;
+cl_command_queue cmdQueue=0;
+cl_kernel naiveKernel=0;
+cl_kernel tiledKernel=0;
+cl_mem inputABuffer=0;
+cl_mem inputBBuffer=0;
+cl_mem outputBuffer=0;
+float* hostA=0;
+float* hostB=0;
+float* copiedBack=0;
+size_t* maxWorkItemSizes=0;
+
+static size_t roundUp(size_t value, size_t multiple)
+{
+    return ( (value + multiple -1) / multiple ) * multiple;
+}
+
+/* Largest power of two tile edge (up to 32) that fits the device's work
+*  item sizes, work group size and local memory. Returns 0 if none does.
+*/
+static cl_uint pickTile(cl_device_id device, cl_uint requestedTile, cl_uint wpt, cl_uint numDims)
+{
+    size_t maxWorkGroupSize=0;
+    cl_ulong localMemSize=0;
+    cl_int err = clGetDeviceInfo(device, CL_DEVICE_MAX_WORK_GROUP_SIZE, sizeof(size_t), &maxWorkGroupSize, NULL);
+    if ( err == CL_SUCCESS )
+        err = clGetDeviceInfo(device, CL_DEVICE_LOCAL_MEM_SIZE, sizeof(cl_ulong), &localMemSize, NULL);
+    if ( err != CL_SUCCESS || numDims < 2 )
+        return 0;
+
+    for (cl_uint tile = (requestedTile != 0)? requestedTile : 32; tile >= wpt; tile /= 2)
+    {
+        cl_uint rowsOfWorkItems = tile / wpt;
+        bool fits = tile <= maxWorkItemSizes[0] &&
+                    rowsOfWorkItems <= maxWorkItemSizes[1] &&
+                    tile * rowsOfWorkItems <= maxWorkGroupSize &&
+                    // matmul_tiled uses the most: two tiles, one padded
+                    ( tile * (tile + 1) + tile * tile ) * sizeof(cl_float) <= localMemSize;
+
+        if ( fits && tile % wpt == 0 )
+            return tile;
+
+        // An explicit tile is not shrunk
+        if ( requestedTile != 0 )
+            return 0;
+    }
+    return 0;
+}
+
+/* Create the program for tile and queue its build */
+static cl_int startTileBuild(cl_device_id device, cl_uint tile, cl_uint wpt)
+{
+    char buildOptions[64];
+    snprintf(buildOptions, sizeof(buildOptions), "-DTILE=%u -DWPT=%u", tile, wpt);
+
+    cl_int err;
+    program = createProgramFromKernelSource(context, device, &kernelSource, buildOptions, &err);
+    if ( err != CL_SUCCESS )
+    {
+        printf("Could not create program:%d\n", err);
+        return err;
+    }
+
+    err = startProgramBuild(buildManager, program, 1, &device, buildOptions);
+    if ( err != CL_SUCCESS )
+        printf("Failed to start build\n");
+    return err;
+}
+
+/* Run kernel with the given 2-D sizes repetitions times and return the
+*  best time in seconds or a negative value on failure. The time of each
+*  run is stored in samples.
+*/
+static double timeKernel(cl_kernel kernel, const size_t* globalSize, const size_t* localSize,
+                         unsigned int repetitions, double* samples)
+{
+    double best=-1.0;
+    for (unsigned int rep=0; rep < repetitions; ++rep)
+    {
+        cl_event event=0;
+        cl_int err = clEnqueueNDRangeKernel(cmdQueue, kernel, /* Work dim */ 2, NULL,
+                                            globalSize, localSize, 0, NULL, &event);
+        if ( err != CL_SUCCESS )
+        {
+            printf("Failed to enqueue kernel: %d\n", err);
+            return -1.0;
+        }
+
+        double seconds=0.0;
+        err = clWaitForEvents(1, &event);
+        if ( err == CL_SUCCESS )
+            err = getEventDuration(event, &seconds);
+        clReleaseEvent(event);
+        if ( err != CL_SUCCESS )
+        {
+            printf("Failed to time kernel: %d\n", err);
+            return -1.0;
+        }
+
+        if ( best < 0.0 || seconds < best ) best = seconds;
+        samples[rep] = seconds;
+    }
+    return best;
+}
+
+/* Fill the output with NaN so elements a kernel does not write are not
+*  left holding the previous kernel's (correct) result.
+*/
+static cl_int clearOutput(size_t elements)
+{
+    cl_float nan = NAN;
+    #ifdef CL_VERSION_1_2
+    cl_int err = clEnqueueFillBuffer(cmdQueue, outputBuffer, &nan, sizeof(nan), 0,
+                                     sizeof(cl_float) * elements, 0, NULL, NULL);
+    #else
+    for (size_t index=0; index < elements; ++index)
+        copiedBack[index] = nan;
+    cl_int err = clEnqueueWriteBuffer(cmdQueue, outputBuffer, CL_FALSE, 0, sizeof(cl_float) * elements,
+                                      copiedBack, 0, NULL, NULL);
+    #endif
+    if ( err == CL_SUCCESS )
+        err = clFinish(cmdQueue);
+    if ( err != CL_SUCCESS )
+        printf("Failed to clear output: %d\n", err);
+    return err;
+}
+
+/* Read back the output and compare it with the host. Returns the number
+*  of mismatches.
+*/
+static cl_uint checkMatmul(cl_uint M, cl_uint N, cl_uint K)
+{
+    if ( clEnqueueReadBuffer(cmdQueue, outputBuffer, CL_TRUE, 0, sizeof(cl_float) * M * N,
+                             copiedBack, 0, NULL, NULL) != CL_SUCCESS )
+    {
+        printf("Failed to read back result\n");
+        return 1;
+    }
+
+    // Check everything for small problems and a sample otherwise
+    bool checkAll = (double) M * N * K <= (double) (1 << 27);
+    cl_uint samples = checkAll? M * N : 4096;
+    cl_uint mismatches=0;
+    for (cl_uint sample=0; sample < samples; ++sample)
+    {
+        size_t index = checkAll? sample : ( (size_t) rand() * RAND_MAX + rand() ) % ((size_t) M * N);
+        size_t row = index / N;
+        size_t col = index % N;
+        double expected=0.0;
+        for (cl_uint k=0; k < K; ++k)
+            expected += (double) hostA[row * K + k] * hostB[k * N + col];
+
+        // Written so NaN (not written) is a mismatch
+        if ( !( fabs(copiedBack[index] - expected) <= 1.0e-4 * K * (fabs(expected) + 1.0) ) )
+            ++mismatches;
+    }
+    return mismatches;
+}
+
+static cl_uint checkTranspose(cl_uint rows, cl_uint cols)
+{
+    if ( clEnqueueReadBuffer(cmdQueue, outputBuffer, CL_TRUE, 0, sizeof(cl_float) * rows * cols,
+                             copiedBack, 0, NULL, NULL) != CL_SUCCESS )
+    {
+        printf("Failed to read back result\n");
+        return 1;
+    }
+
+    cl_uint mismatches=0;
+    for (size_t y=0; y < rows; ++y)
+    {
+        for (size_t x=0; x < cols; ++x)
+        {
+            if ( copiedBack[x * rows + y] != hostA[y * cols + x] )
+                ++mismatches;
+        }
+    }
+    return mismatches;
+}
+
+int main(int argc, char** argv)
+{
+    const char* peaksFile=0;
+    const char* kernelOverride=0;
+    const char* resultsFile=0;
+    cl_uint requestedTile=0;
+    cl_uint wpt=4;
+    unsigned int repetitions=5;
+
+    static struct option longOptions[] =
+    {
+        { "tile", required_argument, 0, 't' },
+        { "wpt", required_argument, 0, 'w' },
+        { "repetitions", required_argument, 0, 'r' },
+        { "peaks", required_argument, 0, 'p' },
+        { "kernel", required_argument, 0, 'k' },
+        { "results", required_argument, 0, 'o' },
+        { 0, 0, 0, 0 }
+    };
+
+    int option=0;
+    while ( (option = getopt_long(argc, argv, "t:w:r:p:k:o:", longOptions, NULL)) != -1 )
+    {
+        switch (option)
+        {
+            case 't': requestedTile = atoi(optarg); break;
+            case 'w': wpt = atoi(optarg); break;
+            case 'r': repetitions = atoi(optarg); break;
+            case 'p': peaksFile = optarg; break;
+            case 'k': kernelOverride = optarg; break;
+            case 'o': resultsFile = optarg; break;
+            default: usage(argv[0]);
+        }
+    }
+
+    if ( argc - optind < 1 || wpt < 1 || repetitions < 1 )
+        usage(argv[0]);
+
+    const char* mode = argv[optind];
+    bool isMatmul = ( strcmp(mode, "matmul") == 0 );
+    if ( !isMatmul && strcmp(mode, "transpose") != 0 )
+        usage(argv[0]);
+
+    if ( argc - optind != (isMatmul? 4 : 3) )
+    {
+        usage(argv[0]);
+        assert(0 && "Unreachable");
+    }
+
+    // For transpose M is rows and N is cols
+    cl_uint M = atoi(argv[optind + 1]);
+    cl_uint N = atoi(argv[optind + 2]);
+    cl_uint K = isMatmul? atoi(argv[optind + 3]) : 0;
+    if ( M < 1 || N < 1 || ( isMatmul && K < 1 ) )
+    {
+        printf("Matrix sizes must be > 0\n");
+        exit(1);
+    }
+
+    const char* kernelName = kernelOverride? kernelOverride : (isMatmul? "matmul.cl" : "transpose.cl");
+    cl_int err = getKernelSource( kernelName,
+                                  embeddedKernels,
+                                  sizeof(embeddedKernels)/sizeof(EmbeddedKernel),
+                                  &kernelSource);
+    if ( err != CL_SUCCESS )
+    {
+        printf("Could not open OpenCL kernel: %s\n", kernelName);
+        exit(1);
+    }
+
+    cl_platform_id platform = pickPlatform();
+    cl_device_id device = pickDevice(platform);
+
+    char deviceName[256];
+    if ( clGetDeviceInfo(device, CL_DEVICE_NAME, sizeof(deviceName), deviceName, NULL) == CL_SUCCESS )
+        printf("Using device %s\n", deviceName);
+
+    cl_uint numDims=0;
+    err = getMaxWorkItemSizes(device, &maxWorkItemSizes, &numDims);
+    if ( err != CL_SUCCESS )
+    {
+        cleanUp();
+        exit(1);
+    }
+
+    cl_context_properties cProp[] = { CL_CONTEXT_PLATFORM, (cl_context_properties) platform, 0 };
+    context = clCreateContext(cProp, 1, &device, contextCallBack, NULL, &err);
+    if ( err != CL_SUCCESS )
+    {
+        printf("Failed to create context: %d\n", err);
+        cleanUp();
+        exit(1);
+    }
+
+    /* Profiling is used to time the kernels */
+    cmdQueue = clCreateCommandQueue(context, device, CL_QUEUE_PROFILING_ENABLE, &err);
+    if ( err != CL_SUCCESS )
+    {
+        printf("Couldn't create command queue.\n");
+        cleanUp();
+        exit(1);
+    }
+
+    /* Build for the largest tile the device allows. The kernel may need more
+    *  resources than the device limits suggest so halve the tile until the
+    *  built kernel can run a whole tile. The first build runs on a worker
+    *  thread while the inputs are generated and its log is only printed on
+    *  failure.
+    */
+    buildManager = createBuildManager(/*maxConcurrentBuilds*/ 1, /*printBuildLogs*/ CL_FALSE);
+    if ( buildManager == NULL )
+    {
+        printf("Failed to create build manager\n");
+        cleanUp();
+        exit(1);
+    }
+
+    cl_uint tile = pickTile(device, requestedTile, wpt, numDims);
+    if ( tile != 0 && startTileBuild(device, tile, wpt) != CL_SUCCESS )
+    {
+        cleanUp();
+        exit(1);
+    }
+
+    /* Inputs */
+    size_t sizeA = (size_t) M * (isMatmul? K : N);
+    size_t sizeB = isMatmul? (size_t) K * N : 0;
+    size_t sizeOut = (size_t) M * N;
+    hostA = (float*) malloc( sizeof(float) * sizeA );
+    hostB = (float*) malloc( sizeof(float) * (sizeB > 0? sizeB : 1) );
+    copiedBack = (float*) malloc( sizeof(float) * sizeOut );
+    if ( hostA == 0 || hostB == 0 || copiedBack == 0 )
+    {
+        printf("Failed to malloc memory for host arrays\n");
+        cleanUp();
+        exit(1);
+    }
+
+    srand(1);
+    for (size_t index=0; index < sizeA; ++index)
+        hostA[index] = (float) rand() / RAND_MAX;
+    for (size_t index=0; index < sizeB; ++index)
+        hostB[index] = (float) rand() / RAND_MAX;
+
+    inputABuffer = clCreateBuffer(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR,
+                                  sizeof(float) * sizeA, hostA, &err);
+    if ( err == CL_SUCCESS && isMatmul )
+        inputBBuffer = clCreateBuffer(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR,
+                                      sizeof(float) * sizeB, hostB, &err);
+    if ( err == CL_SUCCESS )
+        outputBuffer = clCreateBuffer(context, CL_MEM_WRITE_ONLY, sizeof(float) * sizeOut, NULL, &err);
+
+    if ( err != CL_SUCCESS )
+    {
+        printf("Failed to create buffer. Error:%d\n", err);
+        cleanUp();
+        exit(1);
+    }
+
+    while ( true )
+    {
+        if ( tile == 0 )
+        {
+            printf("No tile size with %u rows per work item fits the device\n", wpt);
+            cleanUp();
+            exit(1);
+        }
+
+        if ( program == 0 && startTileBuild(device, tile, wpt) != CL_SUCCESS )
+        {
+            cleanUp();
+            exit(1);
+        }
+
+        err = waitForProgramBuild(buildManager, program);
+        if ( err != CL_SUCCESS )
+        {
+            printf("Build failed\n");
+            printProgramBuildInfo(program, device, /*Indent*/ 0);
+            cleanUp();
+            exit(1);
+        }
+
+        naiveKernel = clCreateKernel(program, isMatmul? "matmul_naive" : "transpose_naive", &err);
+        if ( err == CL_SUCCESS )
+            tiledKernel = clCreateKernel(program, isMatmul? "matmul_tiled" : "transpose_tiled", &err);
+
+        if ( err != CL_SUCCESS )
+        {
+            printf("Failed to create kernel object.\n");
+            cleanUp();
+            exit(1);
+        }
+
+        size_t kernelMaxWorkGroupSize=0;
+        err = clGetKernelWorkGroupInfo(tiledKernel, device, CL_KERNEL_WORK_GROUP_SIZE,
+                                       sizeof(size_t), &kernelMaxWorkGroupSize, NULL);
+        if ( err == CL_SUCCESS && tile * (tile / wpt) <= kernelMaxWorkGroupSize )
+            break;
+
+        clReleaseKernel(naiveKernel); naiveKernel=0;
+        clReleaseKernel(tiledKernel); tiledKernel=0;
+        clReleaseProgram(program); program=0;
+        tile = ( requestedTile == 0 && tile / 2 >= wpt )? tile / 2 : 0;
+    }
+
+    printf("Tile %ux%u, %u rows per work item, work group %ux%u\n",
+           tile, tile, wpt, tile, tile / wpt);
+
+    cl_kernel kernels[] = { naiveKernel, tiledKernel };
+    for (int index=0; index < 2; ++index)
+    {
+        cl_uint arg=0;
+        err = clSetKernelArg(kernels[index], arg++, sizeof(cl_uint), &M);
+        if ( err == CL_SUCCESS )
+            err = clSetKernelArg(kernels[index], arg++, sizeof(cl_uint), &N);
+        if ( err == CL_SUCCESS && isMatmul )
+            err = clSetKernelArg(kernels[index], arg++, sizeof(cl_uint), &K);
+        if ( err == CL_SUCCESS )
+            err = clSetKernelArg(kernels[index], arg++, sizeof(cl_mem), &inputABuffer);
+        if ( err == CL_SUCCESS && isMatmul )
+            err = clSetKernelArg(kernels[index], arg++, sizeof(cl_mem), &inputBBuffer);
+        if ( err == CL_SUCCESS )
+            err = clSetKernelArg(kernels[index], arg++, sizeof(cl_mem), &outputBuffer);
+        if ( err != CL_SUCCESS )
+        {
+            printf("Couldn't set kernel argument.\n");
+            cleanUp();
+            exit(1);
+        }
+    }
+
+    /* 2-D ND-ranges. Dimension 0 runs along the rows of the output so
+    *  neighbouring work items access neighbouring elements.
+    */
+    size_t naiveLocal[2] = { tile, tile / wpt };
+    size_t naiveGlobal[2] = { roundUp(N, naiveLocal[0]), roundUp(M, naiveLocal[1]) };
+    size_t tiledLocal[2] = { tile, tile / wpt };
+    size_t tiledGlobal[2] = { roundUp(N, tile), roundUp(M, tile) / wpt };
+
+    DevicePeaks peaks;
+    if ( getDevicePeaks(peaksFile, device, &peaks) != CL_SUCCESS )
+        memset(&peaks, 0, sizeof(peaks));
+    printf("\n");
+
+    const char* names[] = { "Naive", "Tiled" };
+    const char* variantNames[] = { "naive", "tiled" };
+    std::vector<double> samples(repetitions);
+    const size_t* globalSizes[] = { naiveGlobal, tiledGlobal };
+    const size_t* localSizes[] = { naiveLocal, tiledLocal };
+    int result=0;
+    for (int index=0; index < 2; ++index)
+    {
+        if ( clearOutput(sizeOut) != CL_SUCCESS )
+        {
+            result = 1;
+            continue;
+        }
+
+        double seconds = timeKernel(kernels[index], globalSizes[index], localSizes[index], repetitions,
+                                    &samples[0]);
+        if ( seconds < 0.0 )
+        {
+            result = 1;
+            continue;
+        }
+
+        cl_uint mismatches = isMatmul? checkMatmul(M, N, K) : checkTranspose(M, N);
+        printf("%s %s (global %lux%lu, local %lux%lu): %.3f ms%s\n",
+               names[index], mode,
+               (unsigned long) globalSizes[index][0], (unsigned long) globalSizes[index][1],
+               (unsigned long) localSizes[index][0], (unsigned long) localSizes[index][1],
+               seconds * 1.0e3, (mismatches == 0)? "" : " result is WRONG");
+        if ( mismatches != 0 )
+            result = 1;
+
+        KernelWork work;
+        work.integerOps = CL_FALSE;
+        if ( isMatmul )
+        {
+            // Each tile of A is read once per column of tiles and vice versa.
+            // The naive kernel is assumed to get the same reuse from caches.
+            work.bytes = sizeof(cl_float) * ( (double) M * K * ( (N + tile -1) / tile ) +
+                                              (double) K * N * ( (M + tile -1) / tile ) +
+                                              (double) M * N );
+            work.ops = 2.0 * M * N * K;
+        }
+        else
+        {
+            work.bytes = 2.0 * sizeof(cl_float) * M * N;
+            work.ops = 0.0;
+        }
+        printRooflineReport(&work, seconds, &peaks, /*Indent*/ 2);
+
+        if ( resultsFile != NULL )
+        {
+            // The size is the output elements so the shape and tiling go in the variant
+            char variant[64];
+            if ( isMatmul )
+                snprintf(variant, sizeof(variant), "%s/%ux%ux%u/tile%u/wpt%u", variantNames[index], M, N, K, tile, wpt);
+            else
+                snprintf(variant, sizeof(variant), "%s/%ux%u/tile%u/wpt%u", variantNames[index], M, N, tile, wpt);
+            if ( appendBenchmarkResult(resultsFile, device, mode, variant, (cl_ulong) M * N,
+                                       &samples[0], repetitions) != CL_SUCCESS )
+                result = 1;
+        }
+    }
+
+    cleanUp();
+    return result;
+}
+
+void cleanUp()
+{
+    cl_int err=0;
+    releaseKernelSource(&kernelSource);
+
+    // Waits for any outstanding build
+    releaseBuildManager(buildManager);
+
+    cl_mem buffers[] = { inputABuffer, inputBBuffer, outputBuffer };
+    for (unsigned int index=0; index < sizeof(buffers)/sizeof(cl_mem); ++index)
+    {
+        if (buffers[index] != 0)
+        {
+            err = clReleaseMemObject(buffers[index]);
+            handleError(err, "Couldn't release buffer", false);
+        }
+    }
+
+    if (tiledKernel!=0)
+    {
+        err = clReleaseKernel(tiledKernel);
+        handleError(err, "Couldn't release kernel", false);
+    }
+
+    if (naiveKernel!=0)
+    {
+        err = clReleaseKernel(naiveKernel);
+        handleError(err, "Couldn't release kernel", false);
+    }
+
+    if (program!= 0)
+    {
+        err = clReleaseProgram(program);
+        handleError(err, "Couldn't release program", false);
+    }
+
+    if (cmdQueue != 0 )
+    {
+        err = clReleaseCommandQueue(cmdQueue);
+        handleError(err, "Couldn't release command queue", false);
+    }
+
+    if (context!=0)
+    {
+        err = clReleaseContext(context);
+        handleError(err, "Couldn't release context", false);
+    }
+
+    free(hostA);
+    free(hostB);
+    free(copiedBack);
+    free(maxWorkItemSizes);
+}
@@ -0,0 +1,66 @@
+// Transpose of a row major rows x cols matrix of floats into a cols x rows
+// matrix.
+//
+// Build options:
+//   -DTILE=T  Edge of the square tile staged in local memory
+//   -DWPT=W   Rows of the tile moved by each work item. Must divide TILE.
+//
+// transpose_tiled must be run with a local size of (TILE, TILE / WPT) and a
+// global size of (cols, rows / WPT) rounded up to multiples of it.
+
+#ifndef TILE
+#define TILE 16
+#endif
+
+#ifndef WPT
+#define WPT 4
+#endif
+
+// Work items per tile in dimension 1
+#define RTS (TILE / WPT)
+
+// Reference version. The writes are not coalesced.
+__kernel void transpose_naive(uint rows,
+                              uint cols,
+                              __global const float* in,
+                              __global float* out)
+{
+    size_t x = get_global_id(0);
+    size_t y = get_global_id(1);
+    if ( x < cols && y < rows )
+        out[x * rows + y] = in[y * cols + x];
+}
+
+// The tile is read and written a row at a time so both the global reads
+// and writes are coalesced.
+__kernel void transpose_tiled(uint rows,
+                              uint cols,
+                              __global const float* in,
+                              __global float* out)
+{
+    size_t localX = get_local_id(0);
+    size_t localY = get_local_id(1);
+
+    // Padded by a column to avoid bank conflicts on the transposed reads
+    __local float tile[TILE][TILE + 1];
+
+    size_t x = get_group_id(0) * TILE + localX;
+    for (int w=0; w < WPT; ++w)
+    {
+        size_t r = localY + w * RTS;
+        size_t y = get_group_id(1) * TILE + r;
+        if ( x < cols && y < rows )
+            tile[r][localX] = in[y * cols + x];
+    }
+    barrier(CLK_LOCAL_MEM_FENCE);
+
+    // Swap the roles of the groups for the output
+    x = get_group_id(1) * TILE + localX;
+    for (int w=0; w < WPT; ++w)
+    {
+        size_t r = localY + w * RTS;
+        size_t y = get_group_id(0) * TILE + r;
+        if ( x < rows && y < cols )
+            out[y * rows + x] = tile[localX][r];
+    }
+}
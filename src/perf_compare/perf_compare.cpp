@@ -0,0 +1,214 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <assert.h>
+#include <string.h>
+#include <getopt.h>
+#include <vector>
+#include <libclprobe/resultstore.h>
+
+void usage(const char* progName)
+{
+    printf("Usage: %s [options] <results_file> [<baseline_run> <new_run>]\n\n", progName);
+    printf("Compares the benchmark results of two runs in a results file written\n"
+           "with --results by histogram, reduction, persistent, matrix, radix_sort\n"
+           "and prefix_sum --scan-layouts. Results are matched by device,\n"
+           "benchmark, variant and size; the driver version may differ. A result\n"
+           "is a regression if it is slower by more than the threshold and a one\n"
+           "sided Welch's t-test on the repetitions says the slowdown is\n"
+           "significant. Without runs the last two runs in the file are compared.\n"
+           "Exits with 1 if there are regressions or if no results could be\n"
+           "compared.\n\n"
+           "Options:\n"
+           "  --threshold <percent>  Smallest slowdown reported (default 5)\n"
+           "  --alpha <p>            Significance level (default 0.05)\n"
+           "  --list                 List the runs in the file\n");
+    exit(1);
+}
+
+/* Runs in order of first appearance in the file */
+static std::vector<const char*> findRuns(const BenchmarkResult* results, cl_uint numResults)
+{
+    std::vector<const char*> runs;
+    for (cl_uint index=0; index < numResults; ++index)
+    {
+        bool seen=false;
+        for (size_t run=0; run < runs.size() && !seen; ++run)
+            seen = ( strcmp(runs[run], results[index].run) == 0 );
+        if ( !seen )
+            runs.push_back(results[index].run);
+    }
+    return runs;
+}
+
+static bool sameConfiguration(const BenchmarkResult* a, const BenchmarkResult* b)
+{
+    return strcmp(a->device, b->device) == 0 &&
+           strcmp(a->benchmark, b->benchmark) == 0 &&
+           strcmp(a->variant, b->variant) == 0 &&
+           a->size == b->size;
+}
+
+/* Last result of run for the configuration of result or NULL */
+static const BenchmarkResult* findResult(const BenchmarkResult* results, cl_uint numResults,
+                                         const char* run, const BenchmarkResult* result)
+{
+    const BenchmarkResult* found=NULL;
+    for (cl_uint index=0; index < numResults; ++index)
+    {
+        if ( strcmp(results[index].run, run) == 0 && sameConfiguration(&results[index], result) )
+            found = &results[index];
+    }
+    return found;
+}
+
+static void listRuns(const BenchmarkResult* results, cl_uint numResults)
+{
+    std::vector<const char*> runs = findRuns(results, numResults);
+    for (size_t run=0; run < runs.size(); ++run)
+    {
+        cl_uint count=0;
+        const BenchmarkResult* last=NULL;
+        for (cl_uint index=0; index < numResults; ++index)
+        {
+            if ( strcmp(results[index].run, runs[run]) == 0 )
+            {
+                ++count;
+                last = &results[index];
+            }
+        }
+        printf("%s: %u results, %s (driver %s)\n", runs[run], count, last->device, last->driver);
+    }
+}
+
+int main(int argc, char** argv)
+{
+    double thresholdPercent=5.0;
+    double alpha=0.05;
+    bool list=false;
+
+    static struct option longOptions[] =
+    {
+        { "threshold", required_argument, 0, 't' },
+        { "alpha", required_argument, 0, 'a' },
+        { "list", no_argument, 0, 'l' },
+        { 0, 0, 0, 0 }
+    };
+
+    int option=0;
+    while ( (option = getopt_long(argc, argv, "t:a:l", longOptions, NULL)) != -1 )
+    {
+        switch (option)
+        {
+            case 't': thresholdPercent = atof(optarg); break;
+            case 'a': alpha = atof(optarg); break;
+            case 'l': list = true; break;
+            default: usage(argv[0]);
+        }
+    }
+
+    int numArgs = argc - optind;
+    if ( (numArgs != 1 && numArgs != 3) || alpha <= 0.0 || alpha >= 1.0 || thresholdPercent < 0.0 )
+    {
+        usage(argv[0]);
+        assert(0 && "Unreachable");
+    }
+
+    BenchmarkResult* results=0;
+    cl_uint numResults=0;
+    if ( loadBenchmarkResults(argv[optind], &results, &numResults) != CL_SUCCESS )
+        return 1;
+
+    if ( list )
+    {
+        listRuns(results, numResults);
+        free(results);
+        return 0;
+    }
+
+    const char* baselineRun=0;
+    const char* newRun=0;
+    if ( numArgs == 3 )
+    {
+        baselineRun = argv[optind + 1];
+        newRun = argv[optind + 2];
+    }
+    else
+    {
+        std::vector<const char*> runs = findRuns(results, numResults);
+        if ( runs.size() < 2 )
+        {
+            printf("%s has %u run(s), need two to compare\n", argv[optind], (cl_uint) runs.size());
+            free(results);
+            return 1;
+        }
+        baselineRun = runs[runs.size() - 2];
+        newRun = runs[runs.size() - 1];
+    }
+
+    printf("Comparing run %s against baseline %s\n", newRun, baselineRun);
+    printf("%-12s %-24s %10s %12s %12s %8s %8s  %s\n",
+           "benchmark", "variant", "size", "baseline ms", "new ms", "change", "p", "status");
+
+    cl_uint compared=0;
+    cl_uint regressions=0;
+    double threshold = thresholdPercent / 100.0;
+    for (cl_uint index=0; index < numResults; ++index)
+    {
+        const BenchmarkResult* candidate = &results[index];
+        if ( strcmp(candidate->run, newRun) != 0 )
+            continue;
+
+        // Only the last result of each configuration in the new run
+        if ( findResult(results, numResults, newRun, candidate) != candidate )
+            continue;
+
+        const BenchmarkResult* baseline = findResult(results, numResults, baselineRun, candidate);
+        printf("%-12s %-24s %10llu ", candidate->benchmark, candidate->variant,
+               (unsigned long long) candidate->size);
+        if ( baseline == NULL )
+        {
+            printf("%12s %12.4f %8s %8s  no baseline\n", "-", candidate->mean * 1.0e3, "-", "-");
+            continue;
+        }
+
+        double pValue=0.0;
+        double change = compareBenchmarkResults(baseline, candidate, &pValue);
+        ++compared;
+
+        const char* status = "ok";
+        if ( change > threshold )
+        {
+            if ( pValue < 0.0 )
+                status = "slower (too few samples to test)";
+            else if ( pValue < alpha )
+            {
+                status = "REGRESSION";
+                ++regressions;
+            }
+            else
+                status = "slower (not significant)";
+        }
+        else if ( change < -threshold && pValue >= 0.0 && 1.0 - pValue < alpha )
+            status = "faster";
+
+        printf("%12.4f %12.4f %+7.1f%% ", baseline->mean * 1.0e3, candidate->mean * 1.0e3, change * 100.0);
+        if ( pValue < 0.0 )
+            printf("%8s", "-");
+        else
+            printf("%8.4f", pValue);
+        printf("  %s", status);
+        if ( strcmp(baseline->driver, candidate->driver) != 0 )
+            printf(" (driver %s -> %s)", baseline->driver, candidate->driver);
+        printf("\n");
+    }
+
+    printf("\n%u results compared, %u regression%s\n", compared, regressions, (regressions == 1)? "" : "s");
+    if ( compared == 0 )
+    {
+        printf("Run %s has no results to compare with baseline %s\n", newRun, baselineRun);
+        free(results);
+        return 1;
+    }
+    free(results);
+    return ( regressions > 0 )? 1 : 0;
+}
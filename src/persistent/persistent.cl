@@ -0,0 +1,91 @@
+// add.cl and a prefix sum split into independent tiles of one work group
+// each, like a stream of small requests.
+//
+// The *_tiles kernels are the ordinary mode: work group g processes tile
+// firstTile + g, so one launch per tile (or one launch for all of them).
+//
+// The *_persistent kernels are launched once with a fixed number of work
+// groups. Each group takes the next tile from the counter *nextTile with
+// an atomic until none are left. The host must zero the counter before
+// each launch. There are no dependencies between tiles so any number of
+// groups is safe.
+//
+// A tile has local size elements. The local size of the scan kernels must
+// be a power of two.
+
+// add.cl's simple_kernel on one tile
+void addTile(__global int* A, uint tile, uint n)
+{
+    size_t index = tile * get_local_size(0) + get_local_id(0);
+    if ( index < n )
+        A[index] += 1;
+}
+
+// Inclusive (Hillis-Steele) scan of one tile in local memory, the same
+// algorithm as naive_prefix_sum.cl
+void scanTile(__global int* A, __local int* temp, uint tile, uint n)
+{
+    size_t lid = get_local_id(0);
+    size_t index = tile * get_local_size(0) + lid;
+    temp[lid] = ( index < n )? A[index] : 0;
+
+    for (size_t offset = 1; offset < get_local_size(0); offset *= 2)
+    {
+        barrier(CLK_LOCAL_MEM_FENCE);
+        int x = ( lid >= offset )? temp[lid - offset] : 0;
+        barrier(CLK_LOCAL_MEM_FENCE);
+        temp[lid] += x;
+    }
+    barrier(CLK_LOCAL_MEM_FENCE);
+
+    if ( index < n )
+        A[index] = temp[lid];
+}
+
+// Next tile for this work group, the same for all its work items. Returns
+// a value >= numTiles when there is no work left.
+uint nextTileOf(__global volatile uint* nextTile, __local uint* tile)
+{
+    if ( get_local_id(0) == 0 )
+        *tile = atomic_inc(nextTile);
+    barrier(CLK_LOCAL_MEM_FENCE);
+    uint result = *tile;
+    // Everyone has read it before it is replaced
+    barrier(CLK_LOCAL_MEM_FENCE);
+    return result;
+}
+
+__kernel void add_tiles(__global int* A, uint firstTile, uint n)
+{
+    addTile(A, firstTile + get_group_id(0), n);
+}
+
+__kernel void add_persistent(__global int* A,
+                             __global volatile uint* nextTile,
+                             uint numTiles,
+                             uint n)
+{
+    __local uint tile;
+    for (uint t = nextTileOf(nextTile, &tile); t < numTiles; t = nextTileOf(nextTile, &tile))
+        addTile(A, t, n);
+}
+
+__kernel void scan_tiles(__global int* A, __local int* temp, uint firstTile, uint n)
+{
+    scanTile(A, temp, firstTile + get_group_id(0), n);
+}
+
+__kernel void scan_persistent(__global int* A,
+                              __local int* temp,
+                              __global volatile uint* nextTile,
+                              uint numTiles,
+                              uint n)
+{
+    __local uint tile;
+    for (uint t = nextTileOf(nextTile, &tile); t < numTiles; t = nextTileOf(nextTile, &tile))
+    {
+        scanTile(A, temp, t, n);
+        // temp is reused by the next tile
+        barrier(CLK_LOCAL_MEM_FENCE);
+    }
+}
@@ -0,0 +1,530 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <assert.h>
+#include <string.h>
+#include <getopt.h>
+#include <CL/opencl.h>
+#include <libclprobe/clprobe.h>
+#include <libclprobe/driverutil.h>
+#include <libclprobe/kernelsource.h>
+#include <libclprobe/buildmanager.h>
+#include <libclprobe/timing.h>
+#include <libclprobe/resultstore.h>
+#include <vector>
+#include "persistent.cl.h"
+
+/* Kernels compiled into the executable */
+static const EmbeddedKernel embeddedKernels[] =
+{
+    EMBEDDED_KERNEL("persistent.cl", persistent_cl)
+};
+
+/* Work done on each tile, see persistent.cl */
+typedef struct
+{
+    const char* name;
+    const char* tilesKernel;
+    const char* persistentKernel;
+    bool usesLocalMemory; /* Takes a __local int* of one int per work item */
+} Work;
+
+static const Work works[] =
+{
+    { "add", "add_tiles", "add_persistent", false },
+    { "prefix_sum", "scan_tiles", "scan_persistent", true }
+};
+
+static const unsigned int numWorks = sizeof(works)/sizeof(Work);
+
+void usage(const char* progName)
+{
+    printf("Usage: %s [options] <num_tiles>\n\n", progName);
+    printf("Runs many small independent requests (tiles of one work group each)\n"
+           "of the add and prefix_sum work and compares the latency of\n"
+           "  per-launch  one kernel launch per tile\n"
+           "  batched     one launch covering all tiles\n"
+           "  persistent  one launch of a fixed number of work groups which take\n"
+           "              tiles from a global counter with atomics\n\n"
+           "Options:\n"
+           "  --work <add|prefix_sum>  Only run this work\n"
+           "  --local-size <n>   Work group (and tile) size, a power of two\n"
+           "                     (default: up to 256 as the kernels allow)\n"
+           "  --groups <n>       Work groups of the persistent kernels (default:\n"
+           "                     compute units)\n"
+           "  --repetitions <n>  Number of timed runs, the best is reported (default 5)\n"
+           "  --results <file>   Append the times to a results file for perf_compare\n"
+           "  --kernel <file>    Override the embedded persistent.cl\n");
+    exit(1);
+}
+
+void cleanUp();
+
+//Global for clean up convenience
+KernelSource kernelSource;
+BuildManager* buildManager=0;
+cl_program program=0;
+cl_context context=0;
+cl_command_queue cmdQueue=0;
+cl_kernel tilesKernel=0;
+cl_kernel persistentKernel=0;
+cl_int* hostInput=0;
+cl_int* hostOutput=0;
+cl_mem dataBuffer=0;
+cl_mem counterBuffer=0;
+const char* resultsFile=0;
+
+/* Largest power of two work group size up to maxLocalSize both kernels allow */
+static size_t pickLocalSize(cl_device_id device, size_t maxLocalSize)
+{
+    KernelInfo tilesInfo;
+    KernelInfo persistentInfo;
+    if ( getKernelInfo(tilesKernel, device, &tilesInfo) != CL_SUCCESS ||
+         getKernelInfo(persistentKernel, device, &persistentInfo) != CL_SUCCESS )
+        return 0;
+
+    size_t localSize=1;
+    while ( localSize * 2 <= maxLocalSize &&
+            localSize * 2 <= tilesInfo.workGroupSize &&
+            localSize * 2 <= persistentInfo.workGroupSize )
+        localSize *= 2;
+    return localSize;
+}
+
+/* Set the arguments before firstTile (or nextTile) of work's kernels and
+*  return the index of the next one.
+*/
+static cl_uint setDataArgs(cl_kernel kernel, const Work* work, size_t localSize, cl_int* err)
+{
+    cl_uint arg=0;
+    if ( *err == CL_SUCCESS )
+        *err = clSetKernelArg(kernel, arg++, sizeof(cl_mem), &dataBuffer);
+    if ( *err == CL_SUCCESS && work->usesLocalMemory )
+        *err = clSetKernelArg(kernel, arg++, sizeof(cl_int) * localSize, NULL);
+    return arg;
+}
+
+/* Enqueue the tiles kernel on numTiles tiles, tilesPerLaunch at a time */
+static cl_int enqueueTiles(const Work* work, cl_uint numTiles, cl_uint tilesPerLaunch,
+                           size_t localSize, unsigned long* launches)
+{
+    cl_uint n = numTiles * localSize;
+    *launches = 0;
+    for (cl_uint firstTile=0; firstTile < numTiles; firstTile += tilesPerLaunch)
+    {
+        cl_uint tiles = ( numTiles - firstTile < tilesPerLaunch )? numTiles - firstTile : tilesPerLaunch;
+        size_t globalSize = tiles * localSize;
+
+        cl_int err = CL_SUCCESS;
+        cl_uint arg = setDataArgs(tilesKernel, work, localSize, &err);
+        if ( err == CL_SUCCESS )
+            err = clSetKernelArg(tilesKernel, arg++, sizeof(cl_uint), &firstTile);
+        if ( err == CL_SUCCESS )
+            err = clSetKernelArg(tilesKernel, arg++, sizeof(cl_uint), &n);
+        if ( err != CL_SUCCESS )
+        {
+            printf("Couldn't set kernel argument.\n");
+            return err;
+        }
+
+        err = clEnqueueNDRangeKernel(cmdQueue, tilesKernel, 1, NULL, &globalSize, &localSize, 0, NULL, NULL);
+        if ( err != CL_SUCCESS )
+        {
+            printf("Failed to enqueue kernel: %d\n", err);
+            return err;
+        }
+        ++(*launches);
+    }
+    return CL_SUCCESS;
+}
+
+/* Zero the tile counter and enqueue the persistent kernel once */
+static cl_int enqueuePersistent(const Work* work, cl_uint numTiles, size_t numGroups,
+                                size_t localSize, unsigned long* launches)
+{
+    static const cl_uint zero=0;
+    cl_int err = clEnqueueWriteBuffer(cmdQueue, counterBuffer, CL_FALSE, 0, sizeof(cl_uint), &zero, 0, NULL, NULL);
+    if ( err != CL_SUCCESS )
+    {
+        printf("Failed to reset the tile counter: %d\n", err);
+        return err;
+    }
+
+    cl_uint n = numTiles * localSize;
+    cl_uint arg = setDataArgs(persistentKernel, work, localSize, &err);
+    if ( err == CL_SUCCESS )
+        err = clSetKernelArg(persistentKernel, arg++, sizeof(cl_mem), &counterBuffer);
+    if ( err == CL_SUCCESS )
+        err = clSetKernelArg(persistentKernel, arg++, sizeof(cl_uint), &numTiles);
+    if ( err == CL_SUCCESS )
+        err = clSetKernelArg(persistentKernel, arg++, sizeof(cl_uint), &n);
+    if ( err != CL_SUCCESS )
+    {
+        printf("Couldn't set kernel argument.\n");
+        return err;
+    }
+
+    size_t globalSize = numGroups * localSize;
+    err = clEnqueueNDRangeKernel(cmdQueue, persistentKernel, 1, NULL, &globalSize, &localSize, 0, NULL, NULL);
+    if ( err != CL_SUCCESS )
+    {
+        printf("Failed to enqueue kernel: %d\n", err);
+        return err;
+    }
+    *launches = 1;
+    return CL_SUCCESS;
+}
+
+/* Check the data buffer holds work applied to every tile of hostInput */
+static bool checkResult(const Work* work, cl_uint numTiles, size_t localSize)
+{
+    cl_uint n = numTiles * localSize;
+    cl_int err = clEnqueueReadBuffer(cmdQueue, dataBuffer, CL_TRUE, 0, sizeof(cl_int) * n,
+                                     hostOutput, 0, NULL, NULL);
+    if ( err != CL_SUCCESS )
+    {
+        printf("Failed to read back result. Error:%d\n", err);
+        return false;
+    }
+
+    cl_int sum=0;
+    for (cl_uint index=0; index < n; ++index)
+    {
+        if ( index % localSize == 0 )
+            sum = 0;
+        sum += hostInput[index];
+
+        cl_int expected = work->usesLocalMemory? sum : hostInput[index] + 1;
+        if ( hostOutput[index] != expected )
+        {
+            printf("Result is WRONG at index %u\n", index);
+            return false;
+        }
+    }
+    return true;
+}
+
+typedef enum { MODE_PER_LAUNCH, MODE_BATCHED, MODE_PERSISTENT } Mode;
+
+/* Time work in every mode. Returns CL_SUCCESS if all results were correct */
+static cl_int benchmarkWork(const Work* work, cl_device_id device, cl_uint numTiles,
+                            size_t maxLocalSize, size_t numGroups, unsigned int repetitions)
+{
+    static const char* modeNames[] = { "per-launch", "batched", "persistent" };
+
+    cl_int err;
+    tilesKernel = clCreateKernel(program, work->tilesKernel, &err);
+    if ( err == CL_SUCCESS )
+        persistentKernel = clCreateKernel(program, work->persistentKernel, &err);
+    if ( err != CL_SUCCESS )
+    {
+        printf("Failed to create kernel objects for %s.\n", work->name);
+        return err;
+    }
+
+    size_t localSize = pickLocalSize(device, maxLocalSize);
+    if ( localSize == 0 )
+    {
+        printf("Could not get work group limits for %s\n", work->name);
+        return CL_INVALID_WORK_GROUP_SIZE;
+    }
+    cl_uint n = numTiles * localSize;
+
+    printf("%s, %u tiles of %lu elements:\n", work->name, numTiles, (unsigned long) localSize);
+    for (int mode=MODE_PER_LAUNCH; mode <= MODE_PERSISTENT; ++mode)
+    {
+        double best=0.0;
+        std::vector<double> samples;
+        unsigned long launches=0;
+        for (unsigned int rep=0; rep < repetitions; ++rep)
+        {
+            err = clEnqueueWriteBuffer(cmdQueue, dataBuffer, CL_TRUE, 0, sizeof(cl_int) * n,
+                                       hostInput, 0, NULL, NULL);
+            if ( err != CL_SUCCESS )
+            {
+                printf("Failed to write input. Error:%d\n", err);
+                return err;
+            }
+
+            // Host time from the first enqueue to completion, which is what
+            // a caller waiting on the requests sees
+            double start = getHostTime();
+            if ( mode == MODE_PERSISTENT )
+                err = enqueuePersistent(work, numTiles, numGroups, localSize, &launches);
+            else
+                err = enqueueTiles(work, numTiles, ( mode == MODE_PER_LAUNCH )? 1 : numTiles,
+                                   localSize, &launches);
+            if ( err == CL_SUCCESS )
+                err = clFinish(cmdQueue);
+            double seconds = getHostTime() - start;
+            if ( err != CL_SUCCESS )
+                return err;
+
+            if ( rep == 0 || seconds < best ) best = seconds;
+            samples.push_back(seconds);
+        }
+
+        if ( !checkResult(work, numTiles, localSize) )
+            return CL_INVALID_VALUE;
+
+        printf("  %-10s %7lu launches %10.3f ms %10.3f us/tile %8.3f ns/element\n",
+               modeNames[mode], launches, best * 1.0e3, best / numTiles * 1.0e6, best / n * 1.0e9);
+
+        if ( resultsFile != NULL )
+        {
+            // Tiles of a different size are a different configuration
+            char variant[64];
+            snprintf(variant, sizeof(variant), "%s/%s/%lu", work->name, modeNames[mode],
+                     (unsigned long) localSize);
+            err = appendBenchmarkResult(resultsFile, device, "persistent", variant, n, &samples[0], repetitions);
+            if ( err != CL_SUCCESS )
+                return err;
+        }
+    }
+    printf("  (persistent: %lu work groups)\n", (unsigned long) numGroups);
+
+    clReleaseKernel(persistentKernel);
+    persistentKernel = 0;
+    clReleaseKernel(tilesKernel);
+    tilesKernel = 0;
+    return CL_SUCCESS;
+}
+
+int main(int argc, char** argv)
+{
+    const char* kernelName="persistent.cl";
+    const char* workName=0;
+    size_t maxLocalSize=256;
+    size_t numGroups=0;
+    unsigned int repetitions=5;
+
+    static struct option longOptions[] =
+    {
+        { "work", required_argument, 0, 'w' },
+        { "local-size", required_argument, 0, 'l' },
+        { "groups", required_argument, 0, 'g' },
+        { "repetitions", required_argument, 0, 'r' },
+        { "kernel", required_argument, 0, 'k' },
+        { "results", required_argument, 0, 'o' },
+        { 0, 0, 0, 0 }
+    };
+
+    int option=0;
+    while ( (option = getopt_long(argc, argv, "w:l:g:r:k:o:", longOptions, NULL)) != -1 )
+    {
+        switch (option)
+        {
+            case 'w': workName = optarg; break;
+            case 'l': maxLocalSize = atoi(optarg); break;
+            case 'g': numGroups = atoi(optarg); break;
+            case 'r': repetitions = atoi(optarg); break;
+            case 'k': kernelName = optarg; break;
+            case 'o': resultsFile = optarg; break;
+            default: usage(argv[0]);
+        }
+    }
+
+    if ( argc - optind != 1 || repetitions < 1 || maxLocalSize == 0 ||
+         (maxLocalSize & (maxLocalSize -1)) != 0 )
+    {
+        usage(argv[0]);
+        assert(0 && "Unreachable");
+    }
+
+    cl_uint numTiles = atoi(argv[optind]);
+    if ( numTiles < 1 )
+    {
+        printf("Number of tiles must be > 0\n");
+        exit(1);
+    }
+
+    if ( workName != 0 )
+    {
+        bool found=false;
+        for (unsigned int index=0; index < numWorks; ++index)
+            found = found || strcmp(works[index].name, workName) == 0;
+        if ( !found )
+        {
+            printf("Unknown work: %s\n", workName);
+            usage(argv[0]);
+        }
+    }
+
+    cl_int err = getKernelSource( kernelName,
+                                  embeddedKernels,
+                                  sizeof(embeddedKernels)/sizeof(EmbeddedKernel),
+                                  &kernelSource);
+    if ( err != CL_SUCCESS )
+    {
+        printf("Could not open OpenCL kernel: %s\n", kernelName);
+        exit(1);
+    }
+
+    cl_platform_id platform = pickPlatform();
+    cl_device_id device = pickDevice(platform);
+
+    char deviceName[256];
+    if ( clGetDeviceInfo(device, CL_DEVICE_NAME, sizeof(deviceName), deviceName, NULL) == CL_SUCCESS )
+        printf("Using device %s\n", deviceName);
+
+    if ( numGroups == 0 )
+    {
+        cl_uint computeUnits=0;
+        err = clGetDeviceInfo(device, CL_DEVICE_MAX_COMPUTE_UNITS, sizeof(cl_uint), &computeUnits, NULL);
+        if ( err != CL_SUCCESS )
+        {
+            printf("Could not get device limits\n");
+            cleanUp();
+            exit(1);
+        }
+        numGroups = computeUnits;
+    }
+
+    cl_context_properties cProp[] = { CL_CONTEXT_PLATFORM, (cl_context_properties) platform, 0 };
+    context = clCreateContext(cProp, 1, &device, contextCallBack, NULL, &err);
+    if ( err != CL_SUCCESS )
+    {
+        printf("Failed to create context: %d\n", err);
+        cleanUp();
+        exit(1);
+    }
+
+    cmdQueue = clCreateCommandQueue(context, device, 0, &err);
+    if ( err != CL_SUCCESS )
+    {
+        printf("Couldn't create command queue.\n");
+        cleanUp();
+        exit(1);
+    }
+
+    program = createProgramFromKernelSource(context, device, &kernelSource, /*buildOptions*/ NULL, &err);
+    if ( err != CL_SUCCESS )
+    {
+        printf("Could not create program:%d\n", err);
+        cleanUp();
+        exit(1);
+    }
+
+    /* Build on a worker thread while the input is generated. The
+    *  build log is only printed on failure
+    */
+    buildManager = createBuildManager(/*maxConcurrentBuilds*/ 1, /*printBuildLogs*/ CL_FALSE);
+    if ( buildManager == NULL )
+    {
+        printf("Failed to create build manager\n");
+        cleanUp();
+        exit(1);
+    }
+
+    err = startProgramBuild(buildManager, program, 1, &device, /*options*/ NULL);
+    if ( err != CL_SUCCESS )
+    {
+        printf("Failed to start build\n");
+        cleanUp();
+        exit(1);
+    }
+
+    // Sized for the largest tiles, the kernels may pick smaller ones
+    size_t maxElements = numTiles * maxLocalSize;
+    hostInput = (cl_int*) malloc(sizeof(cl_int) * maxElements);
+    hostOutput = (cl_int*) malloc(sizeof(cl_int) * maxElements);
+    if ( hostInput == 0 || hostOutput == 0 )
+    {
+        printf("Failed to malloc memory for host arrays\n");
+        cleanUp();
+        exit(1);
+    }
+
+    srand(1);
+    for (size_t index=0; index < maxElements; ++index)
+        hostInput[index] = rand() % 1000;
+
+    dataBuffer = clCreateBuffer(context, CL_MEM_READ_WRITE, sizeof(cl_int) * maxElements, NULL, &err);
+    if ( err == CL_SUCCESS )
+        counterBuffer = clCreateBuffer(context, CL_MEM_READ_WRITE, sizeof(cl_uint), NULL, &err);
+    if ( err != CL_SUCCESS )
+    {
+        printf("Failed to create buffers. Error:%d\n", err);
+        cleanUp();
+        exit(1);
+    }
+
+    err = waitForProgramBuild(buildManager, program);
+    if ( err != CL_SUCCESS )
+    {
+        printf("Build failed\n");
+        printProgramBuildInfo(program, device, /*Indent*/ 0);
+        cleanUp();
+        exit(1);
+    }
+
+    int result=0;
+    for (unsigned int index=0; index < numWorks; ++index)
+    {
+        if ( workName != 0 && strcmp(works[index].name, workName) != 0 )
+            continue;
+
+        if ( benchmarkWork(&(works[index]), device, numTiles, maxLocalSize, numGroups, repetitions) != CL_SUCCESS )
+        {
+            printf("%s benchmark failed\n", works[index].name);
+            result = 1;
+            break;
+        }
+    }
+
+    cleanUp();
+    return result;
+}
+
+void cleanUp()
+{
+    cl_int err=0;
+    releaseKernelSource(&kernelSource);
+
+    // Waits for any outstanding build
+    releaseBuildManager(buildManager);
+
+    if (counterBuffer!=0)
+    {
+        err = clReleaseMemObject(counterBuffer);
+        handleError(err, "Couldn't release buffer", false);
+    }
+
+    if (dataBuffer!=0)
+    {
+        err = clReleaseMemObject(dataBuffer);
+        handleError(err, "Couldn't release buffer", false);
+    }
+
+    if (persistentKernel!=0)
+    {
+        err = clReleaseKernel(persistentKernel);
+        handleError(err, "Couldn't release kernel", false);
+    }
+
+    if (tilesKernel!=0)
+    {
+        err = clReleaseKernel(tilesKernel);
+        handleError(err, "Couldn't release kernel", false);
+    }
+
+    if (program!= 0)
+    {
+        err = clReleaseProgram(program);
+        handleError(err, "Couldn't release program", false);
+    }
+
+    if (cmdQueue != 0 )
+    {
+        err = clReleaseCommandQueue(cmdQueue);
+        handleError(err, "Couldn't release command queue", false);
+    }
+
+    if (context!=0)
+    {
+        err = clReleaseContext(context);
+        handleError(err, "Couldn't release context", false);
+    }
+
+    free(hostOutput);
+    free(hostInput);
+}
@@ -1,168 +1,1167 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <assert.h>
-#include <sys/stat.h>
+#include <string.h>
+#include <getopt.h>
 #include <CL/opencl.h>
 #include <libclprobe/clprobe.h>
+#include <libclprobe/driverutil.h>
+#include <libclprobe/kernelsource.h>
+#include <libclprobe/buildmanager.h>
+#include <libclprobe/timing.h>
+#include <libclprobe/devicepeaks.h>
+#include <libclprobe/trace.h>
+#include <libclprobe/resultstore.h>
+#include <libclprobe/hybridscheduler.h>
+#include <libclprobe/kernelfunctor.h>
+#include <thread>
+#include <vector>
+#include "scan.h"
+#include "naive_prefix_sum.cl.h"
 #include <errno.h>
 
-void showError(const char* msg, bool quit=true)
+/* Kernels compiled into the executable */
+static const EmbeddedKernel embeddedKernels[] =
 {
-    printf("Error: %s\n", msg);
-    if (quit) exit(1);
+    EMBEDDED_KERNEL("naive_prefix_sum.cl", naive_prefix_sum_cl)
+};
+
+/* Global memory traffic and arithmetic of naive_prefix_sum.cl for an
+*  array of n elements. Used for the roofline report.
+*/
+static KernelWork prefixSumWork(cl_uint n, int numOfIterations)
+{
+    KernelWork work = { 0.0, 0.0, CL_TRUE };
+    for (int d=0; d < numOfIterations; ++d)
+    {
+        // Every work item reads A[tid] and writes B[tid]. Those with
+        // tid >= 2^d also read A[tid - 2^d] and do an add.
+        double active = n - (1 << d);
+        work.bytes += sizeof(cl_int) * (2.0 * n + active);
+        work.ops += active;
+    }
+    return work;
 }
 
-void handleError(cl_int error, const char* msg, bool quit=true)
+void usage(const char* progName)
 {
-    if ( error != CL_SUCCESS)
+    printf("Usage: %s [options] <kernel> <array_size>\n", progName);
+    printf("       %s [options] --compact <lt|gt|ne>:<value> <array_size>\n", progName);
+    printf("       %s [--results <file>] --scan-layouts <array_size>\n", progName);
+    printf("       %s --in-place <array_size>\n", progName);
+    printf("       %s --sub-devices <numa|n> <array_size>\n", progName);
+    printf("       %s [--chunk-size <n>] [--host-threads <n>] --hybrid <array_size>\n\n", progName);
+    printf("<kernel> is the name of an embedded kernel or the path to a kernel\n"
+           "file (OpenCL C or a .spv SPIR-V module) which overrides the embedded\n"
+           "kernel of the same name.\n"
+           "Embedded kernels:\n");
+    for (unsigned int index=0; index < sizeof(embeddedKernels)/sizeof(EmbeddedKernel); ++index)
+        printf("  %s\n", embeddedKernels[index].name);
+    printf("\nOptions:\n"
+           "  --peaks <file>  Device peaks measured by device_benchmark used for the\n"
+           "                  roofline report (default: estimate from device info)\n"
+           "  --trace <file>  Write a Chrome trace of the run (needs a build with\n"
+           "                  ENABLE_TRACING)\n"
+           "  --compact <lt|gt|ne>:<value>\n"
+           "                  Instead of running <kernel> compact an array of random\n"
+           "                  values keeping those less than, greater than or not\n"
+           "                  equal to <value> using the scan library (scan.h)\n"
+           "  --scan-layouts  Instead of running <kernel> benchmark the local memory\n"
+           "                  layouts of the scan library on every device, and its\n"
+           "                  64-bit (cl_ulong) scan\n"
+           "  --results <file>\n"
+           "                  With --scan-layouts append the times to a results\n"
+           "                  file for perf_compare\n"
+           "  --in-place      Instead of running <kernel> scan an array of random\n"
+           "                  values in place in one mapped device buffer, using\n"
+           "                  about half the memory of the other modes\n"
+           "  --sub-devices <numa|n>\n"
+           "                  Instead of running <kernel> split the device into one\n"
+           "                  sub-device per NUMA node (or <n> equal ones) and scan\n"
+           "                  a slice of the array on each, then merge the carries\n"
+           "  --hybrid        Instead of running <kernel> scan an array in chunks split\n"
+           "                  between the device and host threads by a work-stealing\n"
+           "                  scheduler, then add the carries between chunks\n"
+           "  --chunk-size <n>   Elements per chunk for --hybrid (default 1048576)\n"
+           "  --host-threads <n> Host worker threads for --hybrid (default: hardware\n"
+           "                     threads - 1)\n"
+           "  --quiet         Fast start: skip the platform, device, context, program\n"
+           "                  and array printing (build logs only on failure)\n"
+           "  --timings       Report the time spent in each start up phase of <kernel>\n");
+    exit(1);
+}
+
+void cleanUp();
+
+void printArray(cl_int* array, cl_uint nElements)
+{
+    for (cl_uint index=0; index < nElements; ++index)
     {
-        showError(msg, quit);
-        if (quit) assert(0 && "Unreachable");
+        printf("Array[%u] = %d\n", index, array[index]);
     }
 }
 
-cl_platform_id pickPlatform()
+//Global for clean up convenience
+KernelSource kernelSource;
+BuildManager* buildManager=0;
+cl_program program=0;
+cl_context context=0;
+cl_command_queue cmdQueue=0;
+// prefix_sum(A, B, numOfIterations)
+clprobe::KernelFunctor<cl_mem, cl_mem, cl_int> prefixSumKernel;
+cl_event kernelEvent=0;
+cl_int* hostArrayA=0;
+cl_int* hostArrayB=0;
+cl_int* copiedBackArray=0;
+cl_mem arrayABuffer=0;
+cl_mem arrayBBuffer=0;
+ScanPlan* scanPlan=0;
+
+/* Slice of the array scanned by one sub-device (--sub-devices) */
+typedef struct
+{
+    cl_command_queue queue;
+    ScanPlan* plan;
+    cl_mem buffer;
+    cl_uint* mapped; /* Non NULL while mapped for the host */
+    cl_uint begin;
+    cl_uint end;
+} SubDeviceSlice;
+cl_device_id* subDevices=0;
+cl_uint numSubDevices=0;
+std::vector<SubDeviceSlice> slices;
+
+/* Parse "<lt|gt|ne>:<value>". Returns false if it is malformed */
+static bool parseCompactPredicate(const char* arg, CompactPredicate* predicate, cl_uint* value)
+{
+    if ( strlen(arg) < 4 || arg[2] != ':' )
+        return false;
+
+    if ( strncmp(arg, "lt", 2) == 0 )
+        *predicate = COMPACT_LESS_THAN;
+    else if ( strncmp(arg, "gt", 2) == 0 )
+        *predicate = COMPACT_GREATER_THAN;
+    else if ( strncmp(arg, "ne", 2) == 0 )
+        *predicate = COMPACT_NOT_EQUAL;
+    else
+        return false;
+
+    char* end=0;
+    errno = 0;
+    unsigned long parsed = strtoul(arg + 3, &end, 10);
+    if ( errno != 0 || *end != '\0' || parsed > 0xFFFFFFFFUL )
+        return false;
+
+    *value = (cl_uint) parsed;
+    return true;
+}
+
+/* Check and time exclusive scans of n elements from inBuffer with plan.
+*  expected and output hold n elements of the plan's type. The times are
+*  appended to resultsFile unless it is NULL.
+*/
+static cl_int timeScanPlan(ScanPlan* plan, const char* name, cl_device_id device, cl_command_queue queue,
+                           cl_mem inBuffer, cl_mem outBuffer, cl_uint n,
+                           const void* expected, void* output, const char* resultsFile)
 {
-    cl_uint numPlatforms=0;
-    cl_int err = clGetPlatformIDs(0, 0, &numPlatforms);
-    handleError(err, "Could not get number of platforms");
+    const unsigned int batches=5;
+    const unsigned int repetitions=10;
+    size_t bytes = getScanElementSize(plan) * n;
+
+    // Warm up and check
+    cl_int err = enqueueScan(plan, queue, inBuffer, outBuffer, n, SCAN_EXCLUSIVE, 0, NULL, NULL);
+    if ( err == CL_SUCCESS )
+        err = clEnqueueReadBuffer(queue, outBuffer, CL_TRUE, 0, bytes, output, 0, NULL, NULL);
+
+    if ( err == CL_SUCCESS && memcmp(output, expected, bytes) != 0 )
+    {
+        printf("  %-9s result is WRONG\n", name);
+        return CL_INVALID_VALUE;
+    }
 
-    if ( numPlatforms < 1 )
-        showError("Couldn't find a platform");
+    // Each sample is the mean of a batch of back to back scans so they
+    // still overlap as they would without the samples
+    double samples[batches];
+    double seconds=0.0;
+    for (unsigned int batch=0; err == CL_SUCCESS && batch < batches; ++batch)
+    {
+        double start = getHostTime();
+        for (unsigned int rep=0; err == CL_SUCCESS && rep < repetitions; ++rep)
+            err = enqueueScan(plan, queue, inBuffer, outBuffer, n, SCAN_EXCLUSIVE, 0, NULL, NULL);
+        if ( err == CL_SUCCESS )
+            err = clFinish(queue);
+        samples[batch] = ( getHostTime() - start ) / repetitions;
+        seconds += samples[batch] / batches;
+    }
+
+    if ( err == CL_SUCCESS )
+    {
+        printf("  %-9s block %4lu: %8.3f ms %8.2f GB/s\n", name,
+               (unsigned long) getScanBlockSize(plan), seconds * 1.0e3,
+               2.0 * bytes / seconds * 1.0e-9);
+    }
+
+    if ( err == CL_SUCCESS && resultsFile != NULL )
+        err = appendBenchmarkResult(resultsFile, device, "scan", name, n, samples, batches);
+    return err;
+}
+
+/* Scan variants timed by --scan-layouts: each local memory layout, then
+*  cl_ulong elements (padded layout) to show the cost of the wider
+*  accumulator.
+*/
+static const struct { ScanLayout layout; ScanElement element; const char* name; } scanVariants[] =
+{
+    { SCAN_LAYOUT_NAIVE, SCAN_ELEMENT_UINT, "naive" },
+    { SCAN_LAYOUT_PADDED, SCAN_ELEMENT_UINT, "padded" },
+    { SCAN_LAYOUT_SWIZZLED, SCAN_ELEMENT_UINT, "swizzled" },
+    { SCAN_LAYOUT_PADDED, SCAN_ELEMENT_ULONG, "padded64" }
+};
+static const unsigned int numScanVariants = sizeof(scanVariants)/sizeof(scanVariants[0]);
+
+/* A device benchmarked by --scan-layouts with the input and output
+*  buffers of each element type
+*/
+typedef struct
+{
+    cl_device_id device;
+    cl_uint platformIndex;
+    cl_uint deviceIndex;
+    cl_context ctx;
+    cl_command_queue queue;
+    cl_mem inBuffer;
+    cl_mem outBuffer;
+    cl_mem wideInBuffer;
+    cl_mem wideOutBuffer;
+    cl_int err; /* First failure on the device */
+} LayoutDevice;
+
+/* A plan being built for a variant on a device */
+typedef struct
+{
+    ScanPlan* plan;
+    size_t device; /* Index of the LayoutDevice */
+    unsigned int variant; /* Index into scanVariants */
+} LayoutPlan;
+
+static cl_int setUpLayoutDevice(LayoutDevice* layoutDevice, cl_uint n, const cl_uint* input, const cl_ulong* wideInput)
+{
+    cl_int err;
+    layoutDevice->ctx = clCreateContext(NULL, 1, &(layoutDevice->device), contextCallBack, NULL, &err);
+    if ( err != CL_SUCCESS )
+    {
+        printf("Failed to create context: %d\n", err);
+        return err;
+    }
+
+    layoutDevice->queue = clCreateCommandQueue(layoutDevice->ctx, layoutDevice->device, 0, &err);
+    if ( err == CL_SUCCESS )
+        layoutDevice->inBuffer = clCreateBuffer(layoutDevice->ctx, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR,
+                                                sizeof(cl_uint) * n, (void*) input, &err);
+    if ( err == CL_SUCCESS )
+        layoutDevice->outBuffer = clCreateBuffer(layoutDevice->ctx, CL_MEM_READ_WRITE,
+                                                 sizeof(cl_uint) * n, NULL, &err);
+
+    // 64-bit elements. Exact where the cl_uint sums wrap around
+    if ( err == CL_SUCCESS )
+        layoutDevice->wideInBuffer = clCreateBuffer(layoutDevice->ctx, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR,
+                                                    sizeof(cl_ulong) * n, (void*) wideInput, &err);
+    if ( err == CL_SUCCESS )
+        layoutDevice->wideOutBuffer = clCreateBuffer(layoutDevice->ctx, CL_MEM_READ_WRITE,
+                                                     sizeof(cl_ulong) * n, NULL, &err);
+    return err;
+}
+
+static void releaseLayoutDevice(LayoutDevice* layoutDevice)
+{
+    if ( layoutDevice->wideOutBuffer != 0 ) clReleaseMemObject(layoutDevice->wideOutBuffer);
+    if ( layoutDevice->wideInBuffer != 0 ) clReleaseMemObject(layoutDevice->wideInBuffer);
+    if ( layoutDevice->outBuffer != 0 ) clReleaseMemObject(layoutDevice->outBuffer);
+    if ( layoutDevice->inBuffer != 0 ) clReleaseMemObject(layoutDevice->inBuffer);
+    if ( layoutDevice->queue != 0 ) clReleaseCommandQueue(layoutDevice->queue);
+    if ( layoutDevice->ctx != 0 ) clReleaseContext(layoutDevice->ctx);
+}
+
+static void printLayoutDevice(const LayoutDevice* layoutDevice, cl_uint n)
+{
+    char deviceName[256] = "";
+    clGetDeviceInfo(layoutDevice->device, CL_DEVICE_NAME, sizeof(deviceName), deviceName, NULL);
+    printf("Platform %u device %u (%s), %u elements:\n",
+           layoutDevice->platformIndex, layoutDevice->deviceIndex, deviceName, n);
+}
+
+/* Benchmark the scan variants on every device of every platform. The
+*  builds of all the plans are queued up front and each plan is timed as
+*  soon as its program is ready. Returns the exit code.
+*/
+static int benchmarkScanLayouts(cl_uint n, const char* resultsFile)
+{
+    cl_uint* input = (cl_uint*) malloc( sizeof(cl_uint) * n );
+    cl_uint* expected = (cl_uint*) malloc( sizeof(cl_uint) * n );
+    cl_uint* output = (cl_uint*) malloc( sizeof(cl_uint) * n );
+    hostArrayA = (cl_int*) input;
+    hostArrayB = (cl_int*) expected;
+    copiedBackArray = (cl_int*) output;
+    if ( input == 0 || expected == 0 || output == 0 )
+    {
+        printf("Failed to malloc memory for host array\n");
+        return 1;
+    }
+
+    std::vector<cl_ulong> wideInput(n);
+    std::vector<cl_ulong> wideExpected(n);
+    std::vector<cl_ulong> wideOutput(n);
+
+    srand(1);
+    cl_uint sum=0;
+    cl_ulong wideSum=0;
+    for (cl_uint index=0; index < n; ++index)
+    {
+        input[index] = rand() % 1000;
+        expected[index] = sum;
+        sum += input[index];
+
+        wideInput[index] = input[index];
+        wideExpected[index] = wideSum;
+        wideSum += input[index];
+    }
 
     cl_platform_id* platforms=0;
-    cl_uint numberOfPlatforms;
-    err = getPlatformIDs(&platforms, &numberOfPlatforms);
-    handleError(err, "Could not get platform ID");
-    
-    // Just pick first platform
-    cl_platform_id platform = platforms[0];
+    cl_uint numOfPlatforms=0;
+    if ( getPlatformIDs(&platforms, &numOfPlatforms) != CL_SUCCESS )
+    {
+        printf("Failed to get platformsIDs\n");
+        return 1;
+    }
+
+    int result=0;
+    std::vector<LayoutDevice> layoutDevices;
+    for (cl_uint index=0; index < numOfPlatforms; ++index)
+    {
+        cl_device_id* devices=0;
+        cl_uint numDevices=0;
+        if ( getDeviceIDs(platforms[index], &devices, &numDevices) != CL_SUCCESS )
+        {
+            printf("Failed to get devices IDs\n");
+            result = 1;
+            continue;
+        }
+
+        for (cl_uint deviceIndex=0; deviceIndex < numDevices; ++deviceIndex)
+        {
+            LayoutDevice layoutDevice;
+            memset(&layoutDevice, 0, sizeof(layoutDevice));
+            layoutDevice.device = devices[deviceIndex];
+            layoutDevice.platformIndex = index;
+            layoutDevice.deviceIndex = deviceIndex;
+            layoutDevices.push_back(layoutDevice);
+        }
+        free(devices);
+    }
     free(platforms);
-    return platform;
+
+    cl_uint numBuilds = layoutDevices.size() * numScanVariants;
+    cl_uint maxConcurrentBuilds = std::thread::hardware_concurrency();
+    if ( maxConcurrentBuilds == 0 || maxConcurrentBuilds > numBuilds )
+        maxConcurrentBuilds = numBuilds;
+
+    // Build logs are only printed for failed builds
+    buildManager = createBuildManager(maxConcurrentBuilds, CL_FALSE);
+    if ( buildManager == NULL )
+    {
+        printf("Failed to create build manager\n");
+        return 1;
+    }
+
+    std::vector<LayoutPlan> plans;
+    for (size_t index=0; index < layoutDevices.size(); ++index)
+    {
+        LayoutDevice* layoutDevice = &layoutDevices[index];
+        layoutDevice->err = setUpLayoutDevice(layoutDevice, n, input, wideInput.data());
+        for (unsigned int variant=0; layoutDevice->err == CL_SUCCESS && variant < numScanVariants; ++variant)
+        {
+            LayoutPlan plan = { NULL, index, variant };
+            plan.plan = startScanPlanBuild(buildManager, layoutDevice->ctx, layoutDevice->device, n,
+                                           scanVariants[variant].layout, scanVariants[variant].element,
+                                           &(layoutDevice->err));
+            if ( plan.plan != NULL )
+                plans.push_back(plan);
+        }
+
+        if ( layoutDevice->err != CL_SUCCESS )
+        {
+            printLayoutDevice(layoutDevice, n);
+            printf("  Scan benchmark failed: %d\n", layoutDevice->err);
+            result = 1;
+        }
+    }
+
+    // Time the plans in the order their builds finish
+    size_t lastDevice = layoutDevices.size();
+    for (size_t built=0; built < plans.size(); ++built)
+    {
+        cl_program program=0;
+        waitForAnyProgramBuild(buildManager, &program);
+
+        LayoutPlan* plan=0;
+        for (size_t index=0; index < plans.size() && plan == NULL; ++index)
+        {
+            if ( plans[index].plan != NULL && getScanPlanProgram(plans[index].plan) == program )
+                plan = &plans[index];
+        }
+        if ( plan == NULL )
+            continue;
+
+        LayoutDevice* layoutDevice = &layoutDevices[plan->device];
+        if ( plan->device != lastDevice )
+        {
+            printLayoutDevice(layoutDevice, n);
+            lastDevice = plan->device;
+        }
+
+        // The build log is printed by finishScanPlanBuild() on failure
+        bool isWide = ( scanVariants[plan->variant].element == SCAN_ELEMENT_ULONG );
+        cl_int err = finishScanPlanBuild(buildManager, plan->plan);
+        if ( err == CL_SUCCESS && isWide )
+            err = timeScanPlan(plan->plan, scanVariants[plan->variant].name, layoutDevice->device,
+                               layoutDevice->queue, layoutDevice->wideInBuffer, layoutDevice->wideOutBuffer,
+                               n, wideExpected.data(), wideOutput.data(), resultsFile);
+        else if ( err == CL_SUCCESS )
+            err = timeScanPlan(plan->plan, scanVariants[plan->variant].name, layoutDevice->device,
+                               layoutDevice->queue, layoutDevice->inBuffer, layoutDevice->outBuffer,
+                               n, expected, output, resultsFile);
+
+        if ( err != CL_SUCCESS )
+        {
+            printf("  %-9s scan benchmark failed: %d\n", scanVariants[plan->variant].name, err);
+            if ( layoutDevice->err == CL_SUCCESS )
+                layoutDevice->err = err;
+            result = 1;
+        }
+
+        releaseScanPlan(plan->plan);
+        plan->plan = NULL;
+    }
+
+    for (size_t index=0; index < layoutDevices.size(); ++index)
+        releaseLayoutDevice(&layoutDevices[index]);
+    return result;
 }
 
-cl_device_id pickDevice(cl_platform_id platform)
+/* A scan split into chunks. Each chunk is scanned (inclusive) on its own
+*  and its total recorded. The carries are added once all chunks are done.
+*/
+typedef struct
 {
-    cl_device_id* devices;
-    cl_uint numberOfDevices;
+    const cl_uint* input;
+    cl_uint* output;
+    cl_uint* chunkTotals;
+} HybridScan;
 
-    cl_int err = getDeviceIDs(platform, &devices, &numberOfDevices);
+typedef struct
+{
+    HybridScan* scan;
+    cl_command_queue queue;
+    ScanPlan* plan;
+    cl_mem buffer; /* Holds one chunk */
+} DeviceScanWorker;
 
-    handleError(err, "Could not get device IDs");
+static cl_int scanChunkOnDevice(size_t chunk, size_t begin, size_t end, void* userData)
+{
+    DeviceScanWorker* worker = (DeviceScanWorker*) userData;
+    size_t bytes = sizeof(cl_uint) * (end - begin);
+    cl_int err = clEnqueueWriteBuffer(worker->queue, worker->buffer, CL_FALSE, 0, bytes,
+                                      worker->scan->input + begin, 0, NULL, NULL);
+    if ( err == CL_SUCCESS )
+        err = enqueueScan(worker->plan, worker->queue, worker->buffer, worker->buffer,
+                          end - begin, SCAN_INCLUSIVE, 0, NULL, NULL);
+    if ( err == CL_SUCCESS )
+        err = clEnqueueReadBuffer(worker->queue, worker->buffer, CL_TRUE, 0, bytes,
+                                  worker->scan->output + begin, 0, NULL, NULL);
+    if ( err != CL_SUCCESS )
+    {
+        printf("Device chunk %lu failed: %d\n", (unsigned long) chunk, err);
+        return err;
+    }
 
-    // Just pick first device
-    cl_device_id device = devices[0];
-    free(devices);
-    return device;
+    worker->scan->chunkTotals[chunk] = worker->scan->output[end -1];
+    return CL_SUCCESS;
 }
 
-void contextCallBack(const char* errInfo,
-                     const void* privateInfo,
-                     size_t cb,
-                     void* userData)
+static cl_int scanChunkOnHost(size_t chunk, size_t begin, size_t end, void* userData)
 {
-    static unsigned int count=0;
-    count++;
-    printf("Context Error (#%u): %s\n", count, errInfo);
+    HybridScan* scan = (HybridScan*) userData;
+    cl_uint sum=0;
+    for (size_t index=begin; index < end; ++index)
+    {
+        sum += scan->input[index];
+        scan->output[index] = sum;
+    }
+    scan->chunkTotals[chunk] = sum;
+    return CL_SUCCESS;
 }
 
-void usage(const char* progName)
+/* Inclusive scan of random values split between the device and host
+*  threads. It runs twice, the second run seeded with the throughput
+*  observed in the first. Returns the exit code.
+*/
+static int runHybridScan(cl_device_id device, cl_uint arraySize, cl_uint chunkSize, cl_uint numHostThreads)
 {
-    printf("Usage: %s <kernel file> <array_size>\n", progName);
-    exit(1);
+    cl_int err;
+    cl_uint* input = (cl_uint*) malloc( sizeof(cl_uint) * arraySize );
+    cl_uint* output = (cl_uint*) malloc( sizeof(cl_uint) * arraySize );
+    size_t numChunks = (arraySize + chunkSize -1) / chunkSize;
+    std::vector<cl_uint> chunkTotals(numChunks);
+    hostArrayA = (cl_int*) input;
+    copiedBackArray = (cl_int*) output;
+    if ( input == 0 || output == 0 )
+    {
+        printf("Failed to malloc memory for host array\n");
+        return 1;
+    }
+
+    srand(1);
+    for (cl_uint index=0; index < arraySize; ++index)
+        input[index] = rand() % 1000;
+
+    size_t deviceChunk = ( chunkSize < arraySize )? chunkSize : arraySize;
+    scanPlan = createScanPlan(context, device, deviceChunk, &err);
+    if ( scanPlan == NULL )
+    {
+        printf("Failed to create scan plan: %d\n", err);
+        return 1;
+    }
+
+    arrayABuffer = clCreateBuffer(context, CL_MEM_READ_WRITE, sizeof(cl_uint) * deviceChunk, NULL, &err);
+    if ( err != CL_SUCCESS )
+    {
+        printf("Failed to create buffer. Error:%d\n", err);
+        return 1;
+    }
+
+    HybridScan scan = { input, output, &chunkTotals[0] };
+    DeviceScanWorker deviceWorker = { &scan, cmdQueue, scanPlan, arrayABuffer };
+
+    // Worker 0 drives the device, the rest run the host code
+    std::vector<HybridWorker> workers;
+    HybridWorker deviceEntry = { "device", scanChunkOnDevice, &deviceWorker };
+    HybridWorker hostEntry = { "host", scanChunkOnHost, &scan };
+    workers.push_back(deviceEntry);
+    for (cl_uint index=0; index < numHostThreads; ++index)
+        workers.push_back(hostEntry);
+
+    std::vector<HybridWorkerStats> stats(workers.size());
+    printf("Scanning %u elements in %lu chunks of %u with the device and %u host threads\n",
+           arraySize, (unsigned long) numChunks, chunkSize, numHostThreads);
+
+    for (int run=0; run < 2; ++run)
+    {
+        double start = getHostTime();
+        err = runHybridSchedule(arraySize, chunkSize, workers.size(), &workers[0], &stats[0]);
+        double scheduled = getHostTime();
+        if ( err != CL_SUCCESS )
+        {
+            printf("Hybrid scan failed: %d\n", err);
+            return 1;
+        }
+
+        // Stitch the chunks together
+        cl_uint carry=0;
+        for (size_t chunk=0; chunk < numChunks; ++chunk)
+        {
+            size_t begin = chunk * chunkSize;
+            size_t end = ( begin + chunkSize < arraySize )? begin + chunkSize : arraySize;
+            if ( carry != 0 )
+            {
+                for (size_t index=begin; index < end; ++index)
+                    output[index] += carry;
+            }
+            carry += chunkTotals[chunk];
+        }
+        double finished = getHostTime();
+
+        printf("\n%s run: %.3f ms (chunks %.3f ms, carries %.3f ms)\n",
+               (run == 0)? "First" : "Seeded",
+               (finished - start) * 1.0e3, (scheduled - start) * 1.0e3, (finished - scheduled) * 1.0e3);
+        printHybridStats(workers.size(), &workers[0], &stats[0], /*Indent*/ 2);
+
+        cl_uint sum=0;
+        for (cl_uint index=0; index < arraySize; ++index)
+        {
+            sum += input[index];
+            if ( output[index] != sum )
+            {
+                printf("Hybrid scan result is WRONG at index %u\n", index);
+                return 1;
+            }
+        }
+    }
+
+    printf("Hybrid scan result is correct\n");
+    return 0;
 }
 
-/* The Client is responsible for freeing the memory
-*  allocated.
-*
-*  Returns a NULL pointer if file cannot be opened.
+/* Inclusive scan of random values in place. There is one device buffer,
+*  allocated in host visible memory, which is filled and checked through a
+*  mapping, plus the plan's block totals. The input is regenerated from
+*  the seed to check the result rather than kept. Returns the exit code.
 */
-char* loadKernelFromFile(const char* path)
+static int runInPlaceScan(cl_device_id device, cl_uint arraySize)
 {
-    char* source=0;
+    cl_int err;
+    size_t bytes = sizeof(cl_uint) * arraySize;
+    arrayABuffer = clCreateBuffer(context, CL_MEM_READ_WRITE | CL_MEM_ALLOC_HOST_PTR, bytes, NULL, &err);
+    if ( err != CL_SUCCESS )
+    {
+        printf("Failed to create buffer. Error:%d\n", err);
+        return 1;
+    }
 
-    struct stat fileInfo;
-    if( stat(path, &fileInfo) !=  0)
+    cl_uint* mapped = (cl_uint*) clEnqueueMapBuffer(cmdQueue, arrayABuffer, CL_TRUE, CL_MAP_WRITE,
+                                                    0, bytes, 0, NULL, NULL, &err);
+    if ( err != CL_SUCCESS )
     {
-        perror("Could not access file");
-        return NULL;
+        printf("Failed to map buffer. Error:%d\n", err);
+        return 1;
     }
 
-    /* File size in bytes */
-    off_t fileSize = fileInfo.st_size;
-    if ( fileSize < 1 )
+    srand(1);
+    for (cl_uint index=0; index < arraySize; ++index)
+        mapped[index] = rand() % 1000;
+
+    err = clEnqueueUnmapMemObject(cmdQueue, arrayABuffer, mapped, 0, NULL, NULL);
+    if ( err != CL_SUCCESS )
     {
-        printf("Reported file size of %ld bytes is invalid.\n", fileSize);
-        return NULL;
+        printf("Failed to unmap buffer. Error:%d\n", err);
+        return 1;
     }
 
-    FILE* f = fopen(path,"rb");
+    scanPlan = createScanPlan(context, device, arraySize, &err);
+    if ( scanPlan == NULL )
+    {
+        printf("Failed to create scan plan: %d\n", err);
+        return 1;
+    }
 
-    if (f == NULL)
+    double start = getHostTime();
+    err = enqueueScan(scanPlan, cmdQueue, arrayABuffer, arrayABuffer, arraySize,
+                      SCAN_INCLUSIVE, 0, NULL, &kernelEvent);
+    if ( err == CL_SUCCESS )
+        err = clWaitForEvents(1, &kernelEvent);
+    double duration = getHostTime() - start;
+    if ( err != CL_SUCCESS )
     {
-        perror("Failed to open file.");
-        return NULL;
+        printf("In-place scan failed: %d\n", err);
+        return 1;
     }
-    
-    // Allocated memory for file
-    source = (char*) malloc(  fileSize + 
-                            /* For '\0' terminator */ 1);
 
-    if (source == 0)
+    printf("In-place scan of %u elements in %.3f ms\n", arraySize, duration * 1.0e3);
+    printf("Device memory: %.2f MB array + %.2f KB block totals\n",
+           bytes / (1024.0 * 1024.0), getScanScratchSize(scanPlan) / 1024.0);
+
+    mapped = (cl_uint*) clEnqueueMapBuffer(cmdQueue, arrayABuffer, CL_TRUE, CL_MAP_READ,
+                                           0, bytes, 0, NULL, NULL, &err);
+    if ( err != CL_SUCCESS )
     {
-        printf("Could not allocated memory for kernel file.");
-        fclose(f);
-        return NULL;
+        printf("Failed to map buffer. Error:%d\n", err);
+        return 1;
     }
 
-    if ( fread(/*ptr*/ source, /* no of bytes */ 1 , fileSize , /*FILE*/ f) != ( (size_t) fileSize) )
+    srand(1);
+    cl_uint sum=0;
+    cl_uint wrongIndex=arraySize;
+    for (cl_uint index=0; index < arraySize && wrongIndex == arraySize; ++index)
     {
-        printf("Failed to read %s into memory.", path);
-        fclose(f);
-        free(source);
-        return NULL;
+        sum += rand() % 1000;
+        if ( mapped[index] != sum )
+            wrongIndex = index;
     }
 
-    // Write NULL terminator
-    source[fileSize] = '\0';
+    clEnqueueUnmapMemObject(cmdQueue, arrayABuffer, mapped, 0, NULL, NULL);
+    clFinish(cmdQueue);
+    if ( wrongIndex != arraySize )
+    {
+        printf("In-place scan result is WRONG at index %u\n", wrongIndex);
+        return 1;
+    }
 
-    return source;
+    printf("In-place scan result is correct\n");
+    return 0;
 }
 
+#ifdef CL_VERSION_1_2
+/* Map slice for the host, blocking until its commands are done */
+static cl_int mapSlice(SubDeviceSlice* slice, cl_map_flags flags)
+{
+    cl_int err;
+    slice->mapped = (cl_uint*) clEnqueueMapBuffer(slice->queue, slice->buffer, CL_TRUE, flags, 0,
+                                                  sizeof(cl_uint) * (slice->end - slice->begin),
+                                                  0, NULL, NULL, &err);
+    if ( err != CL_SUCCESS )
+        slice->mapped = NULL;
+    return err;
+}
 
-void cleanUp();
+static cl_int unmapSlice(SubDeviceSlice* slice)
+{
+    cl_int err = clEnqueueUnmapMemObject(slice->queue, slice->buffer, slice->mapped, 0, NULL, NULL);
+    slice->mapped = NULL;
+    return err;
+}
 
-void printArray(cl_int* array, cl_uint nElements)
+static void addCarry(SubDeviceSlice* slice, cl_uint carry)
 {
-    for (cl_uint index=0; index < nElements; ++index)
+    for (cl_uint index=0; index < slice->end - slice->begin; ++index)
+        slice->mapped[index] += carry;
+}
+
+/* Inclusive scan of random values split between sub-devices of device,
+*  one per NUMA node if count is 0 or else count equal ones. Each slice
+*  lives in a buffer the sub-device touches first (a fill on its queue)
+*  so on CPU runtimes its pages are placed on that sub-device's NUMA node.
+*  The slices are scanned at the same time, then a thread per slice adds
+*  the carry of the slices before it. Returns the exit code.
+*/
+static int runSubDeviceScan(cl_device_id device, cl_uint arraySize, cl_uint count)
+{
+    cl_int err = createSubDevices(device, count, &subDevices, &numSubDevices);
+    if ( err != CL_SUCCESS )
     {
-        printf("Array[%u] = %d\n", index, array[index]);
+        if ( count == 0 )
+            printf("Could not split the device by NUMA node, try --sub-devices <n>\n");
+        return 1;
+    }
+
+    if ( numSubDevices > arraySize )
+    {
+        printf("Array size must be at least the number of sub-devices (%u)\n", numSubDevices);
+        return 1;
+    }
+
+    context = clCreateContext(NULL, numSubDevices, subDevices, contextCallBack, NULL, &err);
+    if ( err != CL_SUCCESS )
+    {
+        printf("Failed to create context: %d\n", err);
+        return 1;
+    }
+
+    printf("Scanning %u elements on %u sub-devices (%s)\n", arraySize, numSubDevices,
+           (count == 0)? "one per NUMA node" : "equal partitions");
+
+    static const cl_uint zero=0;
+    slices.resize(numSubDevices);
+    for (cl_uint index=0; index < numSubDevices; ++index)
+    {
+        SubDeviceSlice* slice = &slices[index];
+        slice->begin = (cl_ulong) arraySize * index / numSubDevices;
+        slice->end = (cl_ulong) arraySize * (index + 1) / numSubDevices;
+        cl_uint elements = slice->end - slice->begin;
+
+        slice->queue = clCreateCommandQueue(context, subDevices[index], 0, &err);
+        if ( err == CL_SUCCESS )
+            slice->plan = createScanPlan(context, subDevices[index], elements, &err);
+        if ( err == CL_SUCCESS )
+            slice->buffer = clCreateBuffer(context, CL_MEM_READ_WRITE | CL_MEM_ALLOC_HOST_PTR,
+                                           sizeof(cl_uint) * elements, NULL, &err);
+        // First touch by the sub-device
+        if ( err == CL_SUCCESS )
+            err = clEnqueueFillBuffer(slice->queue, slice->buffer, &zero, sizeof(zero),
+                                      0, sizeof(cl_uint) * elements, 0, NULL, NULL);
+        if ( err != CL_SUCCESS )
+        {
+            printf("Failed to set up sub-device %u: %d\n", index, err);
+            return 1;
+        }
+
+        cl_uint computeUnits=0;
+        clGetDeviceInfo(subDevices[index], CL_DEVICE_MAX_COMPUTE_UNITS, sizeof(cl_uint), &computeUnits, NULL);
+        printf("  sub-device %u: %u compute units, elements [%u, %u)\n",
+               index, computeUnits, slice->begin, slice->end);
+    }
+
+    /* Fill the input through mappings, after the first touch */
+    srand(1);
+    for (cl_uint index=0; index < numSubDevices; ++index)
+    {
+        SubDeviceSlice* slice = &slices[index];
+        err = mapSlice(slice, CL_MAP_WRITE);
+        if ( err != CL_SUCCESS )
+        {
+            printf("Failed to map slice %u: %d\n", index, err);
+            return 1;
+        }
+
+        for (cl_uint element=0; element < slice->end - slice->begin; ++element)
+            slice->mapped[element] = rand() % 1000;
+
+        unmapSlice(slice);
     }
+
+    /* Scan every slice in place at the same time */
+    std::vector<cl_event> scanned(numSubDevices, (cl_event) 0);
+    double start = getHostTime();
+    for (cl_uint index=0; err == CL_SUCCESS && index < numSubDevices; ++index)
+    {
+        SubDeviceSlice* slice = &slices[index];
+        err = enqueueScan(slice->plan, slice->queue, slice->buffer, slice->buffer,
+                          slice->end - slice->begin, SCAN_INCLUSIVE, 0, NULL, &scanned[index]);
+        if ( err == CL_SUCCESS )
+            err = clFlush(slice->queue);
+    }
+    if ( err == CL_SUCCESS )
+        err = clWaitForEvents(numSubDevices, &scanned[0]);
+    double scannedTime = getHostTime();
+
+    for (cl_uint index=0; index < numSubDevices; ++index)
+    {
+        if ( scanned[index] != 0 )
+            clReleaseEvent(scanned[index]);
+    }
+
+    if ( err != CL_SUCCESS )
+    {
+        printf("Sub-device scan failed: %d\n", err);
+        return 1;
+    }
+
+    /* Merge the carries. Each slice's carry is the sum of those before it */
+    std::vector<cl_uint> carries(numSubDevices);
+    cl_uint carry=0;
+    for (cl_uint index=0; err == CL_SUCCESS && index < numSubDevices; ++index)
+    {
+        err = mapSlice(&slices[index], CL_MAP_READ | CL_MAP_WRITE);
+        if ( err == CL_SUCCESS )
+        {
+            carries[index] = carry;
+            carry += slices[index].mapped[slices[index].end - slices[index].begin - 1];
+        }
+    }
+    if ( err != CL_SUCCESS )
+    {
+        printf("Failed to map slices: %d\n", err);
+        return 1;
+    }
+
+    std::vector<std::thread> threads;
+    for (cl_uint index=1; index < numSubDevices; ++index)
+        threads.push_back(std::thread(addCarry, &slices[index], carries[index]));
+    for (size_t index=0; index < threads.size(); ++index)
+        threads[index].join();
+    double mergedTime = getHostTime();
+
+    printf("Scan %.3f ms, carry merge %.3f ms, total %.3f ms\n", (scannedTime - start) * 1.0e3,
+           (mergedTime - scannedTime) * 1.0e3, (mergedTime - start) * 1.0e3);
+
+    /* Check against the same random values */
+    srand(1);
+    cl_uint sum=0;
+    for (cl_uint index=0; index < numSubDevices; ++index)
+    {
+        const SubDeviceSlice* slice = &slices[index];
+        for (cl_uint element=0; element < slice->end - slice->begin; ++element)
+        {
+            sum += rand() % 1000;
+            if ( slice->mapped[element] != sum )
+            {
+                printf("Sub-device scan result is WRONG at index %u\n", slice->begin + element);
+                return 1;
+            }
+        }
+    }
+
+    printf("Sub-device scan result is correct\n");
+    return 0;
+}
+#else
+static int runSubDeviceScan(cl_device_id, cl_uint, cl_uint)
+{
+    printf("Sub-devices need OpenCL 1.2\n");
+    return 1;
 }
+#endif
 
-//Global for clean up convenience
-char* kernelSource=0;
-cl_program program=0;
-cl_context context=0;
-cl_command_queue cmdQueue=0;
-cl_kernel kernel=0;
-cl_int* hostArrayA=0;
-cl_int* hostArrayB=0;
-cl_int* copiedBackArray=0;
-cl_mem arrayABuffer=0;
-cl_mem arrayBBuffer=0;
+/* Compact an array of random values on the device and check the result
+*  against the host. Returns the exit code.
+*/
+static int runCompaction(cl_device_id device,
+                         cl_uint arraySize,
+                         CompactPredicate predicate,
+                         cl_uint value)
+{
+    cl_int err;
+    cl_uint* input = (cl_uint*) malloc( sizeof(cl_uint) * arraySize );
+    cl_uint* output = (cl_uint*) malloc( sizeof(cl_uint) * arraySize );
+    hostArrayA = (cl_int*) input;
+    copiedBackArray = (cl_int*) output;
+    if ( input == 0 || output == 0 )
+    {
+        printf("Failed to malloc memory for host array\n");
+        return 1;
+    }
+
+    srand(1);
+    for (cl_uint index=0; index < arraySize; ++index)
+        input[index] = rand() % 1000;
+
+    scanPlan = createScanPlan(context, device, arraySize, &err);
+    if ( scanPlan == NULL )
+    {
+        printf("Failed to create scan plan: %d\n", err);
+        return 1;
+    }
+
+    arrayABuffer = clCreateBuffer(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR,
+                                  sizeof(cl_uint) * arraySize, input, &err);
+    if ( err == CL_SUCCESS )
+        arrayBBuffer = clCreateBuffer(context, CL_MEM_WRITE_ONLY,
+                                      sizeof(cl_uint) * arraySize, NULL, &err);
+
+    if ( err != CL_SUCCESS )
+    {
+        printf("Failed to create buffer. Error:%d\n", err);
+        return 1;
+    }
+
+    double start = getHostTime();
+    err = enqueueCompact(scanPlan, cmdQueue, arrayABuffer, arrayBBuffer, arraySize,
+                         predicate, value, 0, NULL, &kernelEvent);
+    if ( err != CL_SUCCESS )
+    {
+        printf("Failed to enqueue compaction: %d\n", err);
+        return 1;
+    }
+
+    // The count arrives with the event so no separate blocking read is needed
+    err = clWaitForEvents(1, &kernelEvent);
+    double duration = getHostTime() - start;
+    if ( err != CL_SUCCESS )
+    {
+        printf("Compaction failed: %d\n", err);
+        return 1;
+    }
+
+    cl_uint count = getCompactCount(scanPlan);
+    printf("Compaction kept %u of %u elements in %.3f ms\n", count, arraySize, duration * 1.0e3);
+
+    if ( count > 0 )
+    {
+        err = clEnqueueReadBuffer(cmdQueue, arrayBBuffer, CL_TRUE, 0, sizeof(cl_uint) * count,
+                                  output, 0, NULL, NULL);
+        if ( err != CL_SUCCESS )
+        {
+            printf("Failed to read back result. Error:%d\n", err);
+            return 1;
+        }
+    }
+
+    /* Check against the host */
+    cl_uint expected=0;
+    for (cl_uint index=0; index < arraySize; ++index)
+    {
+        cl_uint x = input[index];
+        bool keep = ( predicate == COMPACT_LESS_THAN && x < value ) ||
+                    ( predicate == COMPACT_GREATER_THAN && x > value ) ||
+                    ( predicate == COMPACT_NOT_EQUAL && x != value );
+        if ( !keep )
+            continue;
+
+        if ( expected >= count || output[expected] != x )
+        {
+            printf("Compaction result is WRONG at output index %u\n", expected);
+            return 1;
+        }
+        ++expected;
+    }
+
+    if ( expected != count )
+    {
+        printf("Compaction result is WRONG: expected %u elements\n", expected);
+        return 1;
+    }
+
+    printf("Compaction result is correct\n");
+    return 0;
+}
 
 int main(int argc, char** argv)
 {
-    if (argc != 3)
+    double startTime = getHostTime();
+    StartupTimings timings = {};
+    double phaseStart=0.0;
+    bool quiet=false;
+    bool reportTimings=false;
+    const char* peaksFile=0;
+    const char* traceFile=0;
+    const char* resultsFile=0;
+    bool compactMode=false;
+    bool scanLayoutsMode=false;
+    bool hybridMode=false;
+    bool inPlaceMode=false;
+    bool subDeviceMode=false;
+    cl_uint subDeviceCount=0;
+    cl_uint chunkSize=1 << 20;
+    unsigned int hardwareThreads = std::thread::hardware_concurrency();
+    cl_uint numHostThreads = ( hardwareThreads > 1 )? hardwareThreads - 1 : 1;
+    CompactPredicate compactPredicate=COMPACT_NOT_EQUAL;
+    cl_uint compactValue=0;
+    static struct option longOptions[] =
+    {
+        { "peaks", required_argument, 0, 'p' },
+        { "trace", required_argument, 0, 'T' },
+        { "compact", required_argument, 0, 'c' },
+        { "scan-layouts", no_argument, 0, 's' },
+        { "results", required_argument, 0, 'o' },
+        { "hybrid", no_argument, 0, 'y' },
+        { "in-place", no_argument, 0, 'i' },
+        { "sub-devices", required_argument, 0, 'D' },
+        { "chunk-size", required_argument, 0, 'z' },
+        { "host-threads", required_argument, 0, 't' },
+        { "quiet", no_argument, 0, 'q' },
+        { "timings", no_argument, 0, 'm' },
+        { 0, 0, 0, 0 }
+    };
+
+    int option=0;
+    while ( (option = getopt_long(argc, argv, "p:c:so:yiD:z:t:T:qm", longOptions, NULL)) != -1 )
+    {
+        switch (option)
+        {
+            case 'p':
+                peaksFile = optarg;
+                break;
+            case 'T':
+                traceFile = optarg;
+                break;
+            case 'c':
+                compactMode = true;
+                if ( !parseCompactPredicate(optarg, &compactPredicate, &compactValue) )
+                {
+                    printf("Invalid compaction predicate: %s\n", optarg);
+                    usage(argv[0]);
+                }
+                break;
+            case 's':
+                scanLayoutsMode = true;
+                break;
+            case 'o':
+                resultsFile = optarg;
+                break;
+            case 'y':
+                hybridMode = true;
+                break;
+            case 'i':
+                inPlaceMode = true;
+                break;
+            case 'D':
+                subDeviceMode = true;
+                subDeviceCount = ( strcmp(optarg, "numa") == 0 )? 0 : atoi(optarg);
+                if ( subDeviceCount == 0 && strcmp(optarg, "numa") != 0 )
+                {
+                    printf("Invalid number of sub-devices: %s\n", optarg);
+                    usage(argv[0]);
+                }
+                break;
+            case 'z':
+                chunkSize = atoi(optarg);
+                break;
+            case 't':
+                numHostThreads = atoi(optarg);
+                break;
+            case 'q':
+                quiet = true;
+                break;
+            case 'm':
+                reportTimings = true;
+                break;
+            default:
+                usage(argv[0]);
+        }
+    }
+
+    int numModes = (compactMode? 1 : 0) + (scanLayoutsMode? 1 : 0) + (hybridMode? 1 : 0) +
+                   (inPlaceMode? 1 : 0) + (subDeviceMode? 1 : 0);
+    if (argc - optind != ((numModes > 0)? 1 : 2) || numModes > 1 || chunkSize == 0 ||
+        ( resultsFile != NULL && !scanLayoutsMode ))
     {
         usage(argv[0]);
         assert(0 && "Unreachable");
     }
 
-    kernelSource = loadKernelFromFile( argv[1]);
-    unsigned int arraySize = atoi( argv[2] );
-    printf("Using array size of %u\n", arraySize);
+    if ( scanLayoutsMode )
+    {
+        unsigned int arraySize = atoi( argv[optind] );
+        if ( arraySize == 0 )
+        {
+            printf("Array size must be > 0\n");
+            exit(1);
+        }
+
+        int result = benchmarkScanLayouts(arraySize, resultsFile);
+        cleanUp();
+        return result;
+    }
+
+    if ( subDeviceMode )
+    {
+        unsigned int arraySize = atoi( argv[optind] );
+        if ( arraySize == 0 )
+        {
+            printf("Array size must be > 0\n");
+            exit(1);
+        }
+
+        cl_platform_id platform = pickPlatform();
+        cl_device_id device = pickDevice(platform);
+        int result = runSubDeviceScan(device, arraySize, subDeviceCount);
+        cleanUp();
+        return result;
+    }
+
+    if ( compactMode || hybridMode || inPlaceMode )
+    {
+        unsigned int arraySize = atoi( argv[optind] );
+        if ( arraySize == 0 )
+        {
+            printf("Array size must be > 0\n");
+            exit(1);
+        }
+
+        cl_platform_id platform = pickPlatform();
+        cl_device_id device = pickDevice(platform);
+        cl_int err;
+        cl_context_properties cProp[] = { CL_CONTEXT_PLATFORM, (cl_context_properties) platform, 0 };
+        context = clCreateContext(cProp, 1, &device, contextCallBack, NULL, &err);
+        if ( err == CL_SUCCESS )
+            cmdQueue = clCreateCommandQueue(context, device, 0, &err);
+
+        if ( err != CL_SUCCESS )
+        {
+            printf("Failed to create context or command queue: %d\n", err);
+            cleanUp();
+            exit(1);
+        }
+
+        int result=0;
+        if ( compactMode )
+            result = runCompaction(device, arraySize, compactPredicate, compactValue);
+        else if ( inPlaceMode )
+            result = runInPlaceScan(device, arraySize);
+        else
+            result = runHybridScan(device, arraySize, chunkSize, numHostThreads);
+        cleanUp();
+        return result;
+    }
+
+    const char* kernelName = argv[optind];
+    phaseStart = getHostTime();
+    cl_int err = getKernelSource( kernelName,
+                                  embeddedKernels,
+                                  sizeof(embeddedKernels)/sizeof(EmbeddedKernel),
+                                  &kernelSource);
+    timings.kernelLoad = getHostTime() - phaseStart;
+    unsigned int arraySize = atoi( argv[optind + 1] );
+    if ( !quiet )
+        printf("Using array size of %u\n", arraySize);
 
     // Check is power of 2
     if ( (arraySize & (arraySize -1)) != 0 || arraySize <= 0)
@@ -176,33 +1175,40 @@ int main(int argc, char** argv)
     /* compute number of loop iterations */
     // do log_2(arraySize)
     int numOfIterations = __builtin_ctz(arraySize);
-    printf("Computed # of loop iterations: %d\n", numOfIterations);
+    if ( !quiet )
+        printf("Computed # of loop iterations: %d\n", numOfIterations);
 
-    if (kernelSource == NULL)
+    if (err != CL_SUCCESS)
     {
-        printf("Could not open OpenCL kernel: %s\n", argv[1]);
+        printf("Could not open OpenCL kernel: %s\n", kernelName);
         exit(1);
     }
-    else
+    else if ( !quiet )
     {
-        printf("%s loaded as string into memory.\n", argv[1]);
+        printf("%s loaded as string into memory.\n", kernelName);
     }
 
     cl_platform_id platform=0;
     cl_device_id device=0;
-    cl_int err=CL_SUCCESS;
-
-    platform = pickPlatform();
-    printf("Selected Platform:\n");
-    printPlatformInfo(platform,0);
-    printf("\n");
 
+    phaseStart = getHostTime();
+    platform = pickPlatform(&timings.icdLoad);
     device = pickDevice(platform);
-    printf("Selected Device:\n");
-    printDeviceInfo(device, 0);
-    printf("\n");
+    timings.platformEnumeration = getHostTime() - phaseStart - timings.icdLoad;
+
+    if ( !quiet )
+    {
+        printf("Selected Platform:\n");
+        printPlatformInfo(platform,0);
+        printf("\n");
+
+        printf("Selected Device:\n");
+        printDeviceInfo(device, 0);
+        printf("\n");
+    }
 
     /* Create Context */
+    phaseStart = getHostTime();
     cl_context_properties cProp[] = { CL_CONTEXT_PLATFORM, (cl_context_properties) platform, 0 };
     context= clCreateContext( /*properties*/ cProp,
                               /*num_device*/ 1,
@@ -218,17 +1224,19 @@ int main(int argc, char** argv)
         cleanUp();
         exit(1);
     }
-    else
+    else if ( !quiet )
+    {
         printf("Created context.\n");
 
-    printf("Context:\n");
-    err = printContextInfo(context,0);
-    printf("\n");
+        printf("Context:\n");
+        err = printContextInfo(context,0);
+        printf("\n");
+    }
 
-    /* Create command queue */
+    /* Create command queue. Profiling is used to time the kernel */
     cmdQueue = clCreateCommandQueue( context,
                                      device,
-                                     /*properties */ 0,
+                                     /*properties */ CL_QUEUE_PROFILING_ENABLE,
                                      &err
                                    );
 
@@ -238,14 +1246,16 @@ int main(int argc, char** argv)
         cleanUp();
         exit(1);
     }
+    // Excludes the context info printing
+    timings.contextCreation = getHostTime() - phaseStart;
 
     /* Create kernel */
-    program = clCreateProgramWithSource( context, 
-                                         /*number of strings*/ 1,
-                                         (const char**)  &kernelSource,
-                                         /* NULL terminated, don't need lengths*/ NULL,
-                                         &err
-                                       );
+    program = createProgramFromKernelSource( context,
+                                             device,
+                                             &kernelSource,
+                                             /* Compiler options */ NULL,
+                                             &err
+                                           );
 
     if ( err != CL_SUCCESS )
     {
@@ -254,36 +1264,33 @@ int main(int argc, char** argv)
         exit(1);
     }
 
-    /* Compile Kernel */
-    printf("Trying to compile & link kernel.\n");
-    err = clBuildProgram( program, 
-                          /* num_devices */ 1,
-                          /* devices*/ &device,
-                          /* Compiler options */ NULL,
-                          /* Callback */ NULL,
-                          /* User Data for call back */ NULL
-                        );
-
+    /* Compile Kernel. Host side set up continues while it builds */
+    if ( !quiet )
+        printf("Trying to compile & link kernel.\n");
     #ifndef KLEE_CL
-    // Output build log
-    printProgramBuildInfo(program, device, /*Indent*/ 0);
+    // One program so one worker. The build log is output when the build is
+    // waited for, in quiet mode only on failure
+    buildManager = createBuildManager(/*maxConcurrentBuilds*/ 1, /*printBuildLogs*/ quiet? CL_FALSE : CL_TRUE);
+    #else
+    buildManager = createBuildManager(/*maxConcurrentBuilds*/ 1, /*printBuildLogs*/ CL_FALSE);
     #endif
-    if ( err != CL_SUCCESS )
+    if ( buildManager == NULL )
     {
-        printf("Build failed\n");
+        printf("Failed to create build manager\n");
         cleanUp();
         exit(1);
     }
 
-    #ifndef KLEE_CL
-    printProgramInfo(program, /*Indent*/ 0);
-    #endif
-
-    /* Create kernel object */
-    kernel = clCreateKernel( program, "prefix_sum", &err);
-    if (err != CL_SUCCESS )
+    phaseStart = getHostTime();
+    err = startProgramBuild( buildManager,
+                             program,
+                             /* num_devices */ 1,
+                             /* devices*/ &device,
+                             /* Compiler options */ NULL
+                           );
+    if ( err != CL_SUCCESS )
     {
-        printf("Failed to create kernel object.\n");
+        printf("Failed to start build\n");
         cleanUp();
         exit(1);
     }
@@ -311,13 +1318,17 @@ int main(int argc, char** argv)
         hostArrayB[index] = 0;
     }
 
-    printf("Created Array:\n");
-    printArray( hostArrayA, arraySize);
-    printf("\n");
-    printArray( hostArrayB, arraySize);
-    printf("\n");
+    if ( !quiet )
+    {
+        printf("Created Array:\n");
+        printArray( hostArrayA, arraySize);
+        printf("\n");
+        printArray( hostArrayB, arraySize);
+        printf("\n");
+    }
 
     // Create Buffer
+    TRACE_BEGIN("create buffers");
     arrayABuffer = clCreateBuffer(context,
                                  CL_MEM_READ_WRITE | CL_MEM_COPY_HOST_PTR,
                                  sizeof(cl_int) * arraySize,
@@ -347,24 +1358,38 @@ int main(int argc, char** argv)
     }
 
 
+    TRACE_END();
+
+    /* Wait for the kernel we need to finish building */
+    err = waitForProgramBuild(buildManager, program);
+    timings.build = getHostTime() - phaseStart;
+    if ( err != CL_SUCCESS )
+    {
+        printf("Build failed\n");
+        #ifndef KLEE_CL
+        if ( quiet )
+            printProgramBuildInfo(program, device, /*Indent*/ 0);
+        #endif
+        cleanUp();
+        exit(1);
+    }
+
+    #ifndef KLEE_CL
+    if ( !quiet )
+        printProgramInfo(program, /*Indent*/ 0);
+    #endif
+
+    /* Create kernel object, checking its signature */
+    prefixSumKernel = clprobe::KernelFunctor<cl_mem, cl_mem, cl_int>::create(program, "prefix_sum", &err);
+    if (err != CL_SUCCESS )
+    {
+        printf("Failed to create kernel object.\n");
+        cleanUp();
+        exit(1);
+    }
+
     /* Setup kernel arguments */
-    err |= clSetKernelArg( kernel,
-                          /* argument index*/ 0,
-                          sizeof(cl_mem),
-                          &arrayABuffer
-                        );
-
-    err |= clSetKernelArg( kernel,
-                          /* argument index*/ 1,
-                          sizeof(cl_mem),
-                          &arrayBBuffer
-                        );
-
-    err |= clSetKernelArg( kernel,
-                          /* argument index*/ 2,
-                          sizeof(int),
-                          &numOfIterations
-                        );
+    err = prefixSumKernel.setArgs(arrayABuffer, arrayBBuffer, numOfIterations);
 
     if ( err != CL_SUCCESS )
     {
@@ -376,18 +1401,41 @@ int main(int argc, char** argv)
     size_t globalWorkSize[] = { arraySize };
     size_t localWorkSize[] = { arraySize };
 
-    printf("Enquing kernel.\n");
+    #ifndef KLEE_CL
+    if ( !quiet )
+    {
+        printf("Kernel:\n");
+        printKernelWorkGroupInfo(prefixSumKernel.get(), device, /*Indent*/ 0);
+        printf("\n");
+    }
+
+    /* Reject launches that exceed the kernel's limits on this device */
+    if ( checkWorkGroupSize(prefixSumKernel.get(), device, 1, localWorkSize) != CL_SUCCESS )
+    {
+        // Every iteration needs the whole array, it cannot be split
+        printf("prefix_sum needs the whole array in one work group, use a smaller array\n");
+        cleanUp();
+        exit(1);
+    }
+    #endif
+
+    if ( !quiet )
+        printf("Enquing kernel.\n");
     /* Enqueue kernel */
+    phaseStart = getHostTime();
+    TRACE_BEGIN("enqueue kernel");
     err = clEnqueueNDRangeKernel( cmdQueue,
-                                  kernel,
+                                  prefixSumKernel.get(),
                                   /* Work dim */ 1,
                                   /* global_work_offset */ NULL,
                                   /* global_work_size */ globalWorkSize,
                                   /* local_work_size */ localWorkSize,
                                   /* num_events_in_wait_list */ 0,
                                   /* event_wait_list */ NULL,
-                                  /* event */ NULL
+                                  /* event */ &kernelEvent
                                  );
+    TRACE_END();
+    TRACE_DEVICE_EVENT("prefix_sum", kernelEvent);
 
     if ( err != CL_SUCCESS )
     {
@@ -397,6 +1445,7 @@ int main(int argc, char** argv)
     }
 
     /* Read back array */
+    TRACE_BEGIN("read back");
     cl_mem resultBuffer = (numOfIterations % 2 != 0)? arrayBBuffer: arrayABuffer;
     err = clEnqueueReadBuffer( cmdQueue,
                                resultBuffer,
@@ -408,11 +1457,43 @@ int main(int argc, char** argv)
                                /* event_wait_list */ NULL,
                                /* event */ NULL
                              );
+    TRACE_END();
+    timings.firstLaunch = getHostTime() - phaseStart;
+
+    if ( !quiet )
+    {
+        printf("\nReading back array:\n");
+        printArray( copiedBackArray, arraySize);
+    }
+
+    if ( reportTimings )
+        printStartupTimings(&timings, getHostTime() - startTime);
 
+    /* Report kernel performance */
+    double kernelTime=0.0;
+    err = getEventDuration(kernelEvent, &kernelTime);
+    if ( err == CL_SUCCESS )
+    {
+        printf("\nKernel execution time: %.3f ms\n", kernelTime * 1.0e3);
+
+        DevicePeaks peaks;
+        if ( getDevicePeaks(peaksFile, device, &peaks) == CL_SUCCESS )
+        {
+            KernelWork work = prefixSumWork(arraySize, numOfIterations);
+            printRooflineReport(&work, kernelTime, &peaks, /*Indent*/ 0);
+        }
+    }
+    else
+        printf("Could not get kernel execution time\n");
 
+    if ( traceFile != 0 )
+    {
+        if ( CLPROBE_TRACING_ENABLED )
+            TRACE_WRITE(traceFile);
+        else
+            printf("Tracing is not enabled in this build (cmake -DENABLE_TRACING=ON)\n");
+    }
 
-    printf("\nReading back array:\n");
-    printArray( copiedBackArray, arraySize);
     cleanUp();
     return 0;
 }
@@ -420,14 +1501,54 @@ int main(int argc, char** argv)
 void cleanUp()
 {
     cl_int err=0;
-    free(kernelSource);
+    releaseKernelSource(&kernelSource);
+
+    // Waits for any outstanding build
+    releaseBuildManager(buildManager);
+    releaseScanPlan(scanPlan);
+
+    for (size_t index=0; index < slices.size(); ++index)
+    {
+        SubDeviceSlice* slice = &slices[index];
+        if (slice->mapped!=NULL)
+        {
+            clEnqueueUnmapMemObject(slice->queue, slice->buffer, slice->mapped, 0, NULL, NULL);
+            clFinish(slice->queue);
+        }
+        releaseScanPlan(slice->plan);
+        if (slice->buffer!=0)
+        {
+            err = clReleaseMemObject(slice->buffer);
+            handleError(err, "Couldn't release buffer", false);
+        }
+        if (slice->queue!=0)
+        {
+            err = clReleaseCommandQueue(slice->queue);
+            handleError(err, "Couldn't release command queue", false);
+        }
+    }
+    slices.clear();
+
+    if (kernelEvent!=0)
+    {
+        err = clReleaseEvent(kernelEvent);
+        handleError(err, "Couldn't release event", false);
+    }
+
+    if (arrayABuffer!=0)
+    {
+        err = clReleaseMemObject(arrayABuffer);
+        handleError(err, "Couldn't release buffer", false);
+    }
 
-    if (kernel!=0)
+    if (arrayBBuffer!=0)
     {
-        err = clReleaseKernel(kernel);
-        handleError(err, "Couldn't release kernel", false);
+        err = clReleaseMemObject(arrayBBuffer);
+        handleError(err, "Couldn't release buffer", false);
     }
 
+    prefixSumKernel.reset();
+
     if (program!= 0)
     {
         err = clReleaseProgram(program);
@@ -446,6 +1567,15 @@ void cleanUp()
         handleError(err, "Couldn't release context", false);
     }
 
+    #ifdef CL_VERSION_1_2
+    for (cl_uint index=0; index < numSubDevices; ++index)
+    {
+        err = clReleaseDevice(subDevices[index]);
+        handleError(err, "Couldn't release sub-device", false);
+    }
+    #endif
+    free(subDevices);
+
     if (hostArrayA !=0)
         free(hostArrayA);
 
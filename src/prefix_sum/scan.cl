@@ -0,0 +1,168 @@
+// Work efficient (Blelloch) scan of cl_uint values (or SCAN_T, see below)
+// used by the scan library (scan.h). Each work group scans a block of 2 * local size
+// elements in local memory. The total of each block is written to
+// blockSums so the blocks can be stitched together by scanning blockSums
+// and adding the results back with add_block_offsets.
+//
+// The local size must be a power of two.
+//
+// The strided accesses of the scan tree all hit the same local memory
+// bank on devices with banked local memory. The layout of the block in
+// local memory is selected with -DSCAN_LAYOUT=N (must match ScanLayout in
+// scan.h):
+//   0  Naive, element i at temp[i]
+//   1  Padded, one unused element after every NUM_BANKS elements
+//   2  Swizzled, the bank bits of i are XORed with the bits above them.
+//      Needs no extra local memory.
+//
+// The element type of scan_blocks and add_block_offsets is SCAN_T (uint
+// unless built with e.g. -DSCAN_T=ulong). The compaction kernels always
+// use uint.
+
+#ifndef SCAN_T
+#define SCAN_T uint
+#endif
+
+#ifndef SCAN_LAYOUT
+#define SCAN_LAYOUT 1
+#endif
+
+#ifndef LOG_NUM_BANKS
+#define LOG_NUM_BANKS 5
+#endif
+
+#define NUM_BANKS (1 << LOG_NUM_BANKS)
+
+#if SCAN_LAYOUT == 1
+#define LOCAL_INDEX(I) ( (I) + ( (I) >> LOG_NUM_BANKS ) )
+#elif SCAN_LAYOUT == 2
+#define LOCAL_INDEX(I) ( (I) ^ ( ( (I) >> LOG_NUM_BANKS ) & (NUM_BANKS - 1) ) )
+#else
+#define LOCAL_INDEX(I) (I)
+#endif
+
+__kernel void scan_blocks(__global const SCAN_T* in,
+                          __global SCAN_T* out,
+                          __global SCAN_T* blockSums,
+                          __local SCAN_T* temp,
+                          uint n,
+                          int inclusive)
+{
+    size_t lid = get_local_id(0);
+    size_t blockSize = 2 * get_local_size(0);
+    size_t base = get_group_id(0) * blockSize;
+
+    // Each work item loads elements lid and lid + local size of the block
+    // so neighbouring work items access neighbouring elements (coalesced).
+    // in and out may be the same buffer. Every element of the block is read
+    // before any is written.
+    size_t ai = lid;
+    size_t bi = lid + get_local_size(0);
+    SCAN_T a = ( base + ai < n )? in[base + ai] : 0;
+    SCAN_T b = ( base + bi < n )? in[base + bi] : 0;
+    temp[LOCAL_INDEX(ai)] = a;
+    temp[LOCAL_INDEX(bi)] = b;
+
+    // Up-sweep (reduce) phase
+    size_t offset = 1;
+    for (size_t d = blockSize >> 1; d > 0; d >>= 1)
+    {
+        barrier(CLK_LOCAL_MEM_FENCE);
+        if ( lid < d )
+        {
+            size_t left = offset * (2 * lid + 1) - 1;
+            size_t right = offset * (2 * lid + 2) - 1;
+            temp[LOCAL_INDEX(right)] += temp[LOCAL_INDEX(left)];
+        }
+        offset <<= 1;
+    }
+
+    if ( lid == 0 )
+    {
+        blockSums[get_group_id(0)] = temp[LOCAL_INDEX(blockSize - 1)];
+        temp[LOCAL_INDEX(blockSize - 1)] = 0;
+    }
+
+    // Down-sweep phase
+    for (size_t d = 1; d < blockSize; d <<= 1)
+    {
+        offset >>= 1;
+        barrier(CLK_LOCAL_MEM_FENCE);
+        if ( lid < d )
+        {
+            size_t left = offset * (2 * lid + 1) - 1;
+            size_t right = offset * (2 * lid + 2) - 1;
+            SCAN_T t = temp[LOCAL_INDEX(left)];
+            temp[LOCAL_INDEX(left)] = temp[LOCAL_INDEX(right)];
+            temp[LOCAL_INDEX(right)] += t;
+        }
+    }
+    barrier(CLK_LOCAL_MEM_FENCE);
+
+    if ( base + ai < n )
+        out[base + ai] = temp[LOCAL_INDEX(ai)] + ( inclusive? a : 0 );
+    if ( base + bi < n )
+        out[base + bi] = temp[LOCAL_INDEX(bi)] + ( inclusive? b : 0 );
+}
+
+// Add the scanned block totals to every element of each block.
+__kernel void add_block_offsets(__global SCAN_T* data,
+                                __global const SCAN_T* blockOffsets,
+                                uint n)
+{
+    size_t localSize = get_local_size(0);
+    size_t index = get_group_id(0) * 2 * localSize + get_local_id(0);
+    SCAN_T offset = blockOffsets[get_group_id(0)];
+
+    if ( index < n )
+        data[index] += offset;
+    if ( index + localSize < n )
+        data[index + localSize] += offset;
+}
+
+// Stream compaction. The predicate values must match CompactPredicate in
+// scan.h. The flags written by compact_flags are scanned (exclusive) to
+// give each kept element its position in the output.
+#define COMPACT_NOT_EQUAL 0
+#define COMPACT_LESS_THAN 1
+#define COMPACT_GREATER_THAN 2
+
+#define KEEP(X, PREDICATE, VALUE) \
+    ( ( (PREDICATE) == COMPACT_NOT_EQUAL && (X) != (VALUE) ) || \
+      ( (PREDICATE) == COMPACT_LESS_THAN && (X) < (VALUE) ) || \
+      ( (PREDICATE) == COMPACT_GREATER_THAN && (X) > (VALUE) ) )
+
+__kernel void compact_flags(__global const uint* in,
+                            __global uint* flags,
+                            uint n,
+                            int predicate,
+                            uint value)
+{
+    size_t index = get_global_id(0);
+    if ( index < n )
+        flags[index] = KEEP(in[index], predicate, value)? 1 : 0;
+}
+
+// positions is the exclusive scan of the flags. The predicate is evaluated
+// again rather than reading the flags back. The last work item writes the
+// number of kept elements to count.
+__kernel void compact_scatter(__global const uint* in,
+                              __global const uint* positions,
+                              __global uint* out,
+                              __global uint* count,
+                              uint n,
+                              int predicate,
+                              uint value)
+{
+    size_t index = get_global_id(0);
+    if ( index >= n )
+        return;
+
+    uint x = in[index];
+    uint keep = KEEP(x, predicate, value)? 1 : 0;
+    if ( keep )
+        out[positions[index]] = x;
+
+    if ( index == n - 1 )
+        *count = positions[index] + keep;
+}
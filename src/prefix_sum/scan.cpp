@@ -0,0 +1,507 @@
+#include "scan.h"
+#include <cstdio>
+#include <vector>
+#include <libclprobe/clprobe.h>
+#include <libclprobe/kernelsource.h>
+#include <libclprobe/buildmanager.h>
+#include "scan.cl.h"
+
+struct ScanPlan
+{
+    cl_context context;
+    cl_device_id device;
+    cl_program program;
+    char buildOptions[96];
+    ScanLayout layout;
+    cl_kernel scanKernel;
+    cl_kernel addKernel;
+    size_t localSize; /* Work group size. Each group scans 2*localSize elements */
+    size_t localElements; /* Local memory (in elements) needed for a block */
+    ScanElement element;
+    size_t elementSize; /* sizeof the cl_uint or cl_ulong elements */
+    size_t maxElements;
+    std::vector<cl_mem> blockSums; /* Block totals for each level of recursion */
+    size_t blockSumsBytes;
+
+    /* Stream compaction. Created on first use */
+    cl_kernel flagsKernel;
+    cl_kernel scatterKernel;
+    cl_mem positions; /* Scanned predicate flags */
+    cl_mem count; /* Number of elements kept (device side) */
+    cl_mem pinnedCount; /* Host visible copy of count */
+    cl_uint* mappedCount;
+    cl_command_queue mapQueue; /* Queue pinnedCount was mapped with */
+};
+
+void releaseScanPlan(ScanPlan* plan)
+{
+    if ( plan == NULL )
+        return;
+
+    for (size_t level=0; level < plan->blockSums.size(); ++level)
+        clReleaseMemObject(plan->blockSums[level]);
+
+    if ( plan->mappedCount != NULL )
+    {
+        clEnqueueUnmapMemObject(plan->mapQueue, plan->pinnedCount, plan->mappedCount, 0, NULL, NULL);
+        clFinish(plan->mapQueue);
+    }
+    if ( plan->mapQueue != 0 ) clReleaseCommandQueue(plan->mapQueue);
+    if ( plan->pinnedCount != 0 ) clReleaseMemObject(plan->pinnedCount);
+    if ( plan->count != 0 ) clReleaseMemObject(plan->count);
+    if ( plan->positions != 0 ) clReleaseMemObject(plan->positions);
+    if ( plan->scatterKernel != 0 ) clReleaseKernel(plan->scatterKernel);
+    if ( plan->flagsKernel != 0 ) clReleaseKernel(plan->flagsKernel);
+
+    if ( plan->addKernel != 0 ) clReleaseKernel(plan->addKernel);
+    if ( plan->scanKernel != 0 ) clReleaseKernel(plan->scanKernel);
+    if ( plan->program != 0 ) clReleaseProgram(plan->program);
+    if ( plan->context != 0 ) clReleaseContext(plan->context);
+    delete plan;
+}
+
+static size_t numBlocks(size_t n, size_t blockSize)
+{
+    return (n + blockSize -1) / blockSize;
+}
+
+/* Must match LOG_NUM_BANKS passed to scan.cl */
+static const unsigned int logNumBanks = 5;
+
+/* Local memory (in elements) needed to scan a block of blockSize elements */
+static size_t localElementsForLayout(size_t blockSize, ScanLayout layout)
+{
+    if ( layout == SCAN_LAYOUT_PADDED )
+        return blockSize + ( (blockSize -1) >> logNumBanks );
+
+    return blockSize;
+}
+
+ScanPlan* createScanPlan(cl_context context, cl_device_id device, size_t maxElements, cl_int* err)
+{
+    return createScanPlanWithLayout(context, device, maxElements, SCAN_LAYOUT_PADDED, err);
+}
+
+ScanPlan* createScanPlanWithLayout(cl_context context,
+                                   cl_device_id device,
+                                   size_t maxElements,
+                                   ScanLayout layout,
+                                   cl_int* err)
+{
+    return createScanPlanWithElement(context, device, maxElements, layout, SCAN_ELEMENT_UINT, err);
+}
+
+ScanPlan* createScanPlanWithElement(cl_context context,
+                                    cl_device_id device,
+                                    size_t maxElements,
+                                    ScanLayout layout,
+                                    ScanElement element,
+                                    cl_int* err)
+{
+    ScanPlan* plan = startScanPlanBuild(NULL, context, device, maxElements, layout, element, err);
+    if ( plan == NULL )
+        return NULL;
+
+    *err = finishScanPlanBuild(NULL, plan);
+    if ( *err != CL_SUCCESS )
+    {
+        releaseScanPlan(plan);
+        return NULL;
+    }
+    return plan;
+}
+
+ScanPlan* startScanPlanBuild(BuildManager* manager,
+                             cl_context context,
+                             cl_device_id device,
+                             size_t maxElements,
+                             ScanLayout layout,
+                             ScanElement element,
+                             cl_int* err)
+{
+    ScanPlan* plan = new ScanPlan();
+    plan->context = context;
+    plan->device = device;
+    plan->program = 0;
+    plan->layout = layout;
+    plan->scanKernel = 0;
+    plan->addKernel = 0;
+    plan->localSize = 0;
+    plan->localElements = 0;
+    plan->maxElements = maxElements;
+    plan->element = element;
+    plan->blockSumsBytes = 0;
+    plan->elementSize = ( element == SCAN_ELEMENT_ULONG )? sizeof(cl_ulong) : sizeof(cl_uint);
+    plan->flagsKernel = 0;
+    plan->scatterKernel = 0;
+    plan->positions = 0;
+    plan->count = 0;
+    plan->pinnedCount = 0;
+    plan->mappedCount = NULL;
+    plan->mapQueue = 0;
+
+    *err = clRetainContext(context);
+    if ( *err != CL_SUCCESS )
+    {
+        plan->context = 0;
+        releaseScanPlan(plan);
+        return NULL;
+    }
+
+    snprintf(plan->buildOptions, sizeof(plan->buildOptions),
+             "-DSCAN_LAYOUT=%d -DLOG_NUM_BANKS=%u -DSCAN_T=%s", (int) layout, logNumBanks, ( element == SCAN_ELEMENT_ULONG )? "ulong" : "uint");
+
+    // The layout and element type are macros so the SPIR-V cannot be used
+    KernelSource source = { (const char*) scan_cl, scan_cl_il, scan_cl_il_size, NULL };
+    plan->program = createProgramFromKernelSource(context, device, &source, plan->buildOptions, err);
+    if ( *err != CL_SUCCESS )
+    {
+        printf("Could not create scan program:%d\n", *err);
+        releaseScanPlan(plan);
+        return NULL;
+    }
+
+    if ( manager != NULL )
+    {
+        *err = startProgramBuild(manager, plan->program, 1, &device, plan->buildOptions);
+        if ( *err != CL_SUCCESS )
+        {
+            printf("Could not queue scan build:%d\n", *err);
+            releaseScanPlan(plan);
+            return NULL;
+        }
+    }
+    return plan;
+}
+
+cl_program getScanPlanProgram(const ScanPlan* plan)
+{
+    return plan->program;
+}
+
+cl_int finishScanPlanBuild(BuildManager* manager, ScanPlan* plan)
+{
+    cl_device_id device = plan->device;
+    cl_int err = ( manager != NULL )? waitForProgramBuild(manager, plan->program)
+                                    : clBuildProgram(plan->program, 1, &device, plan->buildOptions, NULL, NULL);
+    if ( err != CL_SUCCESS )
+    {
+        printf("Scan build failed\n");
+        printProgramBuildInfo(plan->program, device, /*Indent*/ 0);
+        return err;
+    }
+
+    plan->scanKernel = clCreateKernel(plan->program, "scan_blocks", &err);
+    if ( err == CL_SUCCESS )
+        plan->addKernel = clCreateKernel(plan->program, "add_block_offsets", &err);
+
+    if ( err != CL_SUCCESS )
+    {
+        printf("Failed to create scan kernel objects.\n");
+        return err;
+    }
+
+    /* Pick the largest power of two work group size (up to 256) that the
+    *  kernel and local memory allow.
+    */
+    size_t kernelMaxWorkGroupSize=0;
+    cl_ulong localMemSize=0;
+    err = clGetKernelWorkGroupInfo(plan->scanKernel, device, CL_KERNEL_WORK_GROUP_SIZE,
+                                   sizeof(size_t), &kernelMaxWorkGroupSize, NULL);
+    if ( err == CL_SUCCESS )
+        err = clGetDeviceInfo(device, CL_DEVICE_LOCAL_MEM_SIZE, sizeof(cl_ulong), &localMemSize, NULL);
+
+    if ( err != CL_SUCCESS )
+    {
+        printf("Could not get work group limits for scan.\n");
+        return err;
+    }
+
+    plan->localSize = 1;
+    while ( plan->localSize * 2 <= kernelMaxWorkGroupSize &&
+            plan->localSize * 2 <= 256 &&
+            localElementsForLayout(2 * (plan->localSize * 2), plan->layout) * plan->elementSize <= localMemSize )
+        plan->localSize *= 2;
+
+    plan->localElements = localElementsForLayout(2 * plan->localSize, plan->layout);
+
+    /* Allocate the block totals for each level. The last level is a single
+    *  block whose total is not needed but is still written.
+    */
+    size_t blockSize = 2 * plan->localSize;
+    size_t n = (plan->maxElements > 0)? plan->maxElements : 1;
+    while (true)
+    {
+        size_t blocks = numBlocks(n, blockSize);
+        cl_mem sums = clCreateBuffer(plan->context, CL_MEM_READ_WRITE, plan->elementSize * blocks, NULL, &err);
+        if ( err != CL_SUCCESS )
+        {
+            printf("Failed to create scan scratch buffer. Error:%d\n", err);
+            return err;
+        }
+        plan->blockSums.push_back(sums);
+        plan->blockSumsBytes += plan->elementSize * blocks;
+
+        if ( blocks == 1 )
+            break;
+
+        n = blocks;
+    }
+
+    return CL_SUCCESS;
+}
+
+size_t getScanBlockSize(const ScanPlan* plan)
+{
+    return 2 * plan->localSize;
+}
+
+size_t getScanScratchSize(const ScanPlan* plan)
+{
+    return plan->blockSumsBytes;
+}
+
+size_t getScanElementSize(const ScanPlan* plan)
+{
+    return plan->elementSize;
+}
+
+static cl_int enqueueScanLevel(ScanPlan* plan,
+                               cl_command_queue queue,
+                               cl_mem input,
+                               cl_mem output,
+                               size_t n,
+                               ScanType type,
+                               size_t level,
+                               cl_uint numEventsInWaitList,
+                               const cl_event* eventWaitList,
+                               cl_event* event)
+{
+    if ( level >= plan->blockSums.size() )
+        return CL_INVALID_BUFFER_SIZE;
+
+    size_t blocks = numBlocks(n, 2 * plan->localSize);
+    size_t globalSize = blocks * plan->localSize;
+    cl_uint elements = n;
+    cl_int inclusive = (type == SCAN_INCLUSIVE);
+
+    cl_int err = clSetKernelArg(plan->scanKernel, 0, sizeof(cl_mem), &input);
+    if ( err == CL_SUCCESS )
+        err = clSetKernelArg(plan->scanKernel, 1, sizeof(cl_mem), &output);
+    if ( err == CL_SUCCESS )
+        err = clSetKernelArg(plan->scanKernel, 2, sizeof(cl_mem), &(plan->blockSums[level]));
+    if ( err == CL_SUCCESS )
+        err = clSetKernelArg(plan->scanKernel, 3, plan->elementSize * plan->localElements, NULL);
+    if ( err == CL_SUCCESS )
+        err = clSetKernelArg(plan->scanKernel, 4, sizeof(cl_uint), &elements);
+    if ( err == CL_SUCCESS )
+        err = clSetKernelArg(plan->scanKernel, 5, sizeof(cl_int), &inclusive);
+    if ( err != CL_SUCCESS )
+        return err;
+
+    cl_event scanned=0;
+    err = clEnqueueNDRangeKernel(queue, plan->scanKernel, 1, NULL,
+                                 &globalSize, &(plan->localSize),
+                                 numEventsInWaitList, eventWaitList, &scanned);
+    if ( err != CL_SUCCESS )
+        return err;
+
+    if ( blocks == 1 )
+    {
+        // A single block needs no stitching
+        if ( event != NULL )
+            *event = scanned;
+        else
+            clReleaseEvent(scanned);
+        return CL_SUCCESS;
+    }
+
+    /* Scan the block totals in place to get each block's offset */
+    cl_event offsetsScanned=0;
+    err = enqueueScanLevel(plan, queue,
+                           plan->blockSums[level], plan->blockSums[level],
+                           blocks, SCAN_EXCLUSIVE, level + 1,
+                           1, &scanned, &offsetsScanned);
+    clReleaseEvent(scanned);
+    if ( err != CL_SUCCESS )
+        return err;
+
+    err = clSetKernelArg(plan->addKernel, 0, sizeof(cl_mem), &output);
+    if ( err == CL_SUCCESS )
+        err = clSetKernelArg(plan->addKernel, 1, sizeof(cl_mem), &(plan->blockSums[level]));
+    if ( err == CL_SUCCESS )
+        err = clSetKernelArg(plan->addKernel, 2, sizeof(cl_uint), &elements);
+    if ( err == CL_SUCCESS )
+    {
+        err = clEnqueueNDRangeKernel(queue, plan->addKernel, 1, NULL,
+                                     &globalSize, &(plan->localSize),
+                                     1, &offsetsScanned, event);
+    }
+    clReleaseEvent(offsetsScanned);
+    return err;
+}
+
+cl_int enqueueScan(ScanPlan* plan,
+                   cl_command_queue queue,
+                   cl_mem input,
+                   cl_mem output,
+                   size_t n,
+                   ScanType type,
+                   cl_uint numEventsInWaitList,
+                   const cl_event* eventWaitList,
+                   cl_event* event)
+{
+    if ( n == 0 || n > plan->maxElements )
+        return CL_INVALID_BUFFER_SIZE;
+
+    return enqueueScanLevel(plan, queue, input, output, n, type, /*level*/ 0,
+                            numEventsInWaitList, eventWaitList, event);
+}
+
+/* Create the compaction kernels and buffers and map the pinned count buffer */
+static cl_int initCompaction(ScanPlan* plan, cl_command_queue queue)
+{
+    cl_int err = CL_SUCCESS;
+    plan->flagsKernel = clCreateKernel(plan->program, "compact_flags", &err);
+    if ( err == CL_SUCCESS )
+        plan->scatterKernel = clCreateKernel(plan->program, "compact_scatter", &err);
+
+    if ( err == CL_SUCCESS )
+        plan->positions = clCreateBuffer(plan->context, CL_MEM_READ_WRITE,
+                                         sizeof(cl_uint) * plan->maxElements, NULL, &err);
+
+    if ( err == CL_SUCCESS )
+        plan->count = clCreateBuffer(plan->context, CL_MEM_READ_WRITE, sizeof(cl_uint), NULL, &err);
+
+    if ( err == CL_SUCCESS )
+        plan->pinnedCount = clCreateBuffer(plan->context, CL_MEM_READ_WRITE | CL_MEM_ALLOC_HOST_PTR,
+                                           sizeof(cl_uint), NULL, &err);
+
+    if ( err == CL_SUCCESS )
+        plan->mappedCount = (cl_uint*) clEnqueueMapBuffer(queue, plan->pinnedCount, CL_TRUE,
+                                                          CL_MAP_READ | CL_MAP_WRITE, 0, sizeof(cl_uint),
+                                                          0, NULL, NULL, &err);
+
+    if ( err != CL_SUCCESS )
+    {
+        printf("Failed to set up compaction. Error:%d\n", err);
+
+        // Release what was created so the next call starts over
+        if ( plan->pinnedCount != 0 ) clReleaseMemObject(plan->pinnedCount);
+        if ( plan->count != 0 ) clReleaseMemObject(plan->count);
+        if ( plan->positions != 0 ) clReleaseMemObject(plan->positions);
+        if ( plan->scatterKernel != 0 ) clReleaseKernel(plan->scatterKernel);
+        if ( plan->flagsKernel != 0 ) clReleaseKernel(plan->flagsKernel);
+        plan->pinnedCount = 0;
+        plan->count = 0;
+        plan->positions = 0;
+        plan->scatterKernel = 0;
+        plan->flagsKernel = 0;
+        plan->mappedCount = NULL;
+        return err;
+    }
+
+    plan->mapQueue = queue;
+    clRetainCommandQueue(queue);
+    *(plan->mappedCount) = 0;
+    return CL_SUCCESS;
+}
+
+cl_int enqueueCompact(ScanPlan* plan,
+                      cl_command_queue queue,
+                      cl_mem input,
+                      cl_mem output,
+                      size_t n,
+                      CompactPredicate predicate,
+                      cl_uint value,
+                      cl_uint numEventsInWaitList,
+                      const cl_event* eventWaitList,
+                      cl_event* event)
+{
+    if ( n == 0 || n > plan->maxElements )
+        return CL_INVALID_BUFFER_SIZE;
+
+    if ( input == output )
+        return CL_INVALID_MEM_OBJECT;
+
+    // The positions are scanned by the plan so must be cl_uint too
+    if ( plan->element != SCAN_ELEMENT_UINT )
+        return CL_INVALID_OPERATION;
+
+    cl_int err = CL_SUCCESS;
+    if ( plan->mappedCount == NULL )
+    {
+        err = initCompaction(plan, queue);
+        if ( err != CL_SUCCESS )
+            return err;
+    }
+
+    size_t globalSize = numBlocks(n, plan->localSize) * plan->localSize;
+    cl_uint elements = n;
+    cl_int predicateArg = predicate;
+
+    /* 1. Flag the elements to keep */
+    err = clSetKernelArg(plan->flagsKernel, 0, sizeof(cl_mem), &input);
+    if ( err == CL_SUCCESS )
+        err = clSetKernelArg(plan->flagsKernel, 1, sizeof(cl_mem), &(plan->positions));
+    if ( err == CL_SUCCESS )
+        err = clSetKernelArg(plan->flagsKernel, 2, sizeof(cl_uint), &elements);
+    if ( err == CL_SUCCESS )
+        err = clSetKernelArg(plan->flagsKernel, 3, sizeof(cl_int), &predicateArg);
+    if ( err == CL_SUCCESS )
+        err = clSetKernelArg(plan->flagsKernel, 4, sizeof(cl_uint), &value);
+    if ( err != CL_SUCCESS )
+        return err;
+
+    cl_event flagged=0;
+    err = clEnqueueNDRangeKernel(queue, plan->flagsKernel, 1, NULL,
+                                 &globalSize, &(plan->localSize),
+                                 numEventsInWaitList, eventWaitList, &flagged);
+    if ( err != CL_SUCCESS )
+        return err;
+
+    /* 2. Exclusive scan of the flags gives the output positions */
+    cl_event scanned=0;
+    err = enqueueScan(plan, queue, plan->positions, plan->positions, n,
+                      SCAN_EXCLUSIVE, 1, &flagged, &scanned);
+    clReleaseEvent(flagged);
+    if ( err != CL_SUCCESS )
+        return err;
+
+    /* 3. Scatter the kept elements and write the count */
+    err = clSetKernelArg(plan->scatterKernel, 0, sizeof(cl_mem), &input);
+    if ( err == CL_SUCCESS )
+        err = clSetKernelArg(plan->scatterKernel, 1, sizeof(cl_mem), &(plan->positions));
+    if ( err == CL_SUCCESS )
+        err = clSetKernelArg(plan->scatterKernel, 2, sizeof(cl_mem), &output);
+    if ( err == CL_SUCCESS )
+        err = clSetKernelArg(plan->scatterKernel, 3, sizeof(cl_mem), &(plan->count));
+    if ( err == CL_SUCCESS )
+        err = clSetKernelArg(plan->scatterKernel, 4, sizeof(cl_uint), &elements);
+    if ( err == CL_SUCCESS )
+        err = clSetKernelArg(plan->scatterKernel, 5, sizeof(cl_int), &predicateArg);
+    if ( err == CL_SUCCESS )
+        err = clSetKernelArg(plan->scatterKernel, 6, sizeof(cl_uint), &value);
+
+    cl_event scattered=0;
+    if ( err == CL_SUCCESS )
+    {
+        err = clEnqueueNDRangeKernel(queue, plan->scatterKernel, 1, NULL,
+                                     &globalSize, &(plan->localSize),
+                                     1, &scanned, &scattered);
+    }
+    clReleaseEvent(scanned);
+    if ( err != CL_SUCCESS )
+        return err;
+
+    /* 4. Non-blocking read of the count into pinned memory */
+    err = clEnqueueReadBuffer(queue, plan->count, CL_FALSE, 0, sizeof(cl_uint),
+                              plan->mappedCount, 1, &scattered, event);
+    clReleaseEvent(scattered);
+    return err;
+}
+
+cl_uint getCompactCount(const ScanPlan* plan)
+{
+    return ( plan->mappedCount != NULL )? *(plan->mappedCount) : 0;
+}
@@ -0,0 +1,173 @@
+#ifndef PREFIX_SUM_SCAN_H
+#define PREFIX_SUM_SCAN_H
+#include <stddef.h>
+#include <CL/opencl.h>
+#include <libclprobe/buildmanager.h>
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*! Scan (prefix sum) engine for arrays of cl_uint (or cl_ulong) of any size.
+ *
+ *  Each work group scans a block of elements in local memory (scan.cl),
+ *  the per block totals are scanned recursively and then added back.
+ *  A plan owns the program, kernels and the scratch buffers for the block
+ *  totals so it can be reused for many scans.
+ */
+typedef struct ScanPlan ScanPlan;
+
+typedef enum
+{
+    SCAN_EXCLUSIVE, /*!< out[i] = in[0] + ... + in[i-1] */
+    SCAN_INCLUSIVE  /*!< out[i] = in[0] + ... + in[i] */
+} ScanType;
+
+/*! Layout of a block in local memory while it is scanned. Must match
+ *  SCAN_LAYOUT in scan.cl.
+ */
+typedef enum
+{
+    SCAN_LAYOUT_NAIVE=0,   /*!< Element i at i. The scan tree causes bank conflicts */
+    SCAN_LAYOUT_PADDED=1,  /*!< A padding element after every 32 elements */
+    SCAN_LAYOUT_SWIZZLED=2 /*!< Bank bits XORed with the bits above them */
+} ScanLayout;
+
+/*! Element (and accumulator) type of a scan. Sums of many cl_uint values
+ *  wrap around, cl_ulong is exact for far longer at twice the memory
+ *  traffic.
+ */
+typedef enum
+{
+    SCAN_ELEMENT_UINT=0, /*!< cl_uint */
+    SCAN_ELEMENT_ULONG=1 /*!< cl_ulong */
+} ScanElement;
+
+/*! Elements x kept by enqueueCompact(). Must match scan.cl */
+typedef enum
+{
+    COMPACT_NOT_EQUAL=0,   /*!< x != value */
+    COMPACT_LESS_THAN=1,   /*!< x < value */
+    COMPACT_GREATER_THAN=2 /*!< x > value */
+} CompactPredicate;
+
+/*! Create a plan for scanning up to \p maxElements elements on \p device.
+ *
+ *  \returns NULL on failure in which case \p err is set.
+ */
+ScanPlan* createScanPlan(cl_context context, cl_device_id device, size_t maxElements, cl_int* err);
+
+/*! Same as createScanPlan() (which uses SCAN_LAYOUT_PADDED) but with the
+ *  local memory layout given by \p layout.
+ */
+ScanPlan* createScanPlanWithLayout(cl_context context,
+                                   cl_device_id device,
+                                   size_t maxElements,
+                                   ScanLayout layout,
+                                   cl_int* err);
+
+/*! Same as createScanPlanWithLayout() (which scans cl_uint) but for
+ *  elements of type \p element. Plans for cl_ulong only scan, they do not
+ *  support enqueueCompact().
+ */
+ScanPlan* createScanPlanWithElement(cl_context context,
+                                    cl_device_id device,
+                                    size_t maxElements,
+                                    ScanLayout layout,
+                                    ScanElement element,
+                                    cl_int* err);
+
+/*! Same as createScanPlanWithElement() but only creates the program and
+ *  queues its build on \p manager, so the builds of several plans run
+ *  concurrently. The plan cannot be used until finishScanPlanBuild() has
+ *  returned CL_SUCCESS. With a NULL \p manager the program is built by
+ *  finishScanPlanBuild() instead.
+ *
+ *  \returns NULL on failure in which case \p err is set.
+ */
+ScanPlan* startScanPlanBuild(BuildManager* manager,
+                             cl_context context,
+                             cl_device_id device,
+                             size_t maxElements,
+                             ScanLayout layout,
+                             ScanElement element,
+                             cl_int* err);
+
+/*! \returns the program of \p plan, e.g. to find the plan whose build
+ *  waitForAnyProgramBuild() returned.
+ */
+cl_program getScanPlanProgram(const ScanPlan* plan);
+
+/*! Wait for the build of \p plan started by startScanPlanBuild() on
+ *  \p manager then create its kernels and scratch buffers.
+ *
+ *  \returns CL_SUCCESS on success. Otherwise \p plan can only be released.
+ */
+cl_int finishScanPlanBuild(BuildManager* manager, ScanPlan* plan);
+
+/*! Release the resources held by \p plan. */
+void releaseScanPlan(ScanPlan* plan);
+
+/*! \returns the number of elements scanned by each work group. */
+size_t getScanBlockSize(const ScanPlan* plan);
+
+/*! \returns the device memory in bytes \p plan holds for the block
+ *  totals, about n / getScanBlockSize() elements.
+ */
+size_t getScanScratchSize(const ScanPlan* plan);
+
+/*! \returns the size in bytes of an element scanned by \p plan. */
+size_t getScanElementSize(const ScanPlan* plan);
+
+/*! Enqueue a scan of the first \p n elements of \p input into \p output.
+ *  \p input and \p output may be the same buffer.
+ *
+ *  The first command waits on \p eventWaitList and \p event (if not NULL)
+ *  is set to an event for the last command so this works with in-order and
+ *  out-of-order queues. A plan must not be used by more than one thread
+ *  at a time.
+ *
+ *  \returns CL_SUCCESS on success.
+ */
+cl_int enqueueScan(ScanPlan* plan,
+                   cl_command_queue queue,
+                   cl_mem input,
+                   cl_mem output,
+                   size_t n,
+                   ScanType type,
+                   cl_uint numEventsInWaitList,
+                   const cl_event* eventWaitList,
+                   cl_event* event);
+
+/*! Enqueue a stream compaction of the first \p n elements of \p input
+ *  into \p output keeping, in order, the elements that satisfy
+ *  \p predicate against \p value. \p input and \p output must be different
+ *  buffers.
+ *
+ *  The number of elements kept is read back without blocking into a small
+ *  pinned buffer owned by the plan and can be obtained with
+ *  getCompactCount() once \p event has completed. The first call maps that
+ *  buffer using \p queue.
+ *
+ *  \returns CL_SUCCESS on success or CL_INVALID_OPERATION if \p plan does
+ *  not scan cl_uint.
+ */
+cl_int enqueueCompact(ScanPlan* plan,
+                      cl_command_queue queue,
+                      cl_mem input,
+                      cl_mem output,
+                      size_t n,
+                      CompactPredicate predicate,
+                      cl_uint value,
+                      cl_uint numEventsInWaitList,
+                      const cl_event* eventWaitList,
+                      cl_event* event);
+
+/*! \returns the number of elements kept by the last enqueueCompact(). Only
+ *  valid once the event it returned has completed.
+ */
+cl_uint getCompactCount(const ScanPlan* plan);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -0,0 +1,162 @@
+// Kernels for a least significant digit radix sort. Each pass sorts on
+// RADIX_BITS bits of the key:
+//
+// 1. radix_histogram counts the digits in each tile of the input.
+// 2. The histograms are scanned (see scan.h) to get the output offset of
+//    each digit for each tile.
+// 3. radix_scatter moves every element to its place in the output.
+//
+// Build options:
+//   -DKEY_TYPE=uint|ulong   Type of the keys (default uint)
+//   -DHAS_VALUES            Move a uint payload along with the keys
+//   -DITEMS_PER_WORK_ITEM=N Elements handled by each work item (default 16)
+//
+// A work group handles a tile of get_local_size(0) * ITEMS_PER_WORK_ITEM
+// consecutive elements and each work item a run of ITEMS_PER_WORK_ITEM
+// consecutive elements within it which keeps the scatter stable.
+
+#ifndef KEY_TYPE
+#define KEY_TYPE uint
+#endif
+
+#ifndef ITEMS_PER_WORK_ITEM
+#define ITEMS_PER_WORK_ITEM 16
+#endif
+
+#define RADIX_BITS 4
+#define RADIX (1 << RADIX_BITS)
+#define DIGIT(KEY, SHIFT) ( (uint) ( ((KEY) >> (SHIFT)) & (RADIX -1) ) )
+
+// histograms is digit major: histograms[digit * get_num_groups(0) + group]
+// so that an exclusive scan of it gives the output offset of each digit
+// for each tile.
+__kernel void radix_histogram(__global const KEY_TYPE* restrict keys,
+                              __global uint* restrict histograms,
+                              __local uint* localHistogram,
+                              uint n,
+                              uint shift)
+{
+    size_t lid = get_local_id(0);
+    size_t first = ( get_group_id(0) * get_local_size(0) + lid ) * ITEMS_PER_WORK_ITEM;
+
+    if ( lid < RADIX )
+        localHistogram[lid] = 0;
+
+    // Count privately first so there are at most RADIX local atomics per work item
+    uint counts[RADIX];
+    for (int d=0; d < RADIX; ++d)
+        counts[d] = 0;
+
+    for (int i=0; i < ITEMS_PER_WORK_ITEM; ++i)
+    {
+        size_t index = first + i;
+        if ( index < n )
+            counts[DIGIT(keys[index], shift)]++;
+    }
+
+    barrier(CLK_LOCAL_MEM_FENCE);
+    for (int d=0; d < RADIX; ++d)
+    {
+        if ( counts[d] != 0 )
+            atomic_add(&localHistogram[d], counts[d]);
+    }
+    barrier(CLK_LOCAL_MEM_FENCE);
+
+    if ( lid < RADIX )
+        histograms[lid * get_num_groups(0) + get_group_id(0)] = localHistogram[lid];
+}
+
+// Exclusive scan of data[0 .. RADIX * get_local_size(0) -1] by the whole
+// work group. totals must hold get_local_size(0) elements.
+void localExclusiveScan(__local uint* data, __local uint* totals)
+{
+    size_t lid = get_local_id(0);
+    size_t localSize = get_local_size(0);
+    __local uint* mine = data + lid * RADIX;
+
+    // Each work item scans its own RADIX elements
+    uint sum = 0;
+    for (int i=0; i < RADIX; ++i)
+    {
+        uint value = mine[i];
+        mine[i] = sum;
+        sum += value;
+    }
+    totals[lid] = sum;
+    barrier(CLK_LOCAL_MEM_FENCE);
+
+    // Inclusive (Hillis-Steele) scan of the work item totals
+    for (size_t offset=1; offset < localSize; offset <<= 1)
+    {
+        uint value = ( lid >= offset )? totals[lid - offset] : 0;
+        barrier(CLK_LOCAL_MEM_FENCE);
+        totals[lid] += value;
+        barrier(CLK_LOCAL_MEM_FENCE);
+    }
+
+    uint offset = ( lid > 0 )? totals[lid -1] : 0;
+    for (int i=0; i < RADIX; ++i)
+        mine[i] += offset;
+    barrier(CLK_LOCAL_MEM_FENCE);
+}
+
+// offsets is the exclusive scan of the histograms from radix_histogram.
+// localCounts must hold RADIX * get_local_size(0) elements and
+// localTotals get_local_size(0) elements.
+__kernel void radix_scatter(__global const KEY_TYPE* restrict keysIn,
+                            __global KEY_TYPE* restrict keysOut,
+                            #ifdef HAS_VALUES
+                            __global const uint* restrict valuesIn,
+                            __global uint* restrict valuesOut,
+                            #endif
+                            __global const uint* restrict offsets,
+                            __local uint* localCounts,
+                            __local uint* localTotals,
+                            uint n,
+                            uint shift)
+{
+    size_t lid = get_local_id(0);
+    size_t localSize = get_local_size(0);
+    size_t first = ( get_group_id(0) * localSize + lid ) * ITEMS_PER_WORK_ITEM;
+
+    uint counts[RADIX];
+    for (int d=0; d < RADIX; ++d)
+        counts[d] = 0;
+
+    for (int i=0; i < ITEMS_PER_WORK_ITEM; ++i)
+    {
+        size_t index = first + i;
+        if ( index < n )
+            counts[DIGIT(keysIn[index], shift)]++;
+    }
+
+    // Digit major so that after the scan the entry for (digit, work item)
+    // minus the entry for (digit, 0) is the number of elements with that
+    // digit before this work item's run in the tile.
+    for (int d=0; d < RADIX; ++d)
+        localCounts[d * localSize + lid] = counts[d];
+    barrier(CLK_LOCAL_MEM_FENCE);
+
+    localExclusiveScan(localCounts, localTotals);
+
+    uint position[RADIX];
+    for (int d=0; d < RADIX; ++d)
+    {
+        position[d] = offsets[d * get_num_groups(0) + get_group_id(0)] +
+                      localCounts[d * localSize + lid] - localCounts[d * localSize];
+    }
+
+    for (int i=0; i < ITEMS_PER_WORK_ITEM; ++i)
+    {
+        size_t index = first + i;
+        if ( index < n )
+        {
+            KEY_TYPE key = keysIn[index];
+            uint destination = position[DIGIT(key, shift)]++;
+            keysOut[destination] = key;
+            #ifdef HAS_VALUES
+            valuesOut[destination] = valuesIn[index];
+            #endif
+        }
+    }
+}
@@ -0,0 +1,576 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <assert.h>
+#include <string.h>
+#include <getopt.h>
+#include <vector>
+#include <algorithm>
+#include <thread>
+#include <random>
+#include <CL/opencl.h>
+#include <libclprobe/clprobe.h>
+#include <libclprobe/driverutil.h>
+#include <libclprobe/kernelsource.h>
+#include <libclprobe/buildmanager.h>
+#include <libclprobe/timing.h>
+#include <libclprobe/resultstore.h>
+#include <prefix_sum/scan.h>
+#include "radix_sort.cl.h"
+
+/* Kernels compiled into the executable */
+static const EmbeddedKernel embeddedKernels[] =
+{
+    EMBEDDED_KERNEL("radix_sort.cl", radix_sort_cl)
+};
+
+/* Must match RADIX_BITS in radix_sort.cl */
+static const cl_uint radixBits = 4;
+static const cl_uint radix = 1 << radixBits;
+
+/* Passed to radix_sort.cl as ITEMS_PER_WORK_ITEM */
+static const cl_uint itemsPerWorkItem = 16;
+
+void usage(const char* progName)
+{
+    printf("Usage: %s [options] <num_elements>\n\n", progName);
+    printf("Sorts random keys with an OpenCL radix sort and compares it with\n"
+           "std::sort and a multi-threaded host sort.\n\n"
+           "Options:\n"
+           "  --bits <32|64>       Key size in bits (default 32)\n"
+           "  --values             Sort a 32-bit payload along with the keys\n"
+           "  --repetitions <n>    Number of timed runs, the best is reported (default 5)\n"
+           "  --seed <n>           Seed for the random keys (default 1)\n"
+           "  --results <file>     Append the OpenCL sort times to a results file for\n"
+           "                       perf_compare\n"
+           "  --kernel <file>      Override the embedded radix_sort.cl\n");
+    exit(1);
+}
+
+void cleanUp();
+
+//Global for clean up convenience
+KernelSource kernelSource;
+BuildManager* buildManager=0;
+ScanPlan* scanPlan=0;
+cl_program program=0;
+cl_context context=0;
+cl_command_queue cmdQueue=0;
+cl_kernel histogramKernel=0;
+cl_kernel scatterKernel=0;
+cl_mem keyBuffers[2]={0,0};
+cl_mem valueBuffers[2]={0,0};
+cl_mem histogramBuffer=0;
+const char* resultsFile=0;
+
+/* Sort equal sized chunks concurrently then merge neighbouring chunks
+*  concurrently until one is left.
+*/
+template <typename T>
+static void parallelSort(std::vector<T>& data, unsigned int numThreads)
+{
+    if ( numThreads < 1 ) numThreads = 1;
+
+    std::vector<size_t> bounds;
+    for (unsigned int chunk=0; chunk <= numThreads; ++chunk)
+        bounds.push_back( data.size() * chunk / numThreads );
+
+    std::vector<std::thread> threads;
+    for (unsigned int chunk=0; chunk < numThreads; ++chunk)
+    {
+        threads.push_back( std::thread( [&data, &bounds, chunk]()
+        {
+            std::sort(data.begin() + bounds[chunk], data.begin() + bounds[chunk + 1]);
+        }));
+    }
+    for (size_t index=0; index < threads.size(); ++index)
+        threads[index].join();
+
+    for (unsigned int width=1; width < numThreads; width *= 2)
+    {
+        threads.clear();
+        for (unsigned int chunk=0; chunk + width < numThreads; chunk += 2*width)
+        {
+            unsigned int last = std::min(chunk + 2*width, numThreads);
+            threads.push_back( std::thread( [&data, &bounds, chunk, width, last]()
+            {
+                std::inplace_merge(data.begin() + bounds[chunk],
+                                   data.begin() + bounds[chunk + width],
+                                   data.begin() + bounds[last]);
+            }));
+        }
+        for (size_t index=0; index < threads.size(); ++index)
+            threads[index].join();
+    }
+}
+
+/* Enqueue all passes of the radix sort. The sorted keys (and values) end
+*  up in keyBuffers[0] (and valueBuffers[0]) because the number of passes is even.
+*/
+static cl_int enqueueRadixSort(cl_uint n,
+                               cl_uint keyBits,
+                               bool hasValues,
+                               size_t localSize,
+                               size_t numGroups)
+{
+    cl_int err = CL_SUCCESS;
+    size_t globalSize = numGroups * localSize;
+    size_t numHistogramEntries = numGroups * radix;
+
+    for (cl_uint shift=0, pass=0; shift < keyBits; shift += radixBits, ++pass)
+    {
+        cl_mem keysIn = keyBuffers[pass % 2];
+        cl_mem keysOut = keyBuffers[(pass + 1) % 2];
+
+        cl_uint arg=0;
+        err = clSetKernelArg(histogramKernel, arg++, sizeof(cl_mem), &keysIn);
+        if ( err == CL_SUCCESS )
+            err = clSetKernelArg(histogramKernel, arg++, sizeof(cl_mem), &histogramBuffer);
+        if ( err == CL_SUCCESS )
+            err = clSetKernelArg(histogramKernel, arg++, sizeof(cl_uint) * radix, NULL);
+        if ( err == CL_SUCCESS )
+            err = clSetKernelArg(histogramKernel, arg++, sizeof(cl_uint), &n);
+        if ( err == CL_SUCCESS )
+            err = clSetKernelArg(histogramKernel, arg++, sizeof(cl_uint), &shift);
+        if ( err != CL_SUCCESS )
+        {
+            printf("Couldn't set histogram kernel arguments.\n");
+            return err;
+        }
+
+        err = clEnqueueNDRangeKernel(cmdQueue, histogramKernel, 1, NULL,
+                                     &globalSize, &localSize, 0, NULL, NULL);
+        if ( err != CL_SUCCESS )
+        {
+            printf("Failed to enqueue histogram kernel.\n");
+            return err;
+        }
+
+        /* Offset of each digit of each tile in the output */
+        err = enqueueScan(scanPlan, cmdQueue, histogramBuffer, histogramBuffer,
+                          numHistogramEntries, SCAN_EXCLUSIVE, 0, NULL, NULL);
+        if ( err != CL_SUCCESS )
+        {
+            printf("Failed to enqueue histogram scan: %d\n", err);
+            return err;
+        }
+
+        arg=0;
+        err = clSetKernelArg(scatterKernel, arg++, sizeof(cl_mem), &keysIn);
+        if ( err == CL_SUCCESS )
+            err = clSetKernelArg(scatterKernel, arg++, sizeof(cl_mem), &keysOut);
+        if ( hasValues )
+        {
+            if ( err == CL_SUCCESS )
+                err = clSetKernelArg(scatterKernel, arg++, sizeof(cl_mem), &valueBuffers[pass % 2]);
+            if ( err == CL_SUCCESS )
+                err = clSetKernelArg(scatterKernel, arg++, sizeof(cl_mem), &valueBuffers[(pass + 1) % 2]);
+        }
+        if ( err == CL_SUCCESS )
+            err = clSetKernelArg(scatterKernel, arg++, sizeof(cl_mem), &histogramBuffer);
+        if ( err == CL_SUCCESS )
+            err = clSetKernelArg(scatterKernel, arg++, sizeof(cl_uint) * radix * localSize, NULL);
+        if ( err == CL_SUCCESS )
+            err = clSetKernelArg(scatterKernel, arg++, sizeof(cl_uint) * localSize, NULL);
+        if ( err == CL_SUCCESS )
+            err = clSetKernelArg(scatterKernel, arg++, sizeof(cl_uint), &n);
+        if ( err == CL_SUCCESS )
+            err = clSetKernelArg(scatterKernel, arg++, sizeof(cl_uint), &shift);
+        if ( err != CL_SUCCESS )
+        {
+            printf("Couldn't set scatter kernel arguments.\n");
+            return err;
+        }
+
+        err = clEnqueueNDRangeKernel(cmdQueue, scatterKernel, 1, NULL,
+                                     &globalSize, &localSize, 0, NULL, NULL);
+        if ( err != CL_SUCCESS )
+        {
+            printf("Failed to enqueue scatter kernel.\n");
+            return err;
+        }
+    }
+
+    return clFinish(cmdQueue);
+}
+
+/* Pick the largest power of two work group size (up to 256) that both
+*  kernels and local memory allow. Returns 0 if it would be less than
+*  radix which radix_histogram needs.
+*/
+static size_t pickLocalSize(cl_device_id device)
+{
+    size_t histogramMax=0;
+    size_t scatterMax=0;
+    cl_ulong localMemSize=0;
+    cl_int err = clGetKernelWorkGroupInfo(histogramKernel, device, CL_KERNEL_WORK_GROUP_SIZE,
+                                          sizeof(size_t), &histogramMax, NULL);
+    if ( err == CL_SUCCESS )
+        err = clGetKernelWorkGroupInfo(scatterKernel, device, CL_KERNEL_WORK_GROUP_SIZE,
+                                       sizeof(size_t), &scatterMax, NULL);
+    if ( err == CL_SUCCESS )
+        err = clGetDeviceInfo(device, CL_DEVICE_LOCAL_MEM_SIZE, sizeof(cl_ulong), &localMemSize, NULL);
+    if ( err != CL_SUCCESS )
+        return 0;
+
+    size_t localSize=1;
+    while ( localSize * 2 <= std::min(histogramMax, scatterMax) &&
+            localSize * 2 <= 256 &&
+            (radix + 1) * (localSize * 2) * sizeof(cl_uint) <= localMemSize )
+        localSize *= 2;
+
+    return ( localSize >= radix )? localSize : 0;
+}
+
+template <typename Key>
+static int runSort(cl_device_id device,
+                   cl_uint n,
+                   bool hasValues,
+                   unsigned int repetitions,
+                   unsigned int seed)
+{
+    const cl_uint keyBits = sizeof(Key) * 8;
+    cl_int err;
+
+    /* Random keys. The payload is the original index so stability can be checked */
+    std::vector<Key> keys(n);
+    std::vector<cl_uint> values(n);
+    std::mt19937_64 generator(seed);
+    for (cl_uint index=0; index < n; ++index)
+    {
+        keys[index] = (Key) generator();
+        values[index] = index;
+    }
+
+    /* Wait for the sort program (built while the scan plan was created) */
+    err = waitForProgramBuild(buildManager, program);
+    if ( err != CL_SUCCESS )
+    {
+        printf("Build failed\n");
+        return 1;
+    }
+
+    histogramKernel = clCreateKernel(program, "radix_histogram", &err);
+    if ( err == CL_SUCCESS )
+        scatterKernel = clCreateKernel(program, "radix_scatter", &err);
+
+    if ( err != CL_SUCCESS )
+    {
+        printf("Failed to create kernel object.\n");
+        return 1;
+    }
+
+    size_t localSize = pickLocalSize(device);
+    if ( localSize == 0 )
+    {
+        printf("Device cannot run work groups of at least %u work items\n", radix);
+        return 1;
+    }
+
+    size_t tileSize = localSize * itemsPerWorkItem;
+    size_t numGroups = (n + tileSize -1) / tileSize;
+    printf("Work group size %lu, %lu tiles of %lu elements\n",
+           (unsigned long) localSize, (unsigned long) numGroups, (unsigned long) tileSize);
+
+    for (int index=0; index < 2; ++index)
+    {
+        keyBuffers[index] = clCreateBuffer(context, CL_MEM_READ_WRITE, sizeof(Key) * n, NULL, &err);
+        if ( err != CL_SUCCESS ) break;
+
+        if ( hasValues )
+        {
+            valueBuffers[index] = clCreateBuffer(context, CL_MEM_READ_WRITE, sizeof(cl_uint) * n, NULL, &err);
+            if ( err != CL_SUCCESS ) break;
+        }
+    }
+
+    if ( err == CL_SUCCESS )
+        histogramBuffer = clCreateBuffer(context, CL_MEM_READ_WRITE, sizeof(cl_uint) * radix * numGroups, NULL, &err);
+
+    if ( err != CL_SUCCESS )
+    {
+        printf("Failed to create buffer. Error:%d\n", err);
+        return 1;
+    }
+
+    /* Time the device sort (excluding transfers) */
+    double bestDevice=0.0;
+    std::vector<double> deviceSamples;
+    for (unsigned int rep=0; rep < repetitions; ++rep)
+    {
+        err = clEnqueueWriteBuffer(cmdQueue, keyBuffers[0], CL_TRUE, 0, sizeof(Key) * n, &keys[0], 0, NULL, NULL);
+        if ( err == CL_SUCCESS && hasValues )
+            err = clEnqueueWriteBuffer(cmdQueue, valueBuffers[0], CL_TRUE, 0, sizeof(cl_uint) * n, &values[0], 0, NULL, NULL);
+
+        if ( err != CL_SUCCESS )
+        {
+            printf("Failed to write input. Error:%d\n", err);
+            return 1;
+        }
+
+        double start = getHostTime();
+        err = enqueueRadixSort(n, keyBits, hasValues, localSize, numGroups);
+        double duration = getHostTime() - start;
+        if ( err != CL_SUCCESS )
+            return 1;
+
+        if ( rep == 0 || duration < bestDevice ) bestDevice = duration;
+        deviceSamples.push_back(duration);
+    }
+
+    std::vector<Key> sortedKeys(n);
+    std::vector<cl_uint> sortedValues(n);
+    err = clEnqueueReadBuffer(cmdQueue, keyBuffers[0], CL_TRUE, 0, sizeof(Key) * n, &sortedKeys[0], 0, NULL, NULL);
+    if ( err == CL_SUCCESS && hasValues )
+        err = clEnqueueReadBuffer(cmdQueue, valueBuffers[0], CL_TRUE, 0, sizeof(cl_uint) * n, &sortedValues[0], 0, NULL, NULL);
+
+    if ( err != CL_SUCCESS )
+    {
+        printf("Failed to read back result. Error:%d\n", err);
+        return 1;
+    }
+
+    /* Check against a stable sort of the (key, original index) pairs */
+    std::vector< std::pair<Key, cl_uint> > reference(n);
+    for (cl_uint index=0; index < n; ++index)
+        reference[index] = std::make_pair(keys[index], values[index]);
+
+    std::stable_sort(reference.begin(), reference.end(),
+                     [](const std::pair<Key, cl_uint>& a, const std::pair<Key, cl_uint>& b)
+                     { return a.first < b.first; });
+
+    cl_uint mismatches=0;
+    for (cl_uint index=0; index < n; ++index)
+    {
+        if ( sortedKeys[index] != reference[index].first ||
+             ( hasValues && sortedValues[index] != reference[index].second ) )
+        {
+            if ( mismatches == 0 )
+                printf("First mismatch at index %u\n", index);
+            ++mismatches;
+        }
+    }
+
+    if ( mismatches != 0 )
+    {
+        printf("Radix sort result is WRONG (%u mismatches)\n", mismatches);
+        return 1;
+    }
+    printf("Radix sort result is correct%s\n", hasValues? " and stable" : "");
+
+    /* Host reference sorts */
+    double bestStd=0.0;
+    double bestParallel=0.0;
+    unsigned int numThreads = std::thread::hardware_concurrency();
+    for (unsigned int rep=0; rep < repetitions; ++rep)
+    {
+        std::vector<Key> copy(keys);
+        double start = getHostTime();
+        std::sort(copy.begin(), copy.end());
+        double duration = getHostTime() - start;
+        if ( rep == 0 || duration < bestStd ) bestStd = duration;
+
+        copy = keys;
+        start = getHostTime();
+        parallelSort(copy, numThreads);
+        duration = getHostTime() - start;
+        if ( rep == 0 || duration < bestParallel ) bestParallel = duration;
+    }
+
+    printf("\n%u %u-bit keys%s, best of %u runs:\n", n, keyBits,
+           hasValues? " with values" : "", repetitions);
+    printf("  OpenCL radix sort:       %10.3f ms %10.2f Mkeys/s\n",
+           bestDevice * 1.0e3, n / bestDevice * 1.0e-6);
+    printf("  std::sort:               %10.3f ms %10.2f Mkeys/s\n",
+           bestStd * 1.0e3, n / bestStd * 1.0e-6);
+    printf("  Parallel sort (%2u thr):  %10.3f ms %10.2f Mkeys/s\n",
+           numThreads, bestParallel * 1.0e3, n / bestParallel * 1.0e-6);
+
+    if ( resultsFile != NULL )
+    {
+        // Only the device sort, the host sorts do not depend on the driver
+        char variant[64];
+        snprintf(variant, sizeof(variant), "keys%u%s", keyBits, hasValues? "+values" : "");
+        if ( appendBenchmarkResult(resultsFile, device, "radix_sort", variant, n,
+                                   &deviceSamples[0], repetitions) != CL_SUCCESS )
+            return 1;
+    }
+    return 0;
+}
+
+int main(int argc, char** argv)
+{
+    cl_uint keyBits=32;
+    bool hasValues=false;
+    unsigned int repetitions=5;
+    unsigned int seed=1;
+    const char* kernelName="radix_sort.cl";
+
+    static struct option longOptions[] =
+    {
+        { "bits", required_argument, 0, 'b' },
+        { "values", no_argument, 0, 'v' },
+        { "repetitions", required_argument, 0, 'r' },
+        { "seed", required_argument, 0, 's' },
+        { "kernel", required_argument, 0, 'k' },
+        { "results", required_argument, 0, 'o' },
+        { 0, 0, 0, 0 }
+    };
+
+    int option=0;
+    while ( (option = getopt_long(argc, argv, "b:vr:s:k:o:", longOptions, NULL)) != -1 )
+    {
+        switch (option)
+        {
+            case 'b': keyBits = atoi(optarg); break;
+            case 'v': hasValues = true; break;
+            case 'r': repetitions = atoi(optarg); break;
+            case 's': seed = atoi(optarg); break;
+            case 'k': kernelName = optarg; break;
+            case 'o': resultsFile = optarg; break;
+            default: usage(argv[0]);
+        }
+    }
+
+    if ( argc - optind != 1 || ( keyBits != 32 && keyBits != 64 ) || repetitions < 1 )
+    {
+        usage(argv[0]);
+        assert(0 && "Unreachable");
+    }
+
+    cl_uint n = atoi(argv[optind]);
+    if ( n < 1 )
+    {
+        printf("Number of elements must be > 0\n");
+        exit(1);
+    }
+
+    cl_int err = getKernelSource( kernelName,
+                                  embeddedKernels,
+                                  sizeof(embeddedKernels)/sizeof(EmbeddedKernel),
+                                  &kernelSource);
+    if ( err != CL_SUCCESS )
+    {
+        printf("Could not open OpenCL kernel: %s\n", kernelName);
+        exit(1);
+    }
+
+    cl_platform_id platform = pickPlatform();
+    cl_device_id device = pickDevice(platform);
+
+    char deviceName[256];
+    if ( clGetDeviceInfo(device, CL_DEVICE_NAME, sizeof(deviceName), deviceName, NULL) == CL_SUCCESS )
+        printf("Using device %s\n", deviceName);
+
+    cl_context_properties cProp[] = { CL_CONTEXT_PLATFORM, (cl_context_properties) platform, 0 };
+    context = clCreateContext(cProp, 1, &device, contextCallBack, NULL, &err);
+    if ( err != CL_SUCCESS )
+    {
+        printf("Failed to create context: %d\n", err);
+        cleanUp();
+        exit(1);
+    }
+
+    cmdQueue = clCreateCommandQueue(context, device, 0, &err);
+    if ( err != CL_SUCCESS )
+    {
+        printf("Couldn't create command queue.\n");
+        cleanUp();
+        exit(1);
+    }
+
+    /* Build the sort kernels for the key type in the background */
+    char buildOptions[128];
+    snprintf(buildOptions, sizeof(buildOptions), "-DKEY_TYPE=%s %s -DITEMS_PER_WORK_ITEM=%u",
+             (keyBits == 64)? "ulong" : "uint",
+             hasValues? "-DHAS_VALUES" : "",
+             itemsPerWorkItem);
+
+    program = createProgramFromKernelSource(context, device, &kernelSource, buildOptions, &err);
+    if ( err != CL_SUCCESS )
+    {
+        printf("Could not create program:%d\n", err);
+        cleanUp();
+        exit(1);
+    }
+
+    buildManager = createBuildManager(/*maxConcurrentBuilds*/ 1, /*printBuildLogs*/ CL_FALSE);
+    err = startProgramBuild(buildManager, program, 1, &device, buildOptions);
+    if ( err != CL_SUCCESS )
+    {
+        printf("Failed to start build\n");
+        cleanUp();
+        exit(1);
+    }
+
+    /* The histograms have radix entries per tile. The smallest possible
+    *  tile (radix work items) bounds the number of tiles.
+    */
+    size_t maxTiles = (n + radix * itemsPerWorkItem -1) / (radix * itemsPerWorkItem);
+    scanPlan = createScanPlan(context, device, maxTiles * radix, &err);
+    if ( scanPlan == NULL )
+    {
+        printf("Failed to create scan plan: %d\n", err);
+        cleanUp();
+        exit(1);
+    }
+
+    int result = ( keyBits == 64 )?
+                 runSort<cl_ulong>(device, n, hasValues, repetitions, seed) :
+                 runSort<cl_uint>(device, n, hasValues, repetitions, seed);
+
+    if ( result != 0 && buildManager != 0 && isProgramBuildFinished(buildManager, program) )
+        printProgramBuildInfo(program, device, /*Indent*/ 0);
+
+    cleanUp();
+    return result;
+}
+
+void cleanUp()
+{
+    cl_int err=0;
+    releaseKernelSource(&kernelSource);
+
+    // Waits for any outstanding build
+    releaseBuildManager(buildManager);
+    releaseScanPlan(scanPlan);
+
+    cl_mem buffers[] = { keyBuffers[0], keyBuffers[1], valueBuffers[0], valueBuffers[1], histogramBuffer };
+    for (unsigned int index=0; index < sizeof(buffers)/sizeof(cl_mem); ++index)
+    {
+        if (buffers[index] != 0)
+        {
+            err = clReleaseMemObject(buffers[index]);
+            handleError(err, "Couldn't release buffer", false);
+        }
+    }
+
+    if (scatterKernel!=0)
+    {
+        err = clReleaseKernel(scatterKernel);
+        handleError(err, "Couldn't release kernel", false);
+    }
+
+    if (histogramKernel!=0)
+    {
+        err = clReleaseKernel(histogramKernel);
+        handleError(err, "Couldn't release kernel", false);
+    }
+
+    if (program!= 0)
+    {
+        err = clReleaseProgram(program);
+        handleError(err, "Couldn't release program", false);
+    }
+
+    if (cmdQueue != 0 )
+    {
+        err = clReleaseCommandQueue(cmdQueue);
+        handleError(err, "Couldn't release command queue", false);
+    }
+
+    if (context!=0)
+    {
+        err = clReleaseContext(context);
+        handleError(err, "Couldn't release context", false);
+    }
+}
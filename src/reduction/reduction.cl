@@ -0,0 +1,141 @@
+// Sum reductions with different accumulators, to compare their accuracy
+// (or overflow) and throughput.
+//
+// The single pass kernels use a grid-stride loop so every work item first
+// accumulates its own elements, then the work group combines them with a
+// tree in local memory and writes one partial sum. The host adds the
+// partial sums (one per work group). The local size must be a power of
+// two and scratch must hold one accumulator per work item.
+//
+// Build with -DUSE_FP64 on devices with double support for
+// reduce_float_double.
+
+#ifdef USE_FP64
+#pragma OPENCL EXTENSION cl_khr_fp64 : enable
+#endif
+
+// Tree reduction of scratch[0, local size) into scratch[0]
+#define TREE_REDUCE(scratch, lid) \
+    for (size_t d = get_local_size(0) / 2; d > 0; d /= 2) \
+    { \
+        barrier(CLK_LOCAL_MEM_FENCE); \
+        if ( (lid) < d ) \
+            scratch[lid] += scratch[(lid) + d]; \
+    } \
+    barrier(CLK_LOCAL_MEM_FENCE)
+
+// Sum of in[i]^2 accumulated in ACC_T.
+#define SQUARE_SUM_KERNEL(NAME, ACC_T) \
+__kernel void NAME(__global const int* in, \
+                   __global ACC_T* partials, \
+                   __local ACC_T* scratch, \
+                   uint n) \
+{ \
+    size_t lid = get_local_id(0); \
+    ACC_T sum = 0; \
+    for (size_t index = get_global_id(0); index < n; index += get_global_size(0)) \
+    { \
+        ACC_T x = in[index]; \
+        sum += x * x; \
+    } \
+    scratch[lid] = sum; \
+    TREE_REDUCE(scratch, lid); \
+    if ( lid == 0 ) \
+        partials[get_group_id(0)] = scratch[0]; \
+}
+
+// Same as dot_product.cl, overflows past 2^31
+SQUARE_SUM_KERNEL(reduce_square_int, int)
+SQUARE_SUM_KERNEL(reduce_square_long, long)
+
+// Sum of float values accumulated in ACC_T.
+#define FLOAT_SUM_KERNEL(NAME, ACC_T) \
+__kernel void NAME(__global const float* in, \
+                   __global ACC_T* partials, \
+                   __local ACC_T* scratch, \
+                   uint n) \
+{ \
+    size_t lid = get_local_id(0); \
+    ACC_T sum = 0; \
+    for (size_t index = get_global_id(0); index < n; index += get_global_size(0)) \
+        sum += in[index]; \
+    scratch[lid] = sum; \
+    TREE_REDUCE(scratch, lid); \
+    if ( lid == 0 ) \
+        partials[get_group_id(0)] = scratch[0]; \
+}
+
+FLOAT_SUM_KERNEL(reduce_float, float)
+
+#ifdef USE_FP64
+FLOAT_SUM_KERNEL(reduce_float_double, double)
+#endif
+
+// Error free addition: s + e == a + b exactly (Knuth's TwoSum).
+float2 twoSum(float a, float b)
+{
+    float s = a + b;
+    float bb = s - a;
+    float e = (a - (s - bb)) + (b - bb);
+    return (float2)(s, e);
+}
+
+// Compensated (Kahan) float sum. Each work item keeps a running sum and
+// the rounding error lost from it. Work items are combined with TwoSum so
+// the errors of the tree are kept as well. Each partial is (sum, error).
+__kernel void reduce_float_kahan(__global const float* in,
+                                 __global float2* partials,
+                                 __local float2* scratch,
+                                 uint n)
+{
+    size_t lid = get_local_id(0);
+    float sum = 0.0f;
+    float c = 0.0f;
+    for (size_t index = get_global_id(0); index < n; index += get_global_size(0))
+    {
+        float y = in[index] - c;
+        float t = sum + y;
+        c = (t - sum) - y;
+        sum = t;
+    }
+    scratch[lid] = (float2)(sum, -c);
+
+    for (size_t d = get_local_size(0) / 2; d > 0; d /= 2)
+    {
+        barrier(CLK_LOCAL_MEM_FENCE);
+        if ( lid < d )
+        {
+            float2 a = scratch[lid];
+            float2 b = scratch[lid + d];
+            float2 s = twoSum(a.x, b.x);
+            scratch[lid] = (float2)(s.x, s.y + a.y + b.y);
+        }
+    }
+    barrier(CLK_LOCAL_MEM_FENCE);
+
+    if ( lid == 0 )
+        partials[get_group_id(0)] = scratch[0];
+}
+
+// Pairwise float sum. Each work group adds a block of 2 * local size
+// elements with a tree and writes its sum, there is no sequential
+// accumulation. The host runs passes over the sums until one is left, so
+// the rounding error grows with log(n) instead of n.
+__kernel void reduce_float_pairwise(__global const float* in,
+                                    __global float* out,
+                                    __local float* scratch,
+                                    uint n)
+{
+    size_t lid = get_local_id(0);
+    size_t localSize = get_local_size(0);
+    size_t base = get_group_id(0) * 2 * localSize;
+
+    // Coalesced loads of the two halves of the block
+    float a = ( base + lid < n )? in[base + lid] : 0.0f;
+    float b = ( base + lid + localSize < n )? in[base + lid + localSize] : 0.0f;
+    scratch[lid] = a + b;
+    TREE_REDUCE(scratch, lid);
+
+    if ( lid == 0 )
+        out[get_group_id(0)] = scratch[0];
+}
@@ -0,0 +1,593 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <assert.h>
+#include <string.h>
+#include <math.h>
+#include <getopt.h>
+#include <CL/opencl.h>
+#include <libclprobe/clprobe.h>
+#include <libclprobe/driverutil.h>
+#include <libclprobe/kernelsource.h>
+#include <libclprobe/buildmanager.h>
+#include <libclprobe/timing.h>
+#include <libclprobe/resultstore.h>
+#include <vector>
+#include "reduction.cl.h"
+
+/* Kernels compiled into the executable */
+static const EmbeddedKernel embeddedKernels[] =
+{
+    EMBEDDED_KERNEL("reduction.cl", reduction_cl)
+};
+
+/* How the partial sums of a variant are stored and added on the host */
+typedef enum
+{
+    FINISH_INT,      /* cl_int partials added with wrap around like the device */
+    FINISH_LONG,     /* cl_long partials */
+    FINISH_FLOAT,    /* cl_float partials added in float */
+    FINISH_DOUBLE,   /* cl_double partials */
+    FINISH_KAHAN,    /* cl_float2 (sum, error) partials added with TwoSum */
+    FINISH_PAIRWISE  /* Passes on the device until one cl_float is left */
+} Finish;
+
+typedef struct
+{
+    const char* name;
+    const char* kernelName;
+    Finish finish;
+    size_t accumulatorSize;
+    const char* description;
+} Variant;
+
+static const Variant variants[] =
+{
+    { "int", "reduce_square_int", FINISH_INT, sizeof(cl_int),
+      "sum of squares, int accumulator (as dot_product.cl)" },
+    { "long", "reduce_square_long", FINISH_LONG, sizeof(cl_long),
+      "sum of squares, long accumulator" },
+    { "float", "reduce_float", FINISH_FLOAT, sizeof(cl_float),
+      "float sum, float accumulator" },
+    { "kahan", "reduce_float_kahan", FINISH_KAHAN, sizeof(cl_float2),
+      "float sum, compensated (Kahan) float accumulator" },
+    { "pairwise", "reduce_float_pairwise", FINISH_PAIRWISE, sizeof(cl_float),
+      "float sum, pairwise tree over multiple passes" },
+    { "double", "reduce_float_double", FINISH_DOUBLE, sizeof(cl_double),
+      "float sum, double accumulator (needs fp64)" }
+};
+
+static const unsigned int numVariants = sizeof(variants)/sizeof(Variant);
+
+void usage(const char* progName)
+{
+    printf("Usage: %s [options] <num_elements>\n\n", progName);
+    printf("Sums random values with different accumulators and reports the\n"
+           "throughput and the error of each against an exact host sum.\n\n"
+           "Variants:\n");
+    for (unsigned int index=0; index < numVariants; ++index)
+        printf("  %-9s %s\n", variants[index].name, variants[index].description);
+    printf("\nOptions:\n"
+           "  --variant <name>   Only run this variant\n"
+           "  --repetitions <n>  Number of timed runs, the best is reported (default 5)\n"
+           "  --seed <n>         Seed for the random input (default 1)\n"
+           "  --results <file>   Append the times to a results file for perf_compare\n"
+           "  --kernel <file>    Override the embedded reduction.cl\n");
+    exit(1);
+}
+
+void cleanUp();
+
+//Global for clean up convenience
+KernelSource kernelSource;
+BuildManager* buildManager=0;
+cl_program program=0;
+cl_context context=0;
+cl_command_queue cmdQueue=0;
+cl_kernel kernels[numVariants];
+cl_int* hostInts=0;
+cl_float* hostFloats=0;
+unsigned char* hostPartials=0;
+cl_mem intBuffer=0;
+cl_mem floatBuffer=0;
+cl_mem partialsBuffer=0;
+cl_mem pairwiseBuffers[2] = { 0, 0 };
+const char* resultsFile=0;
+
+/* Result of a reduction. Integer variants are exact */
+typedef struct
+{
+    cl_long integer;
+    double real;
+} Sum;
+
+/* Largest power of two work group size (up to 256) kernel allows */
+static size_t pickLocalSize(cl_kernel kernel, cl_device_id device)
+{
+    KernelInfo info;
+    if ( getKernelInfo(kernel, device, &info) != CL_SUCCESS )
+        return 0;
+
+    size_t localSize=1;
+    while ( localSize * 2 <= info.workGroupSize && localSize * 2 <= 256 )
+        localSize *= 2;
+    return localSize;
+}
+
+/* Enqueue kernel, wait for it and add its execution time to seconds */
+static cl_int runKernel(cl_kernel kernel, cl_mem in, cl_mem out, size_t scratchBytes, cl_uint n,
+                        size_t globalSize, size_t localSize, double* seconds)
+{
+    cl_int err = clSetKernelArg(kernel, 0, sizeof(cl_mem), &in);
+    if ( err == CL_SUCCESS )
+        err = clSetKernelArg(kernel, 1, sizeof(cl_mem), &out);
+    if ( err == CL_SUCCESS )
+        err = clSetKernelArg(kernel, 2, scratchBytes, NULL);
+    if ( err == CL_SUCCESS )
+        err = clSetKernelArg(kernel, 3, sizeof(cl_uint), &n);
+    if ( err != CL_SUCCESS )
+    {
+        printf("Couldn't set kernel argument.\n");
+        return err;
+    }
+
+    cl_event event=0;
+    err = clEnqueueNDRangeKernel(cmdQueue, kernel, 1, NULL, &globalSize, &localSize, 0, NULL, &event);
+    if ( err != CL_SUCCESS )
+    {
+        printf("Failed to enqueue kernel: %d\n", err);
+        return err;
+    }
+
+    double kernelSeconds=0.0;
+    err = clWaitForEvents(1, &event);
+    if ( err == CL_SUCCESS )
+        err = getEventDuration(event, &kernelSeconds);
+    clReleaseEvent(event);
+    if ( err != CL_SUCCESS )
+    {
+        printf("Failed to time kernel: %d\n", err);
+        return err;
+    }
+
+    *seconds += kernelSeconds;
+    return CL_SUCCESS;
+}
+
+/* Add the partial sums of one work group each on the host */
+static Sum finishPartials(const Variant* variant, size_t numGroups)
+{
+    Sum sum = { 0, 0.0 };
+    if ( variant->finish == FINISH_INT )
+    {
+        // Unsigned so the wrap around matches the device without UB
+        cl_uint total=0;
+        for (size_t group=0; group < numGroups; ++group)
+            total += (cl_uint) ((cl_int*) hostPartials)[group];
+        sum.integer = (cl_int) total;
+        sum.real = (double) sum.integer;
+    }
+    else if ( variant->finish == FINISH_LONG )
+    {
+        for (size_t group=0; group < numGroups; ++group)
+            sum.integer += ((cl_long*) hostPartials)[group];
+        sum.real = (double) sum.integer;
+    }
+    else if ( variant->finish == FINISH_FLOAT )
+    {
+        cl_float total=0.0f;
+        for (size_t group=0; group < numGroups; ++group)
+            total += ((cl_float*) hostPartials)[group];
+        sum.real = total;
+    }
+    else if ( variant->finish == FINISH_DOUBLE )
+    {
+        for (size_t group=0; group < numGroups; ++group)
+            sum.real += ((cl_double*) hostPartials)[group];
+    }
+    else if ( variant->finish == FINISH_KAHAN )
+    {
+        // TwoSum in float like the kernel, the errors are kept separately
+        volatile cl_float total=0.0f;
+        cl_float error=0.0f;
+        for (size_t group=0; group < numGroups; ++group)
+        {
+            cl_float2 partial = ((cl_float2*) hostPartials)[group];
+            volatile cl_float s = total + partial.s[0];
+            volatile cl_float bb = s - total;
+            error += ( (total - (s - bb)) + (partial.s[0] - bb) ) + partial.s[1];
+            total = s;
+        }
+        sum.real = (cl_float) (total + error);
+    }
+    return sum;
+}
+
+/* Run variant once, setting seconds to the total kernel time and sum to
+*  the result.
+*/
+static cl_int runReduction(const Variant* variant, cl_kernel kernel, cl_uint n,
+                           size_t globalSize, size_t localSize, double* seconds, Sum* sum)
+{
+    *seconds = 0.0;
+    size_t scratchBytes = localSize * variant->accumulatorSize;
+
+    if ( variant->finish == FINISH_PAIRWISE )
+    {
+        // Each pass sums blocks of 2 * localSize until one value is left
+        cl_mem in = floatBuffer;
+        cl_uint remaining = n;
+        unsigned int pass=0;
+        do
+        {
+            size_t blocks = (remaining + 2 * localSize - 1) / (2 * localSize);
+            cl_mem out = pairwiseBuffers[pass % 2];
+            cl_int err = runKernel(kernel, in, out, scratchBytes, remaining,
+                                   blocks * localSize, localSize, seconds);
+            if ( err != CL_SUCCESS )
+                return err;
+
+            in = out;
+            remaining = blocks;
+            ++pass;
+        } while ( remaining > 1 );
+
+        cl_float total=0.0f;
+        cl_int err = clEnqueueReadBuffer(cmdQueue, in, CL_TRUE, 0, sizeof(cl_float), &total, 0, NULL, NULL);
+        sum->integer = 0;
+        sum->real = total;
+        return err;
+    }
+
+    cl_mem in = ( variant->finish == FINISH_INT || variant->finish == FINISH_LONG )? intBuffer : floatBuffer;
+    cl_int err = runKernel(kernel, in, partialsBuffer, scratchBytes, n, globalSize, localSize, seconds);
+    if ( err != CL_SUCCESS )
+        return err;
+
+    size_t numGroups = globalSize / localSize;
+    err = clEnqueueReadBuffer(cmdQueue, partialsBuffer, CL_TRUE, 0, numGroups * variant->accumulatorSize,
+                              hostPartials, 0, NULL, NULL);
+    if ( err != CL_SUCCESS )
+    {
+        printf("Failed to read back partial sums: %d\n", err);
+        return err;
+    }
+
+    *sum = finishPartials(variant, numGroups);
+    return CL_SUCCESS;
+}
+
+/* Time variant and print its throughput and error against the exact sums */
+static cl_int benchmarkVariant(const Variant* variant, cl_kernel kernel, cl_device_id device,
+                               cl_uint n, size_t numGroups, unsigned int repetitions,
+                               cl_long exactSquares, double exactFloats)
+{
+    size_t localSize = pickLocalSize(kernel, device);
+    if ( localSize == 0 )
+    {
+        printf("%-9s could not get work group limits\n", variant->name);
+        return CL_INVALID_WORK_GROUP_SIZE;
+    }
+
+    double best=0.0;
+    std::vector<double> samples;
+    Sum sum = { 0, 0.0 };
+    for (unsigned int rep=0; rep < repetitions; ++rep)
+    {
+        double seconds=0.0;
+        cl_int err = runReduction(variant, kernel, n, numGroups * localSize, localSize, &seconds, &sum);
+        if ( err != CL_SUCCESS )
+            return err;
+
+        if ( rep == 0 || seconds < best ) best = seconds;
+        samples.push_back(seconds);
+    }
+
+    bool integer = ( variant->finish == FINISH_INT || variant->finish == FINISH_LONG );
+    size_t elementSize = integer? sizeof(cl_int) : sizeof(cl_float);
+    printf("%-9s %8.3f ms %8.2f GB/s  ", variant->name, best * 1.0e3,
+           elementSize * (double) n / best * 1.0e-9);
+    if ( integer )
+    {
+        printf("sum %lld", (long long) sum.integer);
+        if ( sum.integer != exactSquares )
+            printf(" WRONG (exact %lld, overflowed)", (long long) exactSquares);
+        else
+            printf(" exact");
+    }
+    else
+    {
+        double relativeError = ( exactFloats != 0.0 )? fabs(sum.real - exactFloats) / fabs(exactFloats) : 0.0;
+        printf("sum %.9g relative error %.2e", sum.real, relativeError);
+    }
+    printf("\n");
+
+    if ( resultsFile != NULL )
+        return appendBenchmarkResult(resultsFile, device, "reduction", variant->name, n, &samples[0], repetitions);
+    return CL_SUCCESS;
+}
+
+int main(int argc, char** argv)
+{
+    const char* kernelName="reduction.cl";
+    const char* variantName=0;
+    unsigned int repetitions=5;
+    unsigned int seed=1;
+
+    static struct option longOptions[] =
+    {
+        { "variant", required_argument, 0, 'v' },
+        { "repetitions", required_argument, 0, 'r' },
+        { "seed", required_argument, 0, 's' },
+        { "kernel", required_argument, 0, 'k' },
+        { "results", required_argument, 0, 'o' },
+        { 0, 0, 0, 0 }
+    };
+
+    int option=0;
+    while ( (option = getopt_long(argc, argv, "v:r:s:k:o:", longOptions, NULL)) != -1 )
+    {
+        switch (option)
+        {
+            case 'v': variantName = optarg; break;
+            case 'r': repetitions = atoi(optarg); break;
+            case 's': seed = atoi(optarg); break;
+            case 'k': kernelName = optarg; break;
+            case 'o': resultsFile = optarg; break;
+            default: usage(argv[0]);
+        }
+    }
+
+    if ( argc - optind != 1 || repetitions < 1 )
+    {
+        usage(argv[0]);
+        assert(0 && "Unreachable");
+    }
+
+    cl_uint n = atoi(argv[optind]);
+    if ( n < 1 )
+    {
+        printf("Number of elements must be > 0\n");
+        exit(1);
+    }
+
+    if ( variantName != 0 )
+    {
+        bool found=false;
+        for (unsigned int index=0; index < numVariants; ++index)
+            found = found || strcmp(variants[index].name, variantName) == 0;
+        if ( !found )
+        {
+            printf("Unknown variant: %s\n", variantName);
+            usage(argv[0]);
+        }
+    }
+
+    cl_int err = getKernelSource( kernelName,
+                                  embeddedKernels,
+                                  sizeof(embeddedKernels)/sizeof(EmbeddedKernel),
+                                  &kernelSource);
+    if ( err != CL_SUCCESS )
+    {
+        printf("Could not open OpenCL kernel: %s\n", kernelName);
+        exit(1);
+    }
+
+    cl_platform_id platform = pickPlatform();
+    cl_device_id device = pickDevice(platform);
+
+    char deviceName[256];
+    if ( clGetDeviceInfo(device, CL_DEVICE_NAME, sizeof(deviceName), deviceName, NULL) == CL_SUCCESS )
+        printf("Using device %s\n", deviceName);
+
+    // Devices without fp64 report no double capabilities (or fail the query)
+    cl_device_fp_config doubleConfig=0;
+    if ( clGetDeviceInfo(device, CL_DEVICE_DOUBLE_FP_CONFIG, sizeof(doubleConfig), &doubleConfig, NULL) != CL_SUCCESS )
+        doubleConfig = 0;
+
+    cl_context_properties cProp[] = { CL_CONTEXT_PLATFORM, (cl_context_properties) platform, 0 };
+    context = clCreateContext(cProp, 1, &device, contextCallBack, NULL, &err);
+    if ( err != CL_SUCCESS )
+    {
+        printf("Failed to create context: %d\n", err);
+        cleanUp();
+        exit(1);
+    }
+
+    /* Profiling is used to time the kernels */
+    cmdQueue = clCreateCommandQueue(context, device, CL_QUEUE_PROFILING_ENABLE, &err);
+    if ( err != CL_SUCCESS )
+    {
+        printf("Couldn't create command queue.\n");
+        cleanUp();
+        exit(1);
+    }
+
+    const char* buildOptions = ( doubleConfig != 0 )? "-DUSE_FP64" : NULL;
+    program = createProgramFromKernelSource(context, device, &kernelSource, buildOptions, &err);
+    if ( err != CL_SUCCESS )
+    {
+        printf("Could not create program:%d\n", err);
+        cleanUp();
+        exit(1);
+    }
+
+    /* Build on a worker thread while the input is generated. The
+    *  build log is only printed on failure
+    */
+    buildManager = createBuildManager(/*maxConcurrentBuilds*/ 1, /*printBuildLogs*/ CL_FALSE);
+    if ( buildManager == NULL )
+    {
+        printf("Failed to create build manager\n");
+        cleanUp();
+        exit(1);
+    }
+
+    err = startProgramBuild(buildManager, program, 1, &device, buildOptions);
+    if ( err != CL_SUCCESS )
+    {
+        printf("Failed to start build\n");
+        cleanUp();
+        exit(1);
+    }
+
+    /* Random input. Squares of [-500, 500) overflow int after about
+    *  25000 elements. Floats in [0, 1) lose precision in a float sum.
+    */
+    hostInts = (cl_int*) malloc(sizeof(cl_int) * n);
+    hostFloats = (cl_float*) malloc(sizeof(cl_float) * n);
+    if ( hostInts == 0 || hostFloats == 0 )
+    {
+        printf("Failed to malloc memory for host arrays\n");
+        cleanUp();
+        exit(1);
+    }
+
+    srand(seed);
+    cl_long exactSquares=0;
+    double exactFloats=0.0; // Exact enough: double has 29 more bits than float
+    for (cl_uint index=0; index < n; ++index)
+    {
+        hostInts[index] = rand() % 1000 - 500;
+        hostFloats[index] = (cl_float) rand() / ((cl_float) RAND_MAX + 1.0f);
+        exactSquares += (cl_long) hostInts[index] * hostInts[index];
+        exactFloats += hostFloats[index];
+    }
+
+    cl_uint computeUnits=0;
+    err = clGetDeviceInfo(device, CL_DEVICE_MAX_COMPUTE_UNITS, sizeof(cl_uint), &computeUnits, NULL);
+    if ( err != CL_SUCCESS )
+    {
+        printf("Could not get device limits\n");
+        cleanUp();
+        exit(1);
+    }
+    size_t numGroups = computeUnits * 4;
+
+    // Room for the partials of the widest accumulator
+    hostPartials = (unsigned char*) malloc(sizeof(cl_float2) * numGroups);
+    intBuffer = clCreateBuffer(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR,
+                               sizeof(cl_int) * n, hostInts, &err);
+    if ( err == CL_SUCCESS )
+        floatBuffer = clCreateBuffer(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR,
+                                     sizeof(cl_float) * n, hostFloats, &err);
+    if ( err == CL_SUCCESS )
+        partialsBuffer = clCreateBuffer(context, CL_MEM_READ_WRITE, sizeof(cl_float2) * numGroups, NULL, &err);
+    // The first pairwise pass writes at most n / 2 + 1 sums
+    for (unsigned int index=0; err == CL_SUCCESS && index < 2; ++index)
+        pairwiseBuffers[index] = clCreateBuffer(context, CL_MEM_READ_WRITE,
+                                                sizeof(cl_float) * (n / 2 + 1), NULL, &err);
+    if ( err != CL_SUCCESS || hostPartials == 0 )
+    {
+        printf("Failed to create buffers. Error:%d\n", err);
+        cleanUp();
+        exit(1);
+    }
+
+    err = waitForProgramBuild(buildManager, program);
+    if ( err != CL_SUCCESS )
+    {
+        printf("Build failed\n");
+        printProgramBuildInfo(program, device, /*Indent*/ 0);
+        cleanUp();
+        exit(1);
+    }
+
+    printf("Summing %u elements with %lu work groups\n", n, (unsigned long) numGroups);
+    printf("Exact sum of squares %lld, exact float sum %.9g\n\n", (long long) exactSquares, exactFloats);
+
+    int result=0;
+    for (unsigned int index=0; index < numVariants; ++index)
+    {
+        const Variant* variant = &(variants[index]);
+        if ( variantName != 0 && strcmp(variant->name, variantName) != 0 )
+            continue;
+
+        if ( variant->finish == FINISH_DOUBLE && doubleConfig == 0 )
+        {
+            printf("%-9s skipped, the device has no double support\n", variant->name);
+            continue;
+        }
+
+        kernels[index] = clCreateKernel(program, variant->kernelName, &err);
+        if ( err != CL_SUCCESS )
+        {
+            printf("Failed to create kernel object %s.\n", variant->kernelName);
+            result = 1;
+            continue;
+        }
+
+        if ( benchmarkVariant(variant, kernels[index], device, n, numGroups, repetitions,
+                              exactSquares, exactFloats) != CL_SUCCESS )
+            result = 1;
+    }
+
+    cleanUp();
+    return result;
+}
+
+void cleanUp()
+{
+    cl_int err=0;
+    releaseKernelSource(&kernelSource);
+
+    // Waits for any outstanding build
+    releaseBuildManager(buildManager);
+
+    for (unsigned int index=0; index < 2; ++index)
+    {
+        if (pairwiseBuffers[index]!=0)
+        {
+            err = clReleaseMemObject(pairwiseBuffers[index]);
+            handleError(err, "Couldn't release buffer", false);
+        }
+    }
+
+    if (partialsBuffer!=0)
+    {
+        err = clReleaseMemObject(partialsBuffer);
+        handleError(err, "Couldn't release buffer", false);
+    }
+
+    if (floatBuffer!=0)
+    {
+        err = clReleaseMemObject(floatBuffer);
+        handleError(err, "Couldn't release buffer", false);
+    }
+
+    if (intBuffer!=0)
+    {
+        err = clReleaseMemObject(intBuffer);
+        handleError(err, "Couldn't release buffer", false);
+    }
+
+    for (unsigned int index=0; index < numVariants; ++index)
+    {
+        if (kernels[index]!=0)
+        {
+            err = clReleaseKernel(kernels[index]);
+            handleError(err, "Couldn't release kernel", false);
+        }
+    }
+
+    if (program!= 0)
+    {
+        err = clReleaseProgram(program);
+        handleError(err, "Couldn't release program", false);
+    }
+
+    if (cmdQueue != 0 )
+    {
+        err = clReleaseCommandQueue(cmdQueue);
+        handleError(err, "Couldn't release command queue", false);
+    }
+
+    if (context!=0)
+    {
+        err = clReleaseContext(context);
+        handleError(err, "Couldn't release context", false);
+    }
+
+    free(hostPartials);
+    free(hostFloats);
+    free(hostInts);
+}
@@ -1,193 +1,478 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <assert.h>
-#include <sys/stat.h>
+#include <string.h>
+#include <getopt.h>
 #include <CL/opencl.h>
 #include <libclprobe/clprobe.h>
+#include <libclprobe/driverutil.h>
+#include <libclprobe/kernelsource.h>
+#include <libclprobe/buildmanager.h>
+#include <libclprobe/timing.h>
+#include <libclprobe/devicepeaks.h>
+#include <libclprobe/trace.h>
+#include <libclprobe/queuepool.h>
+#include <libclprobe/launcher.h>
+#include <thread>
+#include <vector>
+#include <atomic>
+#include "add.cl.h"
+#include "dot_product.cl.h"
 #include <errno.h>
 
-void showError(const char* msg, bool quit=true)
+/* Kernels compiled into the executable */
+static const EmbeddedKernel embeddedKernels[] =
 {
-    printf("Error: %s\n", msg);
-    if (quit) exit(1);
-}
+    EMBEDDED_KERNEL("add.cl", add_cl),
+    EMBEDDED_KERNEL("dot_product.cl", dot_product_cl)
+};
 
-void handleError(cl_int error, const char* msg, bool quit=true)
+/* Global memory traffic and arithmetic of the embedded kernels for an
+*  array of n elements. Used for the roofline report.
+*/
+static KernelWork addWork(cl_uint n)
 {
-    if ( error != CL_SUCCESS)
-    {
-        showError(msg, quit);
-        if (quit) assert(0 && "Unreachable");
-    }
+    // Every element is read, incremented and written back
+    KernelWork work = { 2.0 * sizeof(cl_int) * n, (double) n, CL_TRUE };
+    return work;
 }
 
-cl_platform_id pickPlatform()
+static KernelWork dotProductWork(cl_uint n)
 {
-    cl_uint numPlatforms=0;
-    cl_int err = clGetPlatformIDs(0, 0, &numPlatforms);
-    handleError(err, "Could not get number of platforms");
-
-    if ( numPlatforms < 1 )
-        showError("Couldn't find a platform");
-
-    cl_platform_id* platforms=0;
-    cl_uint numberOfPlatforms;
-    err = getPlatformIDs(&platforms, &numberOfPlatforms);
-    handleError(err, "Could not get platform ID");
-    
-    // Just pick first platform
-    cl_platform_id platform = platforms[0];
-    free(platforms);
-    return platform;
+    // Squaring reads and writes every element. The reduction steps
+    // (d = n/2, n/4, ..., 1) read 2 and write 1 element per active work item.
+    KernelWork work = { 2.0 * sizeof(cl_int) * n + 3.0 * sizeof(cl_int) * (n - 1),
+                        /* n multiplies and n-1 adds */ 2.0 * n - 1,
+                        CL_TRUE };
+    return work;
 }
 
-cl_device_id pickDevice(cl_platform_id platform)
+typedef struct
 {
-    cl_device_id* devices;
-    cl_uint numberOfDevices;
+    const char* name;
+    KernelWork (*work)(cl_uint);
+} KernelCost;
 
-    cl_int err = getDeviceIDs(platform, &devices, &numberOfDevices);
+static const KernelCost kernelCosts[] =
+{
+    { "add.cl", addWork },
+    { "dot_product.cl", dotProductWork }
+};
 
-    handleError(err, "Could not get device IDs");
+/* Returns NULL if there is no cost model for the kernel */
+static const KernelCost* findKernelCost(const char* kernelName)
+{
+    const char* baseName = strrchr(kernelName, '/');
+    baseName = (baseName == NULL)? kernelName : baseName + 1;
 
-    // Just pick first device
-    cl_device_id device = devices[0];
-    free(devices);
-    return device;
+    for (unsigned int index=0; index < sizeof(kernelCosts)/sizeof(KernelCost); ++index)
+    {
+        if ( strcmp(kernelCosts[index].name, baseName) == 0 )
+            return &(kernelCosts[index]);
+    }
+    return NULL;
 }
 
-void contextCallBack(const char* errInfo,
-                     const void* privateInfo,
-                     size_t cb,
-                     void* userData)
+void usage(const char* progName)
 {
-    static unsigned int count=0;
-    count++;
-    printf("Context Error (#%u): %s\n", count, errInfo);
+    printf("Usage: %s [options] <kernel> <array_size>\n\n", progName);
+    printf("<kernel> is the name of an embedded kernel or the path to a kernel\n"
+           "file (OpenCL C or a .spv SPIR-V module) which overrides the embedded\n"
+           "kernel of the same name.\n"
+           "Embedded kernels:\n");
+    for (unsigned int index=0; index < sizeof(embeddedKernels)/sizeof(EmbeddedKernel); ++index)
+        printf("  %s\n", embeddedKernels[index].name);
+    printf("\nOptions:\n"
+           "  --peaks <file>  Device peaks measured by device_benchmark used for the\n"
+           "                  roofline report (default: estimate from device info)\n"
+           "  --trace <file>  Write a Chrome trace of the run (needs a build with\n"
+           "                  ENABLE_TRACING)\n"
+           "  --batches <n>   After the first run, run the kernel on <n> independent\n"
+           "                  buffers (write, kernel, read each) and time them\n"
+           "  --out-of-order  Run the batches on an out-of-order queue (or a pool of\n"
+           "                  in-order queues if the device lacks support) instead of\n"
+           "                  the single in-order queue. Not with --threads\n"
+           "  --threads <n>   After the first run, launch the kernel from <n> host\n"
+           "                  threads at once (each <batches> times, default 1) with\n"
+           "                  per thread kernels and queues\n"
+           "  --svm           Allocate the array with clSVMAlloc (OpenCL 2.0 devices\n"
+           "                  with SVM support) instead of a buffer, so the kernel\n"
+           "                  works on host visible memory with no read back\n"
+           "  --quiet         Fast start: skip the platform, device, context, program\n"
+           "                  and array printing (build logs only on failure)\n"
+           "  --timings       Report the time spent in each start up phase\n");
+    exit(1);
 }
 
-void usage(const char* progName)
+void cleanUp();
+
+void printArray(cl_int* array, cl_uint nElements)
 {
-    printf("Usage: %s <kernel file> <array_size>\n", progName);
-    exit(1);
+    for (cl_uint index=0; index < nElements; ++index)
+    {
+        printf("Array[%u] = %d\n", index, array[index]);
+    }
 }
 
-/* The Client is responsible for freeing the memory
-*  allocated.
-*
-*  Returns a NULL pointer if file cannot be opened.
+//Global for clean up convenience
+KernelSource kernelSource;
+BuildManager* buildManager=0;
+cl_program program=0;
+cl_context context=0;
+cl_command_queue cmdQueue=0;
+cl_kernel kernel=0;
+cl_event kernelEvent=0;
+cl_int* hostArray=0;
+cl_int* copiedBackArray=0;
+cl_mem arrayBuffer=0;
+cl_int* svmArray=0;
+bool svmMapped=false;
+QueuePool* queuePool=0;
+cl_mem* batchBuffers=0;
+cl_uint numBatchBuffers=0;
+cl_int* batchResults=0;
+Launcher* launcher=0;
+
+/* Number of in-order queues used when the device has no out-of-order support */
+static const cl_uint numFallbackQueues=4;
+
+/* Run the kernel on numBatches independent buffers. Each batch writes the
+*  input, runs the kernel and reads the result back, ordered by events
+*  only, so batches can overlap on an out-of-order queue or a queue pool.
+*  Returns CL_SUCCESS if every batch matches expected.
 */
-char* loadKernelFromFile(const char* path)
+static cl_int runBatches(cl_device_id device,
+                         cl_uint arraySize,
+                         cl_uint numBatches,
+                         bool outOfOrder,
+                         const cl_int* expected)
 {
-    char* source=0;
-
-    struct stat fileInfo;
-    if( stat(path, &fileInfo) !=  0)
+    cl_int err = CL_SUCCESS;
+    const char* mode = "in-order queue";
+    if ( outOfOrder )
     {
-        perror("Could not access file");
-        return NULL;
+        queuePool = createQueuePool(context, device, /*properties*/ 0, numFallbackQueues, &err);
+        if ( queuePool == NULL )
+            return err;
+
+        mode = isOutOfOrderQueuePool(queuePool)? "out-of-order queue" : "round-robin in-order queues";
     }
 
-    /* File size in bytes */
-    off_t fileSize = fileInfo.st_size;
-    if ( fileSize < 1 )
+    size_t arrayBytes = sizeof(cl_int) * arraySize;
+    batchBuffers = (cl_mem*) calloc( numBatches, sizeof(cl_mem) );
+    batchResults = (cl_int*) malloc( arrayBytes * numBatches );
+    if ( batchBuffers == 0 || batchResults == 0 )
     {
-        printf("Reported file size of %ld bytes is invalid.\n", fileSize);
-        return NULL;
+        printf("Failed to malloc memory for batches\n");
+        return CL_OUT_OF_HOST_MEMORY;
     }
 
-    FILE* f = fopen(path,"rb");
+    for (numBatchBuffers=0; numBatchBuffers < numBatches; ++numBatchBuffers)
+    {
+        batchBuffers[numBatchBuffers] = clCreateBuffer(context, CL_MEM_READ_WRITE, arrayBytes, NULL, &err);
+        if ( err != CL_SUCCESS )
+        {
+            printf("Failed to create buffer. Error:%d\n", err);
+            return err;
+        }
+    }
 
-    if (f == NULL)
+    size_t globalWorkSize[] = { arraySize };
+    size_t localWorkSize[] = { 1 };
+    double start = getHostTime();
+    for (cl_uint batch=0; batch < numBatches; ++batch)
     {
-        perror("Failed to open file.");
-        return NULL;
+        cl_command_queue queue = (queuePool != 0)? getNextQueue(queuePool) : cmdQueue;
+        cl_event written=0;
+        cl_event ran=0;
+
+        err = clEnqueueWriteBuffer(queue, batchBuffers[batch], CL_FALSE, 0, arrayBytes, hostArray,
+                                   0, NULL, &written);
+
+        // Arguments are captured when the kernel is enqueued
+        if ( err == CL_SUCCESS )
+            err = clSetKernelArg(kernel, 0, sizeof(cl_mem), &batchBuffers[batch]);
+
+        if ( err == CL_SUCCESS )
+            err = clEnqueueNDRangeKernel(queue, kernel, 1, NULL, globalWorkSize, localWorkSize,
+                                         1, &written, &ran);
+
+        if ( err == CL_SUCCESS )
+            err = clEnqueueReadBuffer(queue, batchBuffers[batch], CL_FALSE, 0, arrayBytes,
+                                      batchResults + (size_t) batch * arraySize, 1, &ran, NULL);
+
+        if ( written != 0 ) clReleaseEvent(written);
+        if ( ran != 0 ) clReleaseEvent(ran);
+        if ( err != CL_SUCCESS )
+        {
+            printf("Failed to enqueue batch %u: %d\n", batch, err);
+            return err;
+        }
     }
-    
-    // Allocated memory for file
-    source = (char*) malloc(  fileSize + 
-                            /* For '\0' terminator */ 1);
 
-    if (source == 0)
+    err = (queuePool != 0)? finishQueuePool(queuePool) : clFinish(cmdQueue);
+    double seconds = getHostTime() - start;
+    if ( err != CL_SUCCESS )
     {
-        printf("Could not allocated memory for kernel file.");
-        fclose(f);
-        return NULL;
+        printf("Batches failed: %d\n", err);
+        return err;
     }
 
-    if ( fread(/*ptr*/ source, /* no of bytes */ 1 , fileSize , /*FILE*/ f) != ( (size_t) fileSize) )
+    cl_uint mismatches=0;
+    for (cl_uint batch=0; batch < numBatches; ++batch)
     {
-        printf("Failed to read %s into memory.", path);
-        fclose(f);
-        free(source);
-        return NULL;
+        if ( memcmp(batchResults + (size_t) batch * arraySize, expected, arrayBytes) != 0 )
+            ++mismatches;
     }
 
-    // Write NULL terminator
-    source[fileSize] = '\0';
+    printf("\n%u batches on %s (%u queue%s): %.3f ms, %.3f ms per batch\n",
+           numBatches, mode,
+           (queuePool != 0)? getQueuePoolSize(queuePool) : 1,
+           (queuePool != 0 && getQueuePoolSize(queuePool) > 1)? "s" : "",
+           seconds * 1.0e3, seconds * 1.0e3 / numBatches);
 
-    return source;
+    if ( mismatches != 0 )
+    {
+        printf("%u batches differ from the first run\n", mismatches);
+        return CL_INVALID_VALUE;
+    }
+    return CL_SUCCESS;
 }
 
+/* Launch the kernel launchesPerThread times from each of numThreads
+*  threads. Every thread uses its own buffer, queue and kernel clone via
+*  the launcher. Returns CL_SUCCESS if every result matches expected.
+*/
+static cl_int runThreads(cl_device_id device,
+                         cl_uint arraySize,
+                         cl_uint numThreads,
+                         cl_uint launchesPerThread,
+                         const cl_int* expected)
+{
+    cl_int err;
+    launcher = createLauncher(context, device, 1, &program, /*properties*/ 0, &err);
+    if ( launcher == NULL )
+    {
+        printf("Failed to create launcher: %d\n", err);
+        return err;
+    }
 
-void cleanUp();
+    std::atomic<cl_uint> failures(0);
+    std::vector<std::thread> threads;
+    double start = getHostTime();
+    for (cl_uint index=0; index < numThreads; ++index)
+    {
+        threads.push_back( std::thread( [arraySize, launchesPerThread, expected, &failures]()
+        {
+            size_t arrayBytes = sizeof(cl_int) * arraySize;
+            std::vector<cl_int> result(arraySize);
+            cl_int err;
+            cl_command_queue queue = getThreadQueue(launcher);
+            cl_mem buffer = clCreateBuffer(context, CL_MEM_READ_WRITE, arrayBytes, NULL, &err);
+            if ( queue == NULL || err != CL_SUCCESS )
+            {
+                failures += launchesPerThread;
+                return;
+            }
+
+            size_t globalWorkSize[] = { arraySize };
+            size_t localWorkSize[] = { 1 };
+            KernelArg args[] = { { sizeof(cl_mem), &buffer } };
+            for (cl_uint launch=0; launch < launchesPerThread; ++launch)
+            {
+                cl_event written=0;
+                err = clEnqueueWriteBuffer(queue, buffer, CL_FALSE, 0, arrayBytes, hostArray,
+                                           0, NULL, &written);
+                if ( err == CL_SUCCESS )
+                    err = launchKernel(launcher, "simple_kernel", 1, args, 1,
+                                       globalWorkSize, localWorkSize, 1, &written, NULL);
+                if ( err == CL_SUCCESS )
+                    err = clEnqueueReadBuffer(queue, buffer, CL_TRUE, 0, arrayBytes, &result[0],
+                                              0, NULL, NULL);
+
+                if ( written != 0 ) clReleaseEvent(written);
+                if ( err != CL_SUCCESS || memcmp(&result[0], expected, arrayBytes) != 0 )
+                    ++failures;
+            }
+            clReleaseMemObject(buffer);
+        }));
+    }
 
-void printArray(cl_int* array, cl_uint nElements)
-{
-    for (cl_uint index=0; index < nElements; ++index)
+    for (size_t index=0; index < threads.size(); ++index)
+        threads[index].join();
+    double seconds = getHostTime() - start;
+
+    cl_uint totalLaunches = numThreads * launchesPerThread;
+    printf("\n%u launches from %u threads: %.3f ms, %.0f launches/s\n",
+           totalLaunches, numThreads, seconds * 1.0e3, totalLaunches / seconds);
+
+    if ( failures != 0 )
     {
-        printf("Array[%u] = %d\n", index, array[index]);
+        printf("%u launches failed or differ from the first run\n", (cl_uint) failures);
+        return CL_INVALID_VALUE;
     }
+    return CL_SUCCESS;
 }
 
-//Global for clean up convenience
-char* kernelSource=0;
-cl_program program=0;
-cl_context context=0;
-cl_command_queue cmdQueue=0;
-cl_kernel kernel=0;
-cl_int* hostArray=0;
-cl_int* copiedBackArray=0;
-cl_mem arrayBuffer=0;
+#ifdef CL_VERSION_2_0
+/* Allocate svmArray and fill it from hostArray. Fine grain allocations
+*  are accessed by the host directly, coarse grain ones are mapped around
+*  host access.
+*/
+static cl_int createSVMArray(cl_uint arraySize, bool fineGrain)
+{
+    size_t bytes = sizeof(cl_int) * arraySize;
+    cl_svm_mem_flags flags = CL_MEM_READ_WRITE | (fineGrain? CL_MEM_SVM_FINE_GRAIN_BUFFER : 0);
+    svmArray = (cl_int*) clSVMAlloc(context, flags, bytes, /*alignment*/ 0);
+    if ( svmArray == NULL )
+        return CL_MEM_OBJECT_ALLOCATION_FAILURE;
+
+    cl_int err = CL_SUCCESS;
+    if ( !fineGrain )
+        err = clEnqueueSVMMap(cmdQueue, CL_TRUE, CL_MAP_WRITE, svmArray, bytes, 0, NULL, NULL);
+    if ( err != CL_SUCCESS )
+        return err;
+
+    memcpy(svmArray, hostArray, bytes);
+
+    if ( !fineGrain )
+        err = clEnqueueSVMUnmap(cmdQueue, svmArray, 0, NULL, NULL);
+    return err;
+}
+
+/* Wait for the kernel to finish writing svmArray and make it readable on
+*  the host. Coarse grain allocations stay mapped until cleanUp().
+*/
+static cl_int finishSVMArray(cl_uint arraySize, bool fineGrain)
+{
+    if ( fineGrain )
+        return clWaitForEvents(1, &kernelEvent);
+
+    cl_int err = clEnqueueSVMMap(cmdQueue, CL_TRUE, CL_MAP_READ, svmArray,
+                                 sizeof(cl_int) * arraySize, 1, &kernelEvent, NULL);
+    svmMapped = ( err == CL_SUCCESS );
+    return err;
+}
+#endif
 
 int main(int argc, char** argv)
 {
-    if (argc != 3)
+    double startTime = getHostTime();
+    StartupTimings timings = {};
+    double phaseStart=0.0;
+    bool quiet=false;
+    bool reportTimings=false;
+    const char* peaksFile=0;
+    const char* traceFile=0;
+    cl_uint numBatches=0;
+    bool outOfOrder=false;
+    cl_uint numThreads=0;
+    bool useSVM=false;
+    bool svmFineGrain=false;
+    static struct option longOptions[] =
+    {
+        { "peaks", required_argument, 0, 'p' },
+        { "trace", required_argument, 0, 'T' },
+        { "batches", required_argument, 0, 'b' },
+        { "out-of-order", no_argument, 0, 'o' },
+        { "threads", required_argument, 0, 't' },
+        { "svm", no_argument, 0, 's' },
+        { "quiet", no_argument, 0, 'q' },
+        { "timings", no_argument, 0, 'm' },
+        { 0, 0, 0, 0 }
+    };
+
+    int option=0;
+    while ( (option = getopt_long(argc, argv, "p:b:ot:T:sqm", longOptions, NULL)) != -1 )
+    {
+        switch (option)
+        {
+            case 'p':
+                peaksFile = optarg;
+                break;
+            case 'T':
+                traceFile = optarg;
+                break;
+            case 'b':
+                numBatches = atoi(optarg);
+                break;
+            case 'o':
+                outOfOrder = true;
+                break;
+            case 't':
+                numThreads = atoi(optarg);
+                break;
+            case 's':
+                useSVM = true;
+                break;
+            case 'q':
+                quiet = true;
+                break;
+            case 'm':
+                reportTimings = true;
+                break;
+            default:
+                usage(argv[0]);
+        }
+    }
+
+    if (argc - optind != 2)
+    {
+        usage(argv[0]);
+        assert(0 && "Unreachable");
+    }
+
+    // The threads use their own in-order queues and only batches use outOfOrder
+    if ( outOfOrder && (numBatches == 0 || numThreads > 0) )
     {
+        printf("--out-of-order needs --batches and cannot be used with --threads\n\n");
         usage(argv[0]);
         assert(0 && "Unreachable");
     }
 
-    kernelSource = loadKernelFromFile( argv[1]);
-    unsigned int arraySize = atoi( argv[2] );
-    printf("Using array size of %u", arraySize);
+    const char* kernelName = argv[optind];
+    phaseStart = getHostTime();
+    cl_int err = getKernelSource( kernelName,
+                                  embeddedKernels,
+                                  sizeof(embeddedKernels)/sizeof(EmbeddedKernel),
+                                  &kernelSource);
+    timings.kernelLoad = getHostTime() - phaseStart;
+    unsigned int arraySize = atoi( argv[optind + 1] );
+    if ( !quiet )
+        printf("Using array size of %u", arraySize);
     assert( arraySize > 0 && arraySize < 512 && "Array size too big");
 
-    if (kernelSource == NULL)
+    if (err != CL_SUCCESS)
     {
-        printf("Could not open OpenCL kernel: %s\n", argv[1]);
+        printf("Could not open OpenCL kernel: %s\n", kernelName);
         exit(1);
     }
-    else
+    else if ( !quiet )
     {
-        printf("%s loaded as string into memory.\n", argv[1]);
+        printf("%s loaded as string into memory.\n", kernelName);
     }
 
     cl_platform_id platform=0;
     cl_device_id device=0;
-    cl_int err=CL_SUCCESS;
-
-    platform = pickPlatform();
-    printf("Selected Platform:\n");
-    printPlatformInfo(platform,0);
-    printf("\n");
 
+    phaseStart = getHostTime();
+    platform = pickPlatform(&timings.icdLoad);
     device = pickDevice(platform);
-    printf("Selected Device:\n");
-    printDeviceInfo(device, 0);
-    printf("\n");
+    timings.platformEnumeration = getHostTime() - phaseStart - timings.icdLoad;
+
+    if ( !quiet )
+    {
+        printf("Selected Platform:\n");
+        printPlatformInfo(platform,0);
+        printf("\n");
+
+        printf("Selected Device:\n");
+        printDeviceInfo(device, 0);
+        printf("\n");
+    }
 
     /* Create Context */
+    phaseStart = getHostTime();
     cl_context_properties cProp[] = { CL_CONTEXT_PLATFORM, (cl_context_properties) platform, 0 };
     context= clCreateContext( /*properties*/ cProp,
                               /*num_device*/ 1,
@@ -203,17 +488,19 @@ int main(int argc, char** argv)
         cleanUp();
         exit(1);
     }
-    else
+    else if ( !quiet )
+    {
         printf("Created context.\n");
 
-    printf("Context:\n");
-    err = printContextInfo(context,0);
-    printf("\n");
+        printf("Context:\n");
+        err = printContextInfo(context,0);
+        printf("\n");
+    }
 
-    /* Create command queue */
+    /* Create command queue. Profiling is used to time the kernel */
     cmdQueue = clCreateCommandQueue( context,
                                      device,
-                                     /*properties */ 0,
+                                     /*properties */ CL_QUEUE_PROFILING_ENABLE,
                                      &err
                                    );
 
@@ -223,14 +510,33 @@ int main(int argc, char** argv)
         cleanUp();
         exit(1);
     }
+    // Excludes the context info printing
+    timings.contextCreation = getHostTime() - phaseStart;
+
+    /* SVM needs an OpenCL 2.0 device with at least coarse grain buffers */
+    if ( useSVM )
+    {
+        cl_bitfield svmCapabilities=0;
+        getDeviceSVMCapabilities(device, &svmCapabilities);
+        #ifdef CL_VERSION_2_0
+        svmFineGrain = ( svmCapabilities & CL_DEVICE_SVM_FINE_GRAIN_BUFFER ) != 0;
+        #endif
+        if ( svmCapabilities == 0 )
+        {
+            printf("Device has no SVM support (needs OpenCL 2.0), using a buffer\n");
+            useSVM = false;
+        }
+        else if ( !quiet )
+            printf("Using %s grain SVM\n", svmFineGrain? "fine" : "coarse");
+    }
 
     /* Create kernel */
-    program = clCreateProgramWithSource( context, 
-                                         /*number of strings*/ 1,
-                                         (const char**)  &kernelSource,
-                                         /* NULL terminated, don't need lengths*/ NULL,
-                                         &err
-                                       );
+    program = createProgramFromKernelSource( context,
+                                             device,
+                                             &kernelSource,
+                                             /* Compiler options */ NULL,
+                                             &err
+                                           );
 
     if ( err != CL_SUCCESS )
     {
@@ -239,43 +545,40 @@ int main(int argc, char** argv)
         exit(1);
     }
 
-    /* Compile Kernel */
-    printf("Trying to compile & link kernel.\n");
-    err = clBuildProgram( program, 
-                          /* num_devices */ 1,
-                          /* devices*/ &device,
-                          /* Compiler options */ NULL,
-                          /* Callback */ NULL,
-                          /* User Data for call back */ NULL
-                        );
-
+    /* Compile Kernel. Host side set up continues while it builds */
+    if ( !quiet )
+        printf("Trying to compile & link kernel.\n");
     #ifndef KLEE_CL
-    // Output build log
-    printProgramBuildInfo(program, device, /*Indent*/ 0);
+    // One program so one worker. The build log is output when the build is
+    // waited for, in quiet mode only on failure
+    buildManager = createBuildManager(/*maxConcurrentBuilds*/ 1, /*printBuildLogs*/ quiet? CL_FALSE : CL_TRUE);
+    #else
+    buildManager = createBuildManager(/*maxConcurrentBuilds*/ 1, /*printBuildLogs*/ CL_FALSE);
     #endif
-    if ( err != CL_SUCCESS )
+    if ( buildManager == NULL )
     {
-        printf("Build failed\n");
+        printf("Failed to create build manager\n");
         cleanUp();
         exit(1);
     }
 
-    #ifndef KLEE_CL
-    printProgramInfo(program, /*Indent*/ 0);
-    #endif
-
-    /* Create kernel object */
-    kernel = clCreateKernel( program, "simple_kernel", &err);
-    if (err != CL_SUCCESS )
+    phaseStart = getHostTime();
+    err = startProgramBuild( buildManager,
+                             program,
+                             /* num_devices */ 1,
+                             /* devices*/ &device,
+                             /* Compiler options */ NULL
+                           );
+    if ( err != CL_SUCCESS )
     {
-        printf("Failed to create kernel object.\n");
+        printf("Failed to start build\n");
         cleanUp();
         exit(1);
     }
 
     /* Create array to copied to host */
-    cl_int* hostArray = (cl_int*) malloc( sizeof(cl_int) * arraySize );
-    cl_int* copiedBackArray = (cl_int*) malloc( sizeof(cl_int) * arraySize );
+    hostArray = (cl_int*) malloc( sizeof(cl_int) * arraySize );
+    copiedBackArray = (cl_int*) malloc( sizeof(cl_int) * arraySize );
     if ( hostArray == 0 || copiedBackArray == 0 )
     {
         printf("Failed to malloc memory for host array\n");
@@ -288,11 +591,20 @@ int main(int argc, char** argv)
     {
         hostArray[index] = index;
     }
-    printf("Created Array:\n");
-    printArray( hostArray, arraySize);
-    printf("\n");
+    if ( !quiet )
+    {
+        printf("Created Array:\n");
+        printArray( hostArray, arraySize);
+        printf("\n");
+    }
 
-    // Create Buffer
+    // Create Buffer (or SVM allocation)
+    TRACE_BEGIN("create buffers");
+    #ifdef CL_VERSION_2_0
+    if ( useSVM )
+        err = createSVMArray(arraySize, svmFineGrain);
+    else
+    #endif
     arrayBuffer = clCreateBuffer(context, 
                                  CL_MEM_READ_WRITE | CL_MEM_COPY_HOST_PTR,
                                  sizeof(cl_int) * arraySize,
@@ -307,7 +619,42 @@ int main(int argc, char** argv)
         exit(1);
     }
 
+    TRACE_END();
+
+    /* Wait for the kernel we need to finish building */
+    err = waitForProgramBuild(buildManager, program);
+    timings.build = getHostTime() - phaseStart;
+    if ( err != CL_SUCCESS )
+    {
+        printf("Build failed\n");
+        #ifndef KLEE_CL
+        if ( quiet )
+            printProgramBuildInfo(program, device, /*Indent*/ 0);
+        #endif
+        cleanUp();
+        exit(1);
+    }
+
+    #ifndef KLEE_CL
+    if ( !quiet )
+        printProgramInfo(program, /*Indent*/ 0);
+    #endif
+
+    /* Create kernel object */
+    kernel = clCreateKernel( program, "simple_kernel", &err);
+    if (err != CL_SUCCESS )
+    {
+        printf("Failed to create kernel object.\n");
+        cleanUp();
+        exit(1);
+    }
+
     /* Setup kernel arguments */
+    #ifdef CL_VERSION_2_0
+    if ( useSVM )
+        err = clSetKernelArgSVMPointer(kernel, /* argument index*/ 0, svmArray);
+    else
+    #endif
     err = clSetKernelArg( kernel,
                           /* argument index*/ 0,
                           sizeof(cl_mem),
@@ -324,8 +671,27 @@ int main(int argc, char** argv)
     size_t globalWorkSize[] = { arraySize };
     size_t localWorkSize[] = { 1 };
 
-    printf("Enquing kernel.\n");
+    #ifndef KLEE_CL
+    if ( !quiet )
+    {
+        printf("Kernel:\n");
+        printKernelWorkGroupInfo(kernel, device, /*Indent*/ 0);
+        printf("\n");
+    }
+
+    /* Reject launches that exceed the kernel's limits on this device */
+    if ( checkWorkGroupSize(kernel, device, 1, localWorkSize) != CL_SUCCESS )
+    {
+        cleanUp();
+        exit(1);
+    }
+    #endif
+
+    if ( !quiet )
+        printf("Enquing kernel.\n");
     /* Enqueue kernel */
+    phaseStart = getHostTime();
+    TRACE_BEGIN("enqueue kernel");
     err = clEnqueueNDRangeKernel( cmdQueue,
                                   kernel,
                                   /* Work dim */ 1,
@@ -334,8 +700,10 @@ int main(int argc, char** argv)
                                   /* local_work_size */ localWorkSize,
                                   /* num_events_in_wait_list */ 0,
                                   /* event_wait_list */ NULL,
-                                  /* event */ NULL
+                                  /* event */ &kernelEvent
                                  );
+    TRACE_END();
+    TRACE_DEVICE_EVENT("simple_kernel", kernelEvent);
 
     if ( err != CL_SUCCESS )
     {
@@ -344,7 +712,17 @@ int main(int argc, char** argv)
         exit(1);
     }
 
-    /* Read back array */
+    /* Read back array. With SVM the kernel wrote to host visible memory */
+    cl_int* resultArray = copiedBackArray;
+    TRACE_BEGIN("read back");
+    #ifdef CL_VERSION_2_0
+    if ( useSVM )
+    {
+        err = finishSVMArray(arraySize, svmFineGrain);
+        resultArray = svmArray;
+    }
+    else
+    #endif
     err = clEnqueueReadBuffer( cmdQueue,
                                arrayBuffer,
                                /* blocking_read */ CL_TRUE,
@@ -355,19 +733,111 @@ int main(int argc, char** argv)
                                /* event_wait_list */ NULL,
                                /* event */ NULL
                              );
+    TRACE_END();
+    timings.firstLaunch = getHostTime() - phaseStart;
+
+    if ( err != CL_SUCCESS )
+    {
+        printf("Failed to read back array. Error:%d\n", err);
+        cleanUp();
+        exit(1);
+    }
 
+    if ( !quiet )
+    {
+        printf("\nReading back array:\n");
+        printArray( resultArray, arraySize);
+    }
+
+    if ( reportTimings )
+        printStartupTimings(&timings, getHostTime() - startTime);
 
+    /* Report kernel performance */
+    double kernelTime=0.0;
+    err = getEventDuration(kernelEvent, &kernelTime);
+    if ( err == CL_SUCCESS )
+    {
+        printf("\nKernel execution time: %.3f ms\n", kernelTime * 1.0e3);
+
+        const KernelCost* cost = findKernelCost(kernelName);
+        DevicePeaks peaks;
+        if ( cost == NULL )
+            printf("No cost model for %s, skipping roofline report\n", kernelName);
+        else if ( getDevicePeaks(peaksFile, device, &peaks) == CL_SUCCESS )
+        {
+            KernelWork work = cost->work(arraySize);
+            printRooflineReport(&work, kernelTime, &peaks, /*Indent*/ 0);
+        }
+    }
+    else
+        printf("Could not get kernel execution time\n");
+
+    if ( traceFile != 0 )
+    {
+        if ( CLPROBE_TRACING_ENABLED )
+            TRACE_WRITE(traceFile);
+        else
+            printf("Tracing is not enabled in this build (cmake -DENABLE_TRACING=ON)\n");
+    }
+
+    int result=0;
+    if ( numThreads > 0 )
+    {
+        cl_uint launchesPerThread = (numBatches > 0)? numBatches : 1;
+        if ( runThreads(device, arraySize, numThreads, launchesPerThread, resultArray) != CL_SUCCESS )
+            result = 1;
+    }
+    else if ( numBatches > 0 && runBatches(device, arraySize, numBatches, outOfOrder, resultArray) != CL_SUCCESS )
+        result = 1;
 
-    printf("\nReading back array:\n");
-    printArray( copiedBackArray, arraySize);
     cleanUp();
-    return 0;
+    return result;
 }
 
 void cleanUp()
 {
     cl_int err=0;
-    free(kernelSource);
+    releaseKernelSource(&kernelSource);
+
+    // Waits for any outstanding build
+    releaseBuildManager(buildManager);
+
+    // Finishes any outstanding batches
+    releaseQueuePool(queuePool);
+    releaseLauncher(launcher);
+
+    for (cl_uint index=0; index < numBatchBuffers; ++index)
+    {
+        err = clReleaseMemObject(batchBuffers[index]);
+        handleError(err, "Couldn't release buffer", false);
+    }
+    free(batchBuffers);
+    free(batchResults);
+
+    if (arrayBuffer!=0)
+    {
+        err = clReleaseMemObject(arrayBuffer);
+        handleError(err, "Couldn't release buffer", false);
+    }
+
+    #ifdef CL_VERSION_2_0
+    if (svmArray!=0)
+    {
+        if (svmMapped)
+        {
+            err = clEnqueueSVMUnmap(cmdQueue, svmArray, 0, NULL, NULL);
+            handleError(err, "Couldn't unmap SVM array", false);
+            clFinish(cmdQueue);
+        }
+        clSVMFree(context, svmArray);
+    }
+    #endif
+
+    if (kernelEvent!=0)
+    {
+        err = clReleaseEvent(kernelEvent);
+        handleError(err, "Couldn't release event", false);
+    }
 
     if (kernel!=0)
     {